@@ -12,8 +12,14 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <cstdint>
+#include <cstring>
 #include <vector>
 
+#if defined(__F16C__) || defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
 #include "glog/logging.h"
 #include "idl/matrix/compression/compression.h"
 #include "idl/matrix/compression/float16.h"
@@ -23,6 +29,175 @@ namespace compression {
 
 using matrix::compression::Float16;
 
+namespace {
+
+static_assert(sizeof(Float16) == sizeof(uint16_t), "Float16 is not 2 bytes");
+
+// Float16 rounds to nearest even like the hardware conversions, so all the
+// paths below produce the same bits.
+void BaseCompressF16(const float* src, size_t num, uint16_t* dst) {
+  for (size_t i = 0; i < num; ++i) {
+    Float16 f16(src[i]);
+    dst[i] = f16.get_raw_data();
+  }
+}
+
+void BaseDecompressF16(const uint16_t* src, size_t num, float* dst) {
+  for (size_t i = 0; i < num; ++i) {
+    Float16 f16;
+    std::memcpy(static_cast<void*>(&f16), src + i, sizeof(Float16));
+    dst[i] = f16.get_m();
+  }
+}
+
+#if defined(__F16C__) && defined(__AVX2__)
+void Avx256CompressF16(const float* src, size_t num, uint16_t* dst) {
+  size_t i = 0;
+  for (; i + 8 <= num; i += 8) {
+    __m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(src + i),
+                                _MM_FROUND_TO_NEAREST_INT);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), h);
+  }
+  BaseCompressF16(src + i, num - i, dst + i);
+}
+
+// Float16::get_m() of 8 halves: infinities clamp to +-65504, both zeros
+// decode to 0, and everything else gets half an ulp added, which is
+// +-2^(exponent - 26) for the biased exponent of the half.
+__m256 Avx256DecodeF16(__m128i h) {
+  const __m256i bits = _mm256_cvtepu16_epi32(h);
+  const __m256i magnitude = _mm256_and_si256(bits, _mm256_set1_epi32(0x7FFF));
+  const __m256i sign =
+      _mm256_slli_epi32(_mm256_and_si256(bits, _mm256_set1_epi32(0x8000)), 16);
+  const __m256i exponent = _mm256_srli_epi32(magnitude, 10);
+  const __m256 median = _mm256_castsi256_ps(_mm256_or_si256(
+      sign,
+      _mm256_slli_epi32(_mm256_add_epi32(exponent, _mm256_set1_epi32(101)),
+                        23)));
+  const __m256 is_inf = _mm256_castsi256_ps(
+      _mm256_cmpeq_epi32(magnitude, _mm256_set1_epi32(0x7C00)));
+  const __m256 is_zero = _mm256_castsi256_ps(
+      _mm256_cmpeq_epi32(magnitude, _mm256_setzero_si256()));
+  __m256 value = _mm256_cvtph_ps(h);
+  value = _mm256_blendv_ps(
+      value, _mm256_or_ps(_mm256_castsi256_ps(sign), _mm256_set1_ps(65504.0f)),
+      is_inf);
+  return _mm256_andnot_ps(is_zero, _mm256_add_ps(value, median));
+}
+
+void Avx256DecompressF16(const uint16_t* src, size_t num, float* dst) {
+  size_t i = 0;
+  for (; i + 8 <= num; i += 8) {
+    __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+    _mm256_storeu_ps(dst + i, Avx256DecodeF16(h));
+  }
+  BaseDecompressF16(src + i, num - i, dst + i);
+}
+#endif
+
+// AVX-512F implies F16C and AVX2, which handle the tails.
+#if defined(__AVX512F__)
+void Avx512CompressF16(const float* src, size_t num, uint16_t* dst) {
+  size_t i = 0;
+  for (; i + 16 <= num; i += 16) {
+    __m256i h = _mm512_cvtps_ph(_mm512_loadu_ps(src + i),
+                                _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), h);
+  }
+  Avx256CompressF16(src + i, num - i, dst + i);
+}
+
+// The same as Avx256DecodeF16, 16 halves at a time.
+__m512 Avx512DecodeF16(__m256i h) {
+  const __m512i bits = _mm512_cvtepu16_epi32(h);
+  const __m512i magnitude = _mm512_and_si512(bits, _mm512_set1_epi32(0x7FFF));
+  const __m512i sign =
+      _mm512_slli_epi32(_mm512_and_si512(bits, _mm512_set1_epi32(0x8000)), 16);
+  const __m512i exponent = _mm512_srli_epi32(magnitude, 10);
+  const __m512i median = _mm512_or_si512(
+      sign,
+      _mm512_slli_epi32(_mm512_add_epi32(exponent, _mm512_set1_epi32(101)),
+                        23));
+  const __mmask16 is_inf =
+      _mm512_cmpeq_epi32_mask(magnitude, _mm512_set1_epi32(0x7C00));
+  const __mmask16 is_zero =
+      _mm512_cmpeq_epi32_mask(magnitude, _mm512_setzero_si512());
+  __m512i value = _mm512_castps_si512(_mm512_cvtph_ps(h));
+  value = _mm512_mask_or_epi32(value, is_inf, sign,
+                               _mm512_set1_epi32(0x477FE000));  // 65504.0f
+  return _mm512_maskz_add_ps(static_cast<__mmask16>(~is_zero),
+                             _mm512_castsi512_ps(value),
+                             _mm512_castsi512_ps(median));
+}
+
+void Avx512DecompressF16(const uint16_t* src, size_t num, float* dst) {
+  size_t i = 0;
+  for (; i + 16 <= num; i += 16) {
+    __m256i h = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+    _mm512_storeu_ps(dst + i, Avx512DecodeF16(h));
+  }
+  Avx256DecompressF16(src + i, num - i, dst + i);
+}
+#endif
+
+void CompressF16(const float* src, size_t num, uint16_t* dst) {
+#if defined(__AVX512F__)
+  Avx512CompressF16(src, num, dst);
+#elif defined(__F16C__) && defined(__AVX2__)
+  Avx256CompressF16(src, num, dst);
+#else
+  BaseCompressF16(src, num, dst);
+#endif
+}
+
+void DecompressF16(const uint16_t* src, size_t num, float* dst) {
+#if defined(__AVX512F__)
+  Avx512DecompressF16(src, num, dst);
+#elif defined(__F16C__) && defined(__AVX2__)
+  Avx256DecompressF16(src, num, dst);
+#else
+  BaseDecompressF16(src, num, dst);
+#endif
+}
+
+// bfloat16 keeps the high half of every float.
+void CompressF16b(const float* src, size_t num, uint16_t* dst) {
+  const uint32_t* bits = reinterpret_cast<const uint32_t*>(src);
+  size_t i = 0;
+#if defined(__AVX2__)
+  for (; i + 16 <= num; i += 16) {
+    __m256i a = _mm256_srli_epi32(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(bits + i)), 16);
+    __m256i b = _mm256_srli_epi32(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(bits + i + 8)), 16);
+    // The pack interleaves the 128 bit lanes of a and b.
+    __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(a, b),
+                                              _MM_SHUFFLE(3, 1, 2, 0));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), packed);
+  }
+#endif
+  for (; i < num; ++i) {
+    dst[i] = static_cast<uint16_t>(bits[i] >> 16);
+  }
+}
+
+void DecompressF16b(const uint16_t* src, size_t num, float* dst) {
+  uint32_t* bits = reinterpret_cast<uint32_t*>(dst);
+  size_t i = 0;
+#if defined(__AVX2__)
+  for (; i + 8 <= num; i += 8) {
+    __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(bits + i),
+                        _mm256_slli_epi32(_mm256_cvtepu16_epi32(h), 16));
+  }
+#endif
+  for (; i < num; ++i) {
+    bits[i] = static_cast<uint32_t>(src[i]) << 16;
+  }
+}
+
+}  // namespace
+
 bool compress_float_list_f16(const char* raw_data, const size_t raw_size,
                              char* out_buffer, size_t* out_size) {
   if ((raw_size % sizeof(float)) != 0) {
@@ -34,13 +209,9 @@ bool compress_float_list_f16(const char* raw_data, const size_t raw_size,
     LOG(ERROR) << "compress_float_list_f16 out_buffer size not enough";
     return false;
   }
-  const float* raw_floats = reinterpret_cast<const float*>(raw_data);
-  Float16* f16_buffer = reinterpret_cast<Float16*>(out_buffer);
-  *out_size = 0;
-  for (size_t i = 0; i < num; ++i) {
-    f16_buffer[i].set(raw_floats[i]);
-    (*out_size) += sizeof(Float16);
-  }
+  CompressF16(reinterpret_cast<const float*>(raw_data), num,
+              reinterpret_cast<uint16_t*>(out_buffer));
+  *out_size = num * sizeof(Float16);
   return true;
 }
 
@@ -53,12 +224,8 @@ bool compress_float_list_f16(const char* raw_data, const size_t raw_size,
   size_t num = raw_size / sizeof(float);
   size_t out_size = num * sizeof(Float16);
   out->resize(out_size);
-  const float* raw_floats = reinterpret_cast<const float*>(raw_data);
-  Float16* f16_buffer =
-      reinterpret_cast<Float16*>(const_cast<char*>(out->data()));
-  for (size_t i = 0; i < num; ++i) {
-    f16_buffer[i].set(raw_floats[i]);
-  }
+  CompressF16(reinterpret_cast<const float*>(raw_data), num,
+              reinterpret_cast<uint16_t*>(const_cast<char*>(out->data())));
   return true;
 }
 
@@ -74,13 +241,9 @@ bool decompress_float_list_f16(const char* compressed_data,
     LOG(ERROR) << "decompress_float_list_f16 got no enough out_buffer";
     return false;
   }
-  const Float16* f16_buffer = reinterpret_cast<const Float16*>(compressed_data);
-  float* out_floats = reinterpret_cast<float*>(out_buffer);
-  *out_size = 0;
-  for (size_t i = 0; i < num; ++i) {
-    out_floats[i] = f16_buffer[i].get_m();
-    (*out_size) += sizeof(float);
-  }
+  DecompressF16(reinterpret_cast<const uint16_t*>(compressed_data), num,
+                reinterpret_cast<float*>(out_buffer));
+  *out_size = num * sizeof(float);
   return true;
 }
 
@@ -93,11 +256,8 @@ bool decompress_float_list_f16(const char* compressed_data,
   size_t num = compressed_size / sizeof(Float16);
   size_t out_size = num * sizeof(float);
   out->resize(out_size);
-  const Float16* f16_buffer = reinterpret_cast<const Float16*>(compressed_data);
-  float* out_floats = reinterpret_cast<float*>(const_cast<char*>(out->data()));
-  for (size_t i = 0; i < num; ++i) {
-    out_floats[i] = f16_buffer[i].get_m();
-  }
+  DecompressF16(reinterpret_cast<const uint16_t*>(compressed_data), num,
+                reinterpret_cast<float*>(const_cast<char*>(out->data())));
   return true;
 }
 
@@ -112,11 +272,8 @@ bool compress_float_list_f16b(const char* raw_data, const size_t raw_size,
   size_t num = raw_size / sizeof(float);
   size_t out_size = num * sizeof(bfloat16);
   out->resize(out_size);
-  const uint16_t* p = reinterpret_cast<const uint16_t*>(raw_data);
-  uint16_t* q = reinterpret_cast<uint16_t*>(const_cast<char*>(out->data()));
-  for (; num != 0; p += 2, q++, num--) {
-    *q = p[1];
-  }
+  CompressF16b(reinterpret_cast<const float*>(raw_data), num,
+               reinterpret_cast<uint16_t*>(const_cast<char*>(out->data())));
   return true;
 }
 
@@ -129,15 +286,37 @@ bool decompress_float_list_f16b(const char* compressed_data,
   size_t num = compressed_size / sizeof(bfloat16);
   size_t out_size = num * sizeof(float);
   out->resize(out_size);
-
-  const uint16_t* p = reinterpret_cast<const uint16_t*>(compressed_data);
-  uint16_t* q = reinterpret_cast<uint16_t*>(const_cast<char*>(out->data()));
-  for (; num != 0; p++, q += 2, num--) {
-    q[0] = 0;
-    q[1] = *p;
-  }
+  DecompressF16b(reinterpret_cast<const uint16_t*>(compressed_data), num,
+                 reinterpret_cast<float*>(const_cast<char*>(out->data())));
   return true;
 }
 
+size_t compressed_row_size_f16(size_t dim) { return dim * sizeof(Float16); }
+
+void compress_float_rows_f16(const float* rows, size_t num_rows, size_t dim,
+                             char* out) {
+  // The rows are contiguous in both layouts.
+  CompressF16(rows, num_rows * dim, reinterpret_cast<uint16_t*>(out));
+}
+
+void decompress_float_rows_f16(const char* compressed, size_t num_rows,
+                               size_t dim, float* out) {
+  DecompressF16(reinterpret_cast<const uint16_t*>(compressed), num_rows * dim,
+                out);
+}
+
+size_t compressed_row_size_f16b(size_t dim) { return dim * sizeof(bfloat16); }
+
+void compress_float_rows_f16b(const float* rows, size_t num_rows, size_t dim,
+                              char* out) {
+  CompressF16b(rows, num_rows * dim, reinterpret_cast<uint16_t*>(out));
+}
+
+void decompress_float_rows_f16b(const char* compressed, size_t num_rows,
+                                size_t dim, float* out) {
+  DecompressF16b(reinterpret_cast<const uint16_t*>(compressed),
+                 num_rows * dim, out);
+}
+
 }  // end namespace compression
 }  // end namespace matrix
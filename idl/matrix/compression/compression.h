@@ -16,6 +16,7 @@
 #ifndef IDL_MATRIX_COMPRESSION_COMPRESSION_H_
 #define IDL_MATRIX_COMPRESSION_COMPRESSION_H_
 
+#include <cstddef>
 #include <string>
 
 namespace matrix {
@@ -42,6 +43,28 @@ bool compress_float_list_qtz8mm(const char* raw_data, const size_t raw_size,
                                 std::string* out);
 bool decompress_float_list_qtz8mm(const char* compressed_data,
                                   size_t compressed_size, std::string* out);
+
+// Batch codecs for num_rows embeddings of dim floats each, stored back to
+// back. Every row is encoded exactly like the single vector functions above
+// encode it, so either side can decode the other. The caller provides buffers
+// of num_rows * compressed_row_size_*(dim) bytes.
+// With F16C, AVX2 or AVX-512 enabled at build time, the fp16 conversions and
+// the qtz8mm min/max and quantization run 8 or 16 floats at a time.
+size_t compressed_row_size_f16(size_t dim);
+void compress_float_rows_f16(const float* rows, size_t num_rows, size_t dim,
+                             char* out);
+void decompress_float_rows_f16(const char* compressed, size_t num_rows,
+                               size_t dim, float* out);
+size_t compressed_row_size_f16b(size_t dim);
+void compress_float_rows_f16b(const float* rows, size_t num_rows, size_t dim,
+                              char* out);
+void decompress_float_rows_f16b(const char* compressed, size_t num_rows,
+                                size_t dim, float* out);
+size_t compressed_row_size_qtz8mm(size_t dim);
+void compress_float_rows_qtz8mm(const float* rows, size_t num_rows,
+                                size_t dim, char* out);
+void decompress_float_rows_qtz8mm(const char* compressed, size_t num_rows,
+                                  size_t dim, float* out);
 }  // end namespace compression
 }  // end namespace matrix
 
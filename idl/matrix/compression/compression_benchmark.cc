@@ -0,0 +1,176 @@
+// Copyright 2022 ByteDance and/or its affiliates.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <random>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "idl/matrix/compression/compression.h"
+#include "idl/matrix/compression/float16.h"
+
+namespace matrix {
+namespace compression {
+namespace {
+
+// Args: number of rows, dim.
+struct Input {
+  explicit Input(const benchmark::State& state)
+      : num_rows(state.range(0)),
+        dim(state.range(1)),
+        rows(num_rows * dim),
+        decompressed(rows.size()),
+        compressed(num_rows * compressed_row_size_f16(dim)) {
+    std::mt19937 gen(0);
+    std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+    for (float& x : rows) {
+      x = dist(gen);
+    }
+  }
+
+  void SetBytesProcessed(benchmark::State* state) const {
+    state->SetBytesProcessed(state->iterations() * rows.size() *
+                             sizeof(float));
+  }
+
+  size_t num_rows;
+  size_t dim;
+  std::vector<float> rows;
+  std::vector<float> decompressed;
+  std::vector<char> compressed;
+};
+
+// The element wise loops of the codecs before.
+void BM_SerialCompressF16(benchmark::State& state) {  // NOLINT
+  Input input(state);
+  Float16* out = reinterpret_cast<Float16*>(input.compressed.data());
+  for (auto _ : state) {
+    for (size_t i = 0; i < input.rows.size(); ++i) {
+      out[i].set(input.rows[i]);
+    }
+    benchmark::DoNotOptimize(out);
+  }
+  input.SetBytesProcessed(&state);
+}
+
+void BM_BatchCompressF16(benchmark::State& state) {  // NOLINT
+  Input input(state);
+  for (auto _ : state) {
+    compress_float_rows_f16(input.rows.data(), input.num_rows, input.dim,
+                            input.compressed.data());
+    benchmark::DoNotOptimize(input.compressed.data());
+  }
+  input.SetBytesProcessed(&state);
+}
+
+void BM_SerialDecompressF16(benchmark::State& state) {  // NOLINT
+  Input input(state);
+  compress_float_rows_f16(input.rows.data(), input.num_rows, input.dim,
+                          input.compressed.data());
+  const Float16* in = reinterpret_cast<const Float16*>(input.compressed.data());
+  for (auto _ : state) {
+    for (size_t i = 0; i < input.decompressed.size(); ++i) {
+      input.decompressed[i] = in[i].get_m();
+    }
+    benchmark::DoNotOptimize(input.decompressed.data());
+  }
+  input.SetBytesProcessed(&state);
+}
+
+void BM_BatchDecompressF16(benchmark::State& state) {  // NOLINT
+  Input input(state);
+  compress_float_rows_f16(input.rows.data(), input.num_rows, input.dim,
+                          input.compressed.data());
+  for (auto _ : state) {
+    decompress_float_rows_f16(input.compressed.data(), input.num_rows,
+                              input.dim, input.decompressed.data());
+    benchmark::DoNotOptimize(input.decompressed.data());
+  }
+  input.SetBytesProcessed(&state);
+}
+
+void BM_SerialCompressQtz8mm(benchmark::State& state) {  // NOLINT
+  Input input(state);
+  const size_t row_size = compressed_row_size_qtz8mm(input.dim);
+  for (auto _ : state) {
+    for (size_t i = 0; i < input.num_rows; ++i) {
+      char* out = input.compressed.data() + i * row_size;
+      set_to_qtz8mm(input.rows.data() + i * input.dim, input.dim, input.dim,
+                    reinterpret_cast<Float16*>(out),
+                    reinterpret_cast<uint8_t*>(out + 2 * sizeof(Float16)));
+    }
+    benchmark::DoNotOptimize(input.compressed.data());
+  }
+  input.SetBytesProcessed(&state);
+}
+
+void BM_BatchCompressQtz8mm(benchmark::State& state) {  // NOLINT
+  Input input(state);
+  for (auto _ : state) {
+    compress_float_rows_qtz8mm(input.rows.data(), input.num_rows, input.dim,
+                               input.compressed.data());
+    benchmark::DoNotOptimize(input.compressed.data());
+  }
+  input.SetBytesProcessed(&state);
+}
+
+void BM_SerialDecompressQtz8mm(benchmark::State& state) {  // NOLINT
+  Input input(state);
+  compress_float_rows_qtz8mm(input.rows.data(), input.num_rows, input.dim,
+                             input.compressed.data());
+  const size_t row_size = compressed_row_size_qtz8mm(input.dim);
+  for (auto _ : state) {
+    for (size_t i = 0; i < input.num_rows; ++i) {
+      const char* in = input.compressed.data() + i * row_size;
+      get_from_qtz8mm(
+          input.decompressed.data() + i * input.dim, input.dim,
+          reinterpret_cast<const Float16*>(in),
+          reinterpret_cast<const uint8_t*>(in + 2 * sizeof(Float16)));
+    }
+    benchmark::DoNotOptimize(input.decompressed.data());
+  }
+  input.SetBytesProcessed(&state);
+}
+
+void BM_BatchDecompressQtz8mm(benchmark::State& state) {  // NOLINT
+  Input input(state);
+  compress_float_rows_qtz8mm(input.rows.data(), input.num_rows, input.dim,
+                             input.compressed.data());
+  for (auto _ : state) {
+    decompress_float_rows_qtz8mm(input.compressed.data(), input.num_rows,
+                                 input.dim, input.decompressed.data());
+    benchmark::DoNotOptimize(input.decompressed.data());
+  }
+  input.SetBytesProcessed(&state);
+}
+
+void Args(benchmark::internal::Benchmark* b) {
+  for (int64_t dim : {8, 16, 32, 64, 128}) {
+    b->Args({4096, dim});
+  }
+}
+
+BENCHMARK(BM_SerialCompressF16)->Apply(Args);
+BENCHMARK(BM_BatchCompressF16)->Apply(Args);
+BENCHMARK(BM_SerialDecompressF16)->Apply(Args);
+BENCHMARK(BM_BatchDecompressF16)->Apply(Args);
+BENCHMARK(BM_SerialCompressQtz8mm)->Apply(Args);
+BENCHMARK(BM_BatchCompressQtz8mm)->Apply(Args);
+BENCHMARK(BM_SerialDecompressQtz8mm)->Apply(Args);
+BENCHMARK(BM_BatchDecompressQtz8mm)->Apply(Args);
+
+}  // namespace
+}  // namespace compression
+}  // namespace matrix
+
+BENCHMARK_MAIN();
@@ -12,6 +12,13 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
+#include <cstring>
+
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
 #include "glog/logging.h"
 
 #include "idl/matrix/compression/compression.h"
@@ -22,6 +29,114 @@ using matrix::compression::Float16;
 namespace matrix {
 namespace compression {
 
+namespace {
+
+// Rows this short are stored as f16, see compress_float_list_qtz8mm.
+constexpr size_t kMaxF16Dim = 4;
+
+// set_to_qtz8mm of a full row, into an unaligned buffer. The vector paths
+// compare and round like the scalar loop, so they produce the same bytes.
+void CompressRowQtz8mm(const float* src, size_t dim, char* out) {
+  float min = src[0];
+  float max = src[0];
+  size_t i = 0;
+#if defined(__AVX2__)
+  if (dim >= 8) {
+    // min_ps(x, m) keeps m when x is NaN, as std::min(m, x) does.
+    __m256 mins = _mm256_set1_ps(src[0]);
+    __m256 maxs = mins;
+    for (; i + 8 <= dim; i += 8) {
+      __m256 x = _mm256_loadu_ps(src + i);
+      mins = _mm256_min_ps(x, mins);
+      maxs = _mm256_max_ps(x, maxs);
+    }
+    float lanes[16];
+    _mm256_storeu_ps(lanes, mins);
+    _mm256_storeu_ps(lanes + 8, maxs);
+    for (int j = 0; j < 8; ++j) {
+      min = std::min(min, lanes[j]);
+      max = std::max(max, lanes[j + 8]);
+    }
+  }
+#endif
+  for (; i < dim; ++i) {
+    min = std::min(min, src[i]);
+    max = std::max(max, src[i]);
+  }
+  const float step = (max - min) / 255;
+  Float16 w[2] = {min, max};
+  std::memcpy(out, w, sizeof(w));
+  uint8_t* v = reinterpret_cast<uint8_t*>(out + sizeof(w));
+  i = 0;
+#if defined(__AVX2__)
+  const __m256 mins = _mm256_set1_ps(min);
+  const __m256 steps = _mm256_set1_ps(step);
+  const __m256 halves = _mm256_set1_ps(0.5f);
+  auto quantize = [&](const float* x) {
+    return _mm256_cvttps_epi32(_mm256_add_ps(
+        halves, _mm256_div_ps(_mm256_sub_ps(_mm256_loadu_ps(x), mins), steps)));
+  };
+  for (; i + 32 <= dim; i += 32) {
+    // Saturating packs of values in [0, 255] (or INT_MIN for NaN, which
+    // becomes 0 like the scalar cast), with the lanes put back in order.
+    __m256i lo = _mm256_packs_epi32(quantize(src + i), quantize(src + i + 8));
+    __m256i hi =
+        _mm256_packs_epi32(quantize(src + i + 16), quantize(src + i + 24));
+    __m256i bytes = _mm256_permutevar8x32_epi32(
+        _mm256_packus_epi16(lo, hi), _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(v + i), bytes);
+  }
+  for (; i + 8 <= dim; i += 8) {
+    __m256i q = quantize(src + i);
+    __m128i words = _mm_packs_epi32(_mm256_castsi256_si128(q),
+                                    _mm256_extracti128_si256(q, 1));
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(v + i),
+                     _mm_packus_epi16(words, words));
+  }
+#endif
+  for (; i < dim; ++i) {
+    v[i] = int(0.5f + (src[i] - min) / step);
+  }
+}
+
+// get_from_qtz8mm of a row in an unaligned buffer.
+void DecompressRowQtz8mm(const char* in, size_t dim, float* dst) {
+  Float16 w[2];
+  std::memcpy(static_cast<void*>(w), in, sizeof(w));
+  const uint8_t* v = reinterpret_cast<const uint8_t*>(in + sizeof(w));
+  const float min = w[0].get();
+  const float max = w[1].get();
+  const float step = (max - min) / 255;
+  size_t i = 0;
+#if defined(__AVX512F__)
+  const __m512 mins16 = _mm512_set1_ps(min);
+  const __m512 steps16 = _mm512_set1_ps(step);
+  for (; i + 16 <= dim; i += 16) {
+    __m512 x = _mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(v + i))));
+    _mm512_storeu_ps(dst + i, _mm512_fmadd_ps(steps16, x, mins16));
+  }
+#endif
+#if defined(__AVX2__)
+  const __m256 mins = _mm256_set1_ps(min);
+  const __m256 steps = _mm256_set1_ps(step);
+  for (; i + 8 <= dim; i += 8) {
+    __m256 x = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(
+        _mm_loadl_epi64(reinterpret_cast<const __m128i*>(v + i))));
+#if defined(__FMA__)
+    _mm256_storeu_ps(dst + i, _mm256_fmadd_ps(steps, x, mins));
+#else
+    _mm256_storeu_ps(dst + i, _mm256_add_ps(mins, _mm256_mul_ps(steps, x)));
+#endif
+  }
+#endif
+  for (; i < dim; ++i) {
+    dst[i] = min + step * v[i];
+  }
+}
+
+}  // namespace
+
 bool compress_float_list_qtz8mm(const char* raw_data, const size_t raw_size,
                                 std::string* out) {
   if ((raw_size % sizeof(float)) != 0) {
@@ -39,12 +154,8 @@ bool compress_float_list_qtz8mm(const char* raw_data, const size_t raw_size,
   out->resize(out_size);
   char* qtz_buf_ptr = const_cast<char*>(out->data());
 
-  const float* raw_floats = reinterpret_cast<const float*>(raw_data);
-  Float16* w_ptr = reinterpret_cast<Float16*>(qtz_buf_ptr);
-  uint8_t* v_ptr =
-      reinterpret_cast<uint8_t*>(qtz_buf_ptr + 2 * sizeof(Float16));
-
-  set_to_qtz8mm(raw_floats, num, num, w_ptr, v_ptr);
+  CompressRowQtz8mm(reinterpret_cast<const float*>(raw_data), num,
+                    qtz_buf_ptr);
   return true;
 }
 
@@ -58,15 +169,38 @@ bool decompress_float_list_qtz8mm(const char* compressed_data,
   size_t num = compressed_size - 2 * sizeof(Float16);
   size_t out_size = num * sizeof(float);
   out->resize(out_size);
-  const char* qtz_buf_ptr = static_cast<const char*>(compressed_data);
+  DecompressRowQtz8mm(compressed_data, num,
+                      reinterpret_cast<float*>(const_cast<char*>(out->data())));
+  return true;
+}
+
+size_t compressed_row_size_qtz8mm(size_t dim) {
+  return dim <= kMaxF16Dim ? compressed_row_size_f16(dim)
+                           : 2 * sizeof(Float16) + dim * sizeof(uint8_t);
+}
 
-  const Float16* w_ptr = reinterpret_cast<const Float16*>(qtz_buf_ptr);
-  const uint8_t* v_ptr =
-      reinterpret_cast<const uint8_t*>(qtz_buf_ptr + 2 * sizeof(Float16));
-  float* out_floats = reinterpret_cast<float*>(const_cast<char*>(out->data()));
+void compress_float_rows_qtz8mm(const float* rows, size_t num_rows,
+                                size_t dim, char* out) {
+  if (dim <= kMaxF16Dim) {
+    compress_float_rows_f16(rows, num_rows, dim, out);
+    return;
+  }
+  const size_t row_size = compressed_row_size_qtz8mm(dim);
+  for (size_t i = 0; i < num_rows; ++i) {
+    CompressRowQtz8mm(rows + i * dim, dim, out + i * row_size);
+  }
+}
 
-  get_from_qtz8mm(out_floats, num, w_ptr, v_ptr);
-  return true;
+void decompress_float_rows_qtz8mm(const char* compressed, size_t num_rows,
+                                  size_t dim, float* out) {
+  if (dim <= kMaxF16Dim) {
+    decompress_float_rows_f16(compressed, num_rows, dim, out);
+    return;
+  }
+  const size_t row_size = compressed_row_size_qtz8mm(dim);
+  for (size_t i = 0; i < num_rows; ++i) {
+    DecompressRowQtz8mm(compressed + i * row_size, dim, out + i * dim);
+  }
 }
 
 }  // end namespace compression
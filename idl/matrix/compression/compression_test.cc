@@ -0,0 +1,243 @@
+// Copyright 2022 ByteDance and/or its affiliates.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "idl/matrix/compression/compression.h"
+#include "idl/matrix/compression/compression_qtz8mm.h"
+#include "idl/matrix/compression/float16.h"
+
+namespace matrix {
+namespace compression {
+namespace {
+
+uint32_t Bits(float f) {
+  uint32_t bits;
+  std::memcpy(&bits, &f, sizeof(bits));
+  return bits;
+}
+
+float FromBits(uint32_t bits) {
+  float f;
+  std::memcpy(&f, &bits, sizeof(f));
+  return f;
+}
+
+// Floats that hit every rounding case of the f16 conversion: all the
+// halves, the floats next to them and halfway between them, NaN, infinities,
+// overflows and float denormals.
+std::vector<float> F16Inputs() {
+  std::vector<float> inputs;
+  for (uint32_t h = 0; h <= 0xFFFF; h += 7) {
+    Float16 f16;
+    uint16_t raw = h;
+    std::memcpy(static_cast<void*>(&f16), &raw, sizeof(raw));
+    float f = f16.get();
+    inputs.push_back(f);
+    inputs.push_back(FromBits(Bits(f) + 1));
+    inputs.push_back(FromBits(Bits(f) + (1 << 12)));
+    inputs.push_back(FromBits(Bits(f) + (1 << 13)));
+  }
+  const float kSpecial[] = {std::numeric_limits<float>::quiet_NaN(),
+                            -std::numeric_limits<float>::quiet_NaN(),
+                            std::numeric_limits<float>::infinity(),
+                            -std::numeric_limits<float>::infinity(),
+                            std::numeric_limits<float>::max(),
+                            std::numeric_limits<float>::denorm_min(),
+                            -std::numeric_limits<float>::denorm_min(),
+                            std::numeric_limits<float>::min(),
+                            65504.0f,
+                            65520.0f,
+                            -65536.0f,
+                            0.0f,
+                            -0.0f};
+  inputs.insert(inputs.end(), std::begin(kSpecial), std::end(kSpecial));
+  std::mt19937 gen(42);
+  std::normal_distribution<float> dist(0, 100);
+  for (int i = 0; i < 1001; ++i) {
+    inputs.push_back(dist(gen));
+  }
+  return inputs;
+}
+
+TEST(CompressionTest, CompressF16) {
+  std::vector<float> inputs = F16Inputs();
+  std::vector<uint16_t> expected(inputs.size());
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    expected[i] = Float16(inputs[i]).get_raw_data();
+  }
+  // Every tail length of the 8 and 16 wide loops.
+  for (size_t offset = 0; offset < 17; ++offset) {
+    size_t num = inputs.size() - offset;
+    std::vector<uint16_t> out(num);
+    compress_float_rows_f16(inputs.data() + offset, 1, num,
+                            reinterpret_cast<char*>(out.data()));
+    for (size_t i = 0; i < num; ++i) {
+      ASSERT_EQ(out[i], expected[offset + i])
+          << "offset " << offset << " input " << inputs[offset + i];
+    }
+  }
+}
+
+TEST(CompressionTest, DecompressF16) {
+  // All the halves, NaN, infinities and denormals included.
+  std::vector<uint16_t> halves(0x10000);
+  std::vector<uint32_t> expected(halves.size());
+  for (uint32_t h = 0; h < halves.size(); ++h) {
+    halves[h] = h;
+    Float16 f16;
+    std::memcpy(static_cast<void*>(&f16), &halves[h], sizeof(uint16_t));
+    expected[h] = Bits(f16.get_m());
+  }
+  for (size_t offset = 0; offset < 17; ++offset) {
+    size_t num = halves.size() - offset;
+    std::vector<float> out(num);
+    decompress_float_rows_f16(
+        reinterpret_cast<const char*>(halves.data() + offset), num, 1,
+        out.data());
+    for (size_t i = 0; i < num; ++i) {
+      ASSERT_EQ(Bits(out[i]), expected[offset + i])
+          << "offset " << offset << " half " << halves[offset + i];
+    }
+  }
+}
+
+TEST(CompressionTest, F16ListMatchesRows) {
+  std::vector<float> inputs = F16Inputs();
+  std::string list;
+  ASSERT_TRUE(compress_float_list_f16(
+      reinterpret_cast<const char*>(inputs.data()),
+      inputs.size() * sizeof(float), &list));
+  std::string rows(inputs.size() * compressed_row_size_f16(1), '\0');
+  compress_float_rows_f16(inputs.data(), inputs.size(), 1, &rows[0]);
+  EXPECT_EQ(list, rows);
+}
+
+TEST(CompressionTest, F16b) {
+  std::vector<float> inputs = F16Inputs();
+  for (size_t offset = 0; offset < 17; ++offset) {
+    size_t num = inputs.size() - offset;
+    std::vector<uint16_t> out(num);
+    compress_float_rows_f16b(inputs.data() + offset, num, 1,
+                             reinterpret_cast<char*>(out.data()));
+    std::vector<float> decoded(num);
+    decompress_float_rows_f16b(reinterpret_cast<const char*>(out.data()), num,
+                               1, decoded.data());
+    for (size_t i = 0; i < num; ++i) {
+      uint32_t bits = Bits(inputs[offset + i]);
+      ASSERT_EQ(out[i], bits >> 16);
+      ASSERT_EQ(Bits(decoded[i]), bits & 0xFFFF0000);
+    }
+  }
+}
+
+// Rows of every kind set_to_qtz8mm has to handle.
+std::vector<std::vector<float>> Qtz8mmRows(size_t dim) {
+  const float kNaN = std::numeric_limits<float>::quiet_NaN();
+  std::vector<std::vector<float>> rows;
+  std::mt19937 gen(dim);
+  std::normal_distribution<float> dist(0, 1);
+  for (int i = 0; i < 4; ++i) {
+    std::vector<float> row(dim);
+    for (float& x : row) {
+      x = dist(gen) * (i + 1);
+    }
+    rows.push_back(row);
+  }
+  rows.push_back(std::vector<float>(dim, 0.0f));
+  rows.push_back(std::vector<float>(dim, 1.5f));
+  rows.push_back(std::vector<float>(dim, kNaN));
+  // NaN first, last and in the middle of the row.
+  for (size_t pos : {size_t{0}, dim / 2, dim - 1}) {
+    std::vector<float> row = rows[0];
+    row[pos] = kNaN;
+    rows.push_back(row);
+  }
+  std::vector<float> row = rows[0];
+  row[dim / 2] = 65504.0f;
+  row[0] = -65504.0f;
+  rows.push_back(row);
+  return rows;
+}
+
+TEST(CompressionTest, Qtz8mm) {
+  for (size_t dim = 1; dim <= 70; ++dim) {
+    std::vector<std::vector<float>> rows = Qtz8mmRows(dim);
+    std::vector<float> flat;
+    for (const auto& row : rows) {
+      flat.insert(flat.end(), row.begin(), row.end());
+    }
+
+    const size_t row_size = compressed_row_size_qtz8mm(dim);
+    std::string batch(rows.size() * row_size, '\0');
+    compress_float_rows_qtz8mm(flat.data(), rows.size(), dim, &batch[0]);
+    std::vector<float> decoded(flat.size());
+    decompress_float_rows_qtz8mm(batch.data(), rows.size(), dim,
+                                 decoded.data());
+
+    for (size_t r = 0; r < rows.size(); ++r) {
+      const std::vector<float>& row = rows[r];
+      std::string expected;
+      std::vector<float> expected_decoded(dim);
+      if (dim <= 4) {
+        // Rows this short are f16.
+        for (size_t i = 0; i < dim; ++i) {
+          Float16 f16(row[i]);
+          uint16_t raw = f16.get_raw_data();
+          expected.append(reinterpret_cast<const char*>(&raw), sizeof(raw));
+          expected_decoded[i] = f16.get_m();
+        }
+      } else {
+        Float16 w[2];
+        std::vector<uint8_t> v(dim);
+        set_to_qtz8mm(row.data(), dim, dim, w, v.data());
+        expected.assign(reinterpret_cast<const char*>(w), sizeof(w));
+        expected.append(v.begin(), v.end());
+        get_from_qtz8mm(expected_decoded.data(), dim, w, v.data());
+      }
+      ASSERT_EQ(expected.size(), row_size);
+      ASSERT_EQ(batch.substr(r * row_size, row_size), expected)
+          << "dim " << dim << " row " << r;
+
+      std::string single;
+      ASSERT_TRUE(compress_float_list_qtz8mm(
+          reinterpret_cast<const char*>(row.data()), dim * sizeof(float),
+          &single));
+      ASSERT_EQ(single, expected) << "dim " << dim << " row " << r;
+      std::string single_decoded;
+      ASSERT_TRUE(decompress_float_list_qtz8mm(single.data(), single.size(),
+                                               &single_decoded));
+      ASSERT_EQ(single_decoded.size(), dim * sizeof(float));
+
+      for (size_t i = 0; i < dim; ++i) {
+        float x;
+        std::memcpy(&x, single_decoded.data() + i * sizeof(float), sizeof(x));
+        ASSERT_EQ(Bits(decoded[r * dim + i]), Bits(expected_decoded[i]))
+            << "dim " << dim << " row " << r << " index " << i;
+        ASSERT_EQ(Bits(x), Bits(expected_decoded[i]))
+            << "dim " << dim << " row " << r << " index " << i;
+      }
+    }
+  }
+}
+
+}  // namespace
+}  // namespace compression
+}  // namespace matrix
@@ -893,7 +893,8 @@ class MergeFlowDataset(dataset_ops.DatasetV2):
                input_dataset,
                dataset_to_merge,
                max_queue_size: int = 1024,
-               variant_type: str = 'example'):
+               variant_type: str = 'example',
+               weights: Optional[List[float]] = None):
     self._input_dataset = input_dataset
     self._dataset_to_merge = dataset_to_merge
 
@@ -940,11 +941,21 @@ class MergeFlowDataset(dataset_ops.DatasetV2):
         for i in range(len(self._dataset_to_merge))
     ]
 
+    # The mixing ratios of input_dataset and dataset_to_merge, when the
+    # inputs have items; by default they are merged in turn.
+    weights = weights or []
+    if weights and len(weights) != len(self._input_datasets):
+      raise ValueError("Expected {} weights, got {}".format(
+          len(self._input_datasets), len(weights)))
+    if any(w <= 0 for w in weights):
+      raise ValueError("Weights must be positive, got {}".format(weights))
+
     variant_tensor = pb_datasource_ops.merge_flow_dataset(
         input_dataset_variant,
         data_flow=data_flow,
         max_queue_size=max_queue_size,
-        variant_type=variant_type)
+        variant_type=variant_type,
+        weights=weights)
     super(MergeFlowDataset, self).__init__(variant_tensor)
 
   def _inputs(self):
@@ -1028,7 +1039,11 @@ def split_flow(self,
                           variant_type=variant_type)
 
 
-def merge_flow(self, dataset_to_merge, max_queue_size: int = 1024, **kwargs):
+def merge_flow(self,
+               dataset_to_merge,
+               max_queue_size: int = 1024,
+               weights: Optional[List[float]] = None,
+               **kwargs):
   value = tf.compat.v1.get_collection(OUTPUT_PB_TYPE_GRAPH_KEY)
   assert len(value) == 1
   variant_type = value[0]
@@ -1036,7 +1051,8 @@ def merge_flow(self, dataset_to_merge, max_queue_size: int = 1024, **kwargs):
   return MergeFlowDataset(self,
                           dataset_to_merge,
                           max_queue_size=max_queue_size,
-                          variant_type=variant_type)
+                          variant_type=variant_type,
+                          weights=weights)
 
 
 class KafkaGen(object):
@@ -42,7 +42,7 @@ def filter_by_fids(variant: tf.Tensor,
   """通过特征ID (FID) 过滤, 离散特征过滤
   
   Args:
-    variant (:obj:`Tensor`): 输入数据, 必须是variant类型
+    variant (:obj:`Tensor`): 输入数据, 必须是variant类型, 可以是一个batch, 并行过滤
     filter_fids (:obj:`List[int]`): 任意一个FID出现`filter_fids`中, 样本被过滤
     has_fids (:obj:`List[int]`): 任意一个FID出现在`has_fids`中, 则样本被选择
     select_fids (:obj:`List[int]`): 所有`select_fids`均出现在样本中, 则样本被选择
@@ -52,7 +52,7 @@ def filter_by_fids(variant: tf.Tensor,
     variant_type (:obj:`str`): variant类型, 可以为instance/example
   
   Returns:
-    variant tensor, 过滤后的数据, variant类型
+    bool tensor, 与`variant`形状相同, 样本是否被选择
   
   """
 
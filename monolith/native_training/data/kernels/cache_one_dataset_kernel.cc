@@ -127,14 +127,43 @@ class CacheOneDatasetOp::Dataset : public DatasetBase {
       return model::MakeKnownRatioNode(std::move(args), 1);
     }
 
+    // The element read ahead is saved with the input, so that a restored
+    // iterator hands it out next.
     Status SaveInternal(SerializationContext* ctx,
                         IteratorStateWriter* writer) override {
-      return errors::Unimplemented("Not Implemented");
+      absl::MutexLock l(&mu_);
+      TF_RETURN_IF_ERROR(SaveInput(ctx, writer, input_impl_));
+      TF_RETURN_IF_ERROR(
+          writer->WriteScalar(full_name("first_element"), first_element_));
+      TF_RETURN_IF_ERROR(writer->WriteScalar(full_name("eof"), eof_));
+      TF_RETURN_IF_ERROR(
+          writer->WriteScalar(full_name("buffered_size"),
+                              static_cast<int64>(buffered_tensors_.size())));
+      for (size_t i = 0; i < buffered_tensors_.size(); ++i) {
+        TF_RETURN_IF_ERROR(writer->WriteTensor(
+            full_name(absl::StrCat("buffered_", i)), buffered_tensors_[i]));
+      }
+      return Status::OK();
     }
 
     Status RestoreInternal(IteratorContext* ctx,
                            IteratorStateReader* reader) override {
-      return errors::Unimplemented("Not Implemented");
+      absl::MutexLock l(&mu_);
+      TF_RETURN_IF_ERROR(RestoreInput(ctx, reader, input_impl_));
+      int64 first_element, eof, buffered_size;
+      TF_RETURN_IF_ERROR(
+          reader->ReadScalar(full_name("first_element"), &first_element));
+      TF_RETURN_IF_ERROR(reader->ReadScalar(full_name("eof"), &eof));
+      TF_RETURN_IF_ERROR(
+          reader->ReadScalar(full_name("buffered_size"), &buffered_size));
+      first_element_ = first_element;
+      eof_ = eof;
+      buffered_tensors_.resize(buffered_size);
+      for (int64 i = 0; i < buffered_size; ++i) {
+        TF_RETURN_IF_ERROR(reader->ReadTensor(
+            full_name(absl::StrCat("buffered_", i)), &buffered_tensors_[i]));
+      }
+      return Status::OK();
     }
 
     absl::Mutex mu_;
@@ -14,10 +14,34 @@
 
 #include "monolith/native_training/data/kernels/df_resource_kernel.h"
 
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "monolith/native_training/runtime/common/metrics.h"
+
 namespace tensorflow {
 namespace monolith_tf {
 
-using Queue = ::monolith::concurrency::Queue<Item>;
+// Emits the stats of a named queue once every so many pops.
+constexpr int64_t kEmitStatsEveryNPops = 1000;
+
+std::string QueueResource::DebugString() const {
+  return absl::StrCat("QueueResource(name=", name_, ", size=", queue_.size(),
+                      ", high_water_mark=", queue_.high_water_mark(), ")");
+}
+
+void QueueResource::MaybeEmitStats() {
+  if (name_.empty() ||
+      num_pops_.fetch_add(1, std::memory_order_relaxed) %
+              kEmitStatsEveryNPops !=
+          0) {
+    return;
+  }
+  std::string tagkv = absl::StrFormat("queue=%s", name_);
+  monolith::GetMetrics()->emit_store("data_flow_queue_size", queue_.size(),
+                                     tagkv);
+  monolith::GetMetrics()->emit_store("data_flow_queue_high_water_mark",
+                                     queue_.high_water_mark(), tagkv);
+}
 
 Status RegisterCancellationCallback(CancellationManager* cancellation_manager,
                                     CancelCallback callback,
@@ -38,6 +62,43 @@ Status RegisterCancellationCallback(CancellationManager* cancellation_manager,
   return Status::OK();
 }
 
+Status WriteItems(data::IteratorStateWriter* writer, const std::string& prefix,
+                  const std::vector<Item>& items) {
+  TF_RETURN_IF_ERROR(writer->WriteScalar(absl::StrCat(prefix, "_size"),
+                                         static_cast<int64>(items.size())));
+  for (size_t i = 0; i < items.size(); ++i) {
+    const std::vector<Tensor>& tensors = items[i].out_tensors;
+    TF_RETURN_IF_ERROR(
+        writer->WriteScalar(absl::StrCat(prefix, "_", i, "_size"),
+                            static_cast<int64>(tensors.size())));
+    for (size_t j = 0; j < tensors.size(); ++j) {
+      TF_RETURN_IF_ERROR(writer->WriteTensor(
+          absl::StrCat(prefix, "_", i, "_", j), tensors[j]));
+    }
+  }
+  return Status::OK();
+}
+
+Status ReadItems(data::IteratorStateReader* reader, const std::string& prefix,
+                 std::vector<Item>* items) {
+  int64 size;
+  TF_RETURN_IF_ERROR(reader->ReadScalar(absl::StrCat(prefix, "_size"), &size));
+  items->resize(size);
+  for (int64 i = 0; i < size; ++i) {
+    Item& item = (*items)[i];
+    item.end_of_sequence = false;
+    int64 num_tensors;
+    TF_RETURN_IF_ERROR(reader->ReadScalar(
+        absl::StrCat(prefix, "_", i, "_size"), &num_tensors));
+    item.out_tensors.resize(num_tensors);
+    for (int64 j = 0; j < num_tensors; ++j) {
+      TF_RETURN_IF_ERROR(reader->ReadTensor(
+          absl::StrCat(prefix, "_", i, "_", j), &item.out_tensors[j]));
+    }
+  }
+  return Status::OK();
+}
+
 class CreateQueueOp : public ResourceOpKernel<QueueResource> {
  public:
   explicit CreateQueueOp(OpKernelConstruction* c) : ResourceOpKernel(c) {
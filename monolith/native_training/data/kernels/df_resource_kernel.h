@@ -15,10 +15,13 @@
 #ifndef MONOLITH_NATIVE_TRAINING_DATA_KERNELS_DF_RESOURCE_KERNEL_H_
 #define MONOLITH_NATIVE_TRAINING_DATA_KERNELS_DF_RESOURCE_KERNEL_H_
 
-#include <chrono>
-#include <thread>
-#include "absl/synchronization/mutex.h"
-#include "monolith/native_training/runtime/concurrency/queue.h"
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "absl/time/time.h"
+#include "monolith/native_training/data/kernels/internal/handoff_queue.h"
+#include "tensorflow/core/framework/dataset.h"
 #include "tensorflow/core/framework/op_kernel.h"
 #include "tensorflow/core/framework/resource_mgr.h"
 #include "tensorflow/core/framework/resource_op_kernel.h"
@@ -33,58 +36,73 @@ typedef struct {
   bool end_of_sequence;
 } Item;
 
-// It is a thin wrapper of GFile. Make it compatible with ResourceKernelOp
-// and thread safe.
+// A bounded queue of items between the threads of data flows. Blocked threads
+// are woken up by the pushes and pops themselves instead of polling.
 class QueueResource : public ResourceBase {
  public:
-  explicit QueueResource(size_t max_size = 100) {
-    queue_ = std::make_unique<::monolith::concurrency::Queue<Item>>(max_size);
-  }
+  // A named queue emits its depth and high water mark as metrics.
+  explicit QueueResource(size_t max_size = 100, std::string name = "")
+      : queue_(max_size), name_(std::move(name)) {}
 
   ~QueueResource() = default;
 
-  std::string DebugString() const override { return "QueueResource"; }
+  std::string DebugString() const override;
 
-  void Push(const Item &item) {
-    bool pushed = false;
-    do {
-      pushed = queue_->try_push(item, std::chrono::milliseconds(100));
-      if (!pushed) {
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
-      }
-    } while (!pushed);
+  // Blocks until the item is pushed, or *cancelled. Returns whether it was
+  // pushed.
+  bool Push(const Item &item, const std::atomic<bool> *cancelled = nullptr) {
+    return queue_.Push(item, cancelled);
   }
 
   bool TryPush(const Item &item, int64_t timeout = 100) {
-    return queue_->try_push(item, std::chrono::milliseconds(timeout));
+    return queue_.TryPush(item, absl::Milliseconds(timeout));
   }
 
-  Item Pop() const {
-    bool poped = false;
-    Item item;
-    do {
-      poped = queue_->try_pop(item, std::chrono::milliseconds(10));
-      if (!poped) {
-        std::this_thread::sleep_for(std::chrono::milliseconds(10));
-      }
-    } while (!poped);
-
-    return item;
+  // Blocks until an item is popped, or *cancelled. Returns whether one was
+  // popped.
+  bool Pop(Item *item, const std::atomic<bool> *cancelled = nullptr) {
+    bool popped = queue_.Pop(item, cancelled);
+    if (popped) MaybeEmitStats();
+    return popped;
   }
 
-  bool TryPop(Item &item, int64_t timeout = 100) const {
-    return queue_->try_pop(item, std::chrono::milliseconds(timeout));
+  bool TryPop(Item &item, int64_t timeout = 100) {
+    bool popped = queue_.TryPop(&item, absl::Milliseconds(timeout));
+    if (popped) MaybeEmitStats();
+    return popped;
   }
 
-  bool Empty() const { return queue_->empty(); }
+  bool Empty() const { return queue_.empty(); }
+
+  // Lets the threads blocked in Push or Pop check their cancellation flags.
+  void Wake() { queue_.Wake(); }
+
+  // Pops all the items without waiting, to restore a checkpoint while the
+  // producers are paused.
+  std::vector<Item> PopAll() { return queue_.PopAll(); }
+
+  // Copies all the items in the queue, to checkpoint them while other
+  // consumers may still pop.
+  std::vector<Item> Snapshot() const { return queue_.Snapshot(); }
 
  private:
-  mutable std::unique_ptr<::monolith::concurrency::Queue<Item>> queue_;
+  void MaybeEmitStats();
+
+  internal::HandoffQueue<Item> queue_;
+  const std::string name_;
+  std::atomic<int64_t> num_pops_{0};
 };
 
 Status RegisterCancellationCallback(CancellationManager *cancellation_manager,
                                     CancelCallback callback,
                                     std::function<void()> *deregister_fn);
+
+// Saves the items buffered by a data flow iterator under the key prefix, and
+// reads them back.
+Status WriteItems(data::IteratorStateWriter *writer, const std::string &prefix,
+                  const std::vector<Item> &items);
+Status ReadItems(data::IteratorStateReader *reader, const std::string &prefix,
+                 std::vector<Item> *items);
 }  // namespace monolith_tf
 }  // namespace tensorflow
 #endif  // MONOLITH_NATIVE_TRAINING_DATA_KERNELS_DF_RESOURCE_KERNEL_H_
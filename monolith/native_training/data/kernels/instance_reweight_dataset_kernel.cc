@@ -99,6 +99,52 @@ class InnerIterator {
     return s;
   }
 
+  // Saves the input and the element still to be replicated under the keys
+  // of the iterator with the given prefix.
+  Status Save(SerializationContext *ctx, IteratorStateWriter *writer,
+              const std::string &prefix) {
+    std::lock_guard<std::mutex> lck(mu_);
+    TF_RETURN_IF_ERROR(input_impl_->Save(ctx, writer));
+    auto key = [&prefix](const std::string &name) {
+      return absl::StrCat(prefix, ":", name);
+    };
+    TF_RETURN_IF_ERROR(writer->WriteScalar(key("index"), index_));
+    TF_RETURN_IF_ERROR(writer->WriteScalar(key("replicas"), replicas_));
+    TF_RETURN_IF_ERROR(
+        writer->WriteScalar(key("end_of_sequence"), end_of_sequence_));
+    TF_RETURN_IF_ERROR(writer->WriteScalar(
+        key("tensors_size"), static_cast<int64>(tensors_->size())));
+    for (size_t i = 0; i < tensors_->size(); ++i) {
+      TF_RETURN_IF_ERROR(writer->WriteTensor(key(absl::StrCat("tensors_", i)),
+                                             (*tensors_)[i]));
+    }
+    return Status::OK();
+  }
+
+  Status Restore(IteratorContext *ctx, IteratorStateReader *reader,
+                 const std::string &prefix) {
+    std::lock_guard<std::mutex> lck(mu_);
+    TF_RETURN_IF_ERROR(input_impl_->Restore(ctx, reader));
+    auto key = [&prefix](const std::string &name) {
+      return absl::StrCat(prefix, ":", name);
+    };
+    int64 index, replicas, end_of_sequence, tensors_size;
+    TF_RETURN_IF_ERROR(reader->ReadScalar(key("index"), &index));
+    TF_RETURN_IF_ERROR(reader->ReadScalar(key("replicas"), &replicas));
+    TF_RETURN_IF_ERROR(
+        reader->ReadScalar(key("end_of_sequence"), &end_of_sequence));
+    TF_RETURN_IF_ERROR(reader->ReadScalar(key("tensors_size"), &tensors_size));
+    index_ = index;
+    replicas_ = replicas;
+    end_of_sequence_ = end_of_sequence;
+    tensors_->resize(tensors_size);
+    for (int64 i = 0; i < tensors_size; ++i) {
+      TF_RETURN_IF_ERROR(reader->ReadTensor(key(absl::StrCat("tensors_", i)),
+                                            &(*tensors_)[i]));
+    }
+    return Status::OK();
+  }
+
  private:
   Status NextInternal(IteratorContext *ctx) {
     std::lock_guard<std::mutex> lck(mu_);
@@ -390,12 +436,12 @@ class InstanceReweightDatasetOp::Dataset : public DatasetBase {
 
     Status SaveInternal(SerializationContext *ctx,
                         IteratorStateWriter *writer) override {
-      return Status::OK();
+      return iter_->Save(ctx, writer, prefix());
     }
 
     Status RestoreInternal(IteratorContext *ctx,
                            IteratorStateReader *reader) override {
-      return Status::OK();
+      return iter_->Restore(ctx, reader, prefix());
     }
 
    private:
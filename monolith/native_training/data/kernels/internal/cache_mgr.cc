@@ -32,6 +32,299 @@ namespace tensorflow {
 namespace monolith_tf {
 namespace internal {
 
+namespace {
+
+enum WireType : uint32_t { kVarint = 0, kFixed64 = 1, kBytes = 2, kFixed32 = 5 };
+
+constexpr uint64_t MakeTag(int field, WireType wire_type) {
+  return (static_cast<uint64_t>(field) << 3) | wire_type;
+}
+
+inline void AppendVarint(uint64_t value, std::string* out) {
+  while (value >= 0x80) {
+    out->push_back(static_cast<char>(value | 0x80));
+    value >>= 7;
+  }
+  out->push_back(static_cast<char>(value));
+}
+
+inline void AppendBytesField(int field, absl::string_view bytes,
+                             std::string* out) {
+  AppendVarint(MakeTag(field, kBytes), out);
+  AppendVarint(bytes.size(), out);
+  out->append(bytes.data(), bytes.size());
+}
+
+inline void AppendVarintField(int field, uint64_t value, std::string* out) {
+  AppendVarint(MakeTag(field, kVarint), out);
+  AppendVarint(value, out);
+}
+
+// Minimal protobuf wire format reader over a flat buffer, length delimited
+// fields are returned as views into the buffer.
+class WireReader {
+ public:
+  explicit WireReader(absl::string_view data)
+      : pos_(data.data()), end_(data.data() + data.size()) {}
+
+  inline bool done() const { return pos_ >= end_; }
+
+  inline const char* position() const { return pos_; }
+
+  bool ReadVarint(uint64_t* value) {
+    uint64_t result = 0;
+    for (int shift = 0; shift < 64 && pos_ < end_; shift += 7) {
+      uint8_t byte = static_cast<uint8_t>(*pos_++);
+      result |= static_cast<uint64_t>(byte & 0x7F) << shift;
+      if (!(byte & 0x80)) {
+        *value = result;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool ReadBytes(absl::string_view* bytes) {
+    uint64_t len;
+    if (!ReadVarint(&len) || len > static_cast<uint64_t>(end_ - pos_)) {
+      return false;
+    }
+    *bytes = absl::string_view(pos_, len);
+    pos_ += len;
+    return true;
+  }
+
+  bool SkipField(uint64_t tag) {
+    uint64_t unused_varint;
+    absl::string_view unused_bytes;
+    switch (tag & 7) {
+      case kVarint:
+        return ReadVarint(&unused_varint);
+      case kFixed64:
+        return Advance(8);
+      case kBytes:
+        return ReadBytes(&unused_bytes);
+      case kFixed32:
+        return Advance(4);
+      default:
+        return false;
+    }
+  }
+
+ private:
+  bool Advance(size_t n) {
+    if (n > static_cast<size_t>(end_ - pos_)) {
+      return false;
+    }
+    pos_ += n;
+    return true;
+  }
+
+  const char* pos_;
+  const char* end_;
+};
+
+// NamedFeature fields.
+constexpr int kNamedFeatureName = 1;
+constexpr int kNamedFeatureFeature = 2;
+constexpr int kNamedFeatureId = 3;
+constexpr int kNamedFeatureSortedId = 6;
+
+// FeatureData fields.
+constexpr int kFeatureDataGid = 1;
+constexpr int kFeatureDataFids = 2;
+constexpr int kFeatureDataFeatureColumns = 3;
+constexpr int kFeatureDataOriginCnt = 4;
+constexpr int kFeatureDataSampleCnt = 5;
+
+// ChannelCache fields.
+constexpr int kChannelCacheChannelId = 1;
+constexpr int kChannelCacheFeatureDatas = 2;
+
+bool ParseFeatureData(absl::string_view bytes, ParsedItem* parsed) {
+  auto item = std::make_shared<ItemFeatures>();
+  WireReader reader(bytes);
+  while (!reader.done()) {
+    uint64_t tag, value;
+    absl::string_view field;
+    if (!reader.ReadVarint(&tag)) {
+      return false;
+    }
+    switch (tag) {
+      case MakeTag(kFeatureDataGid, kVarint):
+        if (!reader.ReadVarint(&item->item_id)) return false;
+        break;
+      case MakeTag(kFeatureDataFids, kBytes): {
+        if (!reader.ReadBytes(&field)) return false;
+        WireReader packed(field);
+        while (!packed.done()) {
+          if (!packed.ReadVarint(&value)) return false;
+          item->fids.push_back(value);
+        }
+        break;
+      }
+      case MakeTag(kFeatureDataFids, kVarint):
+        if (!reader.ReadVarint(&value)) return false;
+        item->fids.push_back(value);
+        break;
+      case MakeTag(kFeatureDataFeatureColumns, kBytes):
+        if (!reader.ReadBytes(&field) ||
+            !item->AddSerializedExampleFeature(field)) {
+          return false;
+        }
+        break;
+      case MakeTag(kFeatureDataOriginCnt, kVarint):
+        if (!reader.ReadVarint(&value)) return false;
+        parsed->origin_cnt = static_cast<int64_t>(value);
+        break;
+      case MakeTag(kFeatureDataSampleCnt, kVarint):
+        if (!reader.ReadVarint(&value)) return false;
+        parsed->sample_cnt = static_cast<int64_t>(value);
+        break;
+      default:
+        if (!reader.SkipField(tag)) return false;
+    }
+  }
+  parsed->item = std::move(item);
+  return true;
+}
+
+}  // namespace
+
+FeatureNameInterner* FeatureNameInterner::GetInstance() {
+  static FeatureNameInterner* instance = new FeatureNameInterner();
+  return instance;
+}
+
+uint32_t FeatureNameInterner::Intern(absl::string_view name) {
+  {
+    absl::ReaderMutexLock l(&mu_);
+    auto it = ids_.find(name);
+    if (it != ids_.end()) {
+      return it->second;
+    }
+  }
+  absl::MutexLock l(&mu_);
+  auto it = ids_.find(name);
+  if (it != ids_.end()) {
+    return it->second;
+  }
+  uint32_t id = names_.size();
+  names_.emplace_back(name);
+  ids_.emplace(names_.back(), id);
+  return id;
+}
+
+absl::string_view FeatureNameInterner::Get(uint32_t id) const {
+  absl::ReaderMutexLock l(&mu_);
+  return names_[id];
+}
+
+void ItemFeatures::AddExampleFeature(const EFeature& nf) {
+  Entry entry{FeatureNameInterner::GetInstance()->Intern(nf.name()),
+              static_cast<uint32_t>(buffer_.size())};
+  if (nf.id() != 0) {
+    // int32 is sign extended on the wire.
+    AppendVarintField(kNamedFeatureId,
+                      static_cast<uint64_t>(static_cast<int64_t>(nf.id())),
+                      &buffer_);
+  }
+  if (nf.has_feature()) {
+    AppendVarint(MakeTag(kNamedFeatureFeature, kBytes), &buffer_);
+    AppendVarint(nf.feature().ByteSizeLong(), &buffer_);
+    nf.feature().AppendToString(&buffer_);
+  }
+  if (nf.sorted_id() != 0) {
+    AppendVarintField(
+        kNamedFeatureSortedId,
+        static_cast<uint64_t>(static_cast<int64_t>(nf.sorted_id())), &buffer_);
+  }
+  AddEntry(entry);
+}
+
+bool ItemFeatures::AddSerializedExampleFeature(absl::string_view serialized) {
+  const size_t offset = buffer_.size();
+  absl::string_view name;
+  WireReader reader(serialized);
+  while (!reader.done()) {
+    const char* field_start = reader.position();
+    uint64_t tag;
+    bool ok = reader.ReadVarint(&tag);
+    if (ok && tag == MakeTag(kNamedFeatureName, kBytes)) {
+      ok = reader.ReadBytes(&name);
+    } else if (ok) {
+      ok = reader.SkipField(tag);
+      buffer_.append(field_start, reader.position() - field_start);
+    }
+    if (!ok) {
+      buffer_.resize(offset);
+      return false;
+    }
+  }
+  AddEntry({FeatureNameInterner::GetInstance()->Intern(name),
+            static_cast<uint32_t>(offset)});
+  return true;
+}
+
+void ItemFeatures::AddEntry(Entry entry) {
+  // A feature added again replaces the earlier one, whose bytes are cut out
+  // of the buffer.
+  for (size_t i = 0; i < entries_.size(); ++i) {
+    if (entries_[i].name_id != entry.name_id) {
+      continue;
+    }
+    // The new bytes are already at the end of buffer_.
+    const uint32_t end =
+        i + 1 < entries_.size() ? entries_[i + 1].offset : entry.offset;
+    const uint32_t size = end - entries_[i].offset;
+    buffer_.erase(entries_[i].offset, size);
+    for (size_t j = i + 1; j < entries_.size(); ++j) {
+      entries_[j].offset -= size;
+    }
+    entry.offset -= size;
+    entries_.erase(entries_.begin() + i);
+    break;
+  }
+  entries_.push_back(entry);
+}
+
+absl::string_view ItemFeatures::example_feature_name(size_t i) const {
+  return FeatureNameInterner::GetInstance()->Get(entries_[i].name_id);
+}
+
+absl::string_view ItemFeatures::example_feature_bytes(size_t i) const {
+  size_t end =
+      i + 1 < entries_.size() ? entries_[i + 1].offset : buffer_.size();
+  return absl::string_view(buffer_).substr(entries_[i].offset,
+                                           end - entries_[i].offset);
+}
+
+bool ItemFeatures::HasExampleFeature(absl::string_view name) const {
+  for (size_t i = 0; i < entries_.size(); ++i) {
+    if (example_feature_name(i) == name) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool ItemFeatures::GetExampleFeature(size_t i, EFeature* nf) const {
+  absl::string_view bytes = example_feature_bytes(i);
+  if (!nf->ParseFromArray(bytes.data(), bytes.size())) {
+    return false;
+  }
+  absl::string_view name = example_feature_name(i);
+  nf->set_name(name.data(), name.size());
+  return true;
+}
+
+void ItemFeatures::AppendSerializedExampleFeature(size_t i,
+                                                  std::string* out) const {
+  AppendBytesField(kNamedFeatureName, example_feature_name(i), out);
+  absl::string_view bytes = example_feature_bytes(i);
+  out->append(bytes.data(), bytes.size());
+}
+
 std::shared_ptr<ItemFeatures> MakeItemFeaturesFromProto(
     const ::monolith::io::proto::FeatureData& feature_data) {
   std::shared_ptr<ItemFeatures> item_feature_ptr =
@@ -41,7 +334,7 @@ std::shared_ptr<ItemFeatures> MakeItemFeaturesFromProto(
     item_feature_ptr->fids.push_back(fid);
   }
   for (const auto& fc : feature_data.feature_columns()) {
-    item_feature_ptr->example_features.emplace(fc.name(), fc);
+    item_feature_ptr->AddExampleFeature(fc);
   }
   return item_feature_ptr;
 }
@@ -71,24 +364,64 @@ bool ItemFeatures::Equal(const ItemFeatures& other) const {
     }
   }
 
-  if (example_features.size() != other.example_features.size()) {
-    for (const auto& it : example_features) {
-      if (other.example_features.count(it.first) == 0) {
-        return false;
-      } else {
-        auto this_feat = it.second.SerializeAsString();
-        auto other_feat =
-            other.example_features.at(it.first).SerializeAsString();
-        if (this_feat != other_feat) {
-          return false;
-        }
-      }
+  if (entries_.size() != other.entries_.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < entries_.size(); ++i) {
+    if (entries_[i].name_id != other.entries_[i].name_id ||
+        example_feature_bytes(i) != other.example_feature_bytes(i)) {
+      return false;
     }
   }
 
   return true;
 }
 
+AliasTable::AliasTable(const std::vector<double>& weights) {
+  size_t n = weights.size();
+  double total = 0;
+  for (double w : weights) {
+    total += std::max(w, 0.0);
+  }
+  if (n == 0 || total <= 0) {
+    return;
+  }
+
+  prob_.resize(n);
+  alias_.resize(n);
+  std::vector<double> scaled(n);
+  std::vector<uint32_t> small, large;
+  for (size_t i = 0; i < n; ++i) {
+    scaled[i] = std::max(weights[i], 0.0) * n / total;
+    if (scaled[i] < 1.0) {
+      small.push_back(i);
+    } else {
+      large.push_back(i);
+    }
+  }
+
+  while (!small.empty() && !large.empty()) {
+    uint32_t s = small.back(), l = large.back();
+    small.pop_back();
+    prob_[s] = scaled[s];
+    alias_[s] = l;
+    scaled[l] -= 1.0 - scaled[s];
+    if (scaled[l] < 1.0) {
+      large.pop_back();
+      small.push_back(l);
+    }
+  }
+  // Leftovers are only due to rounding errors, they are (almost) exactly 1.
+  for (uint32_t i : large) {
+    prob_[i] = 1.0;
+    alias_[i] = i;
+  }
+  for (uint32_t i : small) {
+    prob_[i] = 1.0;
+    alias_[i] = i;
+  }
+}
+
 CacheWithGid::CacheWithGid(int max_item_num, int start_num)
     : start_num_(start_num), max_item_num_(max_item_num) {}
 
@@ -105,11 +438,11 @@ void CacheWithGid::Push(uint64_t item_id,
   if (iit == stats_.end()) {
     auto stats_ptr = std::make_shared<GroupStat>();
     stats_ptr->origin_cnt = origin_cnt;
-    stats_ptr->sample_cnt = sample_cnt;
+    stats_ptr->sample_cnt.store(sample_cnt, std::memory_order_relaxed);
     stats_.emplace(item_id, stats_ptr);
   } else {
     iit->second->origin_cnt += origin_cnt;
-    iit->second->sample_cnt += sample_cnt;
+    iit->second->sample_cnt.fetch_add(sample_cnt, std::memory_order_relaxed);
   }
 
   if ((int64_t)data_queue_.size() > max_item_num_) {
@@ -122,22 +455,45 @@ void CacheWithGid::Push(uint64_t item_id,
 
 std::shared_ptr<const ItemFeatures> CacheWithGid::RandomSelectOne(
     double* freq_factor, double* time_factor) const {
-  if ((int64_t)data_queue_.size() <= start_num_) {
+  std::vector<std::shared_ptr<const ItemFeatures>> items;
+  std::vector<double> freq_factors, time_factors;
+  if (SampleN(1, &items, &freq_factors, &time_factors) == 0) {
     return nullptr;
   }
+  *freq_factor = freq_factors.front();
+  *time_factor = time_factors.front();
+  return items.front();
+}
+
+int CacheWithGid::SampleN(
+    int n, std::vector<std::shared_ptr<const ItemFeatures>>* items,
+    std::vector<double>* freq_factors,
+    std::vector<double>* time_factors) const {
+  const size_t size = data_queue_.size();
+  if ((int64_t)size <= start_num_) {
+    return 0;
+  }
   thread_local std::mt19937 gen((std::random_device())());
-  size_t index = gen() % data_queue_.size();
-  uint64_t item_id = data_queue_[index];
-  auto it = data_.find(item_id);
-  if (it != data_.end()) {
-    *freq_factor = 1.0 / ++(stats_[item_id]->sample_cnt);
-    *time_factor = (index + 1.0) / data_queue_.size();
-    return it->second;
-  } else {
-    LOG_EVERY_N_SEC(ERROR, 1)
-        << "item_id " << item_id << "in queue but not in map";
+  std::uniform_int_distribution<size_t> dist(0, size - 1);
+  int sampled = 0;
+  for (int i = 0; i < n; ++i) {
+    size_t index = dist(gen);
+    uint64_t item_id = data_queue_[index];
+    auto it = data_.find(item_id);
+    auto sit = stats_.find(item_id);
+    if (it == data_.end() || sit == stats_.end()) {
+      LOG_EVERY_N_SEC(ERROR, 1)
+          << "item_id " << item_id << "in queue but not in map";
+      continue;
+    }
+    uint32_t sample_cnt =
+        sit->second->sample_cnt.fetch_add(1, std::memory_order_relaxed) + 1;
+    items->push_back(it->second);
+    freq_factors->push_back(1.0 / sample_cnt);
+    time_factors->push_back((index + 1.0) / size);
+    ++sampled;
   }
-  return nullptr;
+  return sampled;
 }
 
 void CacheWithGid::ToProto(ChannelCache* proto) const {
@@ -149,16 +505,14 @@ void CacheWithGid::ToProto(ChannelCache* proto) const {
       feature_data->add_fids(fid);
     }
 
-    const auto& example_features =
-        it.second->example_features;  // std::shared_ptr<const ItemFeatures>
-    for (const auto& fc_it : example_features) {
-      auto* feature_columns = feature_data->add_feature_columns();
-      feature_columns->CopyFrom(fc_it.second);
+    for (size_t i = 0; i < it.second->example_features_size(); ++i) {
+      it.second->GetExampleFeature(i, feature_data->add_feature_columns());
     }
 
-    const auto& stats = stats_[it.first];
+    const auto& stats = stats_.at(it.first);
     feature_data->set_origin_cnt(stats->origin_cnt);
-    feature_data->set_sample_cnt(stats->sample_cnt);
+    feature_data->set_sample_cnt(
+        stats->sample_cnt.load(std::memory_order_relaxed));
   }
   LOG_EVERY_N(INFO, 1000) << "save size " << data_queue_.size() << " "
                           << data_.size();
@@ -171,26 +525,77 @@ void CacheWithGid::FromProto(const ChannelCache& proto) {
     const auto& feature_data = proto.feature_datas(i);
     auto gid = feature_data.gid();
     data_queue_.emplace_back(gid);
-
-    auto group_feature_ptr = std::make_shared<ItemFeatures>();
-    group_feature_ptr->item_id = gid;
-    for (const auto& fid : feature_data.fids()) {
-      group_feature_ptr->fids.push_back(fid);
-    }
-    for (const auto& fc : feature_data.feature_columns()) {
-      group_feature_ptr->example_features.emplace(fc.name(), fc);
-    }
-    data_.emplace(gid, group_feature_ptr);
+    data_.emplace(gid, MakeItemFeaturesFromProto(feature_data));
 
     std::shared_ptr<GroupStat> stats = std::make_shared<GroupStat>();
     stats->origin_cnt = feature_data.origin_cnt();
-    stats->sample_cnt = feature_data.sample_cnt();
+    stats->sample_cnt.store(feature_data.sample_cnt(),
+                            std::memory_order_relaxed);
     stats_[gid] = stats;
   }
   LOG_EVERY_N(INFO, 1000) << "restore size " << data_queue_.size() << " "
                           << data_.size();
 }
 
+void CacheWithGid::Serialize(uint64_t channel_id, std::string* record) const {
+  AppendVarintField(kChannelCacheChannelId, channel_id, record);
+  std::string feature_data, scratch;
+  // Oldest first, so that the restored queue keeps the same order.
+  for (uint64_t gid : data_queue_) {
+    auto it = data_.find(gid);
+    auto sit = stats_.find(gid);
+    if (it == data_.end() || sit == stats_.end()) {
+      continue;
+    }
+    const ItemFeatures& item = *it->second;
+    feature_data.clear();
+    AppendVarintField(kFeatureDataGid, gid, &feature_data);
+    if (!item.fids.empty()) {
+      scratch.clear();
+      for (uint64_t fid : item.fids) {
+        AppendVarint(fid, &scratch);
+      }
+      AppendBytesField(kFeatureDataFids, scratch, &feature_data);
+    }
+    for (size_t i = 0; i < item.example_features_size(); ++i) {
+      scratch.clear();
+      item.AppendSerializedExampleFeature(i, &scratch);
+      AppendBytesField(kFeatureDataFeatureColumns, scratch, &feature_data);
+    }
+    AppendVarintField(kFeatureDataOriginCnt, sit->second->origin_cnt,
+                      &feature_data);
+    AppendVarintField(kFeatureDataSampleCnt,
+                      sit->second->sample_cnt.load(std::memory_order_relaxed),
+                      &feature_data);
+    AppendBytesField(kChannelCacheFeatureDatas, feature_data, record);
+  }
+}
+
+bool CacheWithGid::Parse(absl::string_view record, uint64_t* channel_id,
+                         std::vector<ParsedItem>* items) {
+  *channel_id = 0;
+  WireReader reader(record);
+  while (!reader.done()) {
+    uint64_t tag;
+    absl::string_view field;
+    if (!reader.ReadVarint(&tag)) {
+      return false;
+    }
+    if (tag == MakeTag(kChannelCacheChannelId, kVarint)) {
+      if (!reader.ReadVarint(channel_id)) return false;
+    } else if (tag == MakeTag(kChannelCacheFeatureDatas, kBytes)) {
+      items->emplace_back();
+      if (!reader.ReadBytes(&field) ||
+          !ParseFeatureData(field, &items->back())) {
+        return false;
+      }
+    } else if (!reader.SkipField(tag)) {
+      return false;
+    }
+  }
+  return true;
+}
+
 bool CacheWithGid::Equal(const CacheWithGid& other) const {
   if (start_num_ != other.start_num_) {
     return false;
@@ -208,7 +613,7 @@ bool CacheWithGid::Equal(const CacheWithGid& other) const {
       if (oit == other.stats_.end()) {
         return false;
       } else {
-        if (it.second->Equal(*oit->second.get())) {
+        if (!it.second->Equal(*oit->second.get())) {
           return false;
         }
       }
@@ -243,6 +648,18 @@ std::shared_ptr<const ItemFeatures> CacheManager::RandomSelectOne(
   return nullptr;
 }
 
+int CacheManager::SampleN(
+    uint64_t channel_id, int n,
+    std::vector<std::shared_ptr<const ItemFeatures>>* items,
+    std::vector<double>* freq_factors,
+    std::vector<double>* time_factors) const {
+  auto it = channel_cache_.find(channel_id);
+  if (it != channel_cache_.end()) {
+    return it->second.SampleN(n, items, freq_factors, time_factors);
+  }
+  return 0;
+}
+
 void CacheManager::Push(uint64_t channel_id, uint64_t item_id,
                         const std::shared_ptr<const ItemFeatures>& item,
                         int64_t origin_cnt, int64_t sample_cnt) {
@@ -262,21 +679,24 @@ absl::flat_hash_map<uint64_t, CacheWithGid>& CacheManager::GetCache() {
 }
 
 void CacheManager::SampleChannelID(uint64_t* channel_id) {
-  std::vector<uint64_t> channel_ids;
-  std::vector<int> cache_size;
-
   if (channel_cache_.size() >= 2) {
-    for (auto iter = channel_cache_.begin(); iter != channel_cache_.end();
-         ++iter) {
-      channel_ids.emplace_back(iter->first);
-      cache_size.emplace_back(iter->second.Size());
+    std::vector<uint64_t> channel_ids;
+    std::vector<double> cache_size;
+    GetChannelSizes(&channel_ids, &cache_size);
+    AliasTable table(cache_size);
+    if (table.empty()) {
+      return;
     }
+    thread_local std::mt19937 gen((std::random_device())());
+    *channel_id = channel_ids[table.Sample(gen)];
+  }
+}
 
-    std::discrete_distribution<int> discrete_dist(cache_size.begin(),
-                                                  cache_size.end());
-
-    std::mt19937 gen(std::random_device{}());
-    *channel_id = channel_ids[discrete_dist(gen)];
+void CacheManager::GetChannelSizes(std::vector<uint64_t>* channel_ids,
+                                   std::vector<double>* sizes) const {
+  for (const auto& it : channel_cache_) {
+    channel_ids->push_back(it.first);
+    sizes->push_back(it.second.Size());
   }
 }
 
@@ -16,13 +16,18 @@
 #define MONOLITH_MONOLITH_NATIVE_TRAINING_DATA_KERNELS_CACHE_MGR_H_
 
 #include <algorithm>
+#include <atomic>
 #include <cstdlib>
 #include <deque>
+#include <random>
 #include <set>
 #include <string>
 #include <vector>
 
+#include "absl/base/thread_annotations.h"
 #include "absl/container/flat_hash_map.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
 #include "monolith/native_training/data/training_instance/cc/pb_variant.h"
 #include "tensorflow/core/platform/env.h"
 
@@ -32,29 +37,120 @@ namespace internal {
 
 struct GroupStat {
   uint32_t origin_cnt = 0;
-  uint32_t sample_cnt = 0;
+  // Bumped by concurrent samplers which only hold a reader lock.
+  std::atomic<uint32_t> sample_cnt{0};
 
-  inline bool operator==(const GroupStat &rhs) const {
-    return origin_cnt == rhs.origin_cnt && sample_cnt == rhs.sample_cnt;
-  }
+  inline bool operator==(const GroupStat &rhs) const { return Equal(rhs); }
 
   inline bool Equal(const GroupStat &rhs) const {
-    return origin_cnt == rhs.origin_cnt && sample_cnt == rhs.sample_cnt;
+    return origin_cnt == rhs.origin_cnt &&
+           sample_cnt.load(std::memory_order_relaxed) ==
+               rhs.sample_cnt.load(std::memory_order_relaxed);
+  }
+};
+
+// Weighted discrete sampler based on Vose's alias method. Building the table
+// is O(n), after which every draw is O(1) and needs only two random numbers,
+// instead of the O(n) std::discrete_distribution setup per call.
+class AliasTable {
+ public:
+  AliasTable() = default;
+
+  explicit AliasTable(const std::vector<double> &weights);
+
+  template <typename URBG>
+  size_t Sample(URBG &gen) const {
+    std::uniform_int_distribution<size_t> column(0, prob_.size() - 1);
+    std::uniform_real_distribution<double> coin(0.0, 1.0);
+    size_t i = column(gen);
+    return coin(gen) < prob_[i] ? i : alias_[i];
   }
+
+  inline bool empty() const { return prob_.empty(); }
+
+  inline size_t size() const { return prob_.size(); }
+
+ private:
+  std::vector<double> prob_;
+  std::vector<uint32_t> alias_;
+};
+
+// Process wide, append-only table mapping feature names to small ids, so that
+// cached items do not each carry a copy of every feature name.
+class FeatureNameInterner {
+ public:
+  static FeatureNameInterner *GetInstance();
+
+  uint32_t Intern(absl::string_view name);
+
+  absl::string_view Get(uint32_t id) const;
+
+ private:
+  FeatureNameInterner() = default;
+
+  mutable absl::Mutex mu_;
+  // std::deque never moves its elements, so the map can key on views.
+  std::deque<std::string> names_ ABSL_GUARDED_BY(mu_);
+  absl::flat_hash_map<absl::string_view, uint32_t> ids_ ABSL_GUARDED_BY(mu_);
 };
 
-struct ItemFeatures {
-  uint64_t item_id;
+// Features of one cached item. The example features are stored as their
+// serialized NamedFeature bytes with the name stripped (and replaced by an
+// interned name id), packed back to back into a single buffer. This is a few
+// times smaller than keeping a map of NamedFeature protos per item, and the
+// bytes can be streamed into a checkpoint without re-serialization.
+class ItemFeatures {
+ public:
+  uint64_t item_id = 0;
   std::vector<uint64_t> fids;
-  absl::flat_hash_map<std::string, ::monolith::io::proto::NamedFeature>
-      example_features;
+
+  // Adding a feature whose name is already present replaces it.
+  void AddExampleFeature(const ::monolith::io::proto::NamedFeature &nf);
+
+  // Adds a feature from its serialized NamedFeature, returns false if the
+  // bytes cannot be parsed.
+  bool AddSerializedExampleFeature(absl::string_view serialized);
+
+  inline size_t example_features_size() const { return entries_.size(); }
+
+  absl::string_view example_feature_name(size_t i) const;
+
+  bool HasExampleFeature(absl::string_view name) const;
+
+  bool GetExampleFeature(size_t i,
+                         ::monolith::io::proto::NamedFeature *nf) const;
+
+  // Appends the serialized NamedFeature i (name included) to out.
+  void AppendSerializedExampleFeature(size_t i, std::string *out) const;
 
   bool Equal(const ItemFeatures &other) const;
+
+ private:
+  struct Entry {
+    uint32_t name_id;
+    uint32_t offset;
+  };
+
+  absl::string_view example_feature_bytes(size_t i) const;
+
+  // Appends the entry of the bytes at the end of buffer_, dropping an
+  // earlier feature of the same name.
+  void AddEntry(Entry entry);
+
+  std::vector<Entry> entries_;
+  std::string buffer_;
 };
 
 std::shared_ptr<ItemFeatures> MakeItemFeaturesFromProto(
     const ::monolith::io::proto::FeatureData &feature_data);
 
+// An item parsed from a serialized ChannelCache, see CacheWithGid::Serialize.
+struct ParsedItem {
+  std::shared_ptr<const ItemFeatures> item;
+  int64_t origin_cnt = 0;
+  int64_t sample_cnt = 0;
+};
+
 class CacheWithGid {
  public:
   explicit CacheWithGid(int max_item_num, int start_num = 0);
@@ -62,13 +158,31 @@ class CacheWithGid {
   void Push(uint64_t item_id, std::shared_ptr<const ItemFeatures> item,
             int64_t origin_cnt = 1, int64_t sample_cnt = 0);
 
+  // Thread safe against other const callers, it only bumps the atomic
+  // sample counters.
   std::shared_ptr<const ItemFeatures> RandomSelectOne(
       double *freq_factor, double *time_factor) const;
 
+  // Draws n items uniformly with replacement, appending the items and their
+  // freq/time factors to the output vectors. Returns the number of items
+  // drawn, which is 0 if the cache holds no more than start_num items.
+  int SampleN(int n, std::vector<std::shared_ptr<const ItemFeatures>> *items,
+              std::vector<double> *freq_factors,
+              std::vector<double> *time_factors) const;
+
   void ToProto(::monolith::io::proto::ChannelCache *proto) const;
 
   void FromProto(const ::monolith::io::proto::ChannelCache &proto);
 
+  // Appends this cache as a serialized ChannelCache to record. The packed
+  // item buffers are written directly, no intermediate protos are built.
+  void Serialize(uint64_t channel_id, std::string *record) const;
+
+  // Parses a serialized ChannelCache into ItemFeatures, with the same
+  // packed representation. Returns false if the record is corrupted.
+  static bool Parse(absl::string_view record, uint64_t *channel_id,
+                    std::vector<ParsedItem> *items);
+
   bool Equal(const CacheWithGid &other) const;
 
   inline int Size() const { return data_queue_.size(); }
@@ -78,7 +192,7 @@ class CacheWithGid {
   int max_item_num_;
 
   absl::flat_hash_map<uint64_t, std::shared_ptr<const ItemFeatures>> data_;
-  mutable absl::flat_hash_map<uint64_t, std::shared_ptr<GroupStat>> stats_;
+  absl::flat_hash_map<uint64_t, std::shared_ptr<GroupStat>> stats_;
   std::deque<uint64_t> data_queue_;
 };
 
@@ -89,6 +203,11 @@ class CacheManager {
   std::shared_ptr<const ItemFeatures> RandomSelectOne(
       uint64_t channel_id, double *freq_factor, double *time_factor) const;
 
+  int SampleN(uint64_t channel_id, int n,
+              std::vector<std::shared_ptr<const ItemFeatures>> *items,
+              std::vector<double> *freq_factors,
+              std::vector<double> *time_factors) const;
+
   void Push(uint64_t channel_id, uint64_t item_id,
             const std::shared_ptr<const ItemFeatures> &item,
             int64_t origin_cnt = 1, int64_t sample_cnt = 0);
@@ -97,6 +216,10 @@ class CacheManager {
 
   void SampleChannelID(uint64_t* channel_id);
 
+  // Appends (channel_id, cache size) of every channel in this manager.
+  void GetChannelSizes(std::vector<uint64_t> *channel_ids,
+                       std::vector<double> *sizes) const;
+
  private:
   int start_num_;
   int max_item_num_per_channel_;
@@ -44,8 +44,8 @@ void gen_item_features(ItemFeatures *item) {
   for (int i = 0; i < num_feats; ++i) {
     NamedFeature nf;
     gen_named_feature(&nf);
-    if (!item->example_features.contains(nf.name())) {
-      item->example_features.insert({nf.name(), nf});
+    if (!item->HasExampleFeature(nf.name())) {
+      item->AddExampleFeature(nf);
     }
   }
 }
@@ -71,6 +71,99 @@ TEST(CACHE_MGR, CacheWithGid) {
   cwg2.FromProto(cache);
 }
 
+TEST(CACHE_MGR, ItemFeatures) {
+  ItemFeatures item;
+  NamedFeature nf;
+  nf.set_name("fc_item_id");
+  nf.set_id(-3);
+  nf.set_sorted_id(7);
+  nf.mutable_feature()->mutable_fid_v2_list()->add_value(42);
+  item.AddExampleFeature(nf);
+  EXPECT_TRUE(item.AddSerializedExampleFeature(nf.SerializeAsString()));
+  EXPECT_FALSE(item.AddSerializedExampleFeature("\x0a\xff"));
+  // The same name again replaces the feature.
+  EXPECT_EQ(item.example_features_size(), 1);
+  EXPECT_TRUE(item.HasExampleFeature("fc_item_id"));
+  EXPECT_FALSE(item.HasExampleFeature("fc_other"));
+
+  for (size_t i = 0; i < item.example_features_size(); ++i) {
+    NamedFeature restored;
+    EXPECT_TRUE(item.GetExampleFeature(i, &restored));
+    EXPECT_EQ(restored.SerializeAsString(), nf.SerializeAsString());
+
+    std::string serialized;
+    item.AppendSerializedExampleFeature(i, &serialized);
+    EXPECT_TRUE(restored.ParseFromString(serialized));
+    EXPECT_EQ(restored.SerializeAsString(), nf.SerializeAsString());
+  }
+}
+
+TEST(CACHE_MGR, ItemFeaturesReplacesSameName) {
+  ItemFeatures item;
+  NamedFeature a, b, a2;
+  a.set_name("fc_a");
+  a.mutable_feature()->mutable_fid_v2_list()->add_value(1);
+  b.set_name("fc_b");
+  b.mutable_feature()->mutable_float_list()->add_value(2.0f);
+  a2.set_name("fc_a");
+  a2.mutable_feature()->mutable_fid_v2_list()->add_value(3);
+  a2.mutable_feature()->mutable_fid_v2_list()->add_value(4);
+  item.AddExampleFeature(a);
+  item.AddExampleFeature(b);
+  EXPECT_TRUE(item.AddSerializedExampleFeature(a2.SerializeAsString()));
+  // The last one wins, as when the features were kept in a map by name.
+  item.AddExampleFeature(b);
+
+  ASSERT_EQ(item.example_features_size(), 2);
+  NamedFeature restored;
+  EXPECT_TRUE(item.GetExampleFeature(0, &restored));
+  EXPECT_EQ(restored.SerializeAsString(), a2.SerializeAsString());
+  EXPECT_TRUE(item.GetExampleFeature(1, &restored));
+  EXPECT_EQ(restored.SerializeAsString(), b.SerializeAsString());
+}
+
+TEST(CACHE_MGR, CacheWithGidSerialize) {
+  CacheWithGid cwg(100, 20);
+  for (int i = 0; i < 50; ++i) {
+    auto item = std::make_shared<ItemFeatures>();
+    item->item_id = i + 1;
+    item->fids = {static_cast<uint64_t>(i), 1ULL << 63};
+    gen_item_features(item.get());
+    cwg.Push(i + 1, item, i, 2 * i);
+  }
+
+  std::string record;
+  cwg.Serialize(9, &record);
+
+  // The record is a valid ChannelCache proto.
+  ChannelCache cache;
+  ASSERT_TRUE(cache.ParseFromString(record));
+  EXPECT_EQ(cache.channel_id(), 9);
+  EXPECT_EQ(cache.feature_datas_size(), 50);
+
+  uint64_t channel_id;
+  std::vector<ParsedItem> items;
+  ASSERT_TRUE(CacheWithGid::Parse(record, &channel_id, &items));
+  EXPECT_EQ(channel_id, 9);
+  ASSERT_EQ(items.size(), 50);
+  for (int i = 0; i < 50; ++i) {
+    EXPECT_EQ(items[i].item->item_id, i + 1);
+    EXPECT_EQ(items[i].origin_cnt, i);
+    EXPECT_EQ(items[i].sample_cnt, 2 * i);
+    auto expected = MakeItemFeaturesFromProto(cache.feature_datas(i));
+    EXPECT_TRUE(items[i].item->Equal(*expected));
+  }
+
+  // Records written through protos can be parsed as well.
+  std::vector<ParsedItem> items_from_proto;
+  ASSERT_TRUE(CacheWithGid::Parse(cache.SerializeAsString(), &channel_id,
+                                  &items_from_proto));
+  EXPECT_EQ(items_from_proto.size(), 50);
+
+  EXPECT_FALSE(CacheWithGid::Parse(record.substr(0, record.size() - 1),
+                                   &channel_id, &items));
+}
+
 TEST(CACHE_MGR, CacheManager) {
   CacheManager cm(1000, 20);
 
@@ -83,6 +176,52 @@ TEST(CACHE_MGR, CacheManager) {
   EXPECT_EQ(cm.GetCache().size(), 1);
 }
 
+TEST(CACHE_MGR, CacheWithGidSampleN) {
+  CacheWithGid cwg(100, 20);
+  std::vector<std::shared_ptr<const ItemFeatures>> items;
+  std::vector<double> freq_factors, time_factors;
+  for (int i = 0; i < 20; ++i) {
+    cwg.Push(i + 1, std::make_shared<ItemFeatures>());
+  }
+  // Not more than start_num items, nothing can be sampled.
+  EXPECT_EQ(cwg.SampleN(8, &items, &freq_factors, &time_factors), 0);
+  EXPECT_TRUE(items.empty());
+
+  for (int i = 20; i < 40; ++i) {
+    auto item = std::make_shared<ItemFeatures>();
+    item->item_id = i + 1;
+    cwg.Push(i + 1, item);
+  }
+  EXPECT_EQ(cwg.SampleN(8, &items, &freq_factors, &time_factors), 8);
+  EXPECT_EQ(items.size(), 8);
+  EXPECT_EQ(freq_factors.size(), 8);
+  EXPECT_EQ(time_factors.size(), 8);
+  for (int i = 0; i < 8; ++i) {
+    EXPECT_NE(items[i], nullptr);
+    EXPECT_GT(freq_factors[i], 0.0);
+    EXPECT_LE(freq_factors[i], 1.0);
+    EXPECT_GT(time_factors[i], 0.0);
+    EXPECT_LE(time_factors[i], 1.0);
+  }
+}
+
+TEST(CACHE_MGR, AliasTable) {
+  AliasTable empty({0.0, 0.0});
+  EXPECT_TRUE(empty.empty());
+
+  AliasTable table({1.0, 0.0, 3.0});
+  EXPECT_EQ(table.size(), 3);
+  std::mt19937 gen(42);
+  std::vector<int> counts(3, 0);
+  constexpr int kNumDraws = 40000;
+  for (int i = 0; i < kNumDraws; ++i) {
+    ++counts[table.Sample(gen)];
+  }
+  EXPECT_EQ(counts[1], 0);
+  EXPECT_NEAR(counts[0] / static_cast<double>(kNumDraws), 0.25, 0.02);
+  EXPECT_NEAR(counts[2] / static_cast<double>(kNumDraws), 0.75, 0.02);
+}
+
 }  // namespace
 }  // namespace internal
 }  // namespace monolith_tf
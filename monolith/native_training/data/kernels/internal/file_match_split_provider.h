@@ -50,7 +50,7 @@ class FileMatchSplitProvider : public SplitProvider {
   std::string current_pat_ = "";
   std::string current_file_ = "";
   const std::vector<std::string> patterns_;
-  ::monolith::concurrency::Queue<std::string> results_;
+  ::monolith::concurrency::MPMCQueue<std::string> results_;
   std::unique_ptr<Thread> feeder_;
 
   Status EnsureFeederInitialized();
@@ -0,0 +1,153 @@
+// Copyright 2022 ByteDance and/or its affiliates.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MONOLITH_NATIVE_TRAINING_DATA_KERNELS_INTERNAL_HANDOFF_QUEUE_H_
+#define MONOLITH_NATIVE_TRAINING_DATA_KERNELS_INTERNAL_HANDOFF_QUEUE_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <deque>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+
+namespace tensorflow {
+namespace monolith_tf {
+namespace internal {
+
+// A bounded FIFO queue handing items from producer to consumer threads.
+// Blocked threads are woken up as soon as an item or a slot is available, and
+// waits can be cancelled by a flag: waiters check it whenever the queue is
+// unlocked, so whoever sets it calls Wake() afterwards.
+template <typename T>
+class HandoffQueue {
+ public:
+  // A max_size of 0 means unbounded.
+  explicit HandoffQueue(size_t max_size)
+      : max_size_(max_size == 0 ? std::numeric_limits<size_t>::max()
+                                : max_size) {}
+
+  HandoffQueue(const HandoffQueue&) = delete;
+  HandoffQueue& operator=(const HandoffQueue&) = delete;
+
+  // Blocks until there is a free slot, or *cancelled. Returns false if the
+  // item was not pushed.
+  bool Push(T item, const std::atomic<bool>* cancelled = nullptr) {
+    return PushUntil(std::move(item), absl::InfiniteFuture(), cancelled);
+  }
+
+  // Like Push, but gives up after timeout.
+  bool TryPush(T item, absl::Duration timeout,
+               const std::atomic<bool>* cancelled = nullptr) {
+    return PushUntil(std::move(item), absl::Now() + timeout, cancelled);
+  }
+
+  // Blocks until there is an item, or *cancelled. Returns false if no item
+  // was popped.
+  bool Pop(T* item, const std::atomic<bool>* cancelled = nullptr) {
+    return PopUntil(item, absl::InfiniteFuture(), cancelled);
+  }
+
+  // Like Pop, but gives up after timeout.
+  bool TryPop(T* item, absl::Duration timeout,
+              const std::atomic<bool>* cancelled = nullptr) {
+    return PopUntil(item, absl::Now() + timeout, cancelled);
+  }
+
+  // Pops all the items without waiting.
+  std::vector<T> PopAll() {
+    std::vector<T> items;
+    absl::MutexLock l(&mu_);
+    items.reserve(items_.size());
+    for (T& item : items_) {
+      items.push_back(std::move(item));
+    }
+    items_.clear();
+    return items;
+  }
+
+  // Copies all the items without popping them, so the consumers never see
+  // the queue emptied.
+  std::vector<T> Snapshot() const {
+    absl::MutexLock l(&mu_);
+    return std::vector<T>(items_.begin(), items_.end());
+  }
+
+  // Lets the waiters check their cancellation flags.
+  void Wake() { absl::MutexLock l(&mu_); }
+
+  size_t size() const {
+    absl::MutexLock l(&mu_);
+    return items_.size();
+  }
+
+  bool empty() const { return size() == 0; }
+
+  // The most items the queue held at once.
+  size_t high_water_mark() const {
+    absl::MutexLock l(&mu_);
+    return high_water_mark_;
+  }
+
+ private:
+  static bool IsCancelled(const std::atomic<bool>* cancelled) {
+    return cancelled != nullptr && cancelled->load(std::memory_order_acquire);
+  }
+
+  bool PushUntil(T item, absl::Time deadline,
+                 const std::atomic<bool>* cancelled) {
+    absl::MutexLock l(&mu_);
+    auto ready = [this, cancelled]() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+      return items_.size() < max_size_ || IsCancelled(cancelled);
+    };
+    mu_.AwaitWithDeadline(absl::Condition(&ready), deadline);
+    if (items_.size() >= max_size_ || IsCancelled(cancelled)) {
+      return false;
+    }
+    items_.push_back(std::move(item));
+    high_water_mark_ = std::max(high_water_mark_, items_.size());
+    return true;
+  }
+
+  bool PopUntil(T* item, absl::Time deadline,
+                const std::atomic<bool>* cancelled) {
+    absl::MutexLock l(&mu_);
+    auto ready = [this, cancelled]() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+      return !items_.empty() || IsCancelled(cancelled);
+    };
+    mu_.AwaitWithDeadline(absl::Condition(&ready), deadline);
+    if (items_.empty() || IsCancelled(cancelled)) {
+      return false;
+    }
+    *item = std::move(items_.front());
+    items_.pop_front();
+    return true;
+  }
+
+  const size_t max_size_;
+  mutable absl::Mutex mu_;
+  std::deque<T> items_ ABSL_GUARDED_BY(mu_);
+  size_t high_water_mark_ ABSL_GUARDED_BY(mu_) = 0;
+};
+
+}  // namespace internal
+}  // namespace monolith_tf
+}  // namespace tensorflow
+
+#endif  // MONOLITH_NATIVE_TRAINING_DATA_KERNELS_INTERNAL_HANDOFF_QUEUE_H_
@@ -0,0 +1,114 @@
+// Copyright 2022 ByteDance and/or its affiliates.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <chrono>
+#include <thread>
+
+#include "benchmark/benchmark.h"
+#include "monolith/native_training/data/kernels/internal/handoff_queue.h"
+#include "monolith/native_training/runtime/concurrency/queue.h"
+
+namespace tensorflow {
+namespace monolith_tf {
+namespace internal {
+namespace {
+
+// How the data flow queues waited before: poll with a short timeout, and
+// sleep between polls.
+class SleepPollingQueue {
+ public:
+  explicit SleepPollingQueue(size_t max_size) : queue_(max_size) {}
+
+  void Push(int item) {
+    while (!queue_.try_push(item, std::chrono::milliseconds(100))) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+  }
+
+  void Pop(int* item) {
+    while (!queue_.try_pop(*item, std::chrono::milliseconds(10))) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+  }
+
+ private:
+  ::monolith::concurrency::Queue<int> queue_;
+};
+
+class BlockingQueue {
+ public:
+  explicit BlockingQueue(size_t max_size) : queue_(max_size) {}
+
+  void Push(int item) { queue_.Push(item); }
+
+  void Pop(int* item) { queue_.Pop(item); }
+
+ private:
+  HandoffQueue<int> queue_;
+};
+
+// Arg: the idle gap between items in microseconds, as when the producer
+// waits on its input. Measures the round trip of an item through a consumer
+// which hands it back on a second queue. A poller which timed out during the
+// gap is asleep when the item comes.
+template <typename QueueType>
+void BM_RoundTrip(benchmark::State& state) {  // NOLINT
+  const auto gap = std::chrono::microseconds(state.range(0));
+  QueueType requests(100);
+  QueueType responses(100);
+  std::thread consumer([&] {
+    int item;
+    do {
+      requests.Pop(&item);
+      responses.Push(item);
+    } while (item >= 0);
+  });
+  int i = 0;
+  for (auto _ : state) {
+    std::this_thread::sleep_for(gap);
+    auto start = std::chrono::steady_clock::now();
+    requests.Push(i++);
+    int item;
+    responses.Pop(&item);
+    state.SetIterationTime(std::chrono::duration<double>(
+                               std::chrono::steady_clock::now() - start)
+                               .count());
+  }
+  requests.Push(-1);
+  int item;
+  responses.Pop(&item);
+  consumer.join();
+}
+
+BENCHMARK_TEMPLATE(BM_RoundTrip, SleepPollingQueue)
+    ->Arg(0)
+    ->Arg(12000)
+    ->Arg(15000)
+    ->Iterations(50)
+    ->UseManualTime()
+    ->Unit(benchmark::kMicrosecond);
+BENCHMARK_TEMPLATE(BM_RoundTrip, BlockingQueue)
+    ->Arg(0)
+    ->Arg(12000)
+    ->Arg(15000)
+    ->Iterations(50)
+    ->UseManualTime()
+    ->Unit(benchmark::kMicrosecond);
+
+}  // namespace
+}  // namespace internal
+}  // namespace monolith_tf
+}  // namespace tensorflow
+
+BENCHMARK_MAIN();
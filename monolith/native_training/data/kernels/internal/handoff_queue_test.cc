@@ -0,0 +1,111 @@
+// Copyright 2022 ByteDance and/or its affiliates.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "monolith/native_training/data/kernels/internal/handoff_queue.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace tensorflow {
+namespace monolith_tf {
+namespace internal {
+namespace {
+
+TEST(HandoffQueueTest, Fifo) {
+  HandoffQueue<int> queue(3);
+  EXPECT_TRUE(queue.Push(1));
+  EXPECT_TRUE(queue.Push(2));
+  EXPECT_TRUE(queue.Push(3));
+  EXPECT_FALSE(queue.TryPush(4, absl::Milliseconds(1)));
+  EXPECT_EQ(queue.size(), 3);
+  int item;
+  EXPECT_TRUE(queue.Pop(&item));
+  EXPECT_EQ(item, 1);
+  EXPECT_TRUE(queue.TryPop(&item, absl::ZeroDuration()));
+  EXPECT_EQ(item, 2);
+  EXPECT_EQ(queue.PopAll(), std::vector<int>({3}));
+  EXPECT_TRUE(queue.empty());
+  EXPECT_FALSE(queue.TryPop(&item, absl::Milliseconds(1)));
+  EXPECT_EQ(queue.high_water_mark(), 3);
+}
+
+TEST(HandoffQueueTest, Snapshot) {
+  HandoffQueue<int> queue(3);
+  EXPECT_TRUE(queue.Push(1));
+  EXPECT_TRUE(queue.Push(2));
+  EXPECT_EQ(queue.Snapshot(), std::vector<int>({1, 2}));
+  EXPECT_EQ(queue.size(), 2);
+  int item;
+  EXPECT_TRUE(queue.Pop(&item));
+  EXPECT_EQ(item, 1);
+  EXPECT_EQ(queue.Snapshot(), std::vector<int>({2}));
+}
+
+TEST(HandoffQueueTest, ProducerConsumer) {
+  constexpr int kNumProducers = 4;
+  constexpr int kNumItems = 1000;
+  HandoffQueue<int> queue(2);
+  std::vector<std::thread> producers;
+  for (int p = 0; p < kNumProducers; ++p) {
+    producers.emplace_back([&queue] {
+      for (int i = 1; i <= kNumItems; ++i) {
+        ASSERT_TRUE(queue.Push(i));
+      }
+    });
+  }
+  int64_t sum = 0;
+  for (int i = 0; i < kNumProducers * kNumItems; ++i) {
+    int item;
+    ASSERT_TRUE(queue.Pop(&item));
+    sum += item;
+  }
+  for (auto& producer : producers) {
+    producer.join();
+  }
+  EXPECT_EQ(sum, kNumProducers * kNumItems * (kNumItems + 1) / 2);
+  EXPECT_LE(queue.high_water_mark(), 2);
+}
+
+TEST(HandoffQueueTest, CancelBlockedPop) {
+  HandoffQueue<int> queue(1);
+  std::atomic<bool> cancelled(false);
+  std::thread consumer([&] {
+    int item;
+    EXPECT_FALSE(queue.Pop(&item, &cancelled));
+  });
+  absl::SleepFor(absl::Milliseconds(10));
+  cancelled = true;
+  queue.Wake();
+  consumer.join();
+}
+
+TEST(HandoffQueueTest, CancelBlockedPush) {
+  HandoffQueue<int> queue(1);
+  std::atomic<bool> cancelled(false);
+  ASSERT_TRUE(queue.Push(1));
+  std::thread producer([&] { EXPECT_FALSE(queue.Push(2, &cancelled)); });
+  absl::SleepFor(absl::Milliseconds(10));
+  cancelled = true;
+  queue.Wake();
+  producer.join();
+  EXPECT_EQ(queue.size(), 1);
+}
+
+}  // namespace
+}  // namespace internal
+}  // namespace monolith_tf
+}  // namespace tensorflow
@@ -0,0 +1,51 @@
+// Copyright 2022 ByteDance and/or its affiliates.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "monolith/native_training/data/kernels/internal/kafka_conf.h"
+
+#include "absl/strings/match.h"
+#include "absl/strings/string_view.h"
+
+namespace tensorflow {
+namespace monolith_tf {
+namespace internal {
+
+bool HasGlobalConf(const std::vector<std::string>& metadata,
+                   const std::string& key) {
+  for (const auto& conf : metadata) {
+    // Topic ("conf.topic.") and pipeline ("monolith.") configurations are
+    // not passed to librdkafka as global ones, as in
+    // KafkaGroupReadableResource::Init.
+    if (absl::StartsWith(conf, "monolith.") ||
+        conf.find("conf.") != std::string::npos) {
+      continue;
+    }
+    absl::string_view name = absl::string_view(conf).substr(0, conf.find('='));
+    if (name == key) return true;
+  }
+  return false;
+}
+
+RdKafka::Conf::ConfResult DisableAutoOffsetStore(
+    const std::vector<std::string>& metadata, RdKafka::Conf* conf,
+    std::string* errstr) {
+  if (HasGlobalConf(metadata, "enable.auto.offset.store")) {
+    return RdKafka::Conf::CONF_OK;
+  }
+  return conf->set("enable.auto.offset.store", "false", *errstr);
+}
+
+}  // namespace internal
+}  // namespace monolith_tf
+}  // namespace tensorflow
@@ -0,0 +1,47 @@
+// Copyright 2022 ByteDance and/or its affiliates.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MONOLITH_NATIVE_TRAINING_DATA_KERNELS_INTERNAL_KAFKA_CONF_H_
+#define MONOLITH_NATIVE_TRAINING_DATA_KERNELS_INTERNAL_KAFKA_CONF_H_
+
+#include <string>
+#include <vector>
+
+#include "rdkafkacpp.h"
+
+namespace tensorflow {
+namespace monolith_tf {
+namespace internal {
+
+// Whether the global configurations of a kafka dataset, "key=value" strings
+// as in its metadata, set `key` explicitly.
+bool HasGlobalConf(const std::vector<std::string>& metadata,
+                   const std::string& key);
+
+// Turns off enable.auto.offset.store unless `metadata` sets it explicitly.
+// The consumers prefetch messages, and the offsets of the ones handed out
+// are stored explicitly, see MessageSource::StoreOffsets. Stored
+// automatically, the offsets of messages fetched but not handed out yet
+// would be committed and those messages skipped after a restart.
+// Conf::get succeeds for a property left at its default, so only the
+// metadata tells whether it was set.
+RdKafka::Conf::ConfResult DisableAutoOffsetStore(
+    const std::vector<std::string>& metadata, RdKafka::Conf* conf,
+    std::string* errstr);
+
+}  // namespace internal
+}  // namespace monolith_tf
+}  // namespace tensorflow
+
+#endif  // MONOLITH_NATIVE_TRAINING_DATA_KERNELS_INTERNAL_KAFKA_CONF_H_
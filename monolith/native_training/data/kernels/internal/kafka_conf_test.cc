@@ -0,0 +1,76 @@
+// Copyright 2022 ByteDance and/or its affiliates.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "monolith/native_training/data/kernels/internal/kafka_conf.h"
+
+#include <memory>
+
+#include "gtest/gtest.h"
+
+namespace tensorflow {
+namespace monolith_tf {
+namespace internal {
+namespace {
+
+std::string GetAutoOffsetStore(const std::vector<std::string>& metadata) {
+  std::unique_ptr<RdKafka::Conf> conf(
+      RdKafka::Conf::create(RdKafka::Conf::CONF_GLOBAL));
+  std::string errstr, value;
+  for (const auto& c : metadata) {
+    size_t eq = c.find('=');
+    EXPECT_EQ(conf->set(c.substr(0, eq), c.substr(eq + 1), errstr),
+              RdKafka::Conf::CONF_OK)
+        << errstr;
+  }
+  EXPECT_EQ(DisableAutoOffsetStore(metadata, conf.get(), &errstr),
+            RdKafka::Conf::CONF_OK)
+      << errstr;
+  EXPECT_EQ(conf->get("enable.auto.offset.store", value),
+            RdKafka::Conf::CONF_OK);
+  return value;
+}
+
+TEST(KafkaConf, DisablesAutoOffsetStoreByDefault) {
+  // A property left at its default ("true") is still got successfully.
+  std::unique_ptr<RdKafka::Conf> conf(
+      RdKafka::Conf::create(RdKafka::Conf::CONF_GLOBAL));
+  std::string value;
+  EXPECT_EQ(conf->get("enable.auto.offset.store", value),
+            RdKafka::Conf::CONF_OK);
+  EXPECT_EQ(value, "true");
+
+  EXPECT_EQ(GetAutoOffsetStore({}), "false");
+  EXPECT_EQ(GetAutoOffsetStore({"group.id=g", "monolith.parse_threads=2"}),
+            "false");
+}
+
+TEST(KafkaConf, KeepsExplicitAutoOffsetStore) {
+  EXPECT_EQ(GetAutoOffsetStore({"enable.auto.offset.store=true"}), "true");
+  EXPECT_EQ(GetAutoOffsetStore({"enable.auto.offset.store=false"}), "false");
+}
+
+TEST(KafkaConf, HasGlobalConf) {
+  std::vector<std::string> metadata = {"group.id=g", "conf.topic.acks=1",
+                                       "monolith.consumer_threads=2"};
+  EXPECT_TRUE(HasGlobalConf(metadata, "group.id"));
+  EXPECT_FALSE(HasGlobalConf(metadata, "group"));
+  EXPECT_FALSE(HasGlobalConf(metadata, "acks"));
+  EXPECT_FALSE(HasGlobalConf(metadata, "conf.topic.acks"));
+  EXPECT_FALSE(HasGlobalConf(metadata, "consumer_threads"));
+}
+
+}  // namespace
+}  // namespace internal
+}  // namespace monolith_tf
+}  // namespace tensorflow
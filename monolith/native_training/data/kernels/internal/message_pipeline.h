@@ -0,0 +1,290 @@
+// Copyright 2022 ByteDance and/or its affiliates.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MONOLITH_NATIVE_TRAINING_DATA_KERNELS_INTERNAL_MESSAGE_PIPELINE_H_
+#define MONOLITH_NATIVE_TRAINING_DATA_KERNELS_INTERNAL_MESSAGE_PIPELINE_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+
+namespace tensorflow {
+namespace monolith_tf {
+namespace internal {
+
+// A message consumed from one partition of a stream. Implementations keep
+// the payload buffer (e.g. an RdKafka::Message) alive until destruction, so
+// that the payload can be parsed in place without copying it first.
+class StreamMessage {
+ public:
+  virtual ~StreamMessage() = default;
+
+  virtual absl::string_view payload() const = 0;
+
+  virtual const std::string& topic() const = 0;
+
+  virtual int32_t partition() const = 0;
+
+  virtual int64_t offset() const = 0;
+};
+
+// (topic, partition)
+using PartitionKey = std::pair<std::string, int32_t>;
+
+// Next offset to read of each partition.
+using PartitionOffsets = absl::flat_hash_map<PartitionKey, int64_t>;
+
+enum class ConsumeResult { kMessage, kTimeout, kEndOfPartition, kFatal };
+
+// A stream consumer, e.g. one kafka consumer of a consumer group. Consume is
+// only called from the fetch thread owning the source, StoreOffsets may be
+// called concurrently from the thread calling MessagePipeline::Next.
+class MessageSource {
+ public:
+  virtual ~MessageSource() = default;
+
+  virtual ConsumeResult Consume(int64_t timeout_ms,
+                                std::unique_ptr<StreamMessage>* message) = 0;
+
+  // Called with the offsets of the messages fetched by this source, once
+  // they have been handed out by MessagePipeline::Next.
+  virtual void StoreOffsets(const PartitionOffsets& offsets) {}
+};
+
+// Fetches messages from several sources on dedicated threads, parses them on
+// a pool of parse threads, and hands out parsed batches in fetch order. The
+// amount of fetched but not yet consumed batches is bounded, so fetching
+// stalls when the consumer falls behind.
+//
+// Messages fetched by the same source are delivered in order, so the offsets
+// reported by committed_offsets() (and to MessageSource::StoreOffsets) only
+// ever cover messages that were actually handed out.
+template <typename Parsed>
+class MessagePipeline {
+ public:
+  struct Options {
+    // Maximum number of messages per batch.
+    int max_batch_messages = 1024;
+    // A partially filled batch is flushed when a source has nothing for
+    // this long.
+    int64_t fetch_timeout_ms = 100;
+    int num_parse_threads = 1;
+    // Batches which are fetched or parsed but not handed out yet.
+    int max_pending_batches = 4;
+  };
+
+  using Messages = std::vector<std::unique_ptr<StreamMessage>>;
+  // Parses a batch of messages. The parser may move out the messages whose
+  // payloads `parsed` still refers to, the others are released right after.
+  using ParseFn = std::function<void(Messages* messages, Parsed* parsed)>;
+
+  MessagePipeline(std::vector<std::unique_ptr<MessageSource>> sources,
+                  ParseFn parse_fn, const Options& options)
+      : sources_(std::move(sources)),
+        parse_fn_(std::move(parse_fn)),
+        options_(options) {
+    options_.max_batch_messages = std::max(options_.max_batch_messages, 1);
+    options_.num_parse_threads = std::max(options_.num_parse_threads, 1);
+    options_.max_pending_batches = std::max(options_.max_pending_batches, 1);
+    for (size_t i = 0; i < sources_.size(); ++i) {
+      threads_.emplace_back(&MessagePipeline::FetchLoop, this, i);
+    }
+    for (int i = 0; i < options_.num_parse_threads; ++i) {
+      threads_.emplace_back(&MessagePipeline::ParseLoop, this);
+    }
+  }
+
+  MessagePipeline(const MessagePipeline&) = delete;
+  MessagePipeline& operator=(const MessagePipeline&) = delete;
+
+  ~MessagePipeline() { Stop(); }
+
+  // Waits at most timeout_ms for the next parsed batch. Returns false on
+  // timeout, after Stop(), or once a source failed fatally.
+  bool Next(int64_t timeout_ms, Parsed* parsed) {
+    PartitionOffsets offsets;
+    int source_index;
+    {
+      absl::MutexLock l(&mu_);
+      auto ready = [this]() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+        return stop_ || fatal_ || ready_.count(next_deliver_seq_) > 0;
+      };
+      mu_.AwaitWithTimeout(absl::Condition(&ready),
+                           absl::Milliseconds(timeout_ms));
+      auto it = ready_.find(next_deliver_seq_);
+      if (stop_ || it == ready_.end()) {
+        return false;
+      }
+      *parsed = std::move(it->second.parsed);
+      offsets = std::move(it->second.offsets);
+      source_index = it->second.source_index;
+      ready_.erase(it);
+      ++next_deliver_seq_;
+      --in_flight_;
+      for (const auto& kv : offsets) {
+        int64_t& committed = committed_offsets_[kv.first];
+        committed = std::max(committed, kv.second);
+      }
+    }
+    sources_[source_index]->StoreOffsets(offsets);
+    return true;
+  }
+
+  bool fatal() const {
+    absl::MutexLock l(&mu_);
+    return fatal_;
+  }
+
+  // Offsets right after the last message handed out by Next, per partition.
+  PartitionOffsets committed_offsets() const {
+    absl::MutexLock l(&mu_);
+    return committed_offsets_;
+  }
+
+  void Stop() {
+    {
+      absl::MutexLock l(&mu_);
+      if (stop_ && threads_.empty()) {
+        return;
+      }
+      stop_ = true;
+      done_ = true;
+    }
+    for (auto& thread : threads_) {
+      thread.join();
+    }
+    threads_.clear();
+  }
+
+ private:
+  struct Batch {
+    int64_t seq = 0;
+    int source_index = 0;
+    Messages messages;
+    PartitionOffsets offsets;
+    Parsed parsed;
+  };
+
+  void FetchLoop(int source_index) {
+    MessageSource* source = sources_[source_index].get();
+    Batch batch;
+    batch.source_index = source_index;
+    while (!done_.load(std::memory_order_relaxed)) {
+      std::unique_ptr<StreamMessage> message;
+      ConsumeResult result =
+          source->Consume(options_.fetch_timeout_ms, &message);
+      if (result == ConsumeResult::kMessage && message != nullptr) {
+        int64_t& offset =
+            batch.offsets[PartitionKey(message->topic(), message->partition())];
+        offset = std::max(offset, message->offset() + 1);
+        batch.messages.push_back(std::move(message));
+        if (static_cast<int>(batch.messages.size()) <
+            options_.max_batch_messages) {
+          continue;
+        }
+      } else if (result == ConsumeResult::kFatal) {
+        absl::MutexLock l(&mu_);
+        fatal_ = true;
+        done_ = true;
+        return;
+      }
+      if (!batch.messages.empty() && !Enqueue(std::move(batch))) {
+        return;
+      }
+      batch = Batch();
+      batch.source_index = source_index;
+    }
+  }
+
+  // Returns false if the pipeline was stopped in the meantime.
+  bool Enqueue(Batch batch) {
+    absl::MutexLock l(&mu_);
+    auto has_room = [this]() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+      return stop_ || in_flight_ < options_.max_pending_batches;
+    };
+    mu_.Await(absl::Condition(&has_room));
+    if (stop_) {
+      return false;
+    }
+    batch.seq = next_fetch_seq_++;
+    ++in_flight_;
+    fetched_.push_back(std::move(batch));
+    return true;
+  }
+
+  void ParseLoop() {
+    while (true) {
+      Batch batch;
+      {
+        absl::MutexLock l(&mu_);
+        auto has_work = [this]() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+          return stop_ || !fetched_.empty();
+        };
+        mu_.Await(absl::Condition(&has_work));
+        if (stop_) {
+          return;
+        }
+        batch = std::move(fetched_.front());
+        fetched_.pop_front();
+      }
+
+      parse_fn_(&batch.messages, &batch.parsed);
+      // Release the payload buffers as early as possible.
+      batch.messages.clear();
+
+      absl::MutexLock l(&mu_);
+      int64_t seq = batch.seq;
+      ready_.emplace(seq, std::move(batch));
+    }
+  }
+
+  std::vector<std::unique_ptr<MessageSource>> sources_;
+  ParseFn parse_fn_;
+  Options options_;
+
+  mutable absl::Mutex mu_;
+  bool stop_ ABSL_GUARDED_BY(mu_) = false;
+  bool fatal_ ABSL_GUARDED_BY(mu_) = false;
+  int64_t next_fetch_seq_ ABSL_GUARDED_BY(mu_) = 0;
+  int64_t next_deliver_seq_ ABSL_GUARDED_BY(mu_) = 0;
+  // Batches between Enqueue and Next, bounded by max_pending_batches.
+  int in_flight_ ABSL_GUARDED_BY(mu_) = 0;
+  std::deque<Batch> fetched_ ABSL_GUARDED_BY(mu_);
+  std::map<int64_t, Batch> ready_ ABSL_GUARDED_BY(mu_);
+  PartitionOffsets committed_offsets_ ABSL_GUARDED_BY(mu_);
+  // stop_ || fatal_, checked by the fetch threads without taking mu_.
+  std::atomic<bool> done_{false};
+
+  std::vector<std::thread> threads_;
+};
+
+}  // namespace internal
+}  // namespace monolith_tf
+}  // namespace tensorflow
+
+#endif  // MONOLITH_NATIVE_TRAINING_DATA_KERNELS_INTERNAL_MESSAGE_PIPELINE_H_
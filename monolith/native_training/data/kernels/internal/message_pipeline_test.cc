@@ -0,0 +1,217 @@
+// Copyright 2022 ByteDance and/or its affiliates.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "monolith/native_training/data/kernels/internal/message_pipeline.h"
+
+#include <thread>
+
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "gtest/gtest.h"
+
+namespace tensorflow {
+namespace monolith_tf {
+namespace internal {
+namespace {
+
+class FakeMessage : public StreamMessage {
+ public:
+  FakeMessage(std::string topic, int32_t partition, int64_t offset)
+      : topic_(std::move(topic)),
+        partition_(partition),
+        offset_(offset),
+        payload_(absl::StrCat(offset)) {}
+
+  absl::string_view payload() const override { return payload_; }
+  const std::string& topic() const override { return topic_; }
+  int32_t partition() const override { return partition_; }
+  int64_t offset() const override { return offset_; }
+
+ private:
+  std::string topic_;
+  int32_t partition_;
+  int64_t offset_;
+  std::string payload_;
+};
+
+// In-process stand-in of a kafka consumer which owns some partitions of a
+// topic and serves num_messages messages from each of them.
+class FakeSource : public MessageSource {
+ public:
+  FakeSource(std::vector<int32_t> partitions, int64_t num_messages,
+             int64_t fatal_after = -1)
+      : partitions_(std::move(partitions)),
+        num_messages_(num_messages),
+        fatal_after_(fatal_after) {}
+
+  ConsumeResult Consume(int64_t timeout_ms,
+                        std::unique_ptr<StreamMessage>* message) override {
+    if (fatal_after_ >= 0 && consumed_ >= fatal_after_) {
+      return ConsumeResult::kFatal;
+    }
+    const int64_t num_partitions = static_cast<int64_t>(partitions_.size());
+    if (consumed_ >= num_messages_ * num_partitions) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      return ConsumeResult::kEndOfPartition;
+    }
+    int32_t partition = partitions_[consumed_ % num_partitions];
+    int64_t offset = consumed_ / num_partitions;
+    ++consumed_;
+    *message = std::make_unique<FakeMessage>("topic", partition, offset);
+    return ConsumeResult::kMessage;
+  }
+
+  void StoreOffsets(const PartitionOffsets& offsets) override {
+    absl::MutexLock l(&mu_);
+    for (const auto& kv : offsets) {
+      stored_[kv.first] = std::max(stored_[kv.first], kv.second);
+    }
+  }
+
+  PartitionOffsets stored() {
+    absl::MutexLock l(&mu_);
+    return stored_;
+  }
+
+ private:
+  std::vector<int32_t> partitions_;
+  int64_t num_messages_;
+  int64_t fatal_after_;
+  int64_t consumed_ = 0;
+
+  absl::Mutex mu_;
+  PartitionOffsets stored_ ABSL_GUARDED_BY(mu_);
+};
+
+struct Parsed {
+  std::vector<int64_t> values;
+  std::vector<int32_t> partitions;
+};
+
+void Parse(MessagePipeline<Parsed>::Messages* messages, Parsed* parsed) {
+  for (const auto& message : *messages) {
+    int64_t value;
+    EXPECT_TRUE(absl::SimpleAtoi(message->payload(), &value));
+    parsed->values.push_back(value);
+    parsed->partitions.push_back(message->partition());
+  }
+}
+
+TEST(MessagePipelineTest, DeliversAllMessagesInPartitionOrder) {
+  constexpr int64_t kNumMessages = 1000;
+  std::vector<std::unique_ptr<MessageSource>> sources;
+  std::vector<FakeSource*> fake_sources;
+  for (int i = 0; i < 4; ++i) {
+    auto source = std::make_unique<FakeSource>(
+        std::vector<int32_t>{2 * i, 2 * i + 1}, kNumMessages);
+    fake_sources.push_back(source.get());
+    sources.push_back(std::move(source));
+  }
+  MessagePipeline<Parsed>::Options options;
+  options.max_batch_messages = 64;
+  options.num_parse_threads = 3;
+  options.max_pending_batches = 2;
+  MessagePipeline<Parsed> pipeline(std::move(sources), Parse, options);
+
+  std::map<int32_t, int64_t> expected_next;
+  int64_t total = 0;
+  while (total < 8 * kNumMessages) {
+    Parsed parsed;
+    if (!pipeline.Next(1000, &parsed)) {
+      continue;
+    }
+    ASSERT_FALSE(parsed.values.empty());
+    for (size_t i = 0; i < parsed.values.size(); ++i) {
+      EXPECT_EQ(parsed.values[i], expected_next[parsed.partitions[i]]++);
+    }
+    total += parsed.values.size();
+  }
+  EXPECT_EQ(total, 8 * kNumMessages);
+
+  Parsed parsed;
+  EXPECT_FALSE(pipeline.Next(10, &parsed));
+  PartitionOffsets offsets = pipeline.committed_offsets();
+  EXPECT_EQ(offsets.size(), 8);
+  for (const auto& kv : offsets) {
+    EXPECT_EQ(kv.first.first, "topic");
+    EXPECT_EQ(kv.second, kNumMessages);
+  }
+  for (int i = 0; i < 4; ++i) {
+    PartitionOffsets stored = fake_sources[i]->stored();
+    EXPECT_EQ(stored.size(), 2);
+    EXPECT_EQ((stored[PartitionKey("topic", 2 * i)]), kNumMessages);
+  }
+}
+
+TEST(MessagePipelineTest, OffsetsOnlyCoverDeliveredMessages) {
+  std::vector<std::unique_ptr<MessageSource>> sources;
+  sources.push_back(std::make_unique<FakeSource>(std::vector<int32_t>{0}, 100));
+  MessagePipeline<Parsed>::Options options;
+  options.max_batch_messages = 10;
+  options.max_pending_batches = 3;
+  MessagePipeline<Parsed> pipeline(std::move(sources), Parse, options);
+
+  Parsed parsed;
+  ASSERT_TRUE(pipeline.Next(1000, &parsed));
+  EXPECT_EQ(parsed.values.size(), 10);
+  // Give the fetcher time to prefetch, which must not move the offsets.
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  PartitionOffsets offsets = pipeline.committed_offsets();
+  EXPECT_EQ((offsets[PartitionKey("topic", 0)]), 10);
+  pipeline.Stop();
+  EXPECT_FALSE(pipeline.Next(10, &parsed));
+}
+
+TEST(MessagePipelineTest, ParserKeepsPayloads) {
+  struct Views {
+    MessagePipeline<Views>::Messages messages;
+    std::vector<absl::string_view> payloads;
+  };
+  std::vector<std::unique_ptr<MessageSource>> sources;
+  sources.push_back(std::make_unique<FakeSource>(std::vector<int32_t>{0}, 10));
+  MessagePipeline<Views>::Options options;
+  options.max_batch_messages = 10;
+  MessagePipeline<Views> pipeline(
+      std::move(sources),
+      [](MessagePipeline<Views>::Messages* messages, Views* views) {
+        for (const auto& message : *messages) {
+          views->payloads.push_back(message->payload());
+        }
+        views->messages = std::move(*messages);
+      },
+      options);
+
+  Views views;
+  ASSERT_TRUE(pipeline.Next(1000, &views));
+  ASSERT_EQ(views.payloads.size(), 10);
+  EXPECT_EQ(views.messages.size(), 10);
+  for (int i = 0; i < 10; ++i) {
+    EXPECT_EQ(views.payloads[i], absl::StrCat(i));
+  }
+}
+
+TEST(MessagePipelineTest, Fatal) {
+  std::vector<std::unique_ptr<MessageSource>> sources;
+  sources.push_back(
+      std::make_unique<FakeSource>(std::vector<int32_t>{0}, 100, 5));
+  MessagePipeline<Parsed> pipeline(std::move(sources), Parse, {});
+  Parsed parsed;
+  EXPECT_FALSE(pipeline.Next(1000, &parsed));
+  EXPECT_TRUE(pipeline.fatal());
+}
+
+}  // namespace
+}  // namespace internal
+}  // namespace monolith_tf
+}  // namespace tensorflow
@@ -0,0 +1,86 @@
+// Copyright 2022 ByteDance and/or its affiliates.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MONOLITH_NATIVE_TRAINING_DATA_KERNELS_INTERNAL_WEIGHTED_FAIR_SCHEDULER_H_
+#define MONOLITH_NATIVE_TRAINING_DATA_KERNELS_INTERNAL_WEIGHTED_FAIR_SCHEDULER_H_
+
+#include <algorithm>
+#include <vector>
+
+namespace tensorflow {
+namespace monolith_tf {
+namespace internal {
+
+// Picks which input to take the next item from, so that input i gets
+// weights[i] / sum(weights) of the items among the inputs which have some.
+// Every input has a virtual finish time which advances by 1 / weight per
+// item, and the ready input whose next item starts first wins. An input
+// which had nothing to give starts again from the current virtual time, so
+// it does not burst to catch up. Equal weights are plain round robin.
+// Not thread safe.
+class WeightedFairScheduler {
+ public:
+  explicit WeightedFairScheduler(std::vector<double> weights)
+      : weights_(std::move(weights)),
+        finish_(weights_.size(), 0.0),
+        last_(static_cast<int>(weights_.size()) - 1) {}
+
+  // Returns the input to take the next item from among the ones for which
+  // ready(i) is true, or -1 if none is. Ties go round robin.
+  template <typename ReadyFn>
+  int Pick(ReadyFn ready) {
+    const int n = weights_.size();
+    int best = -1;
+    double best_start = 0.0;
+    for (int k = 1; k <= n; ++k) {
+      int i = (last_ + k) % n;
+      if (!ready(i)) {
+        continue;
+      }
+      double start = std::max(finish_[i], virtual_time_);
+      if (best < 0 || start < best_start) {
+        best = i;
+        best_start = start;
+      }
+    }
+    if (best >= 0) {
+      virtual_time_ = best_start;
+      finish_[best] = best_start + 1.0 / weights_[best];
+      last_ = best;
+    }
+    return best;
+  }
+
+  // Starts over from input first, e.g. after a restore.
+  void Reset(int first) {
+    std::fill(finish_.begin(), finish_.end(), 0.0);
+    virtual_time_ = 0.0;
+    last_ = (first + weights_.size() - 1) % weights_.size();
+  }
+
+  // The input picked last.
+  int last() const { return last_; }
+
+ private:
+  const std::vector<double> weights_;
+  std::vector<double> finish_;
+  double virtual_time_ = 0.0;
+  int last_;
+};
+
+}  // namespace internal
+}  // namespace monolith_tf
+}  // namespace tensorflow
+
+#endif  // MONOLITH_NATIVE_TRAINING_DATA_KERNELS_INTERNAL_WEIGHTED_FAIR_SCHEDULER_H_
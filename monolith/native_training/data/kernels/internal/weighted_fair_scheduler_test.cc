@@ -0,0 +1,75 @@
+// Copyright 2022 ByteDance and/or its affiliates.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "monolith/native_training/data/kernels/internal/weighted_fair_scheduler.h"
+
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace tensorflow {
+namespace monolith_tf {
+namespace internal {
+namespace {
+
+auto AllReady = [](int) { return true; };
+
+TEST(WeightedFairSchedulerTest, EqualWeightsRoundRobin) {
+  WeightedFairScheduler scheduler({1, 1, 1});
+  std::vector<int> picks;
+  for (int k = 0; k < 6; ++k) {
+    picks.push_back(scheduler.Pick(AllReady));
+  }
+  EXPECT_EQ(picks, std::vector<int>({0, 1, 2, 0, 1, 2}));
+
+  // An input with nothing is skipped.
+  picks.clear();
+  for (int k = 0; k < 4; ++k) {
+    picks.push_back(scheduler.Pick([](int i) { return i != 1; }));
+  }
+  EXPECT_EQ(picks, std::vector<int>({0, 2, 0, 2}));
+  EXPECT_EQ(scheduler.Pick([](int) { return false; }), -1);
+
+  scheduler.Reset(1);
+  EXPECT_EQ(scheduler.Pick(AllReady), 1);
+}
+
+TEST(WeightedFairSchedulerTest, Ratios) {
+  WeightedFairScheduler scheduler({1, 3, 0.5});
+  std::vector<int> counts(3);
+  for (int k = 0; k < 9000; ++k) {
+    ++counts[scheduler.Pick(AllReady)];
+  }
+  EXPECT_NEAR(counts[0], 2000, 2);
+  EXPECT_NEAR(counts[1], 6000, 2);
+  EXPECT_NEAR(counts[2], 1000, 2);
+}
+
+TEST(WeightedFairSchedulerTest, IdleInputDoesNotBurst) {
+  WeightedFairScheduler scheduler({1, 1});
+  for (int k = 0; k < 100; ++k) {
+    EXPECT_EQ(scheduler.Pick([](int i) { return i == 0; }), 0);
+  }
+  // Input 1 comes back with its share only.
+  std::vector<int> counts(2);
+  for (int k = 0; k < 10; ++k) {
+    ++counts[scheduler.Pick(AllReady)];
+  }
+  EXPECT_EQ(counts, std::vector<int>({5, 5}));
+}
+
+}  // namespace
+}  // namespace internal
+}  // namespace monolith_tf
+}  // namespace tensorflow
@@ -14,6 +14,7 @@
 
 #include <atomic>
 #include <cstdlib>
+#include <random>
 
 #include "monolith/native_training/data/kernels/item_pool_kernels.h"
 #include "tensorflow/core/lib/io/record_reader.h"
@@ -66,42 +67,69 @@ struct AsyncPack {
 
 ItemPoolResource::ItemPoolResource(int max_item_num_per_channel, int start_num)
     : start_num_(start_num),
-      max_item_num_per_channel_(max_item_num_per_channel),
-      cache_(std::make_unique<internal::CacheManager>(max_item_num_per_channel,
-                                                      start_num)) {}
+      max_item_num_per_channel_(max_item_num_per_channel) {
+  for (auto& shard : shards_) {
+    absl::MutexLock l(&shard.mu);
+    shard.cache = std::make_unique<internal::CacheManager>(
+        max_item_num_per_channel, start_num);
+  }
+}
 
 Status ItemPoolResource::Add(
     uint64_t channel_id, uint64_t item_id,
     const std::shared_ptr<const internal::ItemFeatures>& item) {
-  absl::MutexLock l(&mu_);
-  cache_->Push(channel_id, item_id, item, 1, 0);
+  Shard& shard = GetShard(channel_id);
+  {
+    absl::WriterMutexLock l(&shard.mu);
+    size_t num_channels = shard.cache->GetCache().size();
+    shard.cache->Push(channel_id, item_id, item, 1, 0);
+    if (shard.cache->GetCache().size() != num_channels) {
+      channel_count_.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+  add_count_.fetch_add(1, std::memory_order_relaxed);
   return Status::OK();
 }
 
 std::shared_ptr<const internal::ItemFeatures> ItemPoolResource::Sample(
     uint64_t channel_id, double* freq_factor, double* time_factor) {
-  absl::MutexLock l(&mu_);
-  return cache_->RandomSelectOne(channel_id, freq_factor, time_factor);
+  const Shard& shard = GetShard(channel_id);
+  absl::ReaderMutexLock l(&shard.mu);
+  return shard.cache->RandomSelectOne(channel_id, freq_factor, time_factor);
+}
+
+int ItemPoolResource::SampleN(
+    uint64_t channel_id, int n,
+    std::vector<std::shared_ptr<const internal::ItemFeatures>>* items,
+    std::vector<double>* freq_factors, std::vector<double>* time_factors) {
+  const Shard& shard = GetShard(channel_id);
+  absl::ReaderMutexLock l(&shard.mu);
+  return shard.cache->SampleN(channel_id, n, items, freq_factors,
+                              time_factors);
 }
 
 Status ItemPoolResource::Save(WritableFile* ostream, int shard_index,
                               int shard_num) {
-  absl::MutexLock l(&mu_);
-  const absl::flat_hash_map<uint64_t, internal::CacheWithGid>& channel_cache_ =
-      cache_->GetCache();
-
   io::RecordWriter writer(ostream);
   Status write_status = Status::OK();
-  for (const auto& pair : channel_cache_) {
-    if (pair.first % shard_num != shard_index) {
-      continue;
+  std::string record;
+  for (auto& shard : shards_) {
+    absl::ReaderMutexLock l(&shard.mu);
+    const absl::flat_hash_map<uint64_t, internal::CacheWithGid>&
+        channel_cache_ = shard.cache->GetCache();
+    for (const auto& pair : channel_cache_) {
+      if (pair.first % shard_num != shard_index) {
+        continue;
+      }
+      record.clear();
+      pair.second.Serialize(pair.first, &record);
+      Status s = writer.WriteRecord(record);
+      if (TF_PREDICT_FALSE(!s.ok())) {
+        write_status.Update(s);
+        break;
+      }
     }
-    ChannelCache channel_cache;
-    channel_cache.set_channel_id(pair.first);
-    pair.second.ToProto(&channel_cache);
-    Status s = writer.WriteRecord(channel_cache.SerializeAsString());
-    if (TF_PREDICT_FALSE(!s.ok())) {
-      write_status.Update(s);
+    if (!write_status.ok()) {
       break;
     }
   }
@@ -113,7 +141,6 @@ Status ItemPoolResource::Save(WritableFile* ostream, int shard_index,
 }
 
 Status ItemPoolResource::Restore(RandomAccessFile* istream, int64 buffer_size) {
-  absl::MutexLock l(&mu_);
   io::RecordReaderOptions opts;
   opts.buffer_size = buffer_size;
   io::SequentialRecordReader reader(istream, opts);
@@ -121,7 +148,8 @@ Status ItemPoolResource::Restore(RandomAccessFile* istream, int64 buffer_size) {
   Status restore_status = Status::OK();
   while (true) {
     tstring s;
-    ChannelCache channel_cache;
+    uint64_t channel_id;
+    std::vector<internal::ParsedItem> items;
     // read record
     Status rs = reader.ReadRecord(&s);
     if (errors::IsOutOfRange(rs)) {
@@ -131,7 +159,8 @@ Status ItemPoolResource::Restore(RandomAccessFile* istream, int64 buffer_size) {
       restore_status.Update(rs);
     }
 
-    if (!channel_cache.ParseFromArray(s.data(), s.size())) {
+    if (!internal::CacheWithGid::Parse(absl::string_view(s.data(), s.size()),
+                                       &channel_id, &items)) {
       restore_status.Update(errors::FailedPrecondition(
           "Unable to parse data. Data might be corrupted"));
       break;
@@ -139,15 +168,22 @@ Status ItemPoolResource::Restore(RandomAccessFile* istream, int64 buffer_size) {
       restore_status.Update(Status::OK());
     }
 
-    for (const auto& feature_data : channel_cache.feature_datas()) {
-      auto item_feature_ptr = internal::MakeItemFeaturesFromProto(feature_data);
-      cache_->Push(channel_cache.channel_id(), feature_data.gid(),
-                   item_feature_ptr, feature_data.origin_cnt(),
-                   feature_data.sample_cnt());
+    Shard& shard = GetShard(channel_id);
+    {
+      absl::WriterMutexLock l(&shard.mu);
+      size_t num_channels = shard.cache->GetCache().size();
+      for (const auto& parsed : items) {
+        shard.cache->Push(channel_id, parsed.item->item_id, parsed.item,
+                          parsed.origin_cnt, parsed.sample_cnt);
+      }
+      if (shard.cache->GetCache().size() != num_channels) {
+        channel_count_.fetch_add(1, std::memory_order_relaxed);
+      }
     }
+    add_count_.fetch_add(items.size(), std::memory_order_relaxed);
     LOG(INFO) << absl::StrFormat(
         "ItemPoolResource: after restore, channel %lld restore %llu items",
-        channel_cache.channel_id(), channel_cache.feature_datas_size());
+        channel_id, items.size());
   }
 
   TF_RETURN_IF_ERROR(restore_status);
@@ -164,18 +200,18 @@ bool ItemPoolResource::Equal(const ItemPoolResource& other) const {
     return false;
   }
 
-  auto this_cache = cache_->GetCache();
-  auto other_cache = other.cache_->GetCache();
-  if (this_cache.size() != other_cache.size()) {
-    return false;
-  } else {
+  for (int i = 0; i < kNumShards; ++i) {
+    absl::ReaderMutexLock l(&shards_[i].mu);
+    absl::ReaderMutexLock ol(&other.shards_[i].mu);
+    const auto& this_cache = shards_[i].cache->GetCache();
+    const auto& other_cache = other.shards_[i].cache->GetCache();
+    if (this_cache.size() != other_cache.size()) {
+      return false;
+    }
     for (const auto& it : this_cache) {
-      if (other_cache.count(it.first) == 0) {
+      auto oit = other_cache.find(it.first);
+      if (oit == other_cache.end() || !it.second.Equal(oit->second)) {
         return false;
-      } else {
-        auto this_channel = it.second;
-        auto other_channel = other_cache.at(it.first);
-        return this_channel.Equal(other_channel);
       }
     }
   }
@@ -184,8 +220,34 @@ bool ItemPoolResource::Equal(const ItemPoolResource& other) const {
 }
 
 void ItemPoolResource::SampleChannelID(uint64_t* channel_id) {
-  absl::MutexLock l(&mu_);
-  cache_->SampleChannelID(channel_id);
+  absl::MutexLock l(&channel_mu_);
+  MaybeRefreshChannelTable();
+  if (channel_ids_.size() < 2 || channel_table_.empty()) {
+    return;
+  }
+  thread_local std::mt19937 gen((std::random_device())());
+  *channel_id = channel_ids_[channel_table_.Sample(gen)];
+}
+
+void ItemPoolResource::MaybeRefreshChannelTable() {
+  int64_t add_count = add_count_.load(std::memory_order_relaxed);
+  int64_t channel_count = channel_count_.load(std::memory_order_relaxed);
+  if (channel_table_add_count_ >= 0 &&
+      channel_count == channel_table_channel_count_ &&
+      add_count - channel_table_add_count_ < kChannelTableRefreshInterval) {
+    return;
+  }
+
+  std::vector<uint64_t> channel_ids;
+  std::vector<double> sizes;
+  for (const auto& shard : shards_) {
+    absl::ReaderMutexLock l(&shard.mu);
+    shard.cache->GetChannelSizes(&channel_ids, &sizes);
+  }
+  channel_ids_ = std::move(channel_ids);
+  channel_table_ = internal::AliasTable(sizes);
+  channel_table_add_count_ = add_count;
+  channel_table_channel_count_ = channel_count;
 }
 
 void get_index_and_worker_num(int* index, int* worker_num) {
@@ -269,8 +331,8 @@ class ItemPoolRandomFillOp : public OpKernel {
     for (int i = 0; i < num_feats; ++i) {
       NamedFeature nf;
       GenNamedFeature(&nf);
-      if (!item->example_features.contains(nf.name())) {
-        item->example_features.insert({nf.name(), nf});
+      if (!item->HasExampleFeature(nf.name())) {
+        item->AddExampleFeature(nf);
       }
     }
   }
@@ -15,6 +15,12 @@
 #ifndef MONOLITH_NATIVE_TRAINING_DATA_KERNELS_ITEM_POOL_KERNELS_H_
 #define MONOLITH_NATIVE_TRAINING_DATA_KERNELS_ITEM_POOL_KERNELS_H_
 
+#include <array>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "absl/synchronization/mutex.h"
 #include "monolith/native_training/data/kernels/internal/cache_mgr.h"
 #include "tensorflow/core/framework/op.h"
 #include "tensorflow/core/framework/op_kernel.h"
@@ -23,6 +29,10 @@
 
 namespace tensorflow {
 namespace monolith_tf {
+// Item pool used for negative sampling. Channels are spread over a fixed
+// number of shards, each guarded by its own reader/writer lock, so that
+// adding to or sampling from one channel does not block the others, and
+// concurrent samplers of the same channel only share a reader lock.
 class ItemPoolResource : public ResourceBase {
  public:
   explicit ItemPoolResource(int max_item_num_per_channel, int start_num = 0);
@@ -36,6 +46,13 @@ class ItemPoolResource : public ResourceBase {
                                                        double* freq_factor,
                                                        double* time_factor);
 
+  // Batched version of Sample, draws up to n items from the channel under a
+  // single lock acquisition. Returns the number of items appended.
+  int SampleN(uint64_t channel_id, int n,
+              std::vector<std::shared_ptr<const internal::ItemFeatures>>* items,
+              std::vector<double>* freq_factors,
+              std::vector<double>* time_factors);
+
   Status Save(WritableFile* ostream, int shard_index, int shard_num);
 
   Status Restore(RandomAccessFile* istream, int64 buffer_size);
@@ -46,9 +63,33 @@ class ItemPoolResource : public ResourceBase {
   void SampleChannelID(uint64_t* channel_id);
 
  private:
-  absl::Mutex mu_;
+  static constexpr int kNumShards = 32;
+  // Channel weights are refreshed after this many Add calls, or immediately
+  // when a new channel shows up.
+  static constexpr int64_t kChannelTableRefreshInterval = 1024;
+
+  struct Shard {
+    mutable absl::Mutex mu;
+    std::unique_ptr<internal::CacheManager> cache ABSL_GUARDED_BY(mu);
+  };
+
+  inline Shard& GetShard(uint64_t channel_id) {
+    return shards_[channel_id % kNumShards];
+  }
+
+  void MaybeRefreshChannelTable() ABSL_EXCLUSIVE_LOCKS_REQUIRED(channel_mu_);
+
   int start_num_, max_item_num_per_channel_;
-  std::unique_ptr<internal::CacheManager> cache_ ABSL_GUARDED_BY(mu_);
+  std::array<Shard, kNumShards> shards_;
+
+  std::atomic<int64_t> add_count_{0};
+  std::atomic<int64_t> channel_count_{0};
+
+  absl::Mutex channel_mu_;
+  int64_t channel_table_add_count_ ABSL_GUARDED_BY(channel_mu_) = -1;
+  int64_t channel_table_channel_count_ ABSL_GUARDED_BY(channel_mu_) = 0;
+  std::vector<uint64_t> channel_ids_ ABSL_GUARDED_BY(channel_mu_);
+  internal::AliasTable channel_table_ ABSL_GUARDED_BY(channel_mu_);
 };
 
 }  // namespace monolith_tf
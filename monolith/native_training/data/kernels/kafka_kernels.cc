@@ -24,11 +24,17 @@ See the License for the specific language governing permissions and
 limitations under the License.
 ==============================================================================*/
 
+#include <cstring>
+
 #include "rdkafkacpp.h"
 #include "tensorflow/core/framework/resource_mgr.h"
 #include "tensorflow/core/framework/resource_op_kernel.h"
 
+#include "absl/strings/match.h"
+#include "absl/strings/numbers.h"
 #include "monolith/native_training/data/kernels/feature_name_mapper_tf_bridge.h"
+#include "monolith/native_training/data/kernels/internal/kafka_conf.h"
+#include "monolith/native_training/data/kernels/internal/message_pipeline.h"
 #include "monolith/native_training/data/training_instance/cc/data_reader.h"
 
 namespace tensorflow {
@@ -48,6 +54,71 @@ using ::tensorflow::monolith_tf::FileStreamReader;
 using ::tensorflow::monolith_tf::InstanceToExample;
 using ::tensorflow::monolith_tf::PBIterator;
 using ::tensorflow::monolith_tf::StdinStreamReader;
+using ::tensorflow::monolith_tf::internal::ConsumeResult;
+using ::tensorflow::monolith_tf::internal::DisableAutoOffsetStore;
+using ::tensorflow::monolith_tf::internal::MessagePipeline;
+using ::tensorflow::monolith_tf::internal::MessageSource;
+using ::tensorflow::monolith_tf::internal::PartitionOffsets;
+using ::tensorflow::monolith_tf::internal::StreamMessage;
+
+// Options which configure the consumption pipeline rather than librdkafka,
+// passed in metadata as e.g. "monolith.consumer_threads=4".
+constexpr char kMonolithConfPrefix[] = "monolith.";
+
+// Reads records from a message payload, handing them out as views into the
+// payload instead of copies.
+class PayloadStreamReader : public BaseStreamReader {
+ public:
+  PayloadStreamReader(const DataFormatOptions& options,
+                      absl::string_view payload)
+      : BaseStreamReader(options), payload_(payload), cur_(0) {}
+
+  uint64 GetOffset() override { return cur_; }
+
+  Status SetOffset(uint64* offset) override {
+    cur_ = *offset;
+    return Status::OK();
+  }
+
+ protected:
+  Status ReadNBytes(size_t n, tstring* result) override {
+    if (cur_ + n > payload_.size()) {
+      return errors::FailedPrecondition("request n error");
+    }
+    if (n > 0 && cur_ == payload_.size()) {
+      return errors::OutOfRange("Size exceeds he content size.");
+    }
+    result->assign_as_view(payload_.data() + cur_, n);
+    cur_ += n;
+    return Status::OK();
+  }
+
+ private:
+  absl::string_view payload_;
+  uint64 cur_;
+};
+
+// Owns a consumed RdKafka::Message, so its payload can be parsed in place.
+class KafkaMessage : public StreamMessage {
+ public:
+  explicit KafkaMessage(std::unique_ptr<RdKafka::Message> message)
+      : message_(std::move(message)), topic_(message_->topic_name()) {}
+
+  absl::string_view payload() const override {
+    return absl::string_view(static_cast<const char*>(message_->payload()),
+                             message_->len());
+  }
+
+  const std::string& topic() const override { return topic_; }
+
+  int32_t partition() const override { return message_->partition(); }
+
+  int64_t offset() const override { return message_->offset(); }
+
+ private:
+  std::unique_ptr<RdKafka::Message> message_;
+  std::string topic_;
+};
 
 }  // namespace
 
@@ -89,8 +160,6 @@ class KafkaEventCb : public RdKafka::EventCb {
   bool run_ TF_GUARDED_BY(mu_) = true;
 };
 
-static int64 partition_count = 0;
-static int64 eof_count = 0;
 class KafkaRebalanceCb : public RdKafka::RebalanceCb {
  public:
   KafkaRebalanceCb() : run_(true) {}
@@ -129,13 +198,10 @@ class KafkaRebalanceCb : public RdKafka::RebalanceCb {
 
       LOG(INFO) << "REBALANCE: Assigning partitions";
       consumer->assign(partitions);
-      partition_count = static_cast<int>(partitions.size());
     } else {
       LOG(INFO) << "REBALANCE: Unassigning partitions";
       consumer->unassign();
-      partition_count = 0;
     }
-    eof_count = 0;
   }
 
  private:
@@ -143,15 +209,72 @@ class KafkaRebalanceCb : public RdKafka::RebalanceCb {
   bool run_ TF_GUARDED_BY(mu_) = true;
 };
 
+// One member of the consumer group, consumed by its own fetch thread. The
+// group spreads the partitions over all members.
+class KafkaConsumerSource : public MessageSource {
+ public:
+  KafkaConsumerSource(std::unique_ptr<RdKafka::KafkaConsumer> consumer,
+                      KafkaEventCb* event_cb)
+      : consumer_(std::move(consumer)), event_cb_(event_cb) {}
+
+  ~KafkaConsumerSource() override {
+    consumer_->unassign();
+    consumer_->close();
+  }
+
+  ConsumeResult Consume(int64_t timeout_ms,
+                        std::unique_ptr<StreamMessage>* message) override {
+    if (!event_cb_->run()) {
+      LOG(ERROR) << "failed to consume messages due to broker issue";
+      return ConsumeResult::kFatal;
+    }
+    std::unique_ptr<RdKafka::Message> msg(consumer_->consume(timeout_ms));
+    switch (msg->err()) {
+      case RdKafka::ERR_NO_ERROR:
+        *message = std::make_unique<KafkaMessage>(std::move(msg));
+        return ConsumeResult::kMessage;
+      case RdKafka::ERR__TRANSPORT:
+        // Not returning an error here as the consumer will try to re-connect.
+        LOG(ERROR) << "Broker transport failure: " << msg->errstr();
+        return ConsumeResult::kTimeout;
+      case RdKafka::ERR__PARTITION_EOF:
+        return ConsumeResult::kEndOfPartition;
+      case RdKafka::ERR__TIMED_OUT:
+        return ConsumeResult::kTimeout;
+      default:
+        LOG(ERROR) << "ERROR Code " << msg->err() << ", errstr is "
+                   << msg->errstr();
+        return ConsumeResult::kTimeout;
+    }
+  }
+
+  // With enable.auto.offset.store=false, only offsets of messages which were
+  // handed out to the graph get committed, never the prefetched ones.
+  void StoreOffsets(const PartitionOffsets& offsets) override {
+    std::vector<RdKafka::TopicPartition*> partitions;
+    for (const auto& kv : offsets) {
+      partitions.push_back(RdKafka::TopicPartition::create(
+          kv.first.first, kv.first.second, kv.second));
+    }
+    RdKafka::ErrorCode err = consumer_->offsets_store(partitions);
+    if (err != RdKafka::ERR_NO_ERROR) {
+      LOG_EVERY_N_SEC(ERROR, 60)
+          << "failed to store offsets: " << RdKafka::err2str(err);
+    }
+    RdKafka::TopicPartition::destroy(partitions);
+  }
+
+ private:
+  std::unique_ptr<RdKafka::KafkaConsumer> consumer_;
+  KafkaEventCb* event_cb_;
+};
+
 class KafkaGroupReadableResource : public ResourceBase {
  public:
   explicit KafkaGroupReadableResource(Env* env) : env_(env) {}
   virtual ~KafkaGroupReadableResource() {
-    if (consumer_.get()) {
-      consumer_->unassign();
-      consumer_->close();
-      consumer_.reset(nullptr);
-    }
+    // Stops the fetch threads and closes the consumers.
+    pipeline_.reset();
   }
 
   virtual Status Init(const std::vector<std::string>& topics,
@@ -195,8 +318,33 @@ class KafkaGroupReadableResource : public ResourceBase {
     // without any risk of being overwritten.
     // Setting the global confs before setting the `default_topic_conf`
     // results in erratic behaviour.
+    MessagePipeline<CurPBIteratorHandler::CurOutput>::Options
+        pipeline_options;
+    int num_consumers = 1;
     for (size_t i = 0; i < metadata.size(); i++) {
-      if (metadata[i] != "" && metadata[i].find("conf.") == string::npos) {
+      if (absl::StartsWith(metadata[i], kMonolithConfPrefix)) {
+        std::vector<string> parts = str_util::Split(metadata[i], "=");
+        int value;
+        if (parts.size() != 2 || !absl::SimpleAtoi(parts[1], &value) ||
+            value <= 0) {
+          return errors::InvalidArgument("invalid monolith configuration: ",
+                                         metadata[i]);
+        }
+        absl::string_view key =
+            absl::string_view(parts[0]).substr(strlen(kMonolithConfPrefix));
+        if (key == "consumer_threads") {
+          num_consumers = value;
+        } else if (key == "parse_threads") {
+          pipeline_options.num_parse_threads = value;
+        } else if (key == "max_pending_batches") {
+          pipeline_options.max_pending_batches = value;
+        } else {
+          return errors::InvalidArgument("unknown monolith configuration: ",
+                                         metadata[i]);
+        }
+        LOG(INFO) << "Kafka configuration: " << metadata[i];
+      } else if (metadata[i] != "" &&
+                 metadata[i].find("conf.") == string::npos) {
         std::vector<string> parts = str_util::Split(metadata[i], "=");
         if (parts.size() != 2) {
           return errors::InvalidArgument("invalid topic configuration: ",
@@ -266,19 +414,32 @@ class KafkaGroupReadableResource : public ResourceBase {
     sscanf(batch_num_messages.c_str(), "%d", &batch_num_messages_);
     LOG(INFO) << "max num of messages per batch: " << batch_num_messages_;
 
-    LOG(INFO) << "Creating the kafka consumer";
-    consumer_.reset(RdKafka::KafkaConsumer::create(conf.get(), errstr));
-    if (!consumer_.get()) {
-      return errors::Internal("failed to create consumer:", errstr);
+    // Messages are prefetched, so offsets are stored explicitly once the
+    // messages are handed out, see KafkaConsumerSource::StoreOffsets.
+    if ((result = DisableAutoOffsetStore(metadata, conf.get(), &errstr)) !=
+        RdKafka::Conf::CONF_OK) {
+      return errors::Internal("failed to set enable.auto.offset.store:",
+                              errstr);
     }
 
     for (int i = 0; i < topics.size(); i++) {
       LOG(INFO) << "Subscribing to the kafka topic: " << topics[i];
     }
-    RdKafka::ErrorCode err = consumer_->subscribe(topics);
-    if (err != RdKafka::ERR_NO_ERROR) {
-      return errors::Internal("failed to subscribe to topics: ",
-                              RdKafka::err2str(err));
+    std::vector<std::unique_ptr<MessageSource>> sources;
+    for (int i = 0; i < num_consumers; ++i) {
+      LOG(INFO) << "Creating the kafka consumer " << i;
+      std::unique_ptr<RdKafka::KafkaConsumer> consumer(
+          RdKafka::KafkaConsumer::create(conf.get(), errstr));
+      if (!consumer.get()) {
+        return errors::Internal("failed to create consumer:", errstr);
+      }
+      RdKafka::ErrorCode err = consumer->subscribe(topics);
+      if (err != RdKafka::ERR_NO_ERROR) {
+        return errors::Internal("failed to subscribe to topics: ",
+                                RdKafka::err2str(err));
+      }
+      sources.push_back(std::make_unique<KafkaConsumerSource>(
+          std::move(consumer), &kafka_event_cb_));
     }
 
     if (input_pb_type == "" && output_pb_type == "") {
@@ -295,6 +456,16 @@ class KafkaGroupReadableResource : public ResourceBase {
     }
 
     options_ = options;
+    pipeline_options.max_batch_messages = batch_num_messages_;
+    pipeline_ =
+        std::make_unique<MessagePipeline<CurPBIteratorHandler::CurOutput>>(
+            std::move(sources),
+            [this](MessagePipeline<
+                       CurPBIteratorHandler::CurOutput>::Messages* messages,
+                   CurPBIteratorHandler::CurOutput* output) {
+              Parse(messages, output);
+            },
+            pipeline_options);
     return Status::OK();
   }
 
@@ -304,7 +475,11 @@ class KafkaGroupReadableResource : public ResourceBase {
       std::vector<Example> exa_pb_list;
       std::vector<Instance> ins_pb_list;
       std::vector<ExampleBatch> eb_pb_list;
+      // Records of string outputs, views into the payloads of `messages`
+      // until they are copied into the output tensor.
       std::vector<tstring> string_list;
+      std::vector<std::unique_ptr<StreamMessage>> messages;
+      size_t num_messages = 0;
     };
 
     Status HandleReaderNextStauts(const Status& s, const tstring& result) {
@@ -364,6 +539,53 @@ class KafkaGroupReadableResource : public ResourceBase {
     }
   };
 
+  // Parses a batch of messages on a pipeline parse thread. Records are read
+  // in place from the message payloads.
+  void Parse(
+      MessagePipeline<CurPBIteratorHandler::CurOutput>::Messages* messages,
+      CurPBIteratorHandler::CurOutput* output) {
+    output->num_messages += messages->size();
+    if (version_ == 1) {
+      output->string_list.reserve(messages->size());
+      for (const auto& message : *messages) {
+        absl::string_view payload = message->payload();
+        output->string_list.emplace_back();
+        output->string_list.back().assign_as_view(payload.data(),
+                                                  payload.size());
+      }
+      output->messages = std::move(*messages);
+      return;
+    }
+
+    PBIteratorWithDataFormatTrans<CurPBIteratorHandler> cur_iter(
+        input_pb_type_, output_pb_type_);
+    FeatureNameMapper fake_mapper;
+    std::unique_ptr<PBIterator> reader;
+    for (const auto& message : *messages) {
+      auto stream_reader =
+          std::make_unique<PayloadStreamReader>(options_, message->payload());
+      if (input_pb_type_ == data_format::INSTANCE ||
+          input_pb_type_ == data_format::EXAMPLE) {
+        reader = absl::make_unique<PBIterator>(
+            std::move(stream_reader), FeaturePruningType::PRUNING_RAW_FEATURE);
+      } else {
+        reader = absl::make_unique<ExampleBatchIterator>(
+            std::move(stream_reader), FeaturePruningType::PRUNING_RAW_FEATURE,
+            &fake_mapper);
+      }
+
+      uint64 offset_ = 0;
+      while (true) {
+        Status s = cur_iter.GetNext(reader.get(), output, &offset_);
+        if (!s.ok()) break;
+        offset_ = reader->GetOffset();
+      }
+    }
+    if (!output->string_list.empty()) {
+      output->messages = std::move(*messages);
+    }
+  }
+
   Status Next(const int64 index, const int64 message_poll_timeout,
               const int64 stream_timeout,
               std::function<Status(const TensorShape& shape, Tensor** message,
@@ -371,89 +593,23 @@ class KafkaGroupReadableResource : public ResourceBase {
                   allocate_func) {
     mutex_lock l(mu_);
 
-    // Initialize necessary variables
-    int64 num_messages = 0;
     max_stream_timeout_polls_ = stream_timeout / message_poll_timeout;
 
-    // Allocate memory for message_value and key_value vectors
-    std::vector<tstring> message_value, key_value;
-    message_value.reserve(batch_num_messages_);
-    // key_value.reserve(batch_num_messages_);
-
-    std::unique_ptr<RdKafka::Message> message;
-    while (consumer_.get() != nullptr && num_messages < batch_num_messages_) {
-      if (!kafka_event_cb_.run()) {
-        return errors::Internal(
-            "failed to consume messages due to broker issue");
-      }
-      message.reset(consumer_->consume(message_poll_timeout));
-      if (message->err() == RdKafka::ERR_NO_ERROR) {
-        // Produce the line as output.
-        message_value.emplace_back(tstring(
-            static_cast<const char*>(message->payload()), message->len()));
-        // key_value.emplace_back(
-        //     (message->key() != nullptr) ? tstring(*message->key()) : "");
-        num_messages++;
-        // Once a message has been successfully retrieved, the
-        // `stream_timeout_polls_` is reset to 0. This allows the dataset
-        // to wait for the entire `stream_timeout` duration when a data
-        // slump occurs in the future.
-        stream_timeout_polls_ = 0;
-      } else if (message->err() == RdKafka::ERR__TRANSPORT) {
-        // Not returning an error here as the consumer will try to re-connect.
-        LOG(ERROR) << "Broker transport failure: " << message->errstr();
-
-      } else if (message->err() == RdKafka::ERR__PARTITION_EOF) {
-        if (++eof_count == partition_count) {
-          LOG(INFO) << "EOF reached for all " << partition_count
-                    << " partition(s)";
-          break;
-        }
-      } else if (message->err() == RdKafka::ERR__TIMED_OUT) {
-        LOG(ERROR) << message->errstr();
-        stream_timeout_polls_++;
-        break;
-      } else {
-        LOG(ERROR) << "ERROR Code " << message->err() << ", errstr is "
-                   << message->errstr();
-      }
-    }
-
-    // Prepare the outputs
-
-    PBIteratorWithDataFormatTrans<CurPBIteratorHandler> cur_iter(
-        input_pb_type_, output_pb_type_);
     CurPBIteratorHandler::CurOutput output;
-    if (version_ == 1) {
-      output.string_list.swap(message_value);
+    if (pipeline_ != nullptr &&
+        pipeline_->Next(message_poll_timeout, &output)) {
+      // Once a batch has been successfully retrieved, the
+      // `stream_timeout_polls_` is reset to 0. This allows the dataset
+      // to wait for the entire `stream_timeout` duration when a data
+      // slump occurs in the future.
+      stream_timeout_polls_ = 0;
+    } else if (pipeline_ == nullptr || pipeline_->fatal()) {
+      return errors::Internal("failed to consume messages due to broker issue");
     } else {
-      // std::ostringstream imploded;
-      // std::copy(message_value.begin(), message_value.end(),
-      //           std::ostream_iterator<std::string>(imploded, ""));
-      //  std::string msg;
-      std::unique_ptr<PBIterator> reader;
-      for (auto& mesg : message_value) {
-        auto stream_reader =
-            std::make_unique<StringStreamReader<tstring> >(options_, mesg);
-        if (input_pb_type_ == data_format::INSTANCE ||
-            input_pb_type_ == data_format::EXAMPLE) {
-          reader = absl::make_unique<PBIterator>(
-              std::move(stream_reader),
-              FeaturePruningType::PRUNING_RAW_FEATURE);
-        } else {
-          reader = absl::make_unique<ExampleBatchIterator>(
-              std::move(stream_reader), FeaturePruningType::PRUNING_RAW_FEATURE,
-              &fake_mapper_);
-        }
-
-        uint64 offset_ = 0;
-        while (true) {
-          Status s = cur_iter.GetNext(reader.get(), &output, &offset_);
-          if (!s.ok()) break;
-          offset_ = reader->GetOffset();
-        }
-      }
+      stream_timeout_polls_++;
     }
+
+    // Prepare the outputs
     size_t all_size = 0;
     if (output_pb_type_ == data_format::EXAMPLE) {
       all_size = output.exa_pb_list.size();
@@ -464,9 +620,9 @@ class KafkaGroupReadableResource : public ResourceBase {
     } else {
       all_size = output.string_list.size();
     }
-    if (all_size < message_value.size()) {
+    if (version_ != 1 && all_size < output.num_messages) {
       LOG(ERROR) << "get not enough pb:" << all_size << ","
-                 << message_value.size();
+                 << output.num_messages;
     }
     TensorShape shape({static_cast<int64>(all_size)});
     Tensor* message_tensor;
@@ -483,7 +639,14 @@ class KafkaGroupReadableResource : public ResourceBase {
       } else if (output_pb_type_ == data_format::EXAMPLEBATCH) {
         message_tensor->flat<Variant>()(i) = std::move(output.eb_pb_list[i]);
       } else {
-        message_tensor->flat<tstring>()(i) = std::move(output.string_list[i]);
+        tstring& record = output.string_list[i];
+        if (record.type() == tstring::VIEW) {
+          // The one copy of a record, out of the payload it was read from.
+          message_tensor->flat<tstring>()(i).assign(record.data(),
+                                                    record.size());
+        } else {
+          message_tensor->flat<tstring>()(i) = std::move(record);
+        }
       }
     }
     if (stream_timeout_polls_ < max_stream_timeout_polls_) {
@@ -492,15 +655,20 @@ class KafkaGroupReadableResource : public ResourceBase {
       continue_fetch_tensor->scalar<int64>()() = 0;
     }
     LOG_EVERY_N_SEC(INFO, 60)
-        << "consumer pb:" << all_size << "," << message_value.size();
+        << "consumer pb:" << all_size << "," << output.num_messages;
     return Status::OK();
   }
 
+  // Offsets right after the last message handed out by Next, per partition.
+  PartitionOffsets committed_offsets() const {
+    return pipeline_ == nullptr ? PartitionOffsets()
+                                : pipeline_->committed_offsets();
+  }
+
   string DebugString() const override { return "KafkaBaseResource"; }
 
   mutable mutex mu_;
   Env* env_ TF_GUARDED_BY(mu_);
-  std::unique_ptr<RdKafka::KafkaConsumer> consumer_ TF_GUARDED_BY(mu_);
   KafkaEventCb kafka_event_cb_ = KafkaEventCb();
   KafkaRebalanceCb kafka_rebalance_cb_ = KafkaRebalanceCb();
   int64 max_stream_timeout_polls_ = -1;
@@ -511,8 +679,10 @@ class KafkaGroupReadableResource : public ResourceBase {
   data_format::DataFormat output_pb_type_;
   data_format::DataFormat input_pb_type_;
   DataFormatOptions options_;
-  FeatureNameMapper fake_mapper_;
   int version_ = 1;
+  // Declared last, so that it is destroyed (and its threads joined) before
+  // the state its parse threads read.
+  std::unique_ptr<MessagePipeline<CurPBIteratorHandler::CurOutput>> pipeline_;
 };
 
 class KafkaGroupReadableInitOp
@@ -12,9 +12,13 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include "absl/memory/memory.h"
 #include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
 #include "monolith/native_training/data/training_instance/cc/pb_variant.h"
 #include "monolith/native_training/data/kernels/df_resource_kernel.h"
+#include "monolith/native_training/data/kernels/internal/weighted_fair_scheduler.h"
+#include "monolith/native_training/runtime/common/metrics.h"
 #include "tensorflow/core/framework/cancellation.h"
 #include "tensorflow/core/framework/dataset.h"
 #include "tensorflow/core/framework/resource_mgr.h"
@@ -27,6 +31,11 @@ using Example = ::monolith::io::proto::Example;
 using Item = ::tensorflow::monolith_tf::Item;
 using QueueResource = ::tensorflow::monolith_tf::QueueResource;
 using VariantType = ::tensorflow::monolith_tf::VariantType;
+using WeightedFairScheduler =
+    ::tensorflow::monolith_tf::internal::WeightedFairScheduler;
+
+// How often the merged item counts of the inputs are reported.
+constexpr int64 kEmitStatsEveryNItems = 1000;
 
 class MergeFlowDatasetOp : public DatasetOpKernel {
  public:
@@ -34,6 +43,7 @@ class MergeFlowDatasetOp : public DatasetOpKernel {
   static constexpr const char *const kDataFlow = "data_flow";
   static constexpr const char *const kMaxQueueSize = "max_queue_size";
   static constexpr const char *const kVariantType = "variant_type";
+  static constexpr const char *const kWeights = "weights";
 
   explicit MergeFlowDatasetOp(OpKernelConstruction *ctx);
 
@@ -45,18 +55,20 @@ class MergeFlowDatasetOp : public DatasetOpKernel {
   std::vector<std::string> data_flows_;
   int max_queue_size_;
   VariantType variant_type_;
+  std::vector<float> weights_;
 };
 
 class MergeFlowDatasetOp::Dataset : public DatasetBase {
  public:
   Dataset(OpKernelContext *ctx, const std::vector<const DatasetBase *> &inputs,
           const std::vector<std::string> &data_flows, int max_queue_size,
-          const VariantType &variant_type)
+          const VariantType &variant_type, const std::vector<float> &weights)
       : DatasetBase(DatasetContext(ctx)),
         inputs_(inputs),
         data_flows_(data_flows),
         max_queue_size_(max_queue_size),
-        variant_type_(variant_type) {
+        variant_type_(variant_type),
+        weights_(weights) {
     for (const auto input : inputs_) {
       input->Ref();
     }
@@ -132,14 +144,17 @@ class MergeFlowDatasetOp::Dataset : public DatasetBase {
     } else {
       b->BuildAttrValue("example", &variant_type_node);
     }
+    AttrValue weights_node;
+    b->BuildAttrValue(weights_, &weights_node);
 
     TF_RETURN_IF_ERROR(
         b->AddDataset(this,                                        // dataset
                       {}, {std::make_pair(0, input_graph_nodes)},  // inputs
                       {{kDataFlow, data_flows_node},
                        {kMaxQueueSize, max_queue_size_node},
-                       {kVariantType, variant_type_node}},  // attrs
-                      output));                             // Node**
+                       {kVariantType, variant_type_node},
+                       {kWeights, weights_node}},  // attrs
+                      output));                   // Node**
 
     return Status::OK();
   }
@@ -150,7 +165,9 @@ class MergeFlowDatasetOp::Dataset : public DatasetBase {
     explicit Iterator(const Params &params)
         : DatasetIterator<Dataset>(params),
           mu_(std::make_shared<mutex>()),
-          output_mu_(std::make_shared<mutex>()) {}
+          output_mu_(std::make_shared<mutex>()),
+          scheduler_(Weights(*params.dataset)),
+          num_merged_(params.dataset->data_flows_.size()) {}
 
     ~Iterator() override {
       CancelThreads();
@@ -169,8 +186,11 @@ class MergeFlowDatasetOp::Dataset : public DatasetBase {
 
     void CancelThreads() TF_LOCKS_EXCLUDED(mu_) {
       cancellation_manager_->StartCancel();
-      mutex_lock l(*mu_);
-      cancelled_ = true;
+      {
+        mutex_lock l(*mu_);
+        cancelled_ = true;
+      }
+      NotifyReady();
     }
 
     Status Initialize(IteratorContext *ctx) override {
@@ -194,9 +214,15 @@ class MergeFlowDatasetOp::Dataset : public DatasetBase {
 
       for (size_t i = 0; i < dataset()->data_flows_.size(); ++i) {
         std::string data_flows_name = dataset()->data_flows_[i];
-        QueueResource *queue = new QueueResource(dataset()->max_queue_size_);
+        QueueResource *queue = new QueueResource(
+            dataset()->max_queue_size_,
+            absl::StrCat(dataset()->node_name(), "/", data_flows_name));
         df_to_queue_.emplace(data_flows_name, queue);
+        flow_tagkvs_.push_back(absl::StrFormat(
+            "flow=%s/%s", dataset()->node_name(), data_flows_name));
         prefetch_thread_finished_.push_back(false);
+        input_mus_.push_back(absl::make_unique<mutex>());
+        pending_.emplace_back();
       }
 
       return s;
@@ -214,15 +240,30 @@ class MergeFlowDatasetOp::Dataset : public DatasetBase {
       {
         mutex_lock output_l(*output_mu_);
         do {
-          for (size_t i = 0; i < dataset()->data_flows_.size(); ++i) {
-            std::string name = dataset()->data_flows_[cur_];
-            const QueueResource *queue = df_to_queue_[name];
-            cur_ = (cur_ + 1) % dataset()->data_flows_.size();
-            if (queue->Empty()) {
-              continue;
+          int64 num_ready;
+          {
+            mutex_lock ready_l(ready_mu_);
+            num_ready = num_ready_;
+          }
+          // Read before the queues: a finished thread pushed all its items.
+          bool finished = true;
+          bool cancelled;
+          {
+            mutex_lock l(*mu_);
+            for (bool f : prefetch_thread_finished_) {
+              finished = finished && f;
             }
+            cancelled = cancelled_;
+          }
+
+          // Only this thread pops, so a queue with items keeps them.
+          int i =
+              scheduler_.Pick([this](int j) { return !Queue(j)->Empty(); });
+          if (i >= 0) {
+            Item item;
+            CHECK(Queue(i)->TryPop(item, 0));
+            CountMerged(i);
 
-            Item item = queue->Pop();
             if (item.end_of_sequence) {
               out_tensors->clear();
               *end_of_sequence = true;
@@ -240,16 +281,17 @@ class MergeFlowDatasetOp::Dataset : public DatasetBase {
             return Status::OK();
           }
 
-          bool finished = true;
-          for (bool f : prefetch_thread_finished_) {
-            finished = finished && f;
-          }
-
-          if (cancelled_ || finished) {
+          if (cancelled || finished) {
             out_tensors->clear();
             *end_of_sequence = true;
             break;
           }
+
+          // Sleeps until a prefetch thread pushes or finishes.
+          mutex_lock ready_l(ready_mu_);
+          while (num_ready_ == num_ready) {
+            ready_cv_.wait(ready_l);
+          }
         } while (true);
       }
 
@@ -262,13 +304,57 @@ class MergeFlowDatasetOp::Dataset : public DatasetBase {
       return model::MakeUnknownRatioNode(std::move(args));
     }
 
+    // Saves every input with the items read from it and not handed out yet:
+    // the ones in its queue and the one its prefetch thread waits to push.
     Status SaveInternal(SerializationContext *ctx,
                         IteratorStateWriter *writer) override {
+      mutex_lock output_l(*output_mu_);
+      // The input picked next when all are ready, as the scheduler starts
+      // over on restore.
+      TF_RETURN_IF_ERROR(writer->WriteScalar(
+          full_name("cur"),
+          static_cast<int64>((scheduler_.last() + 1) % input_impls_.size())));
+      for (size_t i = 0; i < input_impls_.size(); ++i) {
+        mutex_lock input_l(*input_mus_[i]);
+        TF_RETURN_IF_ERROR(input_impls_[i]->Save(ctx, writer));
+        QueueResource *queue = df_to_queue_[dataset()->data_flows_[i]];
+        std::vector<Item> items = queue->Snapshot();
+        if (pending_[i] != nullptr) {
+          items.push_back(*pending_[i]);
+        }
+        TF_RETURN_IF_ERROR(::tensorflow::monolith_tf::WriteItems(
+            writer, full_name(absl::StrCat("items_", i)), items));
+      }
       return Status::OK();
     }
 
     Status RestoreInternal(IteratorContext *ctx,
                            IteratorStateReader *reader) override {
+      mutex_lock output_l(*output_mu_);
+      int64 cur;
+      TF_RETURN_IF_ERROR(reader->ReadScalar(full_name("cur"), &cur));
+      scheduler_.Reset(cur);
+      for (size_t i = 0; i < input_impls_.size(); ++i) {
+        mutex_lock input_l(*input_mus_[i]);
+        TF_RETURN_IF_ERROR(input_impls_[i]->Restore(ctx, reader));
+        std::vector<Item> items;
+        TF_RETURN_IF_ERROR(::tensorflow::monolith_tf::ReadItems(
+            reader, full_name(absl::StrCat("items_", i)), &items));
+        QueueResource *queue = df_to_queue_[dataset()->data_flows_[i]];
+        queue->PopAll();
+        pending_[i].reset();
+        for (Item &item : items) {
+          if (pending_[i] == nullptr && queue->TryPush(item, 0)) {
+            continue;
+          }
+          if (pending_[i] != nullptr) {
+            return errors::FailedPrecondition(
+                "The queue of ", dataset()->data_flows_[i],
+                " is smaller than the checkpointed one");
+          }
+          pending_[i] = absl::make_unique<Item>(std::move(item));
+        }
+      }
       return Status::OK();
     }
 
@@ -281,10 +367,57 @@ class MergeFlowDatasetOp::Dataset : public DatasetBase {
     bool prefetch_thread_started_ TF_GUARDED_BY(*mu_) = false;
     std::vector<bool> prefetch_thread_finished_ TF_GUARDED_BY(*mu_);
 
-    size_t cur_ = 0;
+    // Guarded by output_mu_.
+    WeightedFairScheduler scheduler_;
+    std::vector<int64> num_merged_;
+    int64 num_outputs_ = 0;
+    std::vector<std::string> flow_tagkvs_;
     std::vector<IteratorBase *> input_impls_;
+    // Held by prefetch thread i while it reads from input i and pushes the
+    // item, so that checkpoints see no item in flight.
+    std::vector<std::unique_ptr<mutex>> input_mus_;
+    // The item prefetch thread i read and has not pushed yet.
+    std::vector<std::unique_ptr<Item>> pending_;
     std::vector<Thread *> prefetch_threads_;
     std::unordered_map<std::string, QueueResource *> df_to_queue_;
+    // Counts the pushes and the finished threads, to wake up GetNext when
+    // any queue may have become ready.
+    mutex ready_mu_;
+    condition_variable ready_cv_;
+    int64 num_ready_ TF_GUARDED_BY(ready_mu_) = 0;
+
+    static std::vector<double> Weights(const Dataset &dataset) {
+      if (dataset.weights_.empty()) {
+        return std::vector<double>(dataset.data_flows_.size(), 1.0);
+      }
+      return std::vector<double>(dataset.weights_.begin(),
+                                 dataset.weights_.end());
+    }
+
+    QueueResource *Queue(int i) {
+      return df_to_queue_[dataset()->data_flows_[i]];
+    }
+
+    // Reports how many items were merged from every input.
+    void CountMerged(int i) {
+      ++num_merged_[i];
+      if (++num_outputs_ % kEmitStatsEveryNItems != 0) {
+        return;
+      }
+      for (size_t j = 0; j < num_merged_.size(); ++j) {
+        monolith::GetMetrics()->emit_counter("data_flow_merged_items",
+                                             num_merged_[j], flow_tagkvs_[j]);
+        num_merged_[j] = 0;
+      }
+    }
+
+    void NotifyReady() TF_LOCKS_EXCLUDED(ready_mu_) {
+      {
+        mutex_lock ready_l(ready_mu_);
+        ++num_ready_;
+      }
+      ready_cv_.notify_all();
+    }
 
     Status EnsureThreadStarted(IteratorContext *ctx)
         TF_EXCLUSIVE_LOCKS_REQUIRED(*mu_) {
@@ -309,29 +442,32 @@ class MergeFlowDatasetOp::Dataset : public DatasetBase {
         {
           mutex_lock l(*mu_);
           if (cancelled_) {
-            prefetch_thread_finished_[i] = true;
             break;
           }
         }
 
-        if (!prefetch_thread_finished_[i]) {
-          Item item;
-          input_impls_[i]->GetNext(ctx.get(), &item.out_tensors,
-                                   &item.end_of_sequence);
-          if (item.end_of_sequence) {
-            prefetch_thread_finished_[i] = true;
+        mutex_lock input_l(*input_mus_[i]);
+        if (pending_[i] == nullptr) {
+          auto item = absl::make_unique<Item>();
+          input_impls_[i]->GetNext(ctx.get(), &item->out_tensors,
+                                   &item->end_of_sequence);
+          if (item->end_of_sequence) {
             break;
           }
+          pending_[i] = std::move(item);
+        }
 
-          bool pushed = false;
-          do {
-            if (cancelled_ || prefetch_thread_finished_[i]) {
-              break;
-            }
-            pushed = df_to_queue_[name]->TryPush(item);
-          } while (!pushed);
+        // Gives checkpoints a chance to take the lock between attempts.
+        if (df_to_queue_[name]->TryPush(*pending_[i])) {
+          pending_[i].reset();
+          NotifyReady();
         }
       }
+      {
+        mutex_lock l(*mu_);
+        prefetch_thread_finished_[i] = true;
+      }
+      NotifyReady();
     }
   };
 
@@ -339,6 +475,8 @@ class MergeFlowDatasetOp::Dataset : public DatasetBase {
   std::vector<std::string> data_flows_;
   int max_queue_size_;
   VariantType variant_type_;
+  // The mixing ratios of the inputs, all equal when empty.
+  std::vector<float> weights_;
   std::string container_;
 };
 
@@ -346,6 +484,16 @@ MergeFlowDatasetOp::MergeFlowDatasetOp(OpKernelConstruction *ctx)
     : DatasetOpKernel(ctx) {
   OP_REQUIRES_OK(ctx, ctx->GetAttr(kDataFlow, &data_flows_));
   OP_REQUIRES_OK(ctx, ctx->GetAttr(kMaxQueueSize, &max_queue_size_));
+  OP_REQUIRES_OK(ctx, ctx->GetAttr(kWeights, &weights_));
+  OP_REQUIRES(ctx, weights_.empty() || weights_.size() == data_flows_.size(),
+              errors::InvalidArgument("There are ", weights_.size(),
+                                      " weights for ", data_flows_.size(),
+                                      " data flows"));
+  for (float weight : weights_) {
+    OP_REQUIRES(ctx, weight > 0,
+                errors::InvalidArgument("Weights must be positive, got ",
+                                        weight));
+  }
 
   std::string variant_type;
   OP_REQUIRES_OK(ctx, ctx->GetAttr(kVariantType, &variant_type));
@@ -371,8 +519,8 @@ void MergeFlowDatasetOp::MakeDataset(OpKernelContext *ctx,
     inputs.push_back(input);
   }
 
-  *output =
-      new Dataset(ctx, inputs, data_flows_, max_queue_size_, variant_type_);
+  *output = new Dataset(ctx, inputs, data_flows_, max_queue_size_,
+                        variant_type_, weights_);
 
   std::string container;
   // OP_REQUIRES_OK(ctx, GetNodeAttr(def(), "container", &container));
@@ -427,7 +427,7 @@ class InnerIterator {
       for (auto &named_feature : example->named_feature()) {
         const std::string &feature_name = named_feature.name();
         if (item_features_.count(feature_name) != 0) {
-          item_features->example_features[feature_name] = named_feature;
+          item_features->AddExampleFeature(named_feature);
         } else if (is_positive) {
           named_feature_list_.Add(named_feature);
         }
@@ -468,10 +468,38 @@ class InnerIterator {
     }
   }
 
+  // Decides easy/hard for every negative of the current positive up front, so
+  // that all hard negatives, which share the positive's channel, are drawn
+  // from the item pool with a single SampleN call.
+  void PrepareNegatives() {
+    easy_flags_.clear();
+    hard_items_.clear();
+    hard_freq_factors_.clear();
+    hard_time_factors_.clear();
+    hard_pos_ = 0;
+
+    int hard_num = 0;
+    for (int i = 0; i < neg_num_; ++i) {
+      bool easy = per_channel_ && NeedEasyNeg(easy_hard_ratio_);
+      easy_flags_.push_back(easy);
+      hard_num += !easy;
+    }
+    uint64_t channel_id = gcids_.second;
+    if (hard_num > 0 && channel_id != 0) {
+      resource_->SampleN(channel_id, hard_num, &hard_items_,
+                         &hard_freq_factors_, &hard_time_factors_);
+    }
+  }
+
   bool BuildNegativeTensor(IteratorContext *ctx, Tensor *res) {
+    if (index_ == 0) {
+      PrepareNegatives();
+    }
+
     // hard_easy neg when per_channel enabled
     uint64_t channel_id = gcids_.second;
-    if (per_channel_ && NeedEasyNeg(easy_hard_ratio_)) {
+    bool easy = easy_flags_[index_];
+    if (easy) {
       resource_->SampleChannelID(&channel_id);
       easy_sample_num_++;
     } else {
@@ -482,8 +510,15 @@ class InnerIterator {
       return false;
     }
     double freq_factor, time_factor;
-    std::shared_ptr<const ItemFeatures> cached_item =
-        resource_->Sample(channel_id, &freq_factor, &time_factor);
+    std::shared_ptr<const ItemFeatures> cached_item;
+    if (easy) {
+      cached_item = resource_->Sample(channel_id, &freq_factor, &time_factor);
+    } else if (hard_pos_ < hard_items_.size()) {
+      cached_item = hard_items_[hard_pos_];
+      freq_factor = hard_freq_factors_[hard_pos_];
+      time_factor = hard_time_factors_[hard_pos_];
+      ++hard_pos_;
+    }
     if (!cached_item) {
       return false;
     }
@@ -509,13 +544,12 @@ class InnerIterator {
         new_example.add_label(label);
       }
 
-      const auto &cached_example_features = cached_item->example_features;
       auto *mutable_named_feature = new_example.mutable_named_feature();
       for (const auto &nf : named_feature_list_) {
         mutable_named_feature->Add()->CopyFrom(nf);
       }
-      for (const auto &nf : cached_example_features) {
-        mutable_named_feature->Add()->CopyFrom(nf.second);
+      for (size_t i = 0; i < cached_item->example_features_size(); ++i) {
+        cached_item->GetExampleFeature(i, mutable_named_feature->Add());
       }
       SetLabelAndLineId(&new_example, item_id);
       new_example.set_instance_weight(instance_weight);
@@ -611,6 +645,12 @@ class InnerIterator {
   VariantType variant_type_;
 
   std::pair<uint64_t, uint64_t> gcids_;
+  // Negatives prepared for the current positive instance.
+  std::vector<bool> easy_flags_;
+  std::vector<std::shared_ptr<const ItemFeatures>> hard_items_;
+  std::vector<double> hard_freq_factors_;
+  std::vector<double> hard_time_factors_;
+  size_t hard_pos_ = 0;
   google::protobuf::RepeatedField<::google::protobuf::uint64> fid_list_;
   google::protobuf::RepeatedField<::monolith::io::proto::NamedFeature>
       named_feature_list_;
@@ -32,6 +32,7 @@ using EFeature = ::monolith::io::proto::Feature;
 using Example = ::monolith::io::proto::Example;
 using ExampleBatch = ::monolith::io::proto::ExampleBatch;
 using FeatureListType = ::monolith::io::proto::FeatureListType;
+using NamedFeatureList = ::monolith::io::proto::NamedFeatureList;
 using FieldDescriptor = ::google::protobuf::FieldDescriptor;
 using FeatureConfigs = ::monolith::io::proto::FeatureConfigs;
 
@@ -102,9 +103,9 @@ void BaseParser::AllocateRaggedValues(OpKernelContext *ctx,
 //
 // 1. Instead flat tensor inside, flat it outside (Reduce 2/3 running time)
 // 2. Using switch instead of if
-void BaseParser::FillFeature(OpKernelContext *ctx, const EFeature &feature,
-                             Tensor *tensor, const std::string &name,
-                             const int shape, const int offset) {
+Status BaseParser::FillFeature(const EFeature &feature, Tensor *tensor,
+                               const std::string &name, const int shape,
+                               const int offset) {
   if (feature.has_fid_v1_list()) {
     auto flat = tensor->flat<int64>();
     flat(offset + 1) = flat(offset) + feature.fid_v1_list().value_size();
@@ -160,8 +161,9 @@ void BaseParser::FillFeature(OpKernelContext *ctx, const EFeature &feature,
       }
     }
   } else if (feature.has_bytes_list()) {
-    OP_REQUIRES(ctx, shape == 1,
-                errors::InvalidArgument("shape must be 1 for bytes list!"));
+    if (shape != 1) {
+      return errors::InvalidArgument("shape must be 1 for bytes list!");
+    }
     CHECK_GT(feature.bytes_list().value_size(), 0);
     tensor->flat<tstring>()(offset) = feature.bytes_list().value(0);
   } else {
@@ -171,11 +173,12 @@ void BaseParser::FillFeature(OpKernelContext *ctx, const EFeature &feature,
       LOG(ERROR) << "list of list is not support yet!";
     }
   }
+  return Status::OK();
 }
 
-void BaseParser::FillFromLineId(OpKernelContext *ctx, const LineId &line_id,
-                                std::vector<Tensor *> *out_tensors,
-                                const int offset) {
+Status BaseParser::FillFromLineId(const LineId &line_id,
+                                  std::vector<Tensor *> *out_tensors,
+                                  const int offset) {
   int idx, shape;
   DataType dtype;
   for (const std::string &name : extra_names_) {
@@ -210,10 +213,11 @@ void BaseParser::FillFromLineId(OpKernelContext *ctx, const LineId &line_id,
       tensor->flat<float>()(offset) = line_id.chnid();
     } else {
       const auto *field = descriptor->FindFieldByName(name);
-      OP_REQUIRES_OK(ctx, FillFromLineIdByreflection(line_id, field, tensor,
-                                                     shape, offset));
+      TF_RETURN_IF_ERROR(
+          FillFromLineIdByreflection(line_id, field, tensor, shape, offset));
     }
   }
+  return Status::OK();
 }
 
 Status BaseParser::FillFromLineIdByreflection(const LineId &line_id,
@@ -365,6 +369,60 @@ Status BaseParser::FillFromLineIdByreflection(const LineId &line_id,
   return Status::OK();
 }
 
+void BaseParser::GroupFeatureLists(
+    const std::vector<const ExampleBatch *> &example_batches,
+    std::vector<std::vector<const NamedFeatureList *>> *groups) const {
+  // The line id fills the extra fields, and the label as does __LABEL__.
+  auto group_name = [this](const std::string &name) -> std::string {
+    if (name == "__LABEL__" || name == "label" ||
+        std::find(extra_names_.begin(), extra_names_.end(), name) !=
+            extra_names_.end()) {
+      return "__LINE_ID__";
+    }
+    return name;
+  };
+  std::unordered_map<std::string, size_t> group_index;
+  for (const ExampleBatch *example_batch : example_batches) {
+    for (const auto &named_feature_list : example_batch->named_feature_list()) {
+      const std::string &name = named_feature_list.name();
+      if (name != "__LINE_ID__" && name != "__LABEL__" &&
+          name2info_.count(name) == 0) {
+        continue;
+      }
+      auto it = group_index.emplace(group_name(name), groups->size()).first;
+      if (it->second == groups->size()) {
+        groups->emplace_back();
+      }
+      (*groups)[it->second].push_back(&named_feature_list);
+    }
+  }
+}
+
+Status BaseParser::ForEachFeatureList(
+    OpKernelContext *ctx,
+    const std::vector<std::vector<const NamedFeatureList *>> &groups,
+    int batch_size,
+    const std::function<Status(const NamedFeatureList &)> &fn) const {
+  // The ctx status is not thread safe, so every group keeps its own.
+  std::vector<Status> statuses(groups.size());
+  thread::ThreadPool *workers =
+      ctx->device()->tensorflow_cpu_worker_threads()->workers;
+  workers->ParallelFor(
+      groups.size(), 100 * static_cast<int64>(batch_size),
+      [&groups, &fn, &statuses](int64 begin, int64 end) {
+        for (int64 i = begin; i < end; ++i) {
+          for (const NamedFeatureList *list : groups[i]) {
+            statuses[i] = fn(*list);
+            if (!statuses[i].ok()) break;
+          }
+        }
+      });
+  for (const Status &status : statuses) {
+    TF_RETURN_IF_ERROR(status);
+  }
+  return Status::OK();
+}
+
 ExampleParser::ExampleParser(const std::vector<std::string> &names,
                              const std::vector<int> &shapes,
                              const std::vector<DataType> &dtypes,
@@ -412,8 +470,8 @@ void ExampleParser::Parse(OpKernelContext *ctx,
         auto it = name2info_.find(name);
         if (it == name2info_.end()) continue;
         std::tie(idx, shape, dtype) = it->second;
-        FillFeature(ctx, named_feature.feature(), out_tensors[idx], name, shape,
-                    offset);
+        OP_REQUIRES_OK(ctx, FillFeature(named_feature.feature(),
+                                        out_tensors[idx], name, shape, offset));
         appeared.insert(name);
         if (name == "label") {
           has_fill_label = true;
@@ -477,7 +535,7 @@ void ExampleParser::Parse(OpKernelContext *ctx,
       // for extra fields in line_id
       if (!extra_names_.empty()) {
         const LineId &line_id = example->line_id();
-        FillFromLineId(ctx, line_id, &out_tensors, offset);
+        OP_REQUIRES_OK(ctx, FillFromLineId(line_id, &out_tensors, offset));
       }
 
       offset++;
@@ -531,136 +589,148 @@ void ExampleBatchParser::Parse(OpKernelContext *ctx,
   int batch_size = example_batch.batch_size();
   std::vector<Tensor *> out_tensors;
   out_tensors.resize(idx2info_.size());
-
-  std::string name;
-  int idx, shape;
-  DataType dtype;
+  std::vector<std::vector<const NamedFeatureList *>> groups;
+  GroupFeatureLists({&example_batch}, &groups);
 
   // 1) allocate output tensors for ragged splits and other non-ragged
   AllocateFeatures(ctx, &out_tensors, out_list, batch_size);
+  if (!ctx->status().ok()) return;
 
-  // 2) fill all tensors expect ragged values
-  for (const auto &named_feature_list : example_batch.named_feature_list()) {
-    name = named_feature_list.name();
-    if (name == "__LINE_ID__") {
-      // for extra fields in line_id
-      if (extra_names_.size() > 0) {
-        int offset = 0;
-        for (const auto &feature : named_feature_list.feature()) {
-          LineId line_id;
-          CHECK_GT(feature.bytes_list().value_size(), 0);
-          const auto serialized = feature.bytes_list().value(0);
-          OP_REQUIRES(
-              ctx, line_id.ParseFromArray(serialized.data(), serialized.size()),
-              errors::FailedPrecondition("Failed to parse the LineId."));
-          FillFromLineId(ctx, line_id, &out_tensors, offset);
-          offset++;
+  // 2) fill all tensors expect ragged values, which sizes the ragged values
+  OP_REQUIRES_OK(ctx, ForEachFeatureList(
+                          ctx, groups, batch_size,
+                          [&](const NamedFeatureList &named_feature_list) {
+                            return FillFeatureList(named_feature_list,
+                                                   batch_size, &out_tensors);
+                          }));
+
+  // 3) allocate output tensors for ragged values
+  AllocateRaggedValues(ctx, &out_tensors, out_list, batch_size);
+  if (!ctx->status().ok()) return;
+
+  // 4) fill ragged values
+  if (ragged_names_.size()) {
+    OP_REQUIRES_OK(ctx, ForEachFeatureList(
+                            ctx, groups, batch_size,
+                            [&](const NamedFeatureList &named_feature_list) {
+                              FillRaggedValues(named_feature_list, batch_size,
+                                               out_tensors);
+                              return Status::OK();
+                            }));
+  }
+}
+
+Status ExampleBatchParser::FillFeatureList(
+    const NamedFeatureList &named_feature_list, int batch_size,
+    std::vector<Tensor *> *out_tensors) {
+  int idx, shape;
+  DataType dtype;
+  const std::string &name = named_feature_list.name();
+  if (name == "__LINE_ID__") {
+    // for extra fields in line_id
+    if (extra_names_.size() > 0) {
+      int offset = 0;
+      for (const auto &feature : named_feature_list.feature()) {
+        LineId line_id;
+        CHECK_GT(feature.bytes_list().value_size(), 0);
+        const auto &serialized = feature.bytes_list().value(0);
+        if (!line_id.ParseFromArray(serialized.data(), serialized.size())) {
+          return errors::FailedPrecondition("Failed to parse the LineId.");
         }
+        TF_RETURN_IF_ERROR(FillFromLineId(line_id, out_tensors, offset));
+        offset++;
       }
-    } else if (name == "__LABEL__") {
-      // for label
-      auto it = name2info_.find("label");
-      if (it != name2info_.end()) {
-        std::tie(idx, shape, dtype) = it->second;
-        Tensor *tensor = out_tensors[idx];
+    }
+  } else if (name == "__LABEL__") {
+    // for label
+    auto it = name2info_.find("label");
+    if (it != name2info_.end()) {
+      std::tie(idx, shape, dtype) = it->second;
+      Tensor *tensor = out_tensors->at(idx);
 
-        int offset = 0;
-        for (const auto &feature : named_feature_list.feature()) {
-          if (shape == 1) {
-            CHECK_GT(feature.float_list().value_size(), 0);
-            tensor->flat<float>()(offset) = feature.float_list().value(0);
-          } else {
-            auto matrix = tensor->matrix<float>();
-            for (int j = 0;
-                 j < std::min(shape, feature.float_list().value_size()); ++j) {
-              matrix(offset, j) = feature.float_list().value(j);
-            }
+      int offset = 0;
+      for (const auto &feature : named_feature_list.feature()) {
+        if (shape == 1) {
+          CHECK_GT(feature.float_list().value_size(), 0);
+          tensor->flat<float>()(offset) = feature.float_list().value(0);
+        } else {
+          auto matrix = tensor->matrix<float>();
+          for (int j = 0;
+               j < std::min(shape, feature.float_list().value_size()); ++j) {
+            matrix(offset, j) = feature.float_list().value(j);
           }
-          offset++;
         }
+        offset++;
       }
-    } else if (name == "instance_weight") {
-      auto it = name2info_.find("instance_weight");
-      if (it != name2info_.end()) {
-        std::tie(idx, shape, dtype) = it->second;
-        Tensor *tensor = out_tensors[idx];
-        int offset = 0;
-        for (const auto &feature : named_feature_list.feature()) {
-          CHECK_GT(feature.float_list().value_size(), 0);
-          float instance_weight = feature.float_list().value(0);
-          tensor->flat<float>()(offset) =
-              instance_weight > 0 ? instance_weight : 1.0;
-          offset++;
-        }
+    }
+  } else if (name == "instance_weight") {
+    auto it = name2info_.find("instance_weight");
+    if (it != name2info_.end()) {
+      std::tie(idx, shape, dtype) = it->second;
+      Tensor *tensor = out_tensors->at(idx);
+      int offset = 0;
+      for (const auto &feature : named_feature_list.feature()) {
+        CHECK_GT(feature.float_list().value_size(), 0);
+        float instance_weight = feature.float_list().value(0);
+        tensor->flat<float>()(offset) =
+            instance_weight > 0 ? instance_weight : 1.0;
+        offset++;
+      }
+    }
+  } else {
+    auto it = name2info_.find(name);
+    if (it == name2info_.end()) return Status::OK();
+    std::tie(idx, shape, dtype) = it->second;
+    Tensor *tensor = out_tensors->at(idx);
+
+    if (named_feature_list.type() == FeatureListType::SHARED) {
+      CHECK_GT(named_feature_list.feature_size(), 0);
+      const auto &feature = named_feature_list.feature(0);
+      for (int offset = 0; offset < batch_size; ++offset) {
+        TF_RETURN_IF_ERROR(FillFeature(feature, tensor, name, shape, offset));
       }
     } else {
-      auto it = name2info_.find(name);
-      if (it == name2info_.end()) continue;
-      std::tie(idx, shape, dtype) = name2info_[name];
-      Tensor *tensor = out_tensors[idx];
-
-      if (named_feature_list.type() == FeatureListType::SHARED) {
-        CHECK_GT(named_feature_list.feature_size(), 0);
-        const auto &feature = named_feature_list.feature(0);
-        for (int offset = 0; offset < batch_size; ++offset) {
-          FillFeature(ctx, feature, tensor, name, shape, offset);
-        }
-      } else {
-        int offset = 0;
-        for (const auto &feature : named_feature_list.feature()) {
-          FillFeature(ctx, feature, tensor, name, shape, offset);
-          offset++;
-        }
+      int offset = 0;
+      for (const auto &feature : named_feature_list.feature()) {
+        TF_RETURN_IF_ERROR(FillFeature(feature, tensor, name, shape, offset));
+        offset++;
       }
     }
   }
+  return Status::OK();
+}
 
-  // 3) allocate output tensors for ragged values
-  AllocateRaggedValues(ctx, &out_tensors, out_list, batch_size);
-
-  // 4) fill ragged values
-  if (ragged_names_.size()) {
-    for (const auto &named_feature_list : example_batch.named_feature_list()) {
-      name = named_feature_list.name();
-      auto it = ragged_names_.find(name);
-      if (it != ragged_names_.end()) {
-        std::tie(idx, shape, dtype) = name2info_[name];
-        auto splits = out_tensors[idx]->flat<int64>();
-        auto values = out_tensors[idx + name2info_.size()]->flat<int64>();
-
-        if (named_feature_list.type() == FeatureListType::SHARED) {
-          const auto &feature = named_feature_list.feature(0);
-          for (int offset = 0; offset < batch_size; ++offset) {
-            int start = static_cast<int>(splits(offset));
-            if (feature.has_fid_v1_list()) {
-              for (int i = 0; i < feature.fid_v1_list().value_size(); ++i) {
-                values(start + i) =
-                    convert_fid_v1_to_v2(feature.fid_v1_list().value(i));
-              }
-            } else if (feature.has_fid_v2_list()) {
-              for (int i = 0; i < feature.fid_v2_list().value_size(); ++i) {
-                values(start + i) = feature.fid_v2_list().value(i);
-              }
-            }
-          }
-        } else {
-          int offset = 0;
-          for (const auto &feature : named_feature_list.feature()) {
-            int start = static_cast<int>(splits(offset));
-            if (feature.has_fid_v1_list()) {
-              for (int i = 0; i < feature.fid_v1_list().value_size(); ++i) {
-                values(start + i) =
-                    convert_fid_v1_to_v2(feature.fid_v1_list().value(i));
-              }
-            } else if (feature.has_fid_v2_list()) {
-              for (int i = 0; i < feature.fid_v2_list().value_size(); ++i) {
-                values(start + i) = feature.fid_v2_list().value(i);
-              }
-            }
-            offset++;
-          }
-        }
-      }
+void ExampleBatchParser::FillRaggedValues(
+    const NamedFeatureList &named_feature_list, int batch_size,
+    const std::vector<Tensor *> &out_tensors) {
+  const std::string &name = named_feature_list.name();
+  if (ragged_names_.find(name) == ragged_names_.end()) return;
+  int idx, shape;
+  DataType dtype;
+  std::tie(idx, shape, dtype) = name2info_.find(name)->second;
+  auto splits = out_tensors[idx]->flat<int64>();
+  int64 *values = out_tensors[idx + name2info_.size()]->flat<int64>().data();
+
+  auto fill_row = [&](const EFeature &feature, int offset) {
+    int64 *out = values + splits(offset);
+    if (feature.has_fid_v1_list()) {
+      const auto &fids = feature.fid_v1_list().value();
+      ConvertFidsV1ToV2(fids.data(), fids.size(), out);
+    } else if (feature.has_fid_v2_list()) {
+      const auto &fids = feature.fid_v2_list().value();
+      std::copy(fids.begin(), fids.end(), out);
+    }
+  };
+  if (named_feature_list.type() == FeatureListType::SHARED) {
+    const auto &feature = named_feature_list.feature(0);
+    for (int offset = 0; offset < batch_size; ++offset) {
+      fill_row(feature, offset);
+    }
+  } else {
+    int offset = 0;
+    for (const auto &feature : named_feature_list.feature()) {
+      fill_row(feature, offset);
+      offset++;
     }
   }
 }
@@ -672,134 +742,155 @@ ExampleBatchListParser::ExampleBatchListParser(
     : BaseParser(names, shapes, dtypes, extra_names, input_dtype) {}
 
 void ExampleBatchListParser::Parse(
-    OpKernelContext *ctx, const ExampleBatch &example_batch,
+    OpKernelContext *ctx,
+    const std::vector<const ExampleBatch *> &example_batches,
     const std::vector<internal::TaskConfig> &label_config_,
     float positive_label, float negative_label, OpOutputList *out_list) {
-  int batch_size = example_batch.batch_size();
+  // Like ExampleBatch::MergeFrom, the last batch size set wins.
+  int batch_size = 0;
+  for (const ExampleBatch *example_batch : example_batches) {
+    if (example_batch->batch_size() != 0) {
+      batch_size = example_batch->batch_size();
+    }
+  }
   std::vector<Tensor *> out_tensors;
   out_tensors.resize(idx2info_.size());
-
-  std::string name;
-  int idx, shape;
-  DataType dtype;
+  std::vector<std::vector<const NamedFeatureList *>> groups;
+  GroupFeatureLists(example_batches, &groups);
 
   // 1) allocate output tensors for ragged splits and other non-ragged
   AllocateFeatures(ctx, &out_tensors, out_list, batch_size);
+  if (!ctx->status().ok()) return;
+
+  // 2) fill all tensors expect ragged values, which sizes the ragged values
+  OP_REQUIRES_OK(ctx, ForEachFeatureList(
+                          ctx, groups, batch_size,
+                          [&](const NamedFeatureList &named_feature_list) {
+                            return FillFeatureList(
+                                named_feature_list, label_config_,
+                                positive_label, negative_label, batch_size,
+                                &out_tensors);
+                          }));
 
-  // 2) fill all tensors expect ragged values
-  for (const auto &named_feature_list : example_batch.named_feature_list()) {
-    name = named_feature_list.name();
-    if (name == "__LINE_ID__") {
-      auto it = name2info_.find("label");
-      if (it != name2info_.end()) {
-        std::tie(idx, shape, dtype) = it->second;
-      }
+  // 3) allocate output tensors for ragged values
+  AllocateRaggedValues(ctx, &out_tensors, out_list, batch_size);
+  if (!ctx->status().ok()) return;
 
-      // for extra fields in line_id
-      if (extra_names_.size() > 0) {
-        int offset = 0;
-        for (const auto &feature : named_feature_list.feature()) {
-          LineId line_id;
-          CHECK_GT(feature.bytes_list().value_size(), 0);
-          const auto serialized = feature.bytes_list().value(0);
-          OP_REQUIRES(
-              ctx, line_id.ParseFromArray(serialized.data(), serialized.size()),
-              errors::FailedPrecondition("Failed to parse the LineId."));
-          FillFromLineId(ctx, line_id, &out_tensors, offset);
-          if (it != name2info_.end()) {
-            FillLabelFromLineId(ctx, line_id, label_config_, positive_label,
-                                negative_label, out_tensors[idx], offset);
-          }
-          offset++;
+  // 4) fill ragged values
+  OP_REQUIRES_OK(ctx, ForEachFeatureList(
+                          ctx, groups, batch_size,
+                          [&](const NamedFeatureList &named_feature_list) {
+                            FillRaggedValues(named_feature_list, batch_size,
+                                             out_tensors);
+                            return Status::OK();
+                          }));
+}
+
+Status ExampleBatchListParser::FillFeatureList(
+    const NamedFeatureList &named_feature_list,
+    const std::vector<internal::TaskConfig> &label_config_,
+    float positive_label, float negative_label, int batch_size,
+    std::vector<Tensor *> *out_tensors) {
+  int idx, shape;
+  DataType dtype;
+  const std::string &name = named_feature_list.name();
+  if (name == "__LINE_ID__") {
+    auto it = name2info_.find("label");
+    if (it != name2info_.end()) {
+      std::tie(idx, shape, dtype) = it->second;
+    }
+
+    // for extra fields in line_id
+    if (extra_names_.size() > 0) {
+      int offset = 0;
+      for (const auto &feature : named_feature_list.feature()) {
+        LineId line_id;
+        CHECK_GT(feature.bytes_list().value_size(), 0);
+        const auto &serialized = feature.bytes_list().value(0);
+        if (!line_id.ParseFromArray(serialized.data(), serialized.size())) {
+          return errors::FailedPrecondition("Failed to parse the LineId.");
         }
-      }
-    } else if (name == "instance_weight") {
-      auto it = name2info_.find("instance_weight");
-      if (it != name2info_.end()) {
-        std::tie(idx, shape, dtype) = it->second;
-        Tensor *tensor = out_tensors[idx];
-        int offset = 0;
-        for (const auto &feature : named_feature_list.feature()) {
-          CHECK_GT(feature.float_list().value_size(), 0);
-          float instance_weight = feature.float_list().value(0);
-          tensor->flat<float>()(offset++) =
-              instance_weight > 0 ? instance_weight : 1.0;
+        TF_RETURN_IF_ERROR(FillFromLineId(line_id, out_tensors, offset));
+        if (it != name2info_.end()) {
+          FillLabelFromLineId(line_id, label_config_, positive_label,
+                              negative_label, out_tensors->at(idx), offset);
         }
+        offset++;
       }
-    } else {
-      auto it = name2info_.find(name);
-      if (it == name2info_.end()) continue;
+    }
+  } else if (name == "instance_weight") {
+    auto it = name2info_.find("instance_weight");
+    if (it != name2info_.end()) {
       std::tie(idx, shape, dtype) = it->second;
-      Tensor *tensor = out_tensors[idx];
+      Tensor *tensor = out_tensors->at(idx);
+      int offset = 0;
+      for (const auto &feature : named_feature_list.feature()) {
+        CHECK_GT(feature.float_list().value_size(), 0);
+        float instance_weight = feature.float_list().value(0);
+        tensor->flat<float>()(offset++) =
+            instance_weight > 0 ? instance_weight : 1.0;
+      }
+    }
+  } else {
+    auto it = name2info_.find(name);
+    if (it == name2info_.end()) return Status::OK();
+    std::tie(idx, shape, dtype) = it->second;
+    Tensor *tensor = out_tensors->at(idx);
 
-      if (named_feature_list.type() == FeatureListType::SHARED) {
-        const auto &feature = named_feature_list.feature(0);
-        for (int offset = 0; offset < batch_size; ++offset) {
-          FillFeature(ctx, feature, tensor, name, shape, offset);
-        }
-      } else {
-        int offset = 0;
-        for (const auto &feature : named_feature_list.feature()) {
-          FillFeature(ctx, feature, tensor, name, shape, offset);
-          offset++;
-        }
+    if (named_feature_list.type() == FeatureListType::SHARED) {
+      const auto &feature = named_feature_list.feature(0);
+      for (int offset = 0; offset < batch_size; ++offset) {
+        TF_RETURN_IF_ERROR(FillFeature(feature, tensor, name, shape, offset));
+      }
+    } else {
+      int offset = 0;
+      for (const auto &feature : named_feature_list.feature()) {
+        TF_RETURN_IF_ERROR(FillFeature(feature, tensor, name, shape, offset));
+        offset++;
       }
     }
   }
+  return Status::OK();
+}
 
-  // 3) allocate output tensors for ragged values
-  AllocateRaggedValues(ctx, &out_tensors, out_list, batch_size);
-
-  // 4) fill ragged values
-  for (const auto &named_feature_list : example_batch.named_feature_list()) {
-    name = named_feature_list.name();
-    auto it = ragged_names_.find(name);
-    if (it != ragged_names_.end()) {
-      int slot = named_feature_list.id();
-      std::tie(idx, shape, dtype) = name2info_[name];
-      auto splits = out_tensors[idx]->flat<int64>();
-      auto values = out_tensors[idx + name2info_.size()]->flat<int64>();
-
-      if (named_feature_list.type() == FeatureListType::SHARED) {
-        const auto &feature = named_feature_list.feature(0);
-        for (int offset = 0; offset < batch_size; ++offset) {
-          int start = static_cast<int>(splits(offset));
-          if (feature.has_fid_v1_list()) {
-            for (int i = 0; i < feature.fid_v1_list().value_size(); ++i) {
-              values(start + i) =
-                  GetFidV2(slot, feature.fid_v1_list().value(i));
-            }
-          } else if (feature.has_fid_v2_list()) {
-            for (int i = 0; i < feature.fid_v2_list().value_size(); ++i) {
-              values(start + i) =
-                  GetFidV2(slot, feature.fid_v2_list().value(i));
-            }
-          }
-        }
-      } else {
-        int offset = 0;
-        for (const auto &feature : named_feature_list.feature()) {
-          int start = static_cast<int>(splits(offset));
-          if (feature.has_fid_v1_list()) {
-            for (int i = 0; i < feature.fid_v1_list().value_size(); ++i) {
-              values(start + i) =
-                  GetFidV2(slot, feature.fid_v1_list().value(i));
-            }
-          } else if (feature.has_fid_v2_list()) {
-            for (int i = 0; i < feature.fid_v2_list().value_size(); ++i) {
-              values(start + i) =
-                  GetFidV2(slot, feature.fid_v2_list().value(i));
-            }
-          }
-          offset++;
-        }
-      }
+void ExampleBatchListParser::FillRaggedValues(
+    const NamedFeatureList &named_feature_list, int batch_size,
+    const std::vector<Tensor *> &out_tensors) {
+  const std::string &name = named_feature_list.name();
+  if (ragged_names_.find(name) == ragged_names_.end()) return;
+  int idx, shape;
+  DataType dtype;
+  int slot = named_feature_list.id();
+  std::tie(idx, shape, dtype) = name2info_.find(name)->second;
+  auto splits = out_tensors[idx]->flat<int64>();
+  int64 *values = out_tensors[idx + name2info_.size()]->flat<int64>().data();
+
+  auto fill_row = [&](const EFeature &feature, int offset) {
+    int64 *out = values + splits(offset);
+    if (feature.has_fid_v1_list()) {
+      const auto &fids = feature.fid_v1_list().value();
+      GetFidsV2(slot, fids.data(), fids.size(), out);
+    } else if (feature.has_fid_v2_list()) {
+      const auto &fids = feature.fid_v2_list().value();
+      GetFidsV2(slot, fids.data(), fids.size(), out);
+    }
+  };
+  if (named_feature_list.type() == FeatureListType::SHARED) {
+    const auto &feature = named_feature_list.feature(0);
+    for (int offset = 0; offset < batch_size; ++offset) {
+      fill_row(feature, offset);
+    }
+  } else {
+    int offset = 0;
+    for (const auto &feature : named_feature_list.feature()) {
+      fill_row(feature, offset);
+      offset++;
     }
   }
 }
 
 void ExampleBatchListParser::FillLabelFromLineId(
-    OpKernelContext *ctx, const ::idl::matrix::proto::LineId &line_id,
+    const ::idl::matrix::proto::LineId &line_id,
     const std::vector<internal::TaskConfig> &label_config_,
     float positive_label, float negative_label, Tensor *out_tensor,
     const int offset) {
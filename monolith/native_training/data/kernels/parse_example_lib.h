@@ -15,8 +15,10 @@
 #ifndef MONOLITH_NATIVE_TRAINING_DATA_KERNELS_PARSE_EXAMPLE_LIB_H_
 #define MONOLITH_NATIVE_TRAINING_DATA_KERNELS_PARSE_EXAMPLE_LIB_H_
 
+#include <functional>
 #include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
 #include "google/protobuf/descriptor.h"
 #include "idl/matrix/proto/example.pb.h"
@@ -47,20 +49,38 @@ class BaseParser {
                             std::vector<Tensor *> *out_tensors,
                             OpOutputList *out_list, int batch_size);
 
-  void FillFeature(OpKernelContext *ctx,
-                   const ::monolith::io::proto::Feature &feature,
-                   Tensor *tensor, const std::string &name, int shape,
-                   int offset);
+  Status FillFeature(const ::monolith::io::proto::Feature &feature,
+                     Tensor *tensor, const std::string &name, int shape,
+                     int offset);
 
-  void FillFromLineId(OpKernelContext *ctx,
-                      const ::idl::matrix::proto::LineId &line_id,
-                      std::vector<Tensor *> *out_tensors, const int offset);
+  Status FillFromLineId(const ::idl::matrix::proto::LineId &line_id,
+                        std::vector<Tensor *> *out_tensors, const int offset);
 
   Status FillFromLineIdByreflection(
       const ::idl::matrix::proto::LineId &line_id,
       const ::google::protobuf::FieldDescriptor *field, Tensor *tensor,
       int shape, int offset);
 
+  // Groups the feature lists of the batches by the output tensors they fill,
+  // keeping their order within a group. Lists which fill nothing are left
+  // out.
+  void GroupFeatureLists(
+      const std::vector<const ::monolith::io::proto::ExampleBatch *>
+          &example_batches,
+      std::vector<std::vector<const ::monolith::io::proto::NamedFeatureList *>>
+          *groups) const;
+
+  // Calls fn on every feature list, groups in parallel on the intra op
+  // threads and the lists of a group in order. A group stops at its first
+  // error, and the error of the first failed group is returned.
+  Status ForEachFeatureList(
+      OpKernelContext *ctx,
+      const std::vector<
+          std::vector<const ::monolith::io::proto::NamedFeatureList *>> &groups,
+      int batch_size,
+      const std::function<
+          Status(const ::monolith::io::proto::NamedFeatureList &)> &fn) const;
+
   std::unordered_map<std::string, std::tuple<int, int, DataType>> name2info_;
   std::unordered_map<int, std::tuple<std::string, int, DataType>> idx2info_;
   std::unordered_set<std::string> ragged_names_;
@@ -101,6 +121,15 @@ class ExampleBatchParser : public BaseParser {
   void Parse(OpKernelContext *ctx,
              const ::monolith::io::proto::ExampleBatch &example_batch,
              OpOutputList *out_list);
+
+ private:
+  Status FillFeatureList(
+      const ::monolith::io::proto::NamedFeatureList &named_feature_list,
+      int batch_size, std::vector<Tensor *> *out_tensors);
+
+  void FillRaggedValues(
+      const ::monolith::io::proto::NamedFeatureList &named_feature_list,
+      int batch_size, const std::vector<Tensor *> &out_tensors);
 };
 
 class ExampleBatchListParser : public BaseParser {
@@ -111,17 +140,30 @@ class ExampleBatchListParser : public BaseParser {
                                   const std::vector<std::string> &extra_names,
                                   DataType input_dtype);
 
-  void Parse(OpKernelContext *ctx,
-             const ::monolith::io::proto::ExampleBatch &example_batchs,
-             const std::vector<internal::TaskConfig> &label_config_,
-             float positive_label, float negative_label,
-             OpOutputList *out_list);
+  // The batches hold different features of the same rows, and are parsed in
+  // place as if they were merged into one.
+  void Parse(
+      OpKernelContext *ctx,
+      const std::vector<const ::monolith::io::proto::ExampleBatch *>
+          &example_batches,
+      const std::vector<internal::TaskConfig> &label_config_,
+      float positive_label, float negative_label, OpOutputList *out_list);
 
  private:
   uint64 mask_ = (1 << 48) - 1;
 
+  Status FillFeatureList(
+      const ::monolith::io::proto::NamedFeatureList &named_feature_list,
+      const std::vector<internal::TaskConfig> &label_config_,
+      float positive_label, float negative_label, int batch_size,
+      std::vector<Tensor *> *out_tensors);
+
+  void FillRaggedValues(
+      const ::monolith::io::proto::NamedFeatureList &named_feature_list,
+      int batch_size, const std::vector<Tensor *> &out_tensors);
+
   void FillLabelFromLineId(
-      OpKernelContext *ctx, const ::idl::matrix::proto::LineId &line_id,
+      const ::idl::matrix::proto::LineId &line_id,
       const std::vector<internal::TaskConfig> &label_config_,
       float positive_label, float negative_label, Tensor *out_tensor,
       const int offset);
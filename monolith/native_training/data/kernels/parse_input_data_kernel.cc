@@ -736,18 +736,19 @@ class ParseVariantExampleBatchListOp : public OpKernel {
     // Grab the input tensor
     OpInputList inputs;
     OP_REQUIRES_OK(ctx, ctx->input_list("inputs", &inputs));
-    ExampleBatch example_batch;
+    std::vector<const ExampleBatch *> example_batches;
+    example_batches.reserve(inputs.size());
     int batch_size = 0;
     for (auto iter = inputs.begin(); iter != inputs.end(); ++iter) {
       const ExampleBatch *sub_eb =
           iter->scalar<Variant>()().get<ExampleBatch>();
       batch_size += sub_eb->batch_size();
-      example_batch.MergeFrom(*sub_eb);
+      example_batches.push_back(sub_eb);
     }
 
     OpOutputList out_list;
     OP_REQUIRES_OK(ctx, ctx->output_list("tensors", &out_list));
-    parser_->Parse(ctx, example_batch, label_config_, positive_label_,
+    parser_->Parse(ctx, example_batches, label_config_, positive_label_,
                    negative_label_, &out_list);
 
     counter_->EmitDataConsumeNumCounter(batch_size);
@@ -332,6 +332,11 @@ class PBDatasetOp : public DatasetOpKernel {
         mutex_lock l(mu_);
         if (!reader_) {
           TF_RETURN_IF_ERROR(SetupStreamsLocked(ctx->env()));
+          if (consumed_ > 0) {
+            TF_RETURN_IF_ERROR(reader_->SetPosition(offset_, consumed_));
+            offset_ = reader_->GetOffset();
+            consumed_ = 0;
+          }
         }
         out_tensors->emplace_back(ctx->allocator({}), dataset()->out_type_,
                                   TensorShape({}));
@@ -388,25 +393,43 @@ class PBDatasetOp : public DatasetOpKernel {
       Status SaveInternal(SerializationContext *ctx,
                           IteratorStateWriter *writer) override {
         mutex_lock l(mu_);
-        LOG(INFO) << "Save function is not supported yet.";
         TF_RETURN_IF_ERROR(writer->WriteScalar(full_name("num_random_samples"),
                                                num_random_samples_));
-        TF_RETURN_IF_ERROR(writer->WriteScalar(full_name("offset"), offset_));
+        // Example batches are split into examples, so the position is the
+        // offset of the current batch and the examples of it handed out.
+        uint64 offset = offset_;
+        int64 consumed = consumed_;
+        if (reader_) {
+          reader_->GetPosition(&offset, &consumed);
+        }
+        TF_RETURN_IF_ERROR(writer->WriteScalar(full_name("offset"), offset));
+        TF_RETURN_IF_ERROR(
+            writer->WriteScalar(full_name("consumed"), consumed));
         return Status::OK();
       }
 
       Status RestoreInternal(IteratorContext *ctx,
                              IteratorStateReader *reader) override {
         mutex_lock l(mu_);
-        LOG(INFO) << "Restore function is not supported yet.";
         TF_RETURN_IF_ERROR(reader->ReadScalar(full_name("num_random_samples"),
                                               &num_random_samples_));
         int64 offset;
         TF_RETURN_IF_ERROR(reader->ReadScalar(full_name("offset"), &offset));
+        int64 consumed = 0;
+        // Checkpoints written before the position was saved have no count.
+        if (reader->Contains(full_name("consumed"))) {
+          TF_RETURN_IF_ERROR(
+              reader->ReadScalar(full_name("consumed"), &consumed));
+        }
         if (dataset()->file_name_.empty()) {
+          // Stdin can not be rewound.
           offset_ = 0;
+          consumed_ = 0;
         } else {
+          // The reader is set up again at the restored position by GetNext.
+          ResetStreamsLocked();
           offset_ = offset;
+          consumed_ = consumed;
         }
         return Status::OK();
       }
@@ -454,6 +477,8 @@ class PBDatasetOp : public DatasetOpKernel {
       std::unique_ptr<PBIterator> reader_ TF_GUARDED_BY(mu_);
       int64 num_random_samples_ TF_GUARDED_BY(mu_) = 0;
       uint64 offset_ TF_GUARDED_BY(mu_) = 0;
+      // The examples of the batch at offset_ handed out before a restore.
+      int64 consumed_ TF_GUARDED_BY(mu_) = 0;
       uint64 metric_emit_step_ TF_GUARDED_BY(mu_) = 10000;
       FeatureNameMapper *mapper_ = nullptr;
     };
@@ -12,14 +12,17 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
 #include <string>
 #include <vector>
 #include <unordered_map>
 
 
+#include "absl/container/flat_hash_map.h"
 #include "tensorflow/core/framework/op_kernel.h"
 #include "tensorflow/core/framework/tensor.h"
 #include "tensorflow/core/framework/tensor_shape.h"
+#include "tensorflow/core/platform/threadpool.h"
 #include "idl/matrix/proto/example.pb.h"
 #include "monolith/native_training/data/training_instance/cc/pb_variant.h"
 #include "monolith/native_training/data/training_instance/cc/reader_util.h"
@@ -29,6 +32,21 @@ namespace monolith_tf {
 using Example = ::monolith::io::proto::Example;
 using ExampleBatch = ::monolith::io::proto::ExampleBatch;
 using NamedFeature = ::monolith::io::proto::NamedFeature;
+using EFeature = ::monolith::io::proto::Feature;
+
+namespace {
+
+// The mask and slot bits that SwitchSlot and FeatureCombine rewrite fids with.
+// Unlike switch_slot_v1/v2, they keep the lowest bit of the old slot, which
+// the fids these ops have produced so far depend on.
+void SwitchSlotMask(int slot, int fid_version, uint64_t *mask,
+                    uint64_t *bits) {
+  const int shift = fid_version == 1 ? 54 : 48;
+  *mask = (1ULL << (shift + 1)) - 1;
+  *bits = static_cast<uint64_t>(slot) << shift;
+}
+
+}  // namespace
 
 class SwitchSlotOp : public OpKernel {
  public:
@@ -39,6 +57,7 @@ class SwitchSlotOp : public OpKernel {
     OP_REQUIRES_OK(ctx, ctx->GetAttr("slot", &slot_));
 
     OP_REQUIRES_OK(ctx, ctx->GetAttr("fid_version", &fid_version_));
+    SwitchSlotMask(slot_, fid_version_, &mask_, &bits_);
   }
 
   void Compute(OpKernelContext *context) override {
@@ -52,47 +71,27 @@ class SwitchSlotOp : public OpKernel {
     OP_REQUIRES_OK(context, context->output_list("nested_splits_out",
                                                  &rt_nested_splits_out));
 
+    // The splits are unchanged, so they are passed through without a copy.
     for (int i = 0; i < rt_nested_splits_len; ++i) {
-      Tensor *out_splits;
-      OP_REQUIRES_OK(context,
-                     rt_nested_splits_out.allocate(
-                         i, rt_nested_splits_in[i].shape(), &out_splits));
-      std::memcpy(out_splits->data(), rt_nested_splits_in[i].data(),
-                  sizeof(int64) * rt_nested_splits_in[i].NumElements());
+      rt_nested_splits_out.set(i, rt_nested_splits_in[i]);
     }
 
     const Tensor &rt_dense_values_in = context->input(rt_nested_splits_len);
     Tensor *dense_values_out;
-    OP_REQUIRES_OK(context, context->allocate_output("dense_values_out",
-                                                     rt_dense_values_in.shape(),
-                                                     &dense_values_out));
-    auto dense_values_int_ = rt_dense_values_in.flat<int64>();
-    auto dense_values_out_ = dense_values_out->flat<int64>();
-
-    for (int i = 0; i < dense_values_int_.size(); ++i) {
-      if (fid_version_ == 1) {
-        dense_values_out_(i) = convert_v1(dense_values_int_(i));
-      } else {
-        dense_values_out_(i) = convert_v2(dense_values_int_(i));
-      }
-    }
+    OP_REQUIRES_OK(context, context->forward_input_or_allocate_output(
+                                {"rt_dense_values"}, "dense_values_out",
+                                rt_dense_values_in.shape(), &dense_values_out));
+    auto dense_values_in = rt_dense_values_in.flat<int64>();
+    MaskFids(reinterpret_cast<const uint64_t *>(dense_values_in.data()),
+             dense_values_in.size(), mask_, bits_,
+             dense_values_out->flat<int64>().data());
   }
 
  private:
-  inline int64 convert_v1(int64 fid) {
-    static int64 mask = (static_cast<int64>(1) << 55) - 1;
-    return (static_cast<int64>(slot_) << 54) | (fid & mask);
-  }
-
-  inline int64 convert_v2(int64 fid) {
-    static int64 mask = (static_cast<int64>(1) << 49) - 1;
-    return (static_cast<int64>(slot_) << 48) | (fid & mask);
-  }
-
   int slot_, fid_version_;
+  uint64_t mask_, bits_;
 };
 
-
 enum class VariantType { PBExampleBatch, PBExample };
 
 
@@ -114,9 +113,9 @@ class SwitchSlotBatchOp : public OpKernel {
     );
 
     for (int i = 0; i < features.size(); ++i) {
-      shared_meta_.emplace(std::piecewise_construct,
-                           std::forward_as_tuple(features[i]),
-                           std::forward_as_tuple(inplaces[i], slots[i]));
+      uint64_t slot = slots[i];
+      shared_meta_.emplace(features[i],
+                           SharedMeta{inplaces[i], slot << 54, slot << 48});
     }
 
     OP_REQUIRES_OK(ctx, ctx->GetAttr("suffix", &suffix_));
@@ -166,6 +165,33 @@ class SwitchSlotBatchOp : public OpKernel {
     out_variant_scalar() = *new_eb;
   }
 
+  // How the fids of a feature are switched: in place or into a new feature,
+  // to the slot bits of either fid version.
+  struct SharedMeta {
+    bool inplace;
+    uint64_t v1_bits;
+    uint64_t v2_bits;
+  };
+
+  // Switches the fids of `feature` into `out`, which may be `feature`.
+  static void switch_slot(const EFeature &feature, const SharedMeta &meta,
+                          EFeature *out) {
+    if (feature.has_fid_v1_list()) {
+      const auto &fids = feature.fid_v1_list().value();
+      auto *out_fids = out->mutable_fid_v1_list()->mutable_value();
+      out_fids->Resize(fids.size(), 0);
+      MaskFids(fids.data(), fids.size(), fid_v1_mask, meta.v1_bits,
+               out_fids->mutable_data());
+    }
+    if (feature.has_fid_v2_list()) {
+      const auto &fids = feature.fid_v2_list().value();
+      auto *out_fids = out->mutable_fid_v2_list()->mutable_value();
+      out_fids->Resize(fids.size(), 0);
+      MaskFids(fids.data(), fids.size(), fid_v2_mask, meta.v2_bits,
+               out_fids->mutable_data());
+    }
+  }
+
   Example *switch_slot(const Example &example, google::protobuf::Arena *arena) {
     auto *base = google::protobuf::Arena::CreateMessage<Example>(arena);
     base->CopyFrom(example);
@@ -173,45 +199,19 @@ class SwitchSlotBatchOp : public OpKernel {
       const auto &name = base->named_feature(i).name();
       auto it = shared_meta_.find(name);
       if (it != shared_meta_.end()) {
-        bool inplace = it->second.first;
-        uint64_t shared_slot = it->second.second;
+        const SharedMeta &meta = it->second;
         NamedFeature *named_feature = base->mutable_named_feature(i);
 
-        if (inplace) {
+        if (meta.inplace) {
           auto *feature = named_feature->mutable_feature();
-          if (feature->has_fid_v1_list()) {
-            const auto &size = feature->mutable_fid_v1_list()->value_size();
-            auto *data = feature->mutable_fid_v1_list()->mutable_value()->mutable_data();
-            for (int j = 0; j < size; ++j) {
-              data[j] = switch_slot_v1(data[j], shared_slot);
-            }
-          }
-
-          if (feature->has_fid_v2_list()) {
-            const auto &size = feature->mutable_fid_v2_list()->value_size();
-            auto *data = feature->mutable_fid_v2_list()->mutable_value()->mutable_data();
-            for (int j = 0; j < size; ++j) {
-              data[j] = switch_slot_v2(data[j], shared_slot);
-            }
-          }
+          switch_slot(*feature, meta, feature);
         } else {
           auto &feature = named_feature->feature();
           auto *additive_nf = base->add_named_feature();
           additive_nf->set_id(named_feature->id());
           additive_nf->set_name(name + "_" + suffix_);
           additive_nf->set_sorted_id(named_feature->sorted_id());
-          if (feature.has_fid_v1_list()) {
-            auto *fid_v1_list = additive_nf->mutable_feature()->mutable_fid_v1_list();
-            for (const auto &value : feature.fid_v1_list().value()) {
-              fid_v1_list->add_value(switch_slot_v1(value, shared_slot));
-            }
-          }
-          if (feature.has_fid_v2_list()) {
-            auto *fid_v2_list = additive_nf->mutable_feature()->mutable_fid_v2_list();
-            for (const auto &value : feature.fid_v2_list().value()) {
-              fid_v2_list->add_value(switch_slot_v2(value, shared_slot));
-            }
-          }
+          switch_slot(feature, meta, additive_nf->mutable_feature());
         }
       }
     }
@@ -227,46 +227,21 @@ class SwitchSlotBatchOp : public OpKernel {
       const auto &name = named_feature_list->name();
       auto it = shared_meta_.find(name);
       if (it != shared_meta_.end()) {
-        bool inplace = it->second.first;
-        uint64_t shared_slot = it->second.second;
-        if (inplace) {
+        const SharedMeta &meta = it->second;
+        if (meta.inplace) {
           for (int j = 0; j < named_feature_list->feature_size(); ++j) {
             auto *feature = named_feature_list->mutable_feature(j);
-            if (feature->has_fid_v1_list()) {
-              auto *values = named_feature_list->mutable_feature(j)->mutable_fid_v1_list()->mutable_value();
-              auto *data = values->mutable_data();
-              for (int k = 0; k < values->size(); ++k) {
-                data[k] = switch_slot_v1(data[k], shared_slot);
-              }
-            }
-            if (feature->has_fid_v2_list()) {
-              auto *values = feature->mutable_fid_v2_list()->mutable_value();
-              auto *data = values->mutable_data();
-              for (int k = 0; k < values->size(); ++k) {
-                data[k] = switch_slot_v2(data[k], shared_slot);
-              }
-            }
+            switch_slot(*feature, meta, feature);
           }
         } else {
           auto *additive_nfl = base->add_named_feature_list();
           additive_nfl->set_id(named_feature_list->id());
           additive_nfl->set_name(name + "_" + suffix_);
           additive_nfl->set_type(named_feature_list->type());
-          for (int j = 0; j < named_feature_list->feature_size(); ++j) {
-            auto *feature = additive_nfl->add_feature();
-            if (named_feature_list->feature(j).has_fid_v1_list()) {
-              auto *fid_v1_list = feature->mutable_fid_v1_list();
-              for (const auto &value : named_feature_list->feature(j).fid_v1_list().value()) {
-                fid_v1_list->add_value(switch_slot_v1(value, shared_slot));
-              }
-            }
-
-            if (named_feature_list->feature(j).has_fid_v2_list()) {
-              auto *fid_v2_list = feature->mutable_fid_v2_list();
-              for (const auto &value : named_feature_list->feature(j).fid_v2_list().value()) {
-                fid_v2_list->add_value(switch_slot_v2(value, shared_slot));
-              }
-            }
+          additive_nfl->mutable_feature()->Reserve(
+              named_feature_list->feature_size());
+          for (const auto &feature : named_feature_list->feature()) {
+            switch_slot(feature, meta, additive_nfl->add_feature());
           }
         }
       }
@@ -277,7 +252,7 @@ class SwitchSlotBatchOp : public OpKernel {
 
   VariantType variant_type_;
   std::string suffix_;
-  std::unordered_map<std::string, std::pair<bool, uint64_t>> shared_meta_;
+  absl::flat_hash_map<std::string, SharedMeta> shared_meta_;
 };
 
 class FeatureCombineOp : public OpKernel {
@@ -289,6 +264,7 @@ class FeatureCombineOp : public OpKernel {
     OP_REQUIRES_OK(ctx, ctx->GetAttr("slot", &slot_));
 
     OP_REQUIRES_OK(ctx, ctx->GetAttr("fid_version", &fid_version_));
+    SwitchSlotMask(slot_, fid_version_, &mask_, &bits_);
   }
 
   void Compute(OpKernelContext *context) override {
@@ -320,6 +296,8 @@ class FeatureCombineOp : public OpKernel {
       for (int i = 0; i < batch_splits_src1.size(); ++i) {
         DCHECK_EQ(batch_splits_src1(i), batch_splits_src2(i));
       }
+      // The sequences are those of the inputs.
+      nested_splits_sink.set(src_idx, rt_nested_splits_src1_in[src_idx]);
       src_idx++;
     }
 
@@ -338,12 +316,9 @@ class FeatureCombineOp : public OpKernel {
     auto ins_splits = ins_splits_sink->flat<int64>();
     ins_splits(0) = 0;
     for (int i = 0; i < batch_size; ++i) {
-      int src1_start = ins_splits_src1(i);
-      int src1_end = ins_splits_src1(i + 1);
-      int src2_start = ins_splits_src2(i);
-      int src2_end = ins_splits_src2(i + 1);
-      ins_splits(i + 1) =
-          ins_splits(i) + (src1_end - src1_start) * (src2_end - src2_start);
+      int64 src1_size = ins_splits_src1(i + 1) - ins_splits_src1(i);
+      int64 src2_size = ins_splits_src2(i + 1) - ins_splits_src2(i);
+      ins_splits(i + 1) = ins_splits(i) + src1_size * src2_size;
     }
 
     Tensor *dense_values_sink;
@@ -352,37 +327,34 @@ class FeatureCombineOp : public OpKernel {
                                                      &dense_values_sink));
     auto dense_values = dense_values_sink->flat<int64>();
 
-    int idx = 0;
-    for (int i = 0; i < batch_size; ++i) {
-      int src1_start = ins_splits_src1(i);
-      int src1_end = ins_splits_src1(i + 1);
-      int src2_start = ins_splits_src2(i);
-      int src2_end = ins_splits_src2(i + 1);
-
-      for (int j = src1_start; j < src1_end; ++j) {
-        int64 fid1 = rt_dense_values_src1(j);
-        for (int k = src2_start; k < src2_end; ++k) {
-          int64 fid2 = rt_dense_values_src2(k);
-          if (fid_version_ == 1) {
-            dense_values(idx++) = convert_v1(combine(fid1, fid2));
-          } else {
-            dense_values(idx++) = convert_v2(combine(fid1, fid2));
+    // Every row has its place in the output from the splits, so the rows are
+    // combined in parallel, and the slot is switched once per row range.
+    auto combine_rows = [&](int64 begin, int64 end) {
+      int64 idx = ins_splits(begin);
+      for (int64 i = begin; i < end; ++i) {
+        for (int64 j = ins_splits_src1(i); j < ins_splits_src1(i + 1); ++j) {
+          int64 fid1 = rt_dense_values_src1(j);
+          for (int64 k = ins_splits_src2(i); k < ins_splits_src2(i + 1); ++k) {
+            dense_values(idx++) = combine(fid1, rt_dense_values_src2(k));
           }
         }
       }
+      int64 *values = dense_values.data() + ins_splits(begin);
+      MaskFids(reinterpret_cast<const uint64_t *>(values),
+               ins_splits(end) - ins_splits(begin), mask_, bits_, values);
+    };
+    if (batch_size > 0) {
+      const int64 cost_per_row =
+          kCostPerFid * std::max<int64>(1, ins_splits(batch_size) / batch_size);
+      auto workers =
+          context->device()->tensorflow_cpu_worker_threads()->workers;
+      workers->ParallelFor(batch_size, cost_per_row, combine_rows);
     }
   }
 
  private:
-  inline int64 convert_v1(int64 fid) {
-    static int64 mask = (static_cast<int64>(1) << 55) - 1;
-    return (static_cast<int64>(slot_) << 54) | (fid & mask);
-  }
-
-  inline int64 convert_v2(int64 fid) {
-    static int64 mask = (static_cast<int64>(1) << 49) - 1;
-    return (static_cast<int64>(slot_) << 48) | (fid & mask);
-  }
+  // Roughly the cycles to combine two fids and switch the slot of the result.
+  static constexpr int64 kCostPerFid = 10;
 
   int64 combine(int64 fid1, int64 fid2) {
     auto mu = absl::int128(fid1) * absl::int128(fid2);
@@ -394,6 +366,7 @@ class FeatureCombineOp : public OpKernel {
   }
 
   int slot_, fid_version_;
+  uint64_t mask_, bits_;
 };
 
 namespace {
@@ -12,7 +12,11 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <atomic>
 #include <bitset>
+
+#include "absl/memory/memory.h"
+#include "absl/strings/str_cat.h"
 #include "monolith/native_training/data/training_instance/cc/pb_variant.h"
 #include "monolith/native_training/data/training_instance/cc/reader_util.h"
 #include "monolith/native_training/data/kernels/df_resource_kernel.h"
@@ -149,8 +153,11 @@ class SplitFlowDatasetOp::Dataset : public DatasetBase {
 
     void CancelThreads() TF_LOCKS_EXCLUDED(mu_) {
       cancellation_manager_->StartCancel();
-      mutex_lock l(*mu_);
       cancelled_ = true;
+      mutex_lock l(*mu_);
+      for (auto kv : df_to_queue_) {
+        kv.second->Wake();
+      }
     }
 
     Status Initialize(IteratorContext *ctx) override {
@@ -167,19 +174,18 @@ class SplitFlowDatasetOp::Dataset : public DatasetBase {
       Status s = dataset()->input_->MakeIterator(IteratorContext(params), this,
                                                  prefix(), &input_impl_);
 
-      std::function<Status(QueueResource **)> creator =
-          [this](QueueResource **queue) -> Status {
-        *queue = new QueueResource(dataset()->max_queue_size_);
-        return Status::OK();
-      };
-
       {
         mutex_lock input_l(input_mu_);
         for (size_t i = 0; i < dataset()->data_flows_.size(); ++i) {
           // 1) get data_flow_name and hash it into uint32
           std::string data_flows_name = dataset()->data_flows_[i];
-          uint32 df_code = static_cast<uint32>(::tensorflow::monolith_tf::internal::java_hash_code(data_flows_name));
-          df_code = df_code << 8;
+          uint32 df_code = DataFlowCode(data_flows_name);
+          std::function<Status(QueueResource **)> creator =
+              [this, &data_flows_name](QueueResource **queue) -> Status {
+            *queue = new QueueResource(dataset()->max_queue_size_,
+                                       data_flows_name);
+            return Status::OK();
+          };
 
           // 2) get resource
           QueueResource *resource = nullptr;
@@ -211,18 +217,10 @@ class SplitFlowDatasetOp::Dataset : public DatasetBase {
         mutex_lock output_l(*output_mu_);
         out_tensors->reserve(1);
 
+        // The prefetch thread pushes an end of sequence to every queue once
+        // the input is exhausted, so only a cancellation stops the wait.
         Item item;
-        bool poped = false;
-        while (!poped) {
-          // the queue is empty and the fetch threas is cancelled or finished
-          if (cancelled_ || prefetch_thread_finished_) {
-            out_tensors->clear();
-            *end_of_sequence = true;
-            return Status::OK();
-          }
-          poped = queue_->TryPop(item, 100);
-        }
-
+        bool poped = queue_->Pop(&item, &cancelled_);
         if (!poped || item.end_of_sequence) {
           out_tensors->clear();
           *end_of_sequence = true;
@@ -243,13 +241,67 @@ class SplitFlowDatasetOp::Dataset : public DatasetBase {
       return model::MakeUnknownRatioNode(std::move(args));
     }
 
+    // The iterator of data flow 0 reads the input for all the flows, so it
+    // saves the input with the items read and not handed out yet of every
+    // flow: the ones in its queue and the one the prefetch thread waits to
+    // push. The other iterators have no state of their own.
     Status SaveInternal(SerializationContext *ctx,
                         IteratorStateWriter *writer) override {
+      if (dataset()->index_ != 0) {
+        return Status::OK();
+      }
+      mutex_lock output_l(*output_mu_);
+      mutex_lock prefetch_l(prefetch_mu_);
+      TF_RETURN_IF_ERROR(SaveInput(ctx, writer, input_impl_));
+      for (size_t i = 0; i < dataset()->data_flows_.size(); ++i) {
+        uint32 df_code = DataFlowCode(dataset()->data_flows_[i]);
+        QueueResource *queue = df_to_queue_[df_code];
+        std::vector<Item> items;
+        // The other flows keep popping their queues, so copy them in place
+        // rather than popping and pushing them back.
+        for (Item &item : queue->Snapshot()) {
+          // The end of the input is read again from the restored input.
+          if (!item.end_of_sequence) {
+            items.push_back(std::move(item));
+          }
+        }
+        if (pending_ != nullptr && ItemCode(*pending_) == df_code) {
+          items.push_back(*pending_);
+        }
+        TF_RETURN_IF_ERROR(::tensorflow::monolith_tf::WriteItems(
+            writer, full_name(absl::StrCat("items_", i)), items));
+      }
       return Status::OK();
     }
 
     Status RestoreInternal(IteratorContext *ctx,
                            IteratorStateReader *reader) override {
+      if (dataset()->index_ != 0) {
+        return Status::OK();
+      }
+      mutex_lock output_l(*output_mu_);
+      mutex_lock prefetch_l(prefetch_mu_);
+      TF_RETURN_IF_ERROR(RestoreInput(ctx, reader, input_impl_));
+      pending_.reset();
+      for (size_t i = 0; i < dataset()->data_flows_.size(); ++i) {
+        std::vector<Item> items;
+        TF_RETURN_IF_ERROR(::tensorflow::monolith_tf::ReadItems(
+            reader, full_name(absl::StrCat("items_", i)), &items));
+        QueueResource *queue =
+            df_to_queue_[DataFlowCode(dataset()->data_flows_[i])];
+        queue->PopAll();
+        for (Item &item : items) {
+          if (pending_ == nullptr && queue->TryPush(item, 0)) {
+            continue;
+          }
+          if (pending_ != nullptr) {
+            return errors::FailedPrecondition(
+                "The queue of ", dataset()->data_flows_[i],
+                " is smaller than the checkpointed one");
+          }
+          pending_ = absl::make_unique<Item>(std::move(item));
+        }
+      }
       return Status::OK();
     }
 
@@ -258,14 +310,18 @@ class SplitFlowDatasetOp::Dataset : public DatasetBase {
     const std::shared_ptr<mutex> output_mu_;
     std::function<void()> deregister_fn_;
     std::unique_ptr<CancellationManager> cancellation_manager_;
-    bool cancelled_ TF_GUARDED_BY(*mu_) = false;
+    std::atomic<bool> cancelled_{false};
     bool prefetch_thread_started_ TF_GUARDED_BY(*mu_) = false;
-    bool prefetch_thread_finished_ TF_GUARDED_BY(*mu_) = false;
 
     uint32 data_flow_;
     std::string name_;
     QueueResource *queue_;
     std::unique_ptr<IteratorBase> input_impl_;
+    // Held by the prefetch thread while it reads from the input and pushes
+    // the item, so that checkpoints see no item in flight.
+    mutex prefetch_mu_;
+    // The item the prefetch thread read and has not pushed yet.
+    std::unique_ptr<Item> pending_ TF_GUARDED_BY(prefetch_mu_);
     std::unique_ptr<Thread> prefetch_thread_;
     std::unordered_map<uint32, QueueResource *> df_to_queue_;
 
@@ -285,56 +341,57 @@ class SplitFlowDatasetOp::Dataset : public DatasetBase {
 
     void PrefetchThread(const std::shared_ptr<IteratorContext> &ctx,
                         std::string name) {
-      while (true) {
+      while (!cancelled_) {
+        std::unique_ptr<Item> end;
         {
-          mutex_lock l(*mu_);
-          if (cancelled_) {
-            prefetch_thread_finished_ = true;
-            break;
-          }
-        }
-
-        if (!prefetch_thread_finished_) {
-          Item item;
-          input_impl_->GetNext(ctx.get(), &item.out_tensors,
-                               &item.end_of_sequence);
-
-          if (item.end_of_sequence) {
-            mutex_lock l(*mu_);
-            item.end_of_sequence = true;
-            if (!cancelled_ && !prefetch_thread_finished_) {
-              for (auto kv : df_to_queue_) {
-                kv.second->Push(item);
-              }
-            }
-            break;
-          } else {
-            uint32 code;
-            if (dataset()->variant_type_ == VariantType::PBInstance) {
-              code = item.out_tensors[0]
-                         .scalar<Variant>()()
-                         .get<Instance>()
-                         ->data_source_key();
+          mutex_lock prefetch_l(prefetch_mu_);
+          if (pending_ == nullptr) {
+            auto item = absl::make_unique<Item>();
+            input_impl_->GetNext(ctx.get(), &item->out_tensors,
+                                 &item->end_of_sequence);
+            if (item->end_of_sequence) {
+              end = std::move(item);
             } else {
-              code = item.out_tensors[0]
-                         .scalar<Variant>()()
-                         .get<Example>()
-                         ->data_source_key();
+              pending_ = std::move(item);
             }
+          }
 
-            bool pushed = false;
-            do {
-              if (cancelled_ || prefetch_thread_finished_) {
-                break;
-              }
-              pushed = df_to_queue_[code]->TryPush(item);
-            } while (!pushed);
+          // Gives checkpoints a chance to take the lock between attempts.
+          if (pending_ != nullptr &&
+              df_to_queue_[ItemCode(*pending_)]->TryPush(*pending_)) {
+            pending_.reset();
+          }
+        }
+
+        if (end != nullptr) {
+          for (auto kv : df_to_queue_) {
+            kv.second->Push(*end, &cancelled_);
           }
-        } else {
           break;
         }
       }
     }
+
+    static uint32 DataFlowCode(const std::string &name) {
+      uint32 df_code = static_cast<uint32>(
+          ::tensorflow::monolith_tf::internal::java_hash_code(name));
+      return df_code << 8;
+    }
+
+    // The code of the data flow an item goes to.
+    uint32 ItemCode(const Item &item) const {
+      if (dataset()->variant_type_ == VariantType::PBInstance) {
+        return item.out_tensors[0]
+            .scalar<Variant>()()
+            .get<Instance>()
+            ->data_source_key();
+      } else {
+        return item.out_tensors[0]
+            .scalar<Variant>()()
+            .get<Example>()
+            ->data_source_key();
+      }
+    }
   };
 
   const DatasetBase *const input_;
@@ -183,14 +183,18 @@ class TransformDatasetOp::Dataset : public DatasetBase {
       return model::MakeUnknownRatioNode(std::move(args));
     }
 
+    // Transforms are applied element by element, so the position of the
+    // input is all there is to save.
     Status SaveInternal(SerializationContext *ctx,
                         IteratorStateWriter *writer) override {
-      return Status::OK();
+      tensorflow::mutex_lock l(mu_);
+      return SaveInput(ctx, writer, input_impl_);
     }
 
     Status RestoreInternal(IteratorContext *ctx,
                            IteratorStateReader *reader) override {
-      return Status::OK();
+      tensorflow::mutex_lock l(mu_);
+      return RestoreInput(ctx, reader, input_impl_);
     }
 
    private:
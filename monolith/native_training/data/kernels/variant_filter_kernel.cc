@@ -32,6 +32,7 @@
 #include "tensorflow/core/framework/shape_inference.h"
 #include "tensorflow/core/framework/tensor.h"
 #include "tensorflow/core/framework/variant.h"
+#include "tensorflow/core/platform/threadpool.h"
 #include "third_party/nlohmann/json.hpp"
 
 namespace tensorflow {
@@ -100,6 +101,10 @@ class SetFilterOp : public OpKernel {
 
       OP_REQUIRES_OK(context, mapper_->RegisterValidIds(valid_ids));
     }
+
+    filter_ = std::make_unique<InstanceFilter>(
+        filter_fids_, has_fids_, select_fids_, has_actions_, req_time_min_,
+        select_slots_);
   }
 
   ~SetFilterOp() override { mapper_->Unref(); }
@@ -110,23 +115,32 @@ class SetFilterOp : public OpKernel {
     OP_REQUIRES_OK(
         context,
         context->allocate_output(0, input_tensor.shape(), &output_tensor));
-    auto output = output_tensor->scalar<bool>();
-    output() = IsInstanceOfInterest(input_tensor);
+    auto input = input_tensor.flat<Variant>();
+    auto output = output_tensor->flat<bool>();
+    auto filter_fn = [&](int64 begin, int64 end) {
+      for (int64 i = begin; i < end; ++i) {
+        output(i) = IsInstanceOfInterest(input(i));
+      }
+    };
+    // A batch of variants is filtered in parallel.
+    if (input.size() > 1) {
+      auto workers =
+          context->device()->tensorflow_cpu_worker_threads()->workers;
+      workers->ParallelFor(input.size(), kCostPerInstance, filter_fn);
+    } else {
+      filter_fn(0, input.size());
+    }
   }
 
  private:
-  bool IsInstanceOfInterest(const Tensor &input_tensor) {
-    auto input = input_tensor.scalar<Variant>();
+  // Roughly the cycles to scan the fids of a sample.
+  static constexpr int64 kCostPerInstance = 2000;
+
+  bool IsInstanceOfInterest(const Variant &variant) const {
     if (variant_type_ == "instance") {
-      const auto *instance = input().get<Instance>();
-      return monolith_tf::IsInstanceOfInterest(
-          *instance, filter_fids_, has_fids_, select_fids_, has_actions_,
-          req_time_min_, select_slots_);
+      return filter_->IsInstanceOfInterest(*variant.get<Instance>());
     } else {
-      const auto *example = input().get<Example>();
-      return monolith_tf::IsInstanceOfInterest(
-          *example, filter_fids_, has_fids_, select_fids_, has_actions_,
-          req_time_min_, select_slots_);
+      return filter_->IsInstanceOfInterest(*variant.get<Example>());
     }
   }
 
@@ -137,6 +151,7 @@ class SetFilterOp : public OpKernel {
   std::string variant_type_ = "instance";
   int req_time_min_;
   std::set<uint32_t> select_slots_;
+  std::unique_ptr<InstanceFilter> filter_;
   FeatureNameMapperTfBridge *mapper_;
 };
 
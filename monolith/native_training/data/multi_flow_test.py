@@ -120,6 +120,28 @@ class MultiFlowTest(tf.test.TestCase):
       cnt += 1
     self.assertEqual(cnt, 8)
 
+  def test_weighted_data_flow(self):
+    ofile = os.path.join(MODEL_DIR, 'data.pb')
+    dataset = PBDataset(file_name=ofile,
+                        lagrangex_header=True,
+                        input_pb_type=PbType.INSTANCE,
+                        output_pb_type=PbType.INSTANCE)
+    flows = [
+        dataset.split_flow(data_flow=device_types,
+                           index=i,
+                           variant_type='instance')
+        for i in range(len(device_types))
+    ]
+    dataset = flows[0].merge_flow(dataset_to_merge=flows[1:],
+                                  variant_type='instance',
+                                  weights=[1.0, 2.0, 0.5])
+
+    # The weights only change the order, every instance is merged.
+    cnt = 0
+    for _ in dataset:
+      cnt += 1
+    self.assertEqual(cnt, NUM_INSTANCE)
+
 
 if __name__ == "__main__":
   tf.test.main()
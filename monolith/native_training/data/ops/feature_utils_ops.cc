@@ -41,7 +41,11 @@ REGISTER_OP("SetFilter")
     .Attr("req_time_min: int")
     .Attr("select_slots: list(int)")
     .Attr("variant_type: string")
-    .Output("output: bool");
+    .Output("output: bool")
+    .SetShapeFn([](shape_inference::InferenceContext *ctx) {
+      ctx->set_output(0, ctx->input(0));
+      return Status::OK();
+    });
 
 REGISTER_OP("FeatureValueFilter")
     .Input("input: variant")
@@ -128,6 +128,7 @@ REGISTER_OP("MergeFlowDataset")
     .Attr("data_flow: list(string)")
     .Attr("max_queue_size: int")
     .Attr("variant_type: string")
+    .Attr("weights: list(float) = []")
     .Attr("N: int >= 1")
     .Output("handle: variant")
     .SetDoNotOptimize()
@@ -0,0 +1,134 @@
+# Copyright 2022 ByteDance and/or its affiliates.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+from typing import List
+
+import tensorflow as tf
+
+from monolith.native_training.data.feature_utils import string_to_variant
+from monolith.native_training.data.parsers import parse_example_batch_list
+from idl.matrix.proto.example_pb2 import ExampleBatch, FeatureListType
+from idl.matrix.proto.line_id_pb2 import LineId
+
+BATCH_SIZE = 4
+
+NAMES = [
+    'f_user_id', 'f_item_id', 'f_shared', 'f_dense', 'uid', 'req_time',
+    'sample_rate'
+]
+SHAPES = [-1, -1, -1, 2, 1, 1, 1]
+DTYPES = [
+    tf.int64, tf.int64, tf.int64, tf.float32, tf.int64, tf.int64, tf.float32
+]
+EXTRA_FEATURES = ['uid', 'req_time', 'sample_rate']
+LABEL_CONFIG = '1,2:3;4:'
+
+
+def add_fid_list(example_batch: ExampleBatch,
+                 name: str,
+                 slot: int,
+                 num: int,
+                 shared: bool = False):
+  named_feature_list = example_batch.named_feature_list.add()
+  named_feature_list.id = slot
+  named_feature_list.name = name
+  if shared:
+    named_feature_list.type = FeatureListType.SHARED
+  for i in range(1 if shared else num):
+    feature = named_feature_list.feature.add()
+    feature.fid_v2_list.value.extend(
+        [(slot << 48) | (i * 10 + j) for j in range(i % 3 + 1)])
+
+
+def add_float_list(example_batch: ExampleBatch, name: str,
+                   values: List[List[float]]):
+  named_feature_list = example_batch.named_feature_list.add()
+  named_feature_list.name = name
+  for value in values:
+    named_feature_list.feature.add().float_list.value.extend(value)
+
+
+def add_line_id(example_batch: ExampleBatch, num: int):
+  named_feature_list = example_batch.named_feature_list.add()
+  named_feature_list.name = '__LINE_ID__'
+  for i in range(num):
+    line_id = LineId(uid=100 + i,
+                     req_time=1000 + i,
+                     sample_rate=0.5,
+                     actions=[i % 5])
+    named_feature_list.feature.add().bytes_list.value.append(
+        line_id.SerializeToString())
+
+
+def sub_batches() -> List[ExampleBatch]:
+  # Its batch size is overridden by the last one set.
+  first = ExampleBatch(batch_size=2)
+  add_fid_list(first, 'f_shared', 3, BATCH_SIZE, shared=True)
+  add_float_list(first, 'sample_rate', [[0.1 * i] for i in range(BATCH_SIZE)])
+
+  # No batch size. The line id fills the label and the extra fields, which
+  # the first and the third batches also have lists of.
+  second = ExampleBatch()
+  add_fid_list(second, 'f_user_id', 1, BATCH_SIZE)
+  add_line_id(second, BATCH_SIZE)
+  add_fid_list(second, 'f_unused', 7, BATCH_SIZE)
+
+  third = ExampleBatch(batch_size=BATCH_SIZE)
+  add_fid_list(third, 'f_item_id', 2, BATCH_SIZE)
+  # Individual this time, after the shared list of the first batch.
+  add_fid_list(third, 'f_shared', 4, BATCH_SIZE)
+  add_float_list(third, 'f_dense', [[i, -i] for i in range(BATCH_SIZE)])
+  add_float_list(third, 'sample_rate', [[0.9] for _ in range(BATCH_SIZE)])
+  return [first, second, third]
+
+
+class ParseExampleBatchListTest(tf.test.TestCase):
+
+  def parse(self, example_batches: List[ExampleBatch]):
+    variants = [
+        string_to_variant(tf.constant(eb.SerializeToString()),
+                          variant_type='examplebatch')
+        for eb in example_batches
+    ]
+    return parse_example_batch_list(variants,
+                                    label_config=LABEL_CONFIG,
+                                    names=NAMES,
+                                    shapes=SHAPES,
+                                    dtypes=DTYPES,
+                                    extra_features=EXTRA_FEATURES)
+
+  def test_same_as_merged(self):
+    example_batches = sub_batches()
+    merged = ExampleBatch()
+    for example_batch in example_batches:
+      merged.MergeFrom(example_batch)
+    self.assertEqual(merged.batch_size, BATCH_SIZE)
+
+    expected = self.evaluate(self.parse([merged]))
+    parsed = self.evaluate(self.parse(example_batches))
+    self.assertCountEqual(parsed.keys(), expected.keys())
+    self.assertIn('label', parsed)
+    for name, value in expected.items():
+      if isinstance(value, tf.compat.v1.ragged.RaggedTensorValue):
+        self.assertLen(value.row_splits, BATCH_SIZE + 1, name)
+        self.assertAllEqual(parsed[name].row_splits, value.row_splits, name)
+        self.assertAllEqual(parsed[name].values, value.values, name)
+      else:
+        self.assertLen(value, BATCH_SIZE, name)
+        self.assertAllEqual(parsed[name], value, name)
+
+
+if __name__ == '__main__':
+  tf.compat.v1.disable_eager_execution()
+  tf.test.main()
@@ -27,6 +27,17 @@ struct DataFormatOptions {
   bool kafka_dump = false;
 };
 
+// How a data file is compressed.
+enum InputCompressType {
+  UNKNOW = 0,
+  NO = 1,
+  SNAPPY = 2,
+  ZSTD = 3,
+  ZLIB = 4,
+  GZIP = 5,
+  MAX = 6
+};
+
 inline std::ostream& operator<<(std::ostream& os,
                                 const DataFormatOptions& opts) {
   return os << "lagrangex_header: " << opts.lagrangex_header
@@ -14,6 +14,7 @@
 
 #include <vector>
 
+#include "absl/strings/str_cat.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "monolith/native_training/data/training_instance/cc/data_reader.h"
@@ -25,8 +26,8 @@ namespace {
 
 class ReadWriteTest : public ::testing::TestWithParam<DataFormatOptions> {};
 
-Status ReadBytes(BaseStreamReaderTmpl<absl::string_view>* reader,
-                 absl::string_view* out) {
+template <typename T>
+Status ReadBytes(BaseStreamReaderTmpl<T>* reader, T* out) {
   uint8_t pb_type;
   uint32_t data_source_key;
   return reader->ReadPBBytes(&pb_type, &data_source_key, out);
@@ -48,6 +49,80 @@ TEST_P(ReadWriteTest, Basic) {
   }
 }
 
+class FileReadWriteTest : public ::testing::TestWithParam<InputCompressType> {
+};
+
+TEST_P(FileReadWriteTest, RoundTrip) {
+  DataFormatOptions options;
+  options.lagrangex_header = true;
+  const std::string path =
+      absl::StrCat(::testing::TempDir(), "/file_read_write_", GetParam());
+  std::unique_ptr<WritableFile> f;
+  ASSERT_TRUE(Env::Default()->NewWritableFile(path, &f).ok());
+  // Records span several blocks.
+  FileStreamWriter writer(options, std::move(f), GetParam(),
+                          /*block_size=*/100);
+  for (int i = 0; i < 64; ++i) {
+    EXPECT_TRUE(writer.WriteRecord(std::string(i * 7, 'a' + i % 26)).ok());
+  }
+  auto status = writer.Close();
+  ASSERT_TRUE(status.ok()) << status;
+  EXPECT_FALSE(writer.WriteRecord("a").ok());
+
+  std::unique_ptr<RandomAccessFile> rf;
+  ASSERT_TRUE(Env::Default()->NewRandomAccessFile(path, &rf).ok());
+  FileStreamReader reader(options, std::move(rf), GetParam(),
+                          /*buffer_size=*/1024);
+  tstring out;
+  for (int i = 0; i < 64; ++i) {
+    status = ReadBytes(&reader, &out);
+    ASSERT_TRUE(status.ok()) << status;
+    EXPECT_EQ(std::string(out), std::string(i * 7, 'a' + i % 26)) << i;
+  }
+  EXPECT_FALSE(ReadBytes(&reader, &out).ok());
+}
+
+TEST_P(FileReadWriteTest, FlushAndSyncMidStream) {
+  DataFormatOptions options;
+  const std::string path =
+      absl::StrCat(::testing::TempDir(), "/file_flush_sync_", GetParam());
+  std::unique_ptr<WritableFile> f;
+  ASSERT_TRUE(Env::Default()->NewWritableFile(path, &f).ok());
+  FileStreamWriter writer(options, std::move(f), GetParam(),
+                          /*block_size=*/100);
+  uint64 flushed_size = 0;
+  for (int i = 0; i < 96; ++i) {
+    EXPECT_TRUE(writer.WriteRecord(std::string(i * 5, 'a' + i % 26)).ok());
+    // Blocks written after a flush reuse the spare one.
+    if (i == 31) {
+      auto status = writer.Flush();
+      ASSERT_TRUE(status.ok()) << status;
+      ASSERT_TRUE(Env::Default()->GetFileSize(path, &flushed_size).ok());
+      EXPECT_GT(flushed_size, 0);
+    } else if (i == 63) {
+      auto status = writer.Sync();
+      ASSERT_TRUE(status.ok()) << status;
+      uint64 synced_size;
+      ASSERT_TRUE(Env::Default()->GetFileSize(path, &synced_size).ok());
+      EXPECT_GT(synced_size, flushed_size);
+    }
+  }
+  auto status = writer.Close();
+  ASSERT_TRUE(status.ok()) << status;
+
+  std::unique_ptr<RandomAccessFile> rf;
+  ASSERT_TRUE(Env::Default()->NewRandomAccessFile(path, &rf).ok());
+  FileStreamReader reader(options, std::move(rf), GetParam(),
+                          /*buffer_size=*/1024);
+  tstring out;
+  for (int i = 0; i < 96; ++i) {
+    status = ReadBytes(&reader, &out);
+    ASSERT_TRUE(status.ok()) << status;
+    EXPECT_EQ(std::string(out), std::string(i * 5, 'a' + i % 26)) << i;
+  }
+  EXPECT_FALSE(ReadBytes(&reader, &out).ok());
+}
+
 std::vector<DataFormatOptions> GenerateOptions() {
   std::vector<DataFormatOptions> res;
   for (int i = 0; i < 16; ++i) {
@@ -61,8 +136,71 @@ std::vector<DataFormatOptions> GenerateOptions() {
   return res;
 }
 
+// Reads instances until the end of the stream.
+int ReadAll(PBIterator* it) {
+  int n = 0;
+  ::parser::proto::Instance instance;
+  uint64 offset = it->GetOffset();
+  while (it->next(&offset, &instance).ok()) {
+    offset = it->GetOffset();
+    ++n;
+  }
+  return n;
+}
+
+TEST(ExampleBatchIteratorTest, ResumeInsideBatch) {
+  DataFormatOptions options;
+  std::string s;
+  StringStreamWriter writer(options, &s);
+  ::monolith::io::proto::ExampleBatch batch;
+  batch.set_batch_size(3);
+  std::string serialized = batch.SerializeAsString();
+  std::vector<uint64> batch_offsets;
+  for (int i = 0; i < 2; ++i) {
+    batch_offsets.push_back(s.size());
+    EXPECT_TRUE(writer.WriteRecord(serialized).ok());
+  }
+  auto make_iterator = [&options, &s]() {
+    return std::make_unique<ExampleBatchIterator>(
+        std::make_unique<StringStreamReader<tstring>>(options, tstring(s)),
+        PRUNING_RAW_FEATURE, nullptr);
+  };
+
+  auto it = make_iterator();
+  ::parser::proto::Instance instance;
+  uint64 offset = 0, position;
+  int64 consumed;
+  it->GetPosition(&position, &consumed);
+  EXPECT_EQ(position, 0);
+  EXPECT_EQ(consumed, 0);
+  for (int i = 0; i < 2; ++i) {
+    ASSERT_TRUE(it->next(&offset, &instance).ok());
+    offset = it->GetOffset();
+  }
+  it->GetPosition(&position, &consumed);
+  EXPECT_EQ(position, batch_offsets[0]);
+  EXPECT_EQ(consumed, 2);
+
+  auto restored = make_iterator();
+  ASSERT_TRUE(restored->SetPosition(position, consumed).ok());
+  EXPECT_EQ(ReadAll(restored.get()), 4);
+
+  // A whole batch is resumed from the next one.
+  ASSERT_TRUE(it->next(&offset, &instance).ok());
+  it->GetPosition(&position, &consumed);
+  EXPECT_EQ(position, batch_offsets[1]);
+  EXPECT_EQ(consumed, 0);
+  restored = make_iterator();
+  ASSERT_TRUE(restored->SetPosition(position, consumed).ok());
+  EXPECT_EQ(ReadAll(restored.get()), 3);
+
+  EXPECT_FALSE(make_iterator()->SetPosition(batch_offsets[0], 4).ok());
+}
+
 INSTANTIATE_TEST_SUITE_P(ReadWriteTestAll, ReadWriteTest,
                          testing::ValuesIn(GenerateOptions()));
+INSTANTIATE_TEST_SUITE_P(FileReadWriteTestAll, FileReadWriteTest,
+                         testing::Values(NO, SNAPPY, ZSTD, ZLIB, GZIP));
 
 }  // namespace
 }  // namespace monolith_tf
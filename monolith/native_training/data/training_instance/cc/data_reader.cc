@@ -672,6 +672,19 @@ Status PBIterator::SetOffset(uint64 *offset) {
   return reader_->SetOffset(offset);
 }
 
+void PBIterator::GetPosition(uint64 *offset, int64 *consumed) {
+  *offset = reader_->GetOffset();
+  *consumed = 0;
+}
+
+Status PBIterator::SetPosition(uint64 offset, int64 consumed) {
+  if (consumed != 0) {
+    return errors::InvalidArgument(
+        "Records are not split, while the position consumed ", consumed);
+  }
+  return reader_->SetOffset(&offset);
+}
+
 ExampleBatchIterator::ExampleBatchIterator(
     std::unique_ptr<BaseStreamReader> reader,
     FeaturePruningType feature_pruning_type, FeatureNameMapper *mapper)
@@ -685,14 +698,21 @@ Status ExampleBatchIterator::next_internal(uint64 *offset) {
     index_++;
     return Status::OK();
   }
+  return ReadBatch(offset);
+}
 
+Status ExampleBatchIterator::ReadBatch(uint64 *offset) {
   profiler::TraceMe activity([]() { return "ReadAndDeserialize"; });
   uint8_t pb_type;
   uint32_t data_source_key;
   tstring buf;
   reader_->SetOffset(offset);
+  batch_offset_ = *offset;
   arena_ = std::make_unique<google::protobuf::Arena>();
   cur_ = google::protobuf::Arena::CreateMessage<ExampleBatch>(arena_.get());
+  // Nothing of a batch that fails to parse is consumed.
+  index_ = 0;
+  batch_size_ = 0;
 
   TF_RETURN_IF_ERROR(reader_->ReadPBBytes(&pb_type, &data_source_key, &buf));
   bool ok = cur_->ParseFromArray(buf.data(), buf.size());
@@ -702,12 +722,37 @@ Status ExampleBatchIterator::next_internal(uint64 *offset) {
   if (!ok) {
     return errors::FailedPrecondition("Failed to parse the ExampleBatch.");
   } else {
-    index_ = 0;
     batch_size_ = cur_->batch_size();
     return Status::OK();
   }
 }
 
+void ExampleBatchIterator::GetPosition(uint64 *offset, int64 *consumed) {
+  if (index_ < batch_size_ - 1) {
+    *offset = batch_offset_;
+    *consumed = index_ + 1;
+  } else {
+    *offset = reader_->GetOffset();
+    *consumed = 0;
+  }
+}
+
+Status ExampleBatchIterator::SetPosition(uint64 offset, int64 consumed) {
+  if (consumed == 0) {
+    index_ = 0;
+    batch_size_ = 0;
+    return reader_->SetOffset(&offset);
+  }
+  TF_RETURN_IF_ERROR(ReadBatch(&offset));
+  if (consumed > batch_size_) {
+    return errors::InvalidArgument("The batch at offset ", offset, " has ",
+                                   batch_size_, " examples, while ", consumed,
+                                   " were consumed");
+  }
+  index_ = consumed - 1;
+  return Status::OK();
+}
+
 Status ExampleBatchIterator::next(uint64 *offset, uint32_t *data_source_key,
                                   tstring *serialized) {
   uint8_t pb_type;
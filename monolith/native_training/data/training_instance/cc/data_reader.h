@@ -178,16 +178,6 @@ class InputStreamReader : public BaseStreamReader {
   TF_DISALLOW_COPY_AND_ASSIGN(InputStreamReader);
 };
 
-enum InputCompressType {
-  UNKNOW = 0,
-  NO = 1,
-  SNAPPY = 2,
-  ZSTD = 3,
-  ZLIB = 4,
-  GZIP = 5,
-  MAX = 6
-};
-
 class FileStreamReader : public InputStreamReader {
  public:
   explicit FileStreamReader(const DataFormatOptions &options,
@@ -274,6 +264,12 @@ class PBIterator {
   uint64 GetOffset();
   Status SetOffset(uint64 *offset);
 
+  // The position to resume reading from after the last record returned: the
+  // offset of a serialized record and how many of the records split from it
+  // were returned already.
+  virtual void GetPosition(uint64 *offset, int64 *consumed);
+  virtual Status SetPosition(uint64 offset, int64 consumed);
+
  protected:
   FeaturePruningType feature_pruning_type_ = PRUNING_RAW_FEATURE;
   std::unique_ptr<BaseStreamReader> reader_;
@@ -294,9 +290,15 @@ class ExampleBatchIterator : public PBIterator {
   Status next(uint64 *offset, ::parser::proto::Instance *pb) override;
   Status next(uint64 *offset, ::monolith::io::proto::Example *pb) override;
 
+  void GetPosition(uint64 *offset, int64 *consumed) override;
+  Status SetPosition(uint64 offset, int64 consumed) override;
+
  private:
   Status next_internal(uint64 *offset);
+  Status ReadBatch(uint64 *offset);
   int index_ = 0, batch_size_ = 0;
+  // The offset of the batch in cur_.
+  uint64 batch_offset_ = 0;
   monolith::io::proto::ExampleBatch *cur_;
   std::unique_ptr<google::protobuf::Arena> arena_;
   FeatureNameMapper *mapper_;
@@ -14,24 +14,40 @@
 
 #include "monolith/native_training/data/training_instance/cc/data_writer.h"
 
+#include <algorithm>
+#include <vector>
+
 #include "absl/strings/str_cat.h"
+#include "tensorflow/core/lib/io/zlib_compression_options.h"
+#include "tensorflow/core/lib/io/zlib_outputbuffer.h"
 #include "tensorflow/core/platform/coding.h"
+#include "tensorflow/core/platform/logging.h"
+#include "tensorflow/core/platform/snappy.h"
+#include "zstd.h"
 
 namespace tensorflow {
 namespace monolith_tf {
+namespace {
+
+constexpr char kZeros[16] = {};
+
+// How many full blocks may wait for the background thread.
+constexpr int kMaxPendingBlocks = 2;
+
+}  // namespace
 
 Status BaseStreamWriter::PrepareHeader() {
   if (options_.lagrangex_header) {
-    TF_RETURN_IF_ERROR(Write(std::string(8, 0)));
+    TF_RETURN_IF_ERROR(Write(absl::string_view(kZeros, 8)));
   } else {
     if (options_.kafka_dump_prefix) {
-      TF_RETURN_IF_ERROR(Write(std::string(16, 0)));
+      TF_RETURN_IF_ERROR(Write(absl::string_view(kZeros, 16)));
     }
     if (options_.has_sort_id) {
-      TF_RETURN_IF_ERROR(Write(std::string(8, 0)));
+      TF_RETURN_IF_ERROR(Write(absl::string_view(kZeros, 8)));
     }
     if (options_.kafka_dump) {
-      TF_RETURN_IF_ERROR(Write(std::string(8, 0)));
+      TF_RETURN_IF_ERROR(Write(absl::string_view(kZeros, 8)));
     }
   }
   return Status::OK();
@@ -54,5 +70,282 @@ Status StringStreamWriter::Write(absl::string_view s) {
   return Status::OK();
 }
 
+class FileStreamWriter::Encoder {
+ public:
+  explicit Encoder(WritableFile* file) : file_(file) {}
+  virtual ~Encoder() = default;
+
+  // Compresses a block and appends it to the file.
+  virtual Status Append(absl::string_view block) {
+    return file_->Append(block);
+  }
+
+  // Appends whatever is needed to decode the blocks appended so far.
+  virtual Status Flush() { return Status::OK(); }
+
+  // Ends the compressed stream.
+  virtual Status Close() { return Status::OK(); }
+
+ protected:
+  WritableFile* file_;
+};
+
+namespace {
+
+// A block is the big endian uncompressed and compressed lengths followed by
+// the compressed bytes, as io::ByteSnappyInputBuffer reads it.
+class SnappyEncoder : public FileStreamWriter::Encoder {
+ public:
+  using Encoder::Encoder;
+
+  Status Append(absl::string_view block) override {
+    if (!port::Snappy_Compress(block.data(), block.size(), &compressed_)) {
+      return errors::Unimplemented("Snappy compression is not supported.");
+    }
+    char lengths[8];
+    EncodeBigEndian32(lengths, block.size());
+    EncodeBigEndian32(lengths + 4, compressed_.size());
+    TF_RETURN_IF_ERROR(file_->Append(absl::string_view(lengths, 8)));
+    return file_->Append(compressed_);
+  }
+
+ private:
+  static void EncodeBigEndian32(char* buf, uint32 value) {
+    buf[0] = static_cast<char>(value >> 24);
+    buf[1] = static_cast<char>(value >> 16);
+    buf[2] = static_cast<char>(value >> 8);
+    buf[3] = static_cast<char>(value);
+  }
+
+  std::string compressed_;
+};
+
+// The blocks are one zstd frame, flushed on Flush.
+class ZstdEncoder : public FileStreamWriter::Encoder {
+ public:
+  explicit ZstdEncoder(WritableFile* file)
+      : Encoder(file),
+        context_(ZSTD_createCCtx()),
+        output_(ZSTD_CStreamOutSize()) {}
+
+  ~ZstdEncoder() override { ZSTD_freeCCtx(context_); }
+
+  Status Append(absl::string_view block) override {
+    return Compress(block, ZSTD_e_continue);
+  }
+
+  Status Flush() override { return Compress({}, ZSTD_e_flush); }
+
+  Status Close() override { return Compress({}, ZSTD_e_end); }
+
+ private:
+  Status Compress(absl::string_view data, ZSTD_EndDirective mode) {
+    ZSTD_inBuffer input = {data.data(), data.size(), 0};
+    size_t remaining;
+    do {
+      ZSTD_outBuffer output = {output_.data(), output_.size(), 0};
+      remaining = ZSTD_compressStream2(context_, &output, &input, mode);
+      if (ZSTD_isError(remaining)) {
+        return errors::Internal("ZSTD_compressStream2: ",
+                                ZSTD_getErrorName(remaining));
+      }
+      TF_RETURN_IF_ERROR(
+          file_->Append(absl::string_view(output_.data(), output.pos)));
+    } while (mode == ZSTD_e_continue ? input.pos < input.size
+                                     : remaining != 0);
+    return Status::OK();
+  }
+
+  ZSTD_CCtx* context_;
+  std::vector<char> output_;
+};
+
+class ZlibEncoder : public FileStreamWriter::Encoder {
+ public:
+  ZlibEncoder(WritableFile* file, const io::ZlibCompressionOptions& options)
+      : Encoder(file),
+        output_(file, options.input_buffer_size, options.output_buffer_size,
+                options) {}
+
+  Status Init() { return output_.Init(); }
+
+  Status Append(absl::string_view block) override {
+    return output_.Append(block);
+  }
+
+  Status Flush() override { return output_.Flush(); }
+
+  Status Close() override { return output_.Close(); }
+
+ private:
+  io::ZlibOutputBuffer output_;
+};
+
+std::unique_ptr<FileStreamWriter::Encoder> CreateEncoder(
+    WritableFile* file, InputCompressType compression_type, Status* status) {
+  if (compression_type == InputCompressType::SNAPPY) {
+    return std::make_unique<SnappyEncoder>(file);
+  } else if (compression_type == InputCompressType::ZSTD) {
+    return std::make_unique<ZstdEncoder>(file);
+  } else if (compression_type == InputCompressType::ZLIB ||
+             compression_type == InputCompressType::GZIP) {
+    auto encoder = std::make_unique<ZlibEncoder>(
+        file, compression_type == InputCompressType::ZLIB
+                  ? io::ZlibCompressionOptions::DEFAULT()
+                  : io::ZlibCompressionOptions::GZIP());
+    *status = encoder->Init();
+    return std::move(encoder);
+  } else {
+    return std::make_unique<FileStreamWriter::Encoder>(file);
+  }
+}
+
+}  // namespace
+
+FileStreamWriter::FileStreamWriter(DataFormatOptions options,
+                                   std::unique_ptr<WritableFile> f,
+                                   InputCompressType compression_type,
+                                   int64 block_size)
+    : BaseStreamWriter(std::move(options)),
+      file_(std::move(f)),
+      block_size_(std::max<int64>(block_size, 1)) {
+  encoder_ = CreateEncoder(file_.get(), compression_type, &status_);
+  buffer_.reserve(block_size_);
+  thread_.reset(Env::Default()->StartThread(
+      ThreadOptions(), "file_stream_writer", [this] { Run(); }));
+}
+
+FileStreamWriter::~FileStreamWriter() {
+  if (!closed_) {
+    Status s = Close();
+    if (!s.ok()) {
+      LOG(ERROR) << "Failed to close the file: " << s;
+    }
+  }
+}
+
+Status FileStreamWriter::Flush() {
+  if (closed_) {
+    return errors::FailedPrecondition("The writer is closed.");
+  }
+  return Submit(/*flush=*/true, /*sync=*/false, /*wait=*/true);
+}
+
+Status FileStreamWriter::Sync() {
+  if (closed_) {
+    return errors::FailedPrecondition("The writer is closed.");
+  }
+  return Submit(/*flush=*/true, /*sync=*/true, /*wait=*/true);
+}
+
+Status FileStreamWriter::Close() {
+  if (closed_) {
+    return errors::FailedPrecondition("The writer is closed.");
+  }
+  closed_ = true;
+  Status s = Submit(/*flush=*/false, /*sync=*/false, /*wait=*/true);
+  {
+    mutex_lock l(mu_);
+    stopped_ = true;
+    cv_.notify_all();
+  }
+  thread_.reset();
+  if (s.ok()) {
+    s = encoder_->Close();
+  }
+  s.Update(file_->Close());
+  return s;
+}
+
+Status FileStreamWriter::Write(absl::string_view s) {
+  if (closed_) {
+    return errors::FailedPrecondition("The writer is closed.");
+  }
+  while (!s.empty()) {
+    size_t n = std::min(s.size(), block_size_ - buffer_.size());
+    buffer_.append(s.data(), n);
+    s.remove_prefix(n);
+    if (buffer_.size() == block_size_) {
+      TF_RETURN_IF_ERROR(
+          Submit(/*flush=*/false, /*sync=*/false, /*wait=*/false));
+    }
+  }
+  return Status::OK();
+}
+
+Status FileStreamWriter::Submit(bool flush, bool sync, bool wait) {
+  Block block;
+  block.data.swap(buffer_);
+  block.flush = flush;
+  block.sync = sync;
+  mutex_lock l(mu_);
+  if (!block.data.empty() || flush || sync) {
+    while (status_.ok() && blocks_.size() >= kMaxPendingBlocks) {
+      cv_.wait(l);
+    }
+    if (!status_.ok()) {
+      return status_;
+    }
+    blocks_.push_back(std::move(block));
+    cv_.notify_all();
+  }
+  // Reuses a block written by the background thread.
+  if (spare_.capacity() >= block_size_) {
+    buffer_.swap(spare_);
+  }
+  buffer_.reserve(block_size_);
+  if (wait) {
+    while (!blocks_.empty() || busy_) {
+      cv_.wait(l);
+    }
+  }
+  return status_;
+}
+
+void FileStreamWriter::Run() {
+  while (true) {
+    Block block;
+    bool failed;
+    {
+      mutex_lock l(mu_);
+      while (blocks_.empty() && !stopped_) {
+        cv_.wait(l);
+      }
+      if (blocks_.empty()) {
+        return;
+      }
+      block = std::move(blocks_.front());
+      blocks_.pop_front();
+      busy_ = true;
+      failed = !status_.ok();
+      // There is a free slot for the writer.
+      cv_.notify_all();
+    }
+    Status s;
+    if (!failed) {
+      if (!block.data.empty()) {
+        s = encoder_->Append(block.data);
+      }
+      if (s.ok() && block.flush) {
+        s = encoder_->Flush();
+      }
+      if (s.ok() && block.flush) {
+        s = file_->Flush();
+      }
+      if (s.ok() && block.sync) {
+        s = file_->Sync();
+      }
+    }
+    mutex_lock l(mu_);
+    status_.Update(s);
+    busy_ = false;
+    if (spare_.capacity() < block.data.capacity()) {
+      block.data.clear();
+      spare_.swap(block.data);
+    }
+    cv_.notify_all();
+  }
+}
+
 }  // namespace monolith_tf
 }  // namespace tensorflow
@@ -15,10 +15,18 @@
 #ifndef MONOLITH_NATIVE_TRAINING_DATA_TRAINING_INSTANCE_CC_DATA_WRITER_H_
 #define MONOLITH_NATIVE_TRAINING_DATA_TRAINING_INSTANCE_CC_DATA_WRITER_H_
 
+#include <deque>
+#include <memory>
+#include <string>
+
 #include "absl/strings/string_view.h"
 #include "monolith/native_training/data/training_instance/cc/data_format_options.h"
+#include "tensorflow/core/platform/env.h"
 #include "tensorflow/core/platform/errors.h"
+#include "tensorflow/core/platform/file_system.h"
+#include "tensorflow/core/platform/mutex.h"
 #include "tensorflow/core/platform/status.h"
+#include "tensorflow/core/platform/thread_annotations.h"
 
 namespace tensorflow {
 namespace monolith_tf {
@@ -26,6 +34,7 @@ namespace monolith_tf {
 class BaseStreamWriter {
  public:
   explicit BaseStreamWriter(DataFormatOptions options);
+  virtual ~BaseStreamWriter() = default;
 
   Status WriteRecord(absl::string_view record);
 
@@ -49,6 +58,63 @@ class StringStreamWriter : public BaseStreamWriter {
   std::string* out_;
 };
 
+// Writes records to a file in the framing FileStreamReader reads. Records are
+// buffered into blocks of block_size bytes; a background thread compresses
+// and appends the full blocks while the next one is filled. An error of the
+// background thread is returned by the calls after it. Not thread safe.
+class FileStreamWriter : public BaseStreamWriter {
+ public:
+  FileStreamWriter(DataFormatOptions options, std::unique_ptr<WritableFile> f,
+                   InputCompressType compression_type,
+                   int64 block_size = 4 * 1024 * 1024);
+  // Closes the file if Close was not called, and logs the error if any.
+  ~FileStreamWriter() override;
+
+  // Makes the records written so far readable from the file.
+  Status Flush();
+
+  // Like Flush, and also persists the file to the storage.
+  Status Sync();
+
+  // Flushes and closes the file. Nothing can be written afterwards.
+  Status Close();
+
+  // Compresses the blocks into the file.
+  class Encoder;
+
+ private:
+  struct Block {
+    std::string data;
+    bool flush = false;
+    bool sync = false;
+  };
+
+  Status Write(absl::string_view s) override;
+
+  // Hands buffer_ over to the background thread, and waits for it to finish
+  // when wait is true.
+  Status Submit(bool flush, bool sync, bool wait);
+
+  void Run();
+
+  std::unique_ptr<WritableFile> file_;
+  std::unique_ptr<Encoder> encoder_;
+  const size_t block_size_;
+  std::string buffer_;
+  bool closed_ = false;
+
+  mutex mu_;
+  condition_variable cv_;
+  std::deque<Block> blocks_ TF_GUARDED_BY(mu_);
+  bool busy_ TF_GUARDED_BY(mu_) = false;
+  bool stopped_ TF_GUARDED_BY(mu_) = false;
+  Status status_ TF_GUARDED_BY(mu_);
+  // A written block whose memory the next block reuses.
+  std::string spare_ TF_GUARDED_BY(mu_);
+  // Declared last so that it is joined before the rest is destroyed.
+  std::unique_ptr<Thread> thread_;
+};
+
 }  // namespace monolith_tf
 }  // namespace tensorflow
 
@@ -0,0 +1,110 @@
+// Copyright 2022 ByteDance and/or its affiliates.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "monolith/native_training/data/training_instance/cc/data_reader.h"
+#include "monolith/native_training/data/training_instance/cc/data_writer.h"
+
+namespace tensorflow {
+namespace monolith_tf {
+namespace {
+
+constexpr int kNumRecords = 10000;
+
+// Records of serialized-proto-like bytes: a few distinct values, so that
+// they compress roughly as the real data does.
+std::vector<std::string> MakeRecords(int record_size) {
+  std::mt19937 gen(42);
+  std::uniform_int_distribution<int> byte(0, 15);
+  std::vector<std::string> records(kNumRecords);
+  for (auto& record : records) {
+    record.resize(record_size);
+    for (auto& c : record) {
+      c = static_cast<char>(byte(gen));
+    }
+  }
+  return records;
+}
+
+void WriteFile(const std::string& path, InputCompressType compression_type,
+               const std::vector<std::string>& records) {
+  std::unique_ptr<WritableFile> f;
+  TF_CHECK_OK(Env::Default()->NewWritableFile(path, &f));
+  DataFormatOptions options;
+  options.lagrangex_header = true;
+  FileStreamWriter writer(options, std::move(f), compression_type);
+  for (const auto& record : records) {
+    TF_CHECK_OK(writer.WriteRecord(record));
+  }
+  TF_CHECK_OK(writer.Close());
+}
+
+// Args: the compression type, the record size.
+void BM_Write(benchmark::State& state) {  // NOLINT
+  const auto compression_type =
+      static_cast<InputCompressType>(state.range(0));
+  const auto records = MakeRecords(state.range(1));
+  std::string path;
+  CHECK(Env::Default()->LocalTempFilename(&path));
+  for (auto _ : state) {
+    WriteFile(path, compression_type, records);
+  }
+  state.SetBytesProcessed(state.iterations() * kNumRecords * state.range(1));
+  TF_CHECK_OK(Env::Default()->DeleteFile(path));
+}
+
+void BM_Read(benchmark::State& state) {  // NOLINT
+  const auto compression_type =
+      static_cast<InputCompressType>(state.range(0));
+  std::string path;
+  CHECK(Env::Default()->LocalTempFilename(&path));
+  WriteFile(path, compression_type, MakeRecords(state.range(1)));
+  DataFormatOptions options;
+  options.lagrangex_header = true;
+  for (auto _ : state) {
+    std::unique_ptr<RandomAccessFile> f;
+    TF_CHECK_OK(Env::Default()->NewRandomAccessFile(path, &f));
+    FileStreamReader reader(options, std::move(f), compression_type);
+    uint8_t pb_type;
+    uint32_t data_source_key;
+    tstring record;
+    for (int i = 0; i < kNumRecords; ++i) {
+      TF_CHECK_OK(reader.ReadPBBytes(&pb_type, &data_source_key, &record));
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * kNumRecords * state.range(1));
+  TF_CHECK_OK(Env::Default()->DeleteFile(path));
+}
+
+void Args(benchmark::internal::Benchmark* b) {
+  for (int64_t compression_type : {NO, SNAPPY, ZSTD, GZIP}) {
+    for (int64_t record_size : {256, 4096}) {
+      b->Args({compression_type, record_size});
+    }
+  }
+  b->Unit(benchmark::kMillisecond);
+}
+
+BENCHMARK(BM_Write)->Apply(Args);
+BENCHMARK(BM_Read)->Apply(Args);
+
+}  // namespace
+}  // namespace monolith_tf
+}  // namespace tensorflow
+
+BENCHMARK_MAIN();
@@ -177,7 +177,6 @@ class InstanceDatasetOp : public DatasetOpKernel {
       Status SaveInternal(SerializationContext* ctx,
                           IteratorStateWriter* writer) override {
         mutex_lock l(mu_);
-        LOG(INFO) << "Save function is not supported yet.";
         TF_RETURN_IF_ERROR(writer->WriteScalar(full_name("num_random_samples"),
                                                num_random_samples_));
         TF_RETURN_IF_ERROR(writer->WriteScalar(full_name("offset_"), offset_));
@@ -187,14 +186,15 @@ class InstanceDatasetOp : public DatasetOpKernel {
       Status RestoreInternal(IteratorContext* ctx,
                              IteratorStateReader* reader) override {
         mutex_lock l(mu_);
-        LOG(INFO) << "Restore function is not supported yet.";
         TF_RETURN_IF_ERROR(reader->ReadScalar(full_name("num_random_samples"),
                                               &num_random_samples_));
         int64 offset;
         TF_RETURN_IF_ERROR(reader->ReadScalar(full_name("offset_"), &offset));
         if (dataset()->file_name_.empty()) {
+          // Stdin can not be rewound.
           offset_ = 0;
         } else {
+          ResetStreamsLocked();
           offset_ = offset;
         }
         return Status::OK();
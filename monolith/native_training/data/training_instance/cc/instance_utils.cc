@@ -14,6 +14,211 @@
 
 #include "monolith/native_training/data/training_instance/cc/instance_utils.h"
 
+#include <algorithm>
+
 namespace tensorflow {
-namespace monolith_tf {}  // namespace monolith_tf
+namespace monolith_tf {
+namespace {
+
+// Sets at least this large get a bloom filter: their table no longer fits in
+// the L1 cache, while the filter, 16 bits per fid, mostly does.
+constexpr size_t kBloomMinSize = 4096;
+constexpr size_t kBloomBitsPerFid = 16;
+
+// Bits of seen indices in [0, n), counting the distinct ones.
+class SeenBits {
+ public:
+  explicit SeenBits(size_t n)
+      : n_(n), large_(n > 64 ? (n + 63) / 64 : 0, 0) {}
+
+  void Insert(int i) {
+    uint64_t& word = large_.empty() ? small_ : large_[i >> 6];
+    uint64_t bit = 1ULL << (i & 63);
+    if (!(word & bit)) {
+      word |= bit;
+      ++count_;
+    }
+  }
+
+  bool full() const { return count_ == n_; }
+
+ private:
+  size_t n_;
+  size_t count_ = 0;
+  uint64_t small_ = 0;
+  std::vector<uint64_t> large_;
+};
+
+}  // namespace
+
+FidSet::FidSet(const std::vector<uint64_t>& fids) {
+  size_t capacity = 2;
+  int bits = 1;
+  while (capacity < 2 * fids.size()) {
+    capacity <<= 1;
+    ++bits;
+  }
+  table_.assign(capacity, Entry{0, -1});
+  table_mask_ = capacity - 1;
+  shift_ = 64 - bits;
+  for (uint64_t fid : fids) {
+    size_t i = Bucket(fid);
+    while (table_[i].index >= 0 && table_[i].fid != fid) {
+      i = (i + 1) & table_mask_;
+    }
+    if (table_[i].index < 0) {
+      table_[i] = Entry{fid, static_cast<int32_t>(size_++)};
+    }
+  }
+
+  if (size_ >= kBloomMinSize) {
+    size_t bloom_bits = 64;
+    while (bloom_bits < kBloomBitsPerFid * size_) bloom_bits <<= 1;
+    bloom_.assign(bloom_bits / 64, 0);
+    bloom_mask_ = bloom_bits - 1;
+    for (const Entry& e : table_) {
+      if (e.index < 0) continue;
+      uint64_t h = e.fid * kBloomMul;
+      uint64_t b1 = (h >> 32) & bloom_mask_, b2 = h & bloom_mask_;
+      bloom_[b1 >> 6] |= 1ULL << (b1 & 63);
+      bloom_[b2 >> 6] |= 1ULL << (b2 & 63);
+    }
+  }
+}
+
+// One sample's pass over its fids.
+class InstanceFilter::Scan {
+ public:
+  explicit Scan(const InstanceFilter& filter)
+      : filter_(filter),
+        has_(filter.has_fids_.empty()),
+        selected_(filter.select_fids_.size()),
+        slotted_(filter.select_slots_.size()) {}
+
+  // Visits a fid of `slot`. The fid conditions apply only if `match_fid`,
+  // the slot ones always. Returns false once the outcome is known.
+  bool Visit(uint64_t fid, int slot, bool match_fid) {
+    if (!(filter_.relevant_slots_[slot >> 6] & (1ULL << (slot & 63)))) {
+      return true;
+    }
+    if (match_fid) {
+      if (filter_.filter_fids_.Contains(fid)) {
+        rejected_ = true;
+        return false;
+      }
+      if (!has_) has_ = filter_.has_fids_.Contains(fid);
+      int i = filter_.select_fids_.Find(fid);
+      if (i >= 0) selected_.Insert(i);
+    }
+    int j = filter_.select_slots_.Find(slot);
+    if (j >= 0) slotted_.Insert(j);
+    // Without fids to filter out, nothing can change a satisfied sample.
+    return !(filter_.filter_fids_.empty() && Satisfied());
+  }
+
+  bool Accepted() const { return !rejected_ && Satisfied(); }
+
+ private:
+  bool Satisfied() const {
+    return has_ && selected_.full() && slotted_.full();
+  }
+
+  const InstanceFilter& filter_;
+  bool rejected_ = false;
+  bool has_;
+  SeenBits selected_;
+  SeenBits slotted_;
+};
+
+InstanceFilter::InstanceFilter(const std::set<uint64_t>& filter_fids,
+                               const std::set<uint64_t>& has_fids,
+                               const std::set<uint64_t>& select_fids,
+                               const std::set<int32_t>& has_actions,
+                               int64_t req_time_min,
+                               const std::set<uint32_t>& select_slots)
+    : filter_fids_(filter_fids),
+      has_fids_(has_fids),
+      select_fids_(select_fids),
+      has_actions_(has_actions.begin(), has_actions.end()),
+      req_time_min_(req_time_min),
+      select_slots_(select_slots),
+      relevant_slots_(get_max_slot_number() / 64, 0) {
+  auto mark = [this](int slot) {
+    relevant_slots_[slot >> 6] |= 1ULL << (slot & 63);
+  };
+  for (const auto* fids : {&filter_fids, &has_fids, &select_fids}) {
+    for (uint64_t fid : *fids) {
+      mark(slot_id_v1(fid));
+      mark(slot_id_v2(fid));
+    }
+  }
+  for (uint32_t slot : select_slots) {
+    if (slot >= static_cast<uint32_t>(get_max_slot_number())) {
+      unsatisfiable_ = true;
+    } else {
+      mark(slot);
+    }
+  }
+  scan_fids_ = !filter_fids.empty() || !has_fids.empty() ||
+               !select_fids.empty() || !select_slots.empty();
+}
+
+bool InstanceFilter::IsLineIdOfInterest(
+    const idl::matrix::proto::LineId& line_id) const {
+  if (unsatisfiable_ || line_id.req_time() < req_time_min_) {
+    return false;
+  }
+  if (!has_actions_.empty()) {
+    // `has_actions_` is sorted, coming from a std::set.
+    const auto& actions = line_id.actions();
+    return std::any_of(actions.begin(), actions.end(), [this](int32_t a) {
+      return std::binary_search(has_actions_.begin(), has_actions_.end(), a);
+    });
+  }
+  return true;
+}
+
+bool InstanceFilter::IsInstanceOfInterest(
+    const parser::proto::Instance& instance) const {
+  if (!IsLineIdOfInterest(instance.line_id())) return false;
+  if (!scan_fids_) return true;
+
+  Scan scan(*this);
+  for (uint64_t fid : instance.fid()) {
+    if (!scan.Visit(fid, slot_id_v1(fid), true)) return scan.Accepted();
+  }
+  // As in CollectFidIntoSet, the fids of features only count for their slots.
+  if (!select_slots_.empty()) {
+    for (const auto& feature : instance.feature()) {
+      for (uint64_t fid : feature.fid()) {
+        if (!scan.Visit(fid, slot_id_v2(fid), false)) return scan.Accepted();
+      }
+    }
+  }
+  return scan.Accepted();
+}
+
+bool InstanceFilter::IsInstanceOfInterest(
+    const monolith::io::proto::Example& example) const {
+  if (!IsLineIdOfInterest(example.line_id())) return false;
+  if (!scan_fids_) return true;
+
+  Scan scan(*this);
+  for (const auto& named_feature : example.named_feature()) {
+    const auto& feature = named_feature.feature();
+    if (feature.has_fid_v1_list()) {
+      for (uint64_t fid : feature.fid_v1_list().value()) {
+        if (!scan.Visit(fid, slot_id_v1(fid), true)) return scan.Accepted();
+      }
+    }
+    if (feature.has_fid_v2_list()) {
+      for (uint64_t fid : feature.fid_v2_list().value()) {
+        if (!scan.Visit(fid, slot_id_v2(fid), true)) return scan.Accepted();
+      }
+    }
+  }
+  return scan.Accepted();
+}
+
+}  // namespace monolith_tf
 }  // namespace tensorflow
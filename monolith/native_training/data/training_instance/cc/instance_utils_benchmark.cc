@@ -0,0 +1,110 @@
+// Copyright 2022 ByteDance and/or its affiliates.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <random>
+#include <set>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "monolith/native_training/data/training_instance/cc/instance_utils.h"
+
+namespace tensorflow {
+namespace monolith_tf {
+namespace {
+
+using ::monolith::io::proto::Example;
+
+constexpr int kNumExamples = 256;
+constexpr int kNumSlots = 200;
+
+struct Inputs {
+  std::vector<Example> examples;
+  std::set<uint64_t> filter_fids;
+  std::set<uint64_t> has_fids;
+  std::set<uint32_t> select_slots;
+};
+
+// Args: fids per example, number of `filter_fids`.
+Inputs MakeInputs(const benchmark::State& state) {
+  std::mt19937_64 gen(0);
+  Inputs inputs;
+  inputs.examples.resize(kNumExamples);
+  const int fids_per_slot = state.range(0) / kNumSlots;
+  for (auto& example : inputs.examples) {
+    example.mutable_line_id()->set_req_time(1);
+    example.mutable_line_id()->add_actions(1);
+    for (int slot = 0; slot < kNumSlots; ++slot) {
+      auto* fids = example.add_named_feature()
+                       ->mutable_feature()
+                       ->mutable_fid_v2_list();
+      for (int i = 0; i < fids_per_slot; ++i) {
+        fids->add_value(GetFidV2(slot, gen()));
+      }
+    }
+  }
+  // Fids of a few slots that no example has, as a blocklist usually is.
+  for (int i = 0; i < state.range(1); ++i) {
+    inputs.filter_fids.insert(GetFidV2(kNumSlots + i % 4, gen()));
+  }
+  const auto& first = inputs.examples.front().named_feature(0).feature();
+  inputs.has_fids = {static_cast<uint64_t>(first.fid_v2_list().value(0)),
+                     static_cast<uint64_t>(GetFidV2(1, gen()))};
+  inputs.select_slots = {1, 2, kNumSlots - 1};
+  return inputs;
+}
+
+void SetItemsProcessed(benchmark::State* state) {
+  state->SetItemsProcessed(state->iterations() * kNumExamples);
+}
+
+void BM_IsInstanceOfInterest(benchmark::State& state) {  // NOLINT
+  const Inputs inputs = MakeInputs(state);
+  for (auto _ : state) {
+    for (const auto& example : inputs.examples) {
+      benchmark::DoNotOptimize(IsInstanceOfInterest(
+          example, inputs.filter_fids, inputs.has_fids, {}, {1}, 0,
+          inputs.select_slots));
+    }
+  }
+  SetItemsProcessed(&state);
+}
+
+void BM_InstanceFilter(benchmark::State& state) {  // NOLINT
+  const Inputs inputs = MakeInputs(state);
+  const InstanceFilter filter(inputs.filter_fids, inputs.has_fids, {}, {1}, 0,
+                              inputs.select_slots);
+  for (auto _ : state) {
+    for (const auto& example : inputs.examples) {
+      benchmark::DoNotOptimize(filter.IsInstanceOfInterest(example));
+    }
+  }
+  SetItemsProcessed(&state);
+}
+
+void Args(benchmark::internal::Benchmark* b) {
+  for (int64_t num_fids : {400, 2000}) {
+    for (int64_t num_filter_fids : {10, 100000}) {
+      b->Args({num_fids, num_filter_fids});
+    }
+  }
+}
+
+BENCHMARK(BM_IsInstanceOfInterest)->Apply(Args);
+BENCHMARK(BM_InstanceFilter)->Apply(Args);
+
+}  // namespace
+}  // namespace monolith_tf
+}  // namespace tensorflow
+
+BENCHMARK_MAIN();
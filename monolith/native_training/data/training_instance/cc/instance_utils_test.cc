@@ -14,6 +14,8 @@
 
 #include "monolith/native_training/data/training_instance/cc/instance_utils.h"
 
+#include <random>
+
 #include "absl/time/clock.h"
 #include "glog/logging.h"
 #include "gmock/gmock.h"
@@ -172,6 +174,92 @@ TEST(CollectFidIntoSet, Example) {
   EXPECT_TRUE(!IsInstanceOfInterest(example, {}, {}, {}, {}, 0, select_slots2));
 }
 
+TEST(FidSet, Find) {
+  // Large enough for the bloom filter.
+  std::vector<uint64_t> fids;
+  for (uint64_t i = 0; i < 10000; ++i) {
+    fids.push_back(GetFidV2(i % 100, i));
+  }
+  fids.push_back(fids.front());
+  FidSet fid_set(fids);
+  EXPECT_EQ(fid_set.size(), 10000);
+  std::set<int> indices;
+  for (uint64_t i = 0; i < 10000; ++i) {
+    int index = fid_set.Find(GetFidV2(i % 100, i));
+    ASSERT_GE(index, 0);
+    indices.insert(index);
+    EXPECT_FALSE(fid_set.Contains(GetFidV2(i % 100, i + 10000)));
+  }
+  EXPECT_EQ(indices.size(), 10000);
+
+  EXPECT_FALSE(FidSet().Contains(0));
+  EXPECT_TRUE(FidSet(std::set<uint64_t>{0}).Contains(0));
+}
+
+// Random samples from a small pool of fids, so that every condition both holds
+// and fails, checked against IsInstanceOfInterest.
+TEST(InstanceFilter, SameAsIsInstanceOfInterest) {
+  std::mt19937 gen(0);
+  // The v2 slots are below 64, so that their v1 slot is 0.
+  std::vector<uint64_t> pool;
+  for (int slot = 1; slot <= 4; ++slot) {
+    for (int i = 0; i < 3; ++i) {
+      pool.push_back(GetFidV1(slot, i));
+      pool.push_back(GetFidV2(slot + 20, i));
+    }
+  }
+  auto sample_fids = [&](int max_size) {
+    std::set<uint64_t> fids;
+    for (int n = gen() % (max_size + 1); n > 0; --n) {
+      fids.insert(pool[gen() % pool.size()]);
+    }
+    return fids;
+  };
+
+  for (int round = 0; round < 200; ++round) {
+    std::set<uint64_t> filter_fids = sample_fids(1), has_fids = sample_fids(3),
+                       select_fids = sample_fids(2);
+    std::set<int32_t> has_actions;
+    if (gen() % 2) has_actions = {1, 3};
+    std::set<uint32_t> select_slots;
+    for (int n = gen() % 3; n > 0; --n) {
+      select_slots.insert(gen() % 2 ? 1 + gen() % 4 : 21 + gen() % 4);
+    }
+    int64_t req_time_min = gen() % 2 ? 100 : 0;
+    InstanceFilter filter(filter_fids, has_fids, select_fids, has_actions,
+                          req_time_min, select_slots);
+
+    for (int i = 0; i < 20; ++i) {
+      parser::proto::Instance instance;
+      monolith::io::proto::Example example;
+      for (auto* line_id :
+           {instance.mutable_line_id(), example.mutable_line_id()}) {
+        line_id->set_req_time(gen() % 4 ? 200 : 50);
+        line_id->add_actions(gen() % 4);
+      }
+      for (uint64_t fid : sample_fids(8)) {
+        // v1 fids in both, v2 fids in features and fid_v2_list.
+        auto* feature = example.add_named_feature()->mutable_feature();
+        if (slot_id_v1(fid) != 0) {
+          instance.add_fid(fid);
+          feature->mutable_fid_v1_list()->add_value(fid);
+        } else {
+          instance.add_feature()->add_fid(fid);
+          feature->mutable_fid_v2_list()->add_value(fid);
+        }
+      }
+      EXPECT_EQ(filter.IsInstanceOfInterest(instance),
+                IsInstanceOfInterest(instance, filter_fids, has_fids,
+                                     select_fids, has_actions, req_time_min,
+                                     select_slots));
+      EXPECT_EQ(filter.IsInstanceOfInterest(example),
+                IsInstanceOfInterest(example, filter_fids, has_fids,
+                                     select_fids, has_actions, req_time_min,
+                                     select_slots));
+    }
+  }
+}
+
 }  // namespace
 }  // namespace monolith_tf
 }  // namespace tensorflow
@@ -291,21 +291,26 @@ class InstanceParser::Impl {
       const Instance &instance = instances[i];
       for (const Feature &feature : instance.feature()) {
         if (spec_.float_features_set.contains(feature.name())) {
-          std::vector<float> embedding;
-          bool ret = ue_compress_->decompress_embeddings(
-              feature, &embedding, UECompressMethod::COMPRESS_QTZ8);
+          absl::string_view compressed =
+              ue_compress_->find_compressed_embedding(feature);
+          size_t embedding_size =
+              compressed.empty()
+                  ? 0
+                  : ue_compress_->embedding_size(
+                        compressed, UECompressMethod::COMPRESS_QTZ8);
           int idx = spec_.float_feature_name_to_index.at(feature.name());
-          if (ret) {
+          if (embedding_size > 0) {
             // Process data with qtz8 compression.
-            if (spec_.float_feature_dims[idx] != embedding.size()) {
+            if (spec_.float_feature_dims[idx] != embedding_size) {
               return errors::Internal(
                   "Decompressed qtz8 data length doesn't match feature dim,",
                   " feature dim: ", spec_.float_feature_dims[idx],
-                  ", uncompressed qtz8 size: ", embedding.size());
-            }
-            for (int j = 0; j < spec_.float_feature_dims[idx]; ++j) {
-              values_mat[idx](i, j) = embedding[j];
+                  ", uncompressed qtz8 size: ", embedding_size);
             }
+            // Decompresses into the row of the output.
+            ue_compress_->decompress_embedding(
+                compressed, &values_mat[idx](i, 0),
+                UECompressMethod::COMPRESS_QTZ8);
           } else if (spec_.float_feature_dims[idx] ==
                      feature.float_value_size()) {
             for (int j = 0; j < spec_.float_feature_dims[idx]; ++j) {
@@ -28,6 +28,10 @@
 #include "tensorflow/core/platform/logging.h"
 #include "third_party/nlohmann/json.hpp"
 
+#if defined(_ENABLE_AVX) && defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
 constexpr uint64_t fid_v1_mask = (1LL << 54) - 1;
 constexpr uint64_t fid_v2_mask = (1LL << 48) - 1;
 
@@ -68,6 +72,55 @@ inline int64_t GetFidV2(int slot, int64_t signature) {
   return ((uint64_t)slot << 48) | (signature & fid_v2_mask);
 }
 
+// Batched convert_fid_v1_to_v2, into the 64 bits integers of a tensor.
+template <typename T>
+void ConvertFidsV1ToV2(const uint64_t *fids, int n, T *out) {
+  static_assert(sizeof(T) == sizeof(uint64_t), "fids are 64 bits");
+  int i = 0;
+#if defined(_ENABLE_AVX) && defined(__AVX2__)
+  const __m256i mask = _mm256_set1_epi64x(fid_v2_mask);
+  for (; i + 4 <= n; i += 4) {
+    __m256i fid =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(fids + i));
+    __m256i slot = _mm256_slli_epi64(_mm256_srli_epi64(fid, 54), 48);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i),
+                        _mm256_or_si256(_mm256_and_si256(fid, mask), slot));
+  }
+#endif
+  for (; i < n; ++i) {
+    out[i] = convert_fid_v1_to_v2(fids[i]);
+  }
+}
+
+// Batched `(fid & mask) | bits`, into the 64 bits integers of a tensor: a
+// slot switch with the mask and the slot bits computed once. `out` may be
+// `fids`.
+template <typename T>
+void MaskFids(const uint64_t *fids, int64_t n, uint64_t mask, uint64_t bits,
+              T *out) {
+  static_assert(sizeof(T) == sizeof(uint64_t), "fids are 64 bits");
+  int64_t i = 0;
+#if defined(_ENABLE_AVX) && defined(__AVX2__)
+  const __m256i mask_v = _mm256_set1_epi64x(mask);
+  const __m256i bits_v = _mm256_set1_epi64x(bits);
+  for (; i + 4 <= n; i += 4) {
+    __m256i fid =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(fids + i));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i),
+                        _mm256_or_si256(_mm256_and_si256(fid, mask_v), bits_v));
+  }
+#endif
+  for (; i < n; ++i) {
+    out[i] = (fids[i] & mask) | bits;
+  }
+}
+
+// Batched GetFidV2: the fids of a slot, whatever slot they had before.
+template <typename T>
+void GetFidsV2(int slot, const uint64_t *fids, int n, T *out) {
+  MaskFids(fids, n, fid_v2_mask, static_cast<uint64_t>(slot) << 48, out);
+}
+
 class FeaturePruningByteCounter {
  public:
   ~FeaturePruningByteCounter() {
@@ -14,6 +14,7 @@
 
 #include "monolith/native_training/data/training_instance/cc/reader_util.h"
 #include <string>
+#include <vector>
 #include "gtest/gtest.h"
 
 namespace tensorflow {
@@ -35,6 +36,29 @@ TEST(ReaderUtilTest, GetSlotID) {
 }
 
 
+TEST(ReaderUtilTest, BatchedFidConversion) {
+  std::vector<uint64_t> fids;
+  for (uint64_t i = 0; i < 11; ++i) {
+    fids.push_back((i << 54) | (i * 0x123456789ULL) | (1ULL << 50));
+  }
+  std::vector<int64_t> out(fids.size());
+  ConvertFidsV1ToV2(fids.data(), fids.size(), out.data());
+  for (size_t i = 0; i < fids.size(); ++i) {
+    EXPECT_EQ(out[i], convert_fid_v1_to_v2(fids[i]));
+    EXPECT_EQ(slot_id_v2(out[i]), i);
+  }
+  GetFidsV2(7, fids.data(), fids.size(), out.data());
+  for (size_t i = 0; i < fids.size(); ++i) {
+    EXPECT_EQ(out[i], GetFidV2(7, fids[i]));
+  }
+  // In place.
+  MaskFids(fids.data(), fids.size(), fid_v1_mask, 9ULL << 54, fids.data());
+  for (size_t i = 0; i < fids.size(); ++i) {
+    EXPECT_EQ(slot_id_v1(fids[i]), 9);
+    EXPECT_EQ(fids[i] & fid_v1_mask, (i * 0x123456789ULL) | (1ULL << 50));
+  }
+}
+
 TEST(ReaderUtilTest, FeatureNameMapperNormalCase1) {
   auto mapper = std::make_unique<FeatureNameMapper>();
   ASSERT_FALSE(mapper->IsAvailable());
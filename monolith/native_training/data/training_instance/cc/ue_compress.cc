@@ -12,9 +12,12 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include "monolith/native_training/data/training_instance/cc/ue_compress.h"
+
 #include <string.h>
 
-#include "monolith/native_training/data/training_instance/cc/ue_compress.h"
+#include "absl/strings/match.h"
+#include "absl/strings/strip.h"
 
 namespace tensorflow {
 namespace monolith_tf {
@@ -23,68 +26,201 @@ using matrix::compression::Float16;
 
 const char* UE_COMPRESS_FLAG = "UE_QTZ";
 
+namespace {
+
+bool IsValidMethod(UECompressMethod compress_method) {
+  if (compress_method != UECompressMethod::COMPRESS_QTZ8) {
+    LOG(ERROR) << "invalid compress method: " << compress_method;
+    return false;
+  }
+  return true;
+}
+
+// Writes the flag and the compressed floats to out.
+void CompressTo(const float* embedding, size_t size, std::string* out) {
+  const size_t flag_size = strlen(UE_COMPRESS_FLAG);
+  out->resize(flag_size +
+              matrix::compression::compressed_row_size_qtz8mm(size));
+  char* data = &(*out)[0];
+  memcpy(data, UE_COMPRESS_FLAG, flag_size);
+  matrix::compression::compress_float_rows_qtz8mm(embedding, 1, size,
+                                                  data + flag_size);
+}
+
+absl::string_view StripFlag(absl::string_view value) {
+  return absl::ConsumePrefix(&value, UE_COMPRESS_FLAG) ? value
+                                                       : absl::string_view();
+}
+
+}  // namespace
+
 bool UECompress::compress_embeddings(
     ::idl::matrix::proto::Feature* feature_column,
     UECompressMethod compress_method) {
-  if (compress_method == UECompressMethod::COMPRESS_QTZ8) {
-    auto* bytes_value = feature_column->add_bytes_value();
-    int embedding_size = feature_column->float_value_size();
-    std::vector<float> compress_input;
-    compress_input.reserve(embedding_size);
-    for (auto value : feature_column->float_value()) {
-      compress_input.push_back(value);
-    }
-    std::string compress_out;
-    bool ret = matrix::compression::compress_float_list_qtz8mm(
-        (const char*)compress_input.data(), embedding_size * sizeof(float),
-        &compress_out);
-    if (!ret) {
-      LOG(ERROR) << "compress_embeddings failed, feature_column name=%s"
-                 << feature_column->name().c_str();
-      return false;
-    }
-    *bytes_value = UE_COMPRESS_FLAG + compress_out;
-    return true;
-  } else {
-    LOG(ERROR) << "compress_embeddings invalid compress method:%d"
-               << compress_method;
+  if (!IsValidMethod(compress_method)) {
     return false;
   }
+  const auto& values = feature_column->float_value();
+  CompressTo(values.data(), values.size(),
+             feature_column->add_bytes_value());
+  return true;
 }
 
 bool UECompress::decompress_embeddings(
     const idl::matrix::proto::Feature& feature_column,
     std::vector<float>* embedding, UECompressMethod compress_method) {
-  if (compress_method == UECompressMethod::COMPRESS_QTZ8) {
-    std::string compress_out;
-    std::string bytes_value;
-    for (auto& value : feature_column.bytes_value()) {
-      if (value.find(UE_COMPRESS_FLAG) == 0) {
-        bytes_value = value.substr(strlen(UE_COMPRESS_FLAG));
-      }
+  absl::string_view compressed = find_compressed_embedding(feature_column);
+  size_t size = compressed.empty()
+                    ? 0
+                    : embedding_size(compressed, compress_method);
+  if (size == 0) {
+    return false;
+  }
+  embedding->resize(size);
+  return decompress_embedding(compressed, embedding->data(), compress_method);
+}
+
+absl::string_view UECompress::find_compressed_embedding(
+    const ::idl::matrix::proto::Feature& feature_column) {
+  // The last flagged value wins.
+  const auto& values = feature_column.bytes_value();
+  for (int i = values.size() - 1; i >= 0; --i) {
+    if (absl::StartsWith(values.Get(i), UE_COMPRESS_FLAG)) {
+      return StripFlag(values.Get(i));
     }
-    if (bytes_value.empty()) {
+  }
+  return absl::string_view();
+}
+
+size_t UECompress::embedding_size(absl::string_view compressed,
+                                  UECompressMethod compress_method) {
+  if (!IsValidMethod(compress_method)) {
+    return 0;
+  }
+  // See compress_float_list_qtz8mm: short embeddings are stored as f16.
+  if (compressed.size() <= 4 * sizeof(Float16)) {
+    return compressed.size() % sizeof(Float16) == 0
+               ? compressed.size() / sizeof(Float16)
+               : 0;
+  }
+  return compressed.size() - 2 * sizeof(Float16);
+}
+
+bool UECompress::decompress_embedding(absl::string_view compressed,
+                                      float* embedding,
+                                      UECompressMethod compress_method) {
+  size_t size = embedding_size(compressed, compress_method);
+  if (size == 0) {
+    return false;
+  }
+  matrix::compression::decompress_float_rows_qtz8mm(compressed.data(), 1, size,
+                                                    embedding);
+  return true;
+}
+
+bool UECompress::compress_embedding(::monolith::io::proto::Feature* feature,
+                                    UECompressMethod compress_method) {
+  if (!feature->has_float_list() || feature->float_list().value_size() == 0) {
+    return true;
+  }
+  const auto& values = feature->float_list().value();
+  std::string compressed;
+  CompressTo(values.data(), values.size(), &compressed);
+  // Moves the bytes, which replace the floats.
+  feature->mutable_bytes_list()->add_value(std::move(compressed));
+  return true;
+}
+
+bool UECompress::decompress_embedding(::monolith::io::proto::Feature* feature,
+                                      UECompressMethod compress_method) {
+  if (!feature->has_bytes_list() || feature->bytes_list().value_size() != 1) {
+    return true;
+  }
+  absl::string_view compressed = StripFlag(feature->bytes_list().value(0));
+  size_t size = compressed.empty()
+                    ? 0
+                    : embedding_size(compressed, compress_method);
+  if (size == 0) {
+    return true;
+  }
+  // Keeps the bytes alive while the floats replace them.
+  std::string bytes;
+  bytes.swap(*feature->mutable_bytes_list()->mutable_value(0));
+  compressed = StripFlag(bytes);
+  auto* values = feature->mutable_float_list()->mutable_value();
+  values->Resize(size, 0.0f);
+  return decompress_embedding(compressed, values->mutable_data(),
+                              compress_method);
+}
+
+bool UECompress::compress_embeddings(
+    ::monolith::io::proto::Example* example,
+    const absl::flat_hash_set<std::string>& names,
+    UECompressMethod compress_method) {
+  if (!IsValidMethod(compress_method)) {
+    return false;
+  }
+  for (auto& named_feature : *example->mutable_named_feature()) {
+    if (names.contains(named_feature.name()) &&
+        !compress_embedding(named_feature.mutable_feature(),
+                            compress_method)) {
       return false;
     }
-    bool ret = matrix::compression::decompress_float_list_qtz8mm(
-        (const char*)bytes_value.data(), bytes_value.size(), &compress_out);
-    if (!ret) {
-      LOG(ERROR) << "decompress_embeddings failed, feature_column name=%s"
-                 << feature_column.name().c_str();
-      return false;
+  }
+  return true;
+}
+
+bool UECompress::compress_embeddings(
+    ::monolith::io::proto::ExampleBatch* example_batch,
+    const absl::flat_hash_set<std::string>& names,
+    UECompressMethod compress_method) {
+  if (!IsValidMethod(compress_method)) {
+    return false;
+  }
+  for (auto& named_feature_list :
+       *example_batch->mutable_named_feature_list()) {
+    if (!names.contains(named_feature_list.name())) {
+      continue;
     }
-    size_t embedding_size = bytes_value.size() - 2 * sizeof(Float16);
-    const float* output = reinterpret_cast<const float*>(compress_out.data());
-    embedding->clear();
-    for (size_t i = 0; i < embedding_size; ++i) {
-      embedding->emplace_back(output[i]);
+    for (auto& feature : *named_feature_list.mutable_feature()) {
+      if (!compress_embedding(&feature, compress_method)) {
+        return false;
+      }
     }
-    return true;
-  } else {
-    LOG(ERROR) << "decompress_embeddings invalid compress method:%d"
-               << compress_method;
+  }
+  return true;
+}
+
+bool UECompress::decompress_embeddings(
+    ::monolith::io::proto::Example* example,
+    UECompressMethod compress_method) {
+  if (!IsValidMethod(compress_method)) {
+    return false;
+  }
+  for (auto& named_feature : *example->mutable_named_feature()) {
+    if (!decompress_embedding(named_feature.mutable_feature(),
+                              compress_method)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool UECompress::decompress_embeddings(
+    ::monolith::io::proto::ExampleBatch* example_batch,
+    UECompressMethod compress_method) {
+  if (!IsValidMethod(compress_method)) {
     return false;
   }
+  for (auto& named_feature_list :
+       *example_batch->mutable_named_feature_list()) {
+    for (auto& feature : *named_feature_list.mutable_feature()) {
+      if (!decompress_embedding(&feature, compress_method)) {
+        return false;
+      }
+    }
+  }
+  return true;
 }
 
 }  // namespace monolith_tf
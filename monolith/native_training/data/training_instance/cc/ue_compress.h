@@ -15,9 +15,15 @@
 #ifndef MONOLITH_NATIVE_TRAINING_DATA_TRAINING_INSTANCE_CC_UE_COMPRESS_H_
 #define MONOLITH_NATIVE_TRAINING_DATA_TRAINING_INSTANCE_CC_UE_COMPRESS_H_
 
+#include <string>
+#include <vector>
+
+#include "absl/container/flat_hash_set.h"
+#include "absl/strings/string_view.h"
 #include "glog/logging.h"
 #include "idl/matrix/compression/compression.h"
 #include "idl/matrix/compression/float16.h"
+#include "idl/matrix/proto/example.pb.h"
 #include "idl/matrix/proto/proto_parser.pb.h"
 
 namespace tensorflow {
@@ -37,6 +43,43 @@ class UECompress {
   bool decompress_embeddings(
       const ::idl::matrix::proto::Feature& feature_column,
       std::vector<float>* embedding, UECompressMethod compress_method);
+
+  // The compressed embedding in feature_column without the flag, or an empty
+  // view if there is none. It points into feature_column.
+  absl::string_view find_compressed_embedding(
+      const ::idl::matrix::proto::Feature& feature_column);
+
+  // The number of floats in a compressed embedding, or 0 if it is malformed.
+  size_t embedding_size(absl::string_view compressed,
+                        UECompressMethod compress_method);
+
+  // Decompresses into embedding[0, embedding_size(compressed)), e.g. a row
+  // of the output tensor.
+  bool decompress_embedding(absl::string_view compressed, float* embedding,
+                            UECompressMethod compress_method);
+
+  // In an Example or ExampleBatch, a compressed embedding is a bytes_list
+  // holding the flagged bytes, in place of the float_list. Compresses the
+  // float lists of the features named in names into that form.
+  bool compress_embeddings(::monolith::io::proto::Example* example,
+                           const absl::flat_hash_set<std::string>& names,
+                           UECompressMethod compress_method);
+  bool compress_embeddings(::monolith::io::proto::ExampleBatch* example_batch,
+                           const absl::flat_hash_set<std::string>& names,
+                           UECompressMethod compress_method);
+
+  // Turns all the compressed embeddings back into float lists.
+  bool decompress_embeddings(::monolith::io::proto::Example* example,
+                             UECompressMethod compress_method);
+  bool decompress_embeddings(
+      ::monolith::io::proto::ExampleBatch* example_batch,
+      UECompressMethod compress_method);
+
+ private:
+  bool compress_embedding(::monolith::io::proto::Feature* feature,
+                          UECompressMethod compress_method);
+  bool decompress_embedding(::monolith::io::proto::Feature* feature,
+                            UECompressMethod compress_method);
 };
 
 }  // namespace monolith_tf
@@ -0,0 +1,186 @@
+// Copyright 2022 ByteDance and/or its affiliates.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "monolith/native_training/data/training_instance/cc/ue_compress.h"
+
+namespace tensorflow {
+namespace monolith_tf {
+namespace {
+
+using ::idl::matrix::proto::Feature;
+
+// How the embeddings were compressed and decompressed before: through
+// temporary vectors and strings.
+void LegacyCompress(Feature* feature) {
+  auto* bytes_value = feature->add_bytes_value();
+  int embedding_size = feature->float_value_size();
+  std::vector<float> compress_input;
+  compress_input.reserve(embedding_size);
+  for (auto value : feature->float_value()) {
+    compress_input.push_back(value);
+  }
+  std::string compress_out;
+  matrix::compression::compress_float_list_qtz8mm(
+      reinterpret_cast<const char*>(compress_input.data()),
+      embedding_size * sizeof(float), &compress_out);
+  *bytes_value = "UE_QTZ" + compress_out;
+}
+
+void LegacyDecompress(const Feature& feature, float* out) {
+  std::string compress_out;
+  std::string bytes_value;
+  for (auto& value : feature.bytes_value()) {
+    if (value.find("UE_QTZ") == 0) {
+      bytes_value = value.substr(6);
+    }
+  }
+  matrix::compression::decompress_float_list_qtz8mm(
+      bytes_value.data(), bytes_value.size(), &compress_out);
+  size_t embedding_size =
+      bytes_value.size() - 2 * sizeof(matrix::compression::Float16);
+  const float* output = reinterpret_cast<const float*>(compress_out.data());
+  std::vector<float> embedding;
+  for (size_t i = 0; i < embedding_size; ++i) {
+    embedding.emplace_back(output[i]);
+  }
+  std::copy(embedding.begin(), embedding.end(), out);
+}
+
+// Args: number of features, dim.
+std::vector<Feature> MakeFeatures(const benchmark::State& state) {
+  std::mt19937 gen(0);
+  std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+  std::vector<Feature> features(state.range(0));
+  for (auto& feature : features) {
+    for (int i = 0; i < state.range(1); ++i) {
+      feature.add_float_value(dist(gen));
+    }
+    // Other bytes the flag is looked for in.
+    feature.add_bytes_value(std::string(64, 'b'));
+  }
+  return features;
+}
+
+void SetBytesProcessed(benchmark::State* state) {
+  state->SetBytesProcessed(state->iterations() * state->range(0) *
+                           state->range(1) * sizeof(float));
+}
+
+void BM_LegacyCompress(benchmark::State& state) {  // NOLINT
+  auto features = MakeFeatures(state);
+  for (auto _ : state) {
+    for (auto& feature : features) {
+      LegacyCompress(&feature);
+      feature.mutable_bytes_value()->RemoveLast();
+    }
+  }
+  SetBytesProcessed(&state);
+}
+
+void BM_Compress(benchmark::State& state) {  // NOLINT
+  auto features = MakeFeatures(state);
+  UECompress ue_compress;
+  for (auto _ : state) {
+    for (auto& feature : features) {
+      ue_compress.compress_embeddings(&feature,
+                                      UECompressMethod::COMPRESS_QTZ8);
+      feature.mutable_bytes_value()->RemoveLast();
+    }
+  }
+  SetBytesProcessed(&state);
+}
+
+void BM_LegacyDecompress(benchmark::State& state) {  // NOLINT
+  auto features = MakeFeatures(state);
+  const int dim = state.range(1);
+  UECompress ue_compress;
+  for (auto& feature : features) {
+    ue_compress.compress_embeddings(&feature, UECompressMethod::COMPRESS_QTZ8);
+  }
+  std::vector<float> out(features.size() * dim);
+  for (auto _ : state) {
+    for (size_t i = 0; i < features.size(); ++i) {
+      LegacyDecompress(features[i], out.data() + i * dim);
+    }
+    benchmark::DoNotOptimize(out.data());
+  }
+  SetBytesProcessed(&state);
+}
+
+// Into the rows of a preallocated output, as the instance parser does.
+void BM_Decompress(benchmark::State& state) {  // NOLINT
+  auto features = MakeFeatures(state);
+  const int dim = state.range(1);
+  UECompress ue_compress;
+  for (auto& feature : features) {
+    ue_compress.compress_embeddings(&feature, UECompressMethod::COMPRESS_QTZ8);
+  }
+  std::vector<float> out(features.size() * dim);
+  for (auto _ : state) {
+    for (size_t i = 0; i < features.size(); ++i) {
+      ue_compress.decompress_embedding(
+          ue_compress.find_compressed_embedding(features[i]),
+          out.data() + i * dim, UECompressMethod::COMPRESS_QTZ8);
+    }
+    benchmark::DoNotOptimize(out.data());
+  }
+  SetBytesProcessed(&state);
+}
+
+// Compresses and decompresses an ExampleBatch in place.
+void BM_ExampleBatchRoundTrip(benchmark::State& state) {  // NOLINT
+  auto features = MakeFeatures(state);
+  ::monolith::io::proto::ExampleBatch example_batch;
+  auto* named_feature_list = example_batch.add_named_feature_list();
+  named_feature_list->set_name("ue");
+  for (const auto& feature : features) {
+    auto* float_list =
+        named_feature_list->add_feature()->mutable_float_list();
+    float_list->mutable_value()->CopyFrom(feature.float_value());
+  }
+  UECompress ue_compress;
+  const absl::flat_hash_set<std::string> names = {"ue"};
+  for (auto _ : state) {
+    ue_compress.compress_embeddings(&example_batch, names,
+                                    UECompressMethod::COMPRESS_QTZ8);
+    ue_compress.decompress_embeddings(&example_batch,
+                                      UECompressMethod::COMPRESS_QTZ8);
+  }
+  SetBytesProcessed(&state);
+}
+
+void Args(benchmark::internal::Benchmark* b) {
+  for (int64_t num_features : {256}) {
+    for (int64_t dim : {16, 128}) {
+      b->Args({num_features, dim});
+    }
+  }
+}
+
+BENCHMARK(BM_LegacyCompress)->Apply(Args);
+BENCHMARK(BM_Compress)->Apply(Args);
+BENCHMARK(BM_LegacyDecompress)->Apply(Args);
+BENCHMARK(BM_Decompress)->Apply(Args);
+BENCHMARK(BM_ExampleBatchRoundTrip)->Apply(Args);
+
+}  // namespace
+}  // namespace monolith_tf
+}  // namespace tensorflow
+
+BENCHMARK_MAIN();
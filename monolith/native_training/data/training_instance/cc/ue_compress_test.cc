@@ -13,6 +13,10 @@
 // limitations under the License.
 
 #include "ue_compress.h"
+
+#include <cmath>
+
+#include "absl/strings/match.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 
@@ -56,5 +60,77 @@ TEST(UECompressTest, Basic) {
   }
 }
 
+TEST(UECompressTest, DecompressIntoBuffer) {
+  UECompress ue_compress;
+  // Up to 4 floats are stored as f16.
+  for (int dim : {1, 3, 4, 5, 64}) {
+    ::idl::matrix::proto::Feature feature;
+    std::vector<float> float_values;
+    for (int i = 0; i < dim; ++i) {
+      float_values.push_back(std::sin(i));
+      feature.add_float_value(float_values.back());
+    }
+    feature.add_bytes_value("not compressed");
+    ASSERT_TRUE(ue_compress.compress_embeddings(
+        &feature, UECompressMethod::COMPRESS_QTZ8));
+
+    absl::string_view compressed =
+        ue_compress.find_compressed_embedding(feature);
+    ASSERT_EQ(ue_compress.embedding_size(compressed,
+                                         UECompressMethod::COMPRESS_QTZ8),
+              dim);
+    std::vector<float> embedding(dim + 1, 42.0f);
+    ASSERT_TRUE(ue_compress.decompress_embedding(
+        compressed, embedding.data(), UECompressMethod::COMPRESS_QTZ8));
+    EXPECT_EQ(embedding.back(), 42.0f);
+    embedding.pop_back();
+    EXPECT_THAT(embedding, Pointwise(FloatNear(1e-2), float_values)) << dim;
+  }
+
+  ::idl::matrix::proto::Feature feature;
+  feature.add_bytes_value("not compressed");
+  EXPECT_TRUE(ue_compress.find_compressed_embedding(feature).empty());
+}
+
+TEST(UECompressTest, ExampleBatchInPlace) {
+  UECompress ue_compress;
+  ::monolith::io::proto::ExampleBatch example_batch;
+  example_batch.set_batch_size(2);
+  auto* ue = example_batch.add_named_feature_list();
+  ue->set_name("ue");
+  auto* other = example_batch.add_named_feature_list();
+  other->set_name("other");
+  std::vector<std::vector<float>> float_values = {{1.1, 0.1, 3.1, 5.1, 2.2},
+                                                  {-1.0, 2.0}};
+  for (const auto& values : float_values) {
+    for (auto* list : {ue, other}) {
+      auto* float_list = list->add_feature()->mutable_float_list();
+      for (float v : values) {
+        float_list->add_value(v);
+      }
+    }
+  }
+
+  ASSERT_TRUE(ue_compress.compress_embeddings(
+      &example_batch, {"ue"}, UECompressMethod::COMPRESS_QTZ8));
+  for (const auto& feature : ue->feature()) {
+    ASSERT_TRUE(feature.has_bytes_list());
+    EXPECT_TRUE(absl::StartsWith(feature.bytes_list().value(0), "UE_QTZ"));
+  }
+  for (const auto& feature : other->feature()) {
+    EXPECT_TRUE(feature.has_float_list());
+  }
+
+  ASSERT_TRUE(ue_compress.decompress_embeddings(
+      &example_batch, UECompressMethod::COMPRESS_QTZ8));
+  for (int i = 0; i < 2; ++i) {
+    const auto& feature = ue->feature(i);
+    ASSERT_TRUE(feature.has_float_list());
+    std::vector<float> embedding(feature.float_list().value().begin(),
+                                 feature.float_list().value().end());
+    EXPECT_THAT(embedding, Pointwise(FloatNear(1e-2), float_values[i]));
+  }
+}
+
 }  // namespace monolith_tf
 }  // namespace tensorflow
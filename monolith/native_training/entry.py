@@ -14,6 +14,7 @@
 
 import abc
 import copy
+import hashlib
 from typing import Any, List, Union
 
 import tensorflow as tf
@@ -428,12 +429,15 @@ class RandomUniformInitializer(Initializer):
   
   Args:
     minval, maxval (:obj:`float`): 初始化的区间
+    seed (:obj:`int`): 随机种子，同一个 fid 在同一个种子下初始值相同。默认由
+      hash table 的名字决定，见 set_default_seeds
   
   """
 
-  def __init__(self, minval=None, maxval=None):
+  def __init__(self, minval=None, maxval=None, seed=None):
     self.minval = minval
     self.maxval = maxval
+    self.seed = seed
 
   def as_proto(self):
     init = embedding_hash_table_pb2.InitializerConfig()
@@ -441,6 +445,20 @@ class RandomUniformInitializer(Initializer):
     return init
 
 
+def set_default_seeds(
+    table_config: embedding_hash_table_pb2.EmbeddingHashTableConfig,
+    table_name: str):
+  """Seeds the random uniform initializers without a seed from the table name,
+  so that tables and their segments do not start from the same values."""
+  digest = hashlib.md5(table_name.encode()).digest()
+  seed = int.from_bytes(digest[:8], "little")
+  for i, segment in enumerate(table_config.entry_config.segments):
+    init_config = segment.init_config
+    if (init_config.WhichOneof("type") == "random_uniform" and
+        not init_config.random_uniform.HasField("seed")):
+      init_config.random_uniform.seed = (seed + i) % (1 << 64)
+
+
 class BatchSoftmaxInitializer(Initializer):
 
   def __init__(self, init_step_interval: float):
@@ -49,6 +49,36 @@ class EntryTest(unittest.TestCase):
     entry.RandomUniformInitializer(-0.5, 0.5).as_proto()
     entry.BatchSoftmaxInitializer(1.0).as_proto()
 
+  def test_default_seeds(self):
+
+    def table_config(initializer):
+      config = embedding_hash_table_pb2.EmbeddingHashTableConfig()
+      for _ in range(2):
+        config.entry_config.segments.append(
+            entry.CombineAsSegment(4, initializer, entry.SgdOptimizer(),
+                                   entry.Fp32Compressor()))
+      return config
+
+    def seeds(config):
+      return [
+          segment.init_config.random_uniform.seed
+          for segment in config.entry_config.segments
+      ]
+
+    config = table_config(entry.RandomUniformInitializer(-0.5, 0.5))
+    entry.set_default_seeds(config, "table_a")
+    self.assertEqual(seeds(config), [seeds(config)[0], seeds(config)[0] + 1])
+    same = table_config(entry.RandomUniformInitializer(-0.5, 0.5))
+    entry.set_default_seeds(same, "table_a")
+    self.assertEqual(seeds(same), seeds(config))
+    other = table_config(entry.RandomUniformInitializer(-0.5, 0.5))
+    entry.set_default_seeds(other, "table_b")
+    self.assertNotEqual(seeds(other), seeds(config))
+
+    config = table_config(entry.RandomUniformInitializer(-0.5, 0.5, seed=3))
+    entry.set_default_seeds(config, "table_a")
+    self.assertEqual(seeds(config), [3, 3])
+
   def test_compressor(self):
     entry.Fp16Compressor().as_proto()
     entry.Fp32Compressor().as_proto()
@@ -319,9 +319,18 @@ class HashTable(BaseHashTable):
         random_sleep_ms=random_sleep_ms)
     return self._copy_with_new_table(new_table)
 
-  def restore(self, basename: tf.Tensor) -> "HashTable":
+  def restore(self,
+              basename: tf.Tensor,
+              id_shard_index: int = 0,
+              id_num_shards: int = 1) -> "HashTable":
+    """Restores from basename, a scalar, or a vector of the basenames saved by
+    all PS of a cluster of different size. Only ids with
+    floormod(id, id_num_shards) == id_shard_index are restored."""
     new_table = hash_table_ops.monolith_hash_table_restore(
-        self._table, basename)
+        self._table,
+        basename,
+        id_shard_index=id_shard_index,
+        id_num_shards=id_num_shards)
     return self._copy_with_new_table(new_table)
 
   def _copy_with_new_table(self, new_table: tf.Tensor):
@@ -472,6 +481,7 @@ def hash_table_from_config(config: entry.HashTableConfigInstance,
 
   if is_exporting():
     table_config.entry_config.entry_type = embedding_hash_table_pb2.EntryConfig.EntryType.SERVING
+  entry.set_default_seeds(table_config, name_suffix)
   dim_size = infer_dim_size(config.table_config)
   table_config_str = table_config.SerializeToString()
   slot_expire_time_config = config.table_config.slot_expire_time_config.SerializeToString(
@@ -0,0 +1,118 @@
+// Copyright 2022 ByteDance and/or its affiliates.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MONOLITH_MONOLITH_NATIVE_TRAINING_LAYERS_KERNELS_FFM_CPU_KERNELS_H_
+#define MONOLITH_MONOLITH_NATIVE_TRAINING_LAYERS_KERNELS_FFM_CPU_KERNELS_H_
+
+#include <algorithm>
+#include <cstdint>
+
+#include "monolith/native_training/runtime/hash_table/optimizer/avx_utils.h"
+
+namespace tensorflow {
+namespace monolith_tf {
+
+// The CPU FFM kernels work on batch rows [begin, end) of row major matrices:
+//   left:  [batch, left_feat_num * dim_size]
+//   right: [batch, right_feat_num * dim_size]
+// A batch row only reads and writes its own rows, so disjoint row ranges can
+// be computed concurrently. The rows of one batch row are small enough to stay
+// in L1 while every (left, right) pair of features is visited.
+struct FFMShape {
+  int64_t left_feat_num;
+  int64_t right_feat_num;
+  int64_t dim_size;
+
+  int64_t left_width() const { return left_feat_num * dim_size; }
+  int64_t right_width() const { return right_feat_num * dim_size; }
+  // The number of output columns for one (left, right) pair of features.
+  template <bool kDot>
+  int64_t pair_width() const {
+    return kDot ? 1 : dim_size;
+  }
+  template <bool kDot>
+  int64_t output_width() const {
+    return left_feat_num * right_feat_num * pair_width<kDot>();
+  }
+};
+
+// With kDot, output is [batch, left_feat_num * right_feat_num], and
+//   output(b, l * right_feat_num + r) = <left_l(b), right_r(b)>
+// otherwise output is [batch, left_feat_num * right_feat_num * dim_size],
+// the element wise products of the same pairs.
+template <bool kDot>
+void FFMRows(const FFMShape& shape, const float* left, const float* right,
+             int64_t begin, int64_t end, float* output) {
+  const int64_t dim = shape.dim_size;
+  for (int64_t b = begin; b < end; ++b) {
+    const float* left_row = left + b * shape.left_width();
+    const float* right_row = right + b * shape.right_width();
+    float* out = output + b * shape.output_width<kDot>();
+    for (int64_t l = 0; l < shape.left_feat_num; ++l) {
+      const float* left_feat = left_row + l * dim;
+      for (int64_t r = 0; r < shape.right_feat_num; ++r) {
+        const float* right_feat = right_row + r * dim;
+        if (kDot) {
+          *out = monolith::hash_table::Dot(left_feat, right_feat, dim);
+        } else {
+          monolith::hash_table::Multiply(left_feat, right_feat, out, dim);
+        }
+        out += shape.pair_width<kDot>();
+      }
+    }
+  }
+}
+
+// The gradients of FFMRows<kDot>: grad has the shape of its output, and
+// left_grad and right_grad the shapes of left and right.
+template <bool kDot>
+void FFMGradRows(const FFMShape& shape, const float* grad, const float* left,
+                 const float* right, int64_t begin, int64_t end,
+                 float* left_grad, float* right_grad) {
+  const int64_t dim = shape.dim_size;
+  std::fill(left_grad + begin * shape.left_width(),
+            left_grad + end * shape.left_width(), 0.0f);
+  std::fill(right_grad + begin * shape.right_width(),
+            right_grad + end * shape.right_width(), 0.0f);
+  for (int64_t b = begin; b < end; ++b) {
+    const float* left_row = left + b * shape.left_width();
+    const float* right_row = right + b * shape.right_width();
+    float* left_grad_row = left_grad + b * shape.left_width();
+    float* right_grad_row = right_grad + b * shape.right_width();
+    const float* g = grad + b * shape.output_width<kDot>();
+    for (int64_t l = 0; l < shape.left_feat_num; ++l) {
+      const float* left_feat = left_row + l * dim;
+      float* left_grad_feat = left_grad_row + l * dim;
+      for (int64_t r = 0; r < shape.right_feat_num; ++r) {
+        const float* right_feat = right_row + r * dim;
+        float* right_grad_feat = right_grad_row + r * dim;
+        if (kDot) {
+          monolith::hash_table::Axpy(*g, right_feat, left_grad_feat, dim);
+          monolith::hash_table::Axpy(*g, left_feat, right_grad_feat, dim);
+        } else {
+          monolith::hash_table::MultiplyAdd(g, right_feat, left_grad_feat,
+                                            dim);
+          monolith::hash_table::MultiplyAdd(g, left_feat, right_grad_feat,
+                                            dim);
+        }
+        g += shape.pair_width<kDot>();
+      }
+    }
+  }
+}
+
+}  // namespace monolith_tf
+}  // namespace tensorflow
+
+#endif  // MONOLITH_MONOLITH_NATIVE_TRAINING_LAYERS_KERNELS_FFM_CPU_KERNELS_H_
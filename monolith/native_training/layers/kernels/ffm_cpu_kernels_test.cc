@@ -0,0 +1,151 @@
+// Copyright 2022 ByteDance and/or its affiliates.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "monolith/native_training/layers/kernels/ffm_cpu_kernels.h"
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace tensorflow {
+namespace monolith_tf {
+namespace {
+
+constexpr int64_t kBatchSize = 7;
+// Rows computed by separate calls, as the shards of the op do.
+const std::vector<int64_t> kSplits = {0, 3, 3, 4, kBatchSize};
+
+std::vector<float> RandomFloats(int64_t n, std::mt19937* gen) {
+  std::uniform_real_distribution<float> dist(-1.f, 1.f);
+  std::vector<float> v(n);
+  for (float& x : v) {
+    x = dist(*gen);
+  }
+  return v;
+}
+
+void ExpectNear(const std::vector<float>& actual,
+                const std::vector<float>& expected, const FFMShape& shape) {
+  ASSERT_EQ(actual.size(), expected.size());
+  for (size_t i = 0; i < actual.size(); ++i) {
+    ASSERT_NEAR(actual[i], expected[i], 1e-5f * (1 + std::fabs(expected[i])))
+        << "dim " << shape.dim_size << " index " << i;
+  }
+}
+
+// The serial loops over every batch row, feature pair and dim.
+std::vector<float> SerialFFM(const FFMShape& shape, bool dot,
+                             const std::vector<float>& left,
+                             const std::vector<float>& right) {
+  const int64_t L = shape.left_feat_num, R = shape.right_feat_num;
+  const int64_t D = shape.dim_size;
+  const int64_t ow = dot ? L * R : L * R * D;
+  std::vector<float> output(kBatchSize * ow, 0.0f);
+  for (int64_t b = 0; b < kBatchSize; ++b) {
+    for (int64_t l = 0; l < L; ++l) {
+      for (int64_t r = 0; r < R; ++r) {
+        for (int64_t k = 0; k < D; ++k) {
+          float product = left[b * L * D + l * D + k] *
+                          right[b * R * D + r * D + k];
+          if (dot) {
+            output[b * ow + l * R + r] += product;
+          } else {
+            output[b * ow + (l * R + r) * D + k] = product;
+          }
+        }
+      }
+    }
+  }
+  return output;
+}
+
+void SerialFFMGrad(const FFMShape& shape, bool dot,
+                   const std::vector<float>& grad,
+                   const std::vector<float>& left,
+                   const std::vector<float>& right,
+                   std::vector<float>* left_grad,
+                   std::vector<float>* right_grad) {
+  const int64_t L = shape.left_feat_num, R = shape.right_feat_num;
+  const int64_t D = shape.dim_size;
+  const int64_t gw = dot ? L * R : L * R * D;
+  left_grad->assign(left.size(), 0.0f);
+  right_grad->assign(right.size(), 0.0f);
+  for (int64_t b = 0; b < kBatchSize; ++b) {
+    for (int64_t l = 0; l < L; ++l) {
+      for (int64_t r = 0; r < R; ++r) {
+        for (int64_t k = 0; k < D; ++k) {
+          float g = dot ? grad[b * gw + l * R + r]
+                        : grad[b * gw + (l * R + r) * D + k];
+          (*left_grad)[b * L * D + l * D + k] +=
+              g * right[b * R * D + r * D + k];
+          (*right_grad)[b * R * D + r * D + k] +=
+              g * left[b * L * D + l * D + k];
+        }
+      }
+    }
+  }
+}
+
+template <bool kDot>
+void TestFFM(int64_t dim_size) {
+  const FFMShape shape{3, 5, dim_size};
+  std::mt19937 gen(dim_size);
+  const std::vector<float> left =
+      RandomFloats(kBatchSize * shape.left_width(), &gen);
+  const std::vector<float> right =
+      RandomFloats(kBatchSize * shape.right_width(), &gen);
+
+  std::vector<float> output(kBatchSize * shape.output_width<kDot>(), NAN);
+  for (size_t i = 0; i + 1 < kSplits.size(); ++i) {
+    FFMRows<kDot>(shape, left.data(), right.data(), kSplits[i],
+                  kSplits[i + 1], output.data());
+  }
+  ExpectNear(output, SerialFFM(shape, kDot, left, right), shape);
+
+  const std::vector<float> grad = RandomFloats(output.size(), &gen);
+  // Stale values, which the kernel has to overwrite.
+  std::vector<float> left_grad(left.size(), NAN);
+  std::vector<float> right_grad(right.size(), NAN);
+  for (size_t i = 0; i + 1 < kSplits.size(); ++i) {
+    FFMGradRows<kDot>(shape, grad.data(), left.data(), right.data(),
+                      kSplits[i], kSplits[i + 1], left_grad.data(),
+                      right_grad.data());
+  }
+  std::vector<float> expected_left_grad, expected_right_grad;
+  SerialFFMGrad(shape, kDot, grad, left, right, &expected_left_grad,
+                &expected_right_grad);
+  ExpectNear(left_grad, expected_left_grad, shape);
+  ExpectNear(right_grad, expected_right_grad, shape);
+}
+
+// Whole 8 wide vectors, and dims with tails after them.
+constexpr int64_t kDimSizes[] = {8, 9, 13, 15, 16, 31, 32};
+
+TEST(FFMCpuKernelsTest, Dot) {
+  for (int64_t dim_size : kDimSizes) {
+    TestFFM<true>(dim_size);
+  }
+}
+
+TEST(FFMCpuKernelsTest, Multiply) {
+  for (int64_t dim_size : kDimSizes) {
+    TestFFM<false>(dim_size);
+  }
+}
+
+}  // namespace
+}  // namespace monolith_tf
+}  // namespace tensorflow
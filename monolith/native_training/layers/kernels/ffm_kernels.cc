@@ -16,88 +16,76 @@
 #include <string>
 #include <vector>
 
+#include "monolith/native_training/layers/kernels/ffm_cpu_kernels.h"
 #include "tensorflow/core/framework/op.h"
 #include "tensorflow/core/framework/op_kernel.h"
 #include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/util/work_sharder.h"
 
 namespace tensorflow {
 namespace monolith_tf {
 
 using CPUDevice = Eigen::ThreadPoolDevice;
 
+// Runs fn(begin, end) over ranges of batch rows on the CPU worker threads.
+// `cost` is a rough number of cycles per row.
+template <typename Fn>
+void ForBatchRows(OpKernelContext *ctx, int64 batch_size, int64 cost,
+                  const Fn &fn) {
+  auto *workers = ctx->device()->tensorflow_cpu_worker_threads();
+  Shard(workers->num_threads, workers->workers, batch_size, cost, fn);
+}
+
 template <>
 struct FFMImpl<CPUDevice> {
-  static void Compute(OpKernelContext *ctx, const std::string &int_type,
+  static void Compute(OpKernelContext *ctx, bool dot,
                       TTypes<float>::ConstMatrix left_matrix, int left_feat_num,
                       TTypes<float>::ConstMatrix right_matrix,
                       int right_feat_num, int batch_size, int dim_size,
                       TTypes<float>::Matrix output) {
-    output.setZero();
-
-    for (int l = 0; l < left_feat_num; ++l) {
-      int l_idx = l * dim_size;
-      for (int r = 0; r < right_feat_num; ++r) {
-        int r_idx = r * dim_size;
-        if (int_type == "dot") {
-          int o_idx = l * right_feat_num + r;
-          for (int b = 0; b < batch_size; ++b) {
-            for (int k = 0; k < dim_size; ++k) {
-              output(b, o_idx) +=
-                  left_matrix(b, l_idx + k) * right_matrix(b, r_idx + k);
-            }
-          }
-        } else {
-          int o_idx = (l * right_feat_num + r) * dim_size;
-          for (int b = 0; b < batch_size; ++b) {
-            for (int k = 0; k < dim_size; ++k) {
-              output(b, o_idx + k) =
-                  left_matrix(b, l_idx + k) * right_matrix(b, r_idx + k);
-            }
-          }
-        }
-      }
+    const FFMShape shape{left_feat_num, right_feat_num, dim_size};
+    const float *left = left_matrix.data();
+    const float *right = right_matrix.data();
+    float *out = output.data();
+    const int64 cost = 2 * shape.left_feat_num * shape.right_width();
+    if (dot) {
+      ForBatchRows(ctx, batch_size, cost, [&](int64 begin, int64 end) {
+        FFMRows<true>(shape, left, right, begin, end, out);
+      });
+    } else {
+      ForBatchRows(ctx, batch_size, cost, [&](int64 begin, int64 end) {
+        FFMRows<false>(shape, left, right, begin, end, out);
+      });
     }
   }
 };
 
 template <>
 struct FFMGradImpl<CPUDevice> {
-  static void Compute(OpKernelContext *ctx, const std::string &int_type,
+  static void Compute(OpKernelContext *ctx, bool dot,
                       TTypes<float>::ConstMatrix grad_matrix, int grad_feat_num,
                       TTypes<float>::ConstMatrix left_matrix, int left_feat_num,
                       TTypes<float>::ConstMatrix right_matrix,
                       int right_feat_num, int batch_size, int dim_size,
                       TTypes<float>::Matrix left_grad_matrix,
                       TTypes<float>::Matrix right_grad_matrix) {
-    left_grad_matrix.setZero();
-    right_grad_matrix.setZero();
-
-    for (int g = 0; g < grad_feat_num; ++g) {
-      int l_idx = (g / right_feat_num) * dim_size;
-      int r_idx = (g % right_feat_num) * dim_size;
-
-      if (int_type == "dot") {
-        for (int b = 0; b < batch_size; ++b) {
-          for (int k = 0; k < dim_size; ++k) {
-            left_grad_matrix(b, l_idx + k) +=
-                grad_matrix(b, g) * right_matrix(b, r_idx + k);
-
-            right_grad_matrix(b, r_idx + k) +=
-                grad_matrix(b, g) * left_matrix(b, l_idx + k);
-          }
-        }
-      } else {
-        int g_idx = g * dim_size;
-        for (int b = 0; b < batch_size; ++b) {
-          for (int k = 0; k < dim_size; ++k) {
-            left_grad_matrix(b, l_idx + k) +=
-                grad_matrix(b, g_idx + k) * right_matrix(b, r_idx + k);
-
-            right_grad_matrix(b, r_idx + k) +=
-                grad_matrix(b, g_idx + k) * left_matrix(b, l_idx + k);
-          }
-        }
-      }
+    const FFMShape shape{left_feat_num, right_feat_num, dim_size};
+    const float *grad = grad_matrix.data();
+    const float *left = left_matrix.data();
+    const float *right = right_matrix.data();
+    float *left_grad = left_grad_matrix.data();
+    float *right_grad = right_grad_matrix.data();
+    const int64 cost = 4 * shape.left_feat_num * shape.right_width();
+    if (dot) {
+      ForBatchRows(ctx, batch_size, cost, [&](int64 begin, int64 end) {
+        FFMGradRows<true>(shape, grad, left, right, begin, end, left_grad,
+                          right_grad);
+      });
+    } else {
+      ForBatchRows(ctx, batch_size, cost, [&](int64 begin, int64 end) {
+        FFMGradRows<false>(shape, grad, left, right, begin, end, left_grad,
+                           right_grad);
+      });
     }
   }
 };
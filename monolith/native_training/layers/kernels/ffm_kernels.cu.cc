@@ -80,7 +80,7 @@ __global__ void FFMKernelDot(TTypes<float>::ConstMatrix left_matrix,
 
 template <>
 struct FFMImpl<GPUDevice> {
-  static void Compute(OpKernelContext *ctx, const std::string &int_type,
+  static void Compute(OpKernelContext *ctx, bool dot,
                       TTypes<float>::ConstMatrix left_matrix, int left_feat_num,
                       TTypes<float>::ConstMatrix right_matrix,
                       int right_feat_num, int batch_size, int dim_size,
@@ -88,7 +88,7 @@ struct FFMImpl<GPUDevice> {
     Eigen::GpuDevice gpu_device = ctx->eigen_device<Eigen::GpuDevice>();
     auto config = GetGpuLaunchConfig(batch_size, gpu_device);
 
-    if (int_type == "dot") {
+    if (dot) {
       TF_CHECK_OK(GpuLaunchKernel(
           FFMKernelDot, config.block_count, config.thread_per_block, 0,
           gpu_device.stream(), left_matrix, left_feat_num, right_matrix,
@@ -169,7 +169,7 @@ __global__ void FFMGradKernelDot(
 
 template <>
 struct FFMGradImpl<GPUDevice> {
-  static void Compute(OpKernelContext *ctx, const std::string &int_type,
+  static void Compute(OpKernelContext *ctx, bool dot,
                       TTypes<float>::ConstMatrix grad_matrix, int grad_feat_num,
                       TTypes<float>::ConstMatrix left_matrix, int left_feat_num,
                       TTypes<float>::ConstMatrix right_matrix,
@@ -179,7 +179,7 @@ struct FFMGradImpl<GPUDevice> {
     Eigen::GpuDevice gpu_device = ctx->eigen_device<Eigen::GpuDevice>();
     auto config = GetGpuLaunchConfig(batch_size, gpu_device);
 
-    if (int_type == "dot") {
+    if (dot) {
       TF_CHECK_OK(GpuLaunchKernel(
           FFMGradKernelDot, config.block_count, config.thread_per_block, 0,
           gpu_device.stream(), grad_matrix, grad_feat_num, left_matrix,
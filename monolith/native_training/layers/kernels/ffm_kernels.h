@@ -23,9 +23,10 @@
 namespace tensorflow {
 namespace monolith_tf {
 
+// `dot` selects the "dot" interaction, any other int_type multiplies.
 template <typename Device>
 struct FFMImpl {
-  static void Compute(OpKernelContext *ctx, const std::string &int_type,
+  static void Compute(OpKernelContext *ctx, bool dot,
                       TTypes<float>::ConstMatrix left_matrix, int left_feat_num,
                       TTypes<float>::ConstMatrix right_matrix,
                       int right_feat_num, int batch_size, int dim_size,
@@ -34,7 +35,7 @@ struct FFMImpl {
 
 template <typename Device>
 struct FFMGradImpl {
-  static void Compute(OpKernelContext *ctx, const std::string &int_type,
+  static void Compute(OpKernelContext *ctx, bool dot,
                       TTypes<float>::ConstMatrix grad_matrix, int grad_feat_num,
                       TTypes<float>::ConstMatrix left_matrix, int left_feat_num,
                       TTypes<float>::ConstMatrix right_matrix,
@@ -48,7 +49,9 @@ class FFMOp : public OpKernel {
  public:
   explicit FFMOp(OpKernelConstruction *ctx) : OpKernel(ctx) {
     OP_REQUIRES_OK(ctx, ctx->GetAttr("dim_size", &dim_size_));
-    OP_REQUIRES_OK(ctx, ctx->GetAttr("int_type", &int_type_));
+    std::string int_type;
+    OP_REQUIRES_OK(ctx, ctx->GetAttr("int_type", &int_type));
+    dot_ = int_type == "dot";
   }
 
   void Compute(OpKernelContext *ctx) override {
@@ -58,23 +61,31 @@ class FFMOp : public OpKernel {
         ctx, left_tensor->dims() == 2,
         errors::InvalidArgument("the left input tensor of ffm is not 2D"));
     int64 batch_size = left_tensor->dim_size(0);
+    OP_REQUIRES(ctx, left_tensor->dim_size(1) % dim_size_ == 0,
+                errors::InvalidArgument(
+                    "the left input tensor of ffm is not a multiple of ",
+                    dim_size_, " wide"));
     int64 left_feat_num = left_tensor->dim_size(1) / dim_size_;
     auto left_matrix = left_tensor->matrix<float>();
 
     const Tensor *right_tensor;
     OP_REQUIRES_OK(ctx, ctx->input("right", &right_tensor));
     OP_REQUIRES(
-        ctx, left_tensor->dims() == 2,
+        ctx, right_tensor->dims() == 2,
         errors::InvalidArgument("the right input tensor of ffm is not 2D"));
     OP_REQUIRES(ctx, batch_size == right_tensor->dim_size(0),
                 errors::InvalidArgument(
                     "the batch size of left and right tensor are not match"));
+    OP_REQUIRES(ctx, right_tensor->dim_size(1) % dim_size_ == 0,
+                errors::InvalidArgument(
+                    "the right input tensor of ffm is not a multiple of ",
+                    dim_size_, " wide"));
     int64 right_feat_num = right_tensor->dim_size(1) / dim_size_;
     auto right_matrix = right_tensor->matrix<float>();
 
     Tensor *output_tensor = nullptr;
     int out_last_dim = 0;
-    if (int_type_ == "dot") {
+    if (dot_) {
       out_last_dim = left_feat_num * right_feat_num;
     } else {
       out_last_dim = left_feat_num * right_feat_num * dim_size_;
@@ -83,14 +94,14 @@ class FFMOp : public OpKernel {
     OP_REQUIRES_OK(ctx, ctx->allocate_output(0, {batch_size, out_last_dim},
                                              &output_tensor));
     auto output_matrix = output_tensor->matrix<float>();
-    FFMImpl<Device>::Compute(ctx, int_type_, left_matrix, left_feat_num,
+    FFMImpl<Device>::Compute(ctx, dot_, left_matrix, left_feat_num,
                              right_matrix, right_feat_num, batch_size,
                              dim_size_, output_matrix);
   }
 
  private:
   int dim_size_;
-  std::string int_type_;
+  bool dot_;
 };
 
 template <typename Device>
@@ -98,7 +109,9 @@ class FFMGradOp : public OpKernel {
  public:
   explicit FFMGradOp(OpKernelConstruction *ctx) : OpKernel(ctx) {
     OP_REQUIRES_OK(ctx, ctx->GetAttr("dim_size", &dim_size_));
-    OP_REQUIRES_OK(ctx, ctx->GetAttr("int_type", &int_type_));
+    std::string int_type;
+    OP_REQUIRES_OK(ctx, ctx->GetAttr("int_type", &int_type));
+    dot_ = int_type == "dot";
   }
 
   void Compute(OpKernelContext *ctx) override {
@@ -108,7 +121,7 @@ class FFMGradOp : public OpKernel {
                 errors::InvalidArgument("the grad tensor of ffm is not 2D"));
     int batch_size = grad_tensor->dim_size(0);
     int grad_feat_num = 0;
-    if (int_type_ == "dot") {
+    if (dot_) {
       grad_feat_num = grad_tensor->dim_size(1);
     } else {
       grad_feat_num = grad_tensor->dim_size(1) / dim_size_;
@@ -121,17 +134,30 @@ class FFMGradOp : public OpKernel {
     OP_REQUIRES(
         ctx, left_tensor->dims() == 2,
         errors::InvalidArgument("the left input tensor of ffm is not 2D"));
+    OP_REQUIRES(ctx, left_tensor->dim_size(1) % dim_size_ == 0,
+                errors::InvalidArgument(
+                    "the left input tensor of ffm is not a multiple of ",
+                    dim_size_, " wide"));
     int64 left_feat_num = left_tensor->dim_size(1) / dim_size_;
     auto left_matrix = left_tensor->matrix<float>();
 
     const Tensor *right_tensor;
     OP_REQUIRES_OK(ctx, ctx->input("right", &right_tensor));
     OP_REQUIRES(
-        ctx, left_tensor->dims() == 2,
+        ctx, right_tensor->dims() == 2,
         errors::InvalidArgument("the right input tensor of ffm is not 2D"));
+    OP_REQUIRES(ctx, right_tensor->dim_size(1) % dim_size_ == 0,
+                errors::InvalidArgument(
+                    "the right input tensor of ffm is not a multiple of ",
+                    dim_size_, " wide"));
     int64 right_feat_num = right_tensor->dim_size(1) / dim_size_;
     auto right_matrix = right_tensor->matrix<float>();
 
+    OP_REQUIRES(ctx,
+                left_tensor->dim_size(0) == batch_size &&
+                    right_tensor->dim_size(0) == batch_size,
+                errors::InvalidArgument(
+                    "the batch size of grad, left and right are not match"));
     OP_REQUIRES(ctx, grad_feat_num == left_feat_num * right_feat_num,
                 errors::InvalidArgument("the in/out shape not match"));
 
@@ -145,7 +171,7 @@ class FFMGradOp : public OpKernel {
                                              &right_grad_tensor));
     auto right_grad_matrix = right_grad_tensor->matrix<float>();
 
-    FFMGradImpl<Device>::Compute(ctx, int_type_, grad_matrix, grad_feat_num,
+    FFMGradImpl<Device>::Compute(ctx, dot_, grad_matrix, grad_feat_num,
                                  left_matrix, left_feat_num, right_matrix,
                                  right_feat_num, batch_size, dim_size_,
                                  left_grad_matrix, right_grad_matrix);
@@ -153,7 +179,7 @@ class FFMGradOp : public OpKernel {
 
  private:
   int dim_size_;
-  std::string int_type_;
+  bool dot_;
 };
 
 }  // namespace monolith_tf
@@ -0,0 +1,173 @@
+// Copyright 2022 ByteDance and/or its affiliates.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <vector>
+
+#include "absl/random/random.h"
+#include "benchmark/benchmark.h"
+#include "monolith/native_training/layers/kernels/ffm_cpu_kernels.h"
+
+namespace tensorflow {
+namespace monolith_tf {
+namespace {
+
+// Args: batch size, left and right feature numbers, dim size, dot.
+struct Input {
+  explicit Input(const benchmark::State& state)
+      : batch_size(state.range(0)),
+        shape{state.range(1), state.range(2), state.range(3)},
+        dot(state.range(4) != 0),
+        left(batch_size * shape.left_width()),
+        right(batch_size * shape.right_width()),
+        output(batch_size * (dot ? shape.output_width<true>()
+                                 : shape.output_width<false>())),
+        left_grad(left.size()),
+        right_grad(right.size()) {
+    absl::BitGen bit_gen;
+    for (std::vector<float>* v : {&left, &right, &output}) {
+      for (float& x : *v) {
+        x = absl::Uniform<float>(bit_gen, -1.f, 1.f);
+      }
+    }
+  }
+
+  int64_t batch_size;
+  FFMShape shape;
+  bool dot;
+  std::vector<float> left;
+  std::vector<float> right;
+  // Also the gradient of the backward benchmarks.
+  std::vector<float> output;
+  std::vector<float> left_grad;
+  std::vector<float> right_grad;
+};
+
+// The feature pair major loops of the kernels before, on row major matrices.
+void SerialFFM(Input* in) {
+  const int64_t L = in->shape.left_feat_num, R = in->shape.right_feat_num;
+  const int64_t D = in->shape.dim_size;
+  const int64_t lw = in->shape.left_width(), rw = in->shape.right_width();
+  const int64_t ow = in->output.size() / in->batch_size;
+  std::fill(in->output.begin(), in->output.end(), 0.0f);
+  for (int64_t l = 0; l < L; ++l) {
+    for (int64_t r = 0; r < R; ++r) {
+      for (int64_t b = 0; b < in->batch_size; ++b) {
+        for (int64_t k = 0; k < D; ++k) {
+          float product = in->left[b * lw + l * D + k] *
+                          in->right[b * rw + r * D + k];
+          if (in->dot) {
+            in->output[b * ow + l * R + r] += product;
+          } else {
+            in->output[b * ow + (l * R + r) * D + k] = product;
+          }
+        }
+      }
+    }
+  }
+}
+
+void SerialFFMGrad(Input* in) {
+  const int64_t L = in->shape.left_feat_num, R = in->shape.right_feat_num;
+  const int64_t D = in->shape.dim_size;
+  const int64_t lw = in->shape.left_width(), rw = in->shape.right_width();
+  const int64_t gw = in->output.size() / in->batch_size;
+  std::fill(in->left_grad.begin(), in->left_grad.end(), 0.0f);
+  std::fill(in->right_grad.begin(), in->right_grad.end(), 0.0f);
+  for (int64_t g = 0; g < L * R; ++g) {
+    const int64_t l = g / R, r = g % R;
+    for (int64_t b = 0; b < in->batch_size; ++b) {
+      for (int64_t k = 0; k < D; ++k) {
+        float grad = in->dot ? in->output[b * gw + g]
+                             : in->output[b * gw + g * D + k];
+        in->left_grad[b * lw + l * D + k] +=
+            grad * in->right[b * rw + r * D + k];
+        in->right_grad[b * rw + r * D + k] +=
+            grad * in->left[b * lw + l * D + k];
+      }
+    }
+  }
+}
+
+void BM_SerialFFM(benchmark::State& state) {  // NOLINT
+  Input input(state);
+  for (auto _ : state) {
+    SerialFFM(&input);
+    benchmark::DoNotOptimize(input.output.data());
+  }
+  state.SetItemsProcessed(state.iterations() * input.batch_size);
+}
+
+void BM_RowFFM(benchmark::State& state) {  // NOLINT
+  Input input(state);
+  for (auto _ : state) {
+    if (input.dot) {
+      FFMRows<true>(input.shape, input.left.data(), input.right.data(), 0,
+                    input.batch_size, input.output.data());
+    } else {
+      FFMRows<false>(input.shape, input.left.data(), input.right.data(), 0,
+                     input.batch_size, input.output.data());
+    }
+    benchmark::DoNotOptimize(input.output.data());
+  }
+  state.SetItemsProcessed(state.iterations() * input.batch_size);
+}
+
+void BM_SerialFFMGrad(benchmark::State& state) {  // NOLINT
+  Input input(state);
+  for (auto _ : state) {
+    SerialFFMGrad(&input);
+    benchmark::DoNotOptimize(input.left_grad.data());
+    benchmark::DoNotOptimize(input.right_grad.data());
+  }
+  state.SetItemsProcessed(state.iterations() * input.batch_size);
+}
+
+void BM_RowFFMGrad(benchmark::State& state) {  // NOLINT
+  Input input(state);
+  for (auto _ : state) {
+    if (input.dot) {
+      FFMGradRows<true>(input.shape, input.output.data(), input.left.data(),
+                        input.right.data(), 0, input.batch_size,
+                        input.left_grad.data(), input.right_grad.data());
+    } else {
+      FFMGradRows<false>(input.shape, input.output.data(), input.left.data(),
+                         input.right.data(), 0, input.batch_size,
+                         input.left_grad.data(), input.right_grad.data());
+    }
+    benchmark::DoNotOptimize(input.left_grad.data());
+    benchmark::DoNotOptimize(input.right_grad.data());
+  }
+  state.SetItemsProcessed(state.iterations() * input.batch_size);
+}
+
+void Args(benchmark::internal::Benchmark* b) {
+  for (int64_t dot : {1, 0}) {
+    for (int64_t dim_size : {8, 16, 32}) {
+      b->Args({1024, 16, 16, dim_size, dot});
+    }
+    b->Args({1024, 48, 32, 16, dot});
+  }
+}
+
+BENCHMARK(BM_SerialFFM)->Apply(Args)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_RowFFM)->Apply(Args)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_SerialFFMGrad)->Apply(Args)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_RowFFMGrad)->Apply(Args)->Unit(benchmark::kMillisecond);
+
+}  // namespace
+}  // namespace monolith_tf
+}  // namespace tensorflow
+
+BENCHMARK_MAIN();
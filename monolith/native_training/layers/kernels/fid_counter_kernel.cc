@@ -12,8 +12,16 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <memory>
+#include <string>
+
+#include "absl/strings/str_format.h"
+#include "monolith/native_training/runtime/common/metrics.h"
+#include "monolith/native_training/runtime/hash_filter/fid_count_sketch.h"
 #include "tensorflow/core/framework/op.h"
 #include "tensorflow/core/framework/op_kernel.h"
+#include "tensorflow/core/framework/resource_mgr.h"
+#include "tensorflow/core/framework/resource_op_kernel.h"
 #include "tensorflow/core/framework/shape_inference.h"
 #include "tensorflow/core/framework/tensor.h"
 
@@ -36,10 +44,156 @@ class MonolithFidCounterOp : public OpKernel {
   int counter_threshold_;
 };
 
+using monolith::hash_filter::FidCountSketch;
+
+class FidCountSketchResource : public ResourceBase {
+ public:
+  FidCountSketchResource(const std::string &name,
+                         const FidCountSketch::Options &options)
+      : name_(name), sketch_(options) {}
+
+  FidCountSketch *sketch() { return &sketch_; }
+
+  const std::string &name() const { return name_; }
+
+  std::string DebugString() const override {
+    return absl::StrFormat("FidCountSketch %s, width: %d, depth: %d", name_,
+                           sketch_.width(), sketch_.depth());
+  }
+
+  int64 MemoryUsed() const override { return sketch_.memory_bytes(); }
+
+ private:
+  const std::string name_;
+  FidCountSketch sketch_;
+};
+
+class FidCountSketchOp : public ResourceOpKernel<FidCountSketchResource> {
+ public:
+  explicit FidCountSketchOp(OpKernelConstruction *ctx) : ResourceOpKernel(ctx) {
+    OP_REQUIRES_OK(ctx, ctx->GetAttr("width", &options_.width));
+    OP_REQUIRES_OK(ctx, ctx->GetAttr("depth", &options_.depth));
+    OP_REQUIRES_OK(ctx,
+                   ctx->GetAttr("half_life_steps", &options_.half_life_steps));
+    OP_REQUIRES_OK(ctx, ctx->GetAttr("shared_name", &shared_name_));
+    OP_REQUIRES(ctx, options_.width > 0 && options_.depth > 0,
+                errors::InvalidArgument(
+                    "width and depth of the fid count sketch must be positive"));
+  }
+
+ private:
+  Status CreateResource(FidCountSketchResource **resource)
+      TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) override {
+    *resource = new FidCountSketchResource(shared_name_, options_);
+    return Status::OK();
+  }
+
+  FidCountSketch::Options options_;
+  std::string shared_name_;
+};
+
+class FidCountSketchUpdateOp : public OpKernel {
+ public:
+  explicit FidCountSketchUpdateOp(OpKernelConstruction *ctx)
+      : OpKernel(ctx) {}
+
+  void Compute(OpKernelContext *ctx) override {
+    FidCountSketchResource *resource = nullptr;
+    OP_REQUIRES_OK(ctx,
+                   LookupResource(ctx, HandleFromInput(ctx, 0), &resource));
+    core::ScopedUnref unref(resource);
+    const Tensor &fids = ctx->input(1);
+    const Tensor &step = ctx->input(2);
+    OP_REQUIRES(ctx, TensorShapeUtils::IsScalar(step.shape()),
+                errors::InvalidArgument("step must be a scalar"));
+    Tensor *counts;
+    OP_REQUIRES_OK(ctx, ctx->allocate_output(0, fids.shape(), &counts));
+    auto fids_flat = fids.flat<int64>();
+    auto counts_flat = counts->flat<int64>();
+    resource->sketch()->Update(
+        absl::MakeConstSpan(reinterpret_cast<const int64_t *>(fids_flat.data()),
+                            fids_flat.size()),
+        step.scalar<int64>()(),
+        absl::MakeSpan(reinterpret_cast<int64_t *>(counts_flat.data()),
+                       counts_flat.size()));
+  }
+};
+
+class FidCountSketchLookupOp : public OpKernel {
+ public:
+  explicit FidCountSketchLookupOp(OpKernelConstruction *ctx)
+      : OpKernel(ctx) {}
+
+  void Compute(OpKernelContext *ctx) override {
+    FidCountSketchResource *resource = nullptr;
+    OP_REQUIRES_OK(ctx,
+                   LookupResource(ctx, HandleFromInput(ctx, 0), &resource));
+    core::ScopedUnref unref(resource);
+    const Tensor &fids = ctx->input(1);
+    Tensor *counts;
+    OP_REQUIRES_OK(ctx, ctx->allocate_output(0, fids.shape(), &counts));
+    auto fids_flat = fids.flat<int64>();
+    auto counts_flat = counts->flat<int64>();
+    resource->sketch()->Lookup(
+        absl::MakeConstSpan(reinterpret_cast<const int64_t *>(fids_flat.data()),
+                            fids_flat.size()),
+        absl::MakeSpan(reinterpret_cast<int64_t *>(counts_flat.data()),
+                       counts_flat.size()));
+  }
+};
+
+class FidCountSketchSlotStatsOp : public OpKernel {
+ public:
+  explicit FidCountSketchSlotStatsOp(OpKernelConstruction *ctx)
+      : OpKernel(ctx) {}
+
+  void Compute(OpKernelContext *ctx) override {
+    FidCountSketchResource *resource = nullptr;
+    OP_REQUIRES_OK(ctx,
+                   LookupResource(ctx, HandleFromInput(ctx, 0), &resource));
+    core::ScopedUnref unref(resource);
+    const auto stats = resource->sketch()->GetSlotStats();
+    const int64 num_slots = stats.size();
+    Tensor *slots, *occurrences, *new_fids;
+    OP_REQUIRES_OK(ctx, ctx->allocate_output(0, {num_slots}, &slots));
+    OP_REQUIRES_OK(ctx, ctx->allocate_output(1, {num_slots}, &occurrences));
+    OP_REQUIRES_OK(ctx, ctx->allocate_output(2, {num_slots}, &new_fids));
+    auto slots_vec = slots->vec<int64>();
+    auto occurrences_vec = occurrences->vec<int64>();
+    auto new_fids_vec = new_fids->vec<int64>();
+    for (int64 i = 0; i < num_slots; ++i) {
+      slots_vec(i) = stats[i].first;
+      occurrences_vec(i) = stats[i].second.occurrences;
+      new_fids_vec(i) = stats[i].second.new_fids;
+      const std::string tagkv = absl::StrFormat(
+          "name=%s|slot=%d", resource->name(), stats[i].first);
+      monolith::GetMetrics()->emit_store("fid_counter_slot_occurrences",
+                                         stats[i].second.occurrences, tagkv);
+      monolith::GetMetrics()->emit_store("fid_counter_slot_new_fids",
+                                         stats[i].second.new_fids, tagkv);
+    }
+  }
+};
+
 namespace {
 
 REGISTER_KERNEL_BUILDER(Name("MonolithFidCounter").Device(DEVICE_CPU), MonolithFidCounterOp)
 
+REGISTER_KERNEL_BUILDER(Name("MonolithFidCountSketch").Device(DEVICE_CPU),
+                        FidCountSketchOp)
+
+REGISTER_KERNEL_BUILDER(
+    Name("MonolithFidCountSketchUpdate").Device(DEVICE_CPU),
+    FidCountSketchUpdateOp)
+
+REGISTER_KERNEL_BUILDER(
+    Name("MonolithFidCountSketchLookup").Device(DEVICE_CPU),
+    FidCountSketchLookupOp)
+
+REGISTER_KERNEL_BUILDER(
+    Name("MonolithFidCountSketchSlotStats").Device(DEVICE_CPU),
+    FidCountSketchSlotStatsOp)
+
 }  // namespace
 }  // namespace monolith_tf
 }  // namespace tensorflow
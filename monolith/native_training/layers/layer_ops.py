@@ -121,6 +121,53 @@ def fid_counter(counter: tf.Tensor, counter_threshold: int, step: float = 1.0):
   return counter
 
 
+class FidCountSketch(object):
+  """Estimates how often each fid occurred, in fixed memory.
+
+  Backed by a count-min sketch of `depth` rows of `width` counters, so the
+  estimates never undercount and take depth * width * 4 bytes whatever the
+  number of fids. Counts halve every `half_life_steps` global steps, 0 keeps
+  them forever. Sketches with the same name share their counts.
+
+  Example::
+      >>> sketch = layer_ops.FidCountSketch(half_life_steps=100000)
+      >>> counts = sketch.update(fids)
+      >>> slots, occurrences, new_fids = sketch.slot_stats()
+  """
+
+  def __init__(self,
+               width: int = 1 << 20,
+               depth: int = 4,
+               half_life_steps: int = 0,
+               name: str = "MonolithFidCountSketch"):
+    self._handle = layer_ops_lib.MonolithFidCountSketch(
+        width=width,
+        depth=depth,
+        half_life_steps=half_life_steps,
+        shared_name=name)
+
+  def update(self, fids: tf.Tensor, step: tf.Tensor = None) -> tf.Tensor:
+    """Counts one occurrence of every fid at `step`, the global step by
+    default, and returns the estimated counts including them."""
+    if step is None:
+      step = tf.compat.v1.train.get_or_create_global_step()
+    return layer_ops_lib.MonolithFidCountSketchUpdate(
+        handle=self._handle, fids=fids, step=tf.cast(step, tf.int64))
+
+  def lookup(self, fids: tf.Tensor) -> tf.Tensor:
+    return layer_ops_lib.MonolithFidCountSketchLookup(handle=self._handle,
+                                                      fids=fids)
+
+  def slot_stats(self) -> Tuple[tf.Tensor, tf.Tensor, tf.Tensor]:
+    """Returns the slots seen so far with their occurrences and an estimate of
+    their distinct fids, and emits them as metrics."""
+    return layer_ops_lib.MonolithFidCountSketchSlotStats(handle=self._handle)
+
+  @property
+  def handle(self) -> tf.Tensor:
+    return self._handle
+
+
 @tf.RegisterGradient('MonolithFidCounter')
 def _fid_counter_grad(op, grad: tf.Tensor) -> tf.Tensor:
   counter = op.inputs[0]
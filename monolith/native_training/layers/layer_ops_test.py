@@ -227,6 +227,26 @@ class LayerOpsTest(tf.test.TestCase):
       self.assertAllClose(var_grad, [0])
       print(f"The grad {list(var_grad.numpy())}", flush=True)
 
+  def test_fid_count_sketch(self):
+    sketch = layer_ops.FidCountSketch(width=1024,
+                                      half_life_steps=10,
+                                      name="test_fid_count_sketch")
+    slot1, slot2 = 1 << 48, 2 << 48
+    fids = tf.constant([slot1 | 1, slot2 | 7, slot1 | 1, slot1 | 2],
+                       dtype=tf.int64)
+    self.assertAllEqual(sketch.update(fids, step=0), [2, 1, 2, 1])
+    self.assertAllEqual(sketch.update(fids, step=1), [4, 2, 4, 2])
+    self.assertAllEqual(
+        sketch.lookup(tf.constant([[slot1 | 1], [slot1 | 3]], dtype=tf.int64)),
+        [[4], [0]])
+    slots, occurrences, new_fids = sketch.slot_stats()
+    self.assertAllEqual(slots, [1, 2])
+    self.assertAllEqual(occurrences, [6, 2])
+    self.assertAllEqual(new_fids, [2, 1])
+    # One half life later.
+    sketch.update(tf.constant([], dtype=tf.int64), step=10)
+    self.assertAllEqual(sketch.lookup(fids), [2, 1, 2, 1])
+
 
 if __name__ == '__main__':
   tf.test.main()
@@ -12,6 +12,7 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include "tensorflow/core/framework/common_shape_fns.h"
 #include "tensorflow/core/framework/op.h"
 #include "tensorflow/core/framework/shape_inference.h"
 
@@ -27,4 +28,53 @@ REGISTER_OP("MonolithFidCounter")
       return Status::OK();
     });
 
+REGISTER_OP("MonolithFidCountSketch")
+    .Output("handle: resource")
+    .Attr("width: int = 1048576")
+    .Attr("depth: int = 4")
+    .Attr("half_life_steps: int = 0")
+    .Attr("container: string = ''")
+    .Attr("shared_name: string = ''")
+    .SetIsStateful()
+    .SetShapeFn(shape_inference::ScalarShape);
+
+// Counts one occurrence of every fid at global step `step`, and returns the
+// estimated counts of the fids including this batch.
+REGISTER_OP("MonolithFidCountSketchUpdate")
+    .Input("handle: resource")
+    .Input("fids: int64")
+    .Input("step: int64")
+    .Output("counts: int64")
+    .SetIsStateful()
+    .SetShapeFn([](shape_inference::InferenceContext *ctx) {
+      ctx->set_output(0, ctx->input(1));
+      return Status::OK();
+    });
+
+REGISTER_OP("MonolithFidCountSketchLookup")
+    .Input("handle: resource")
+    .Input("fids: int64")
+    .Output("counts: int64")
+    .SetIsStateful()
+    .SetShapeFn([](shape_inference::InferenceContext *ctx) {
+      ctx->set_output(0, ctx->input(1));
+      return Status::OK();
+    });
+
+// Per slot occurrences and new fid counts of the slots seen so far, which are
+// also emitted as metrics.
+REGISTER_OP("MonolithFidCountSketchSlotStats")
+    .Input("handle: resource")
+    .Output("slots: int64")
+    .Output("occurrences: int64")
+    .Output("new_fids: int64")
+    .SetIsStateful()
+    .SetShapeFn([](shape_inference::InferenceContext *ctx) {
+      auto num_slots = ctx->Vector(ctx->UnknownDim());
+      for (int i = 0; i < 3; ++i) {
+        ctx->set_output(i, num_slots);
+      }
+      return Status::OK();
+    });
+
 }  // namespace tensorflow
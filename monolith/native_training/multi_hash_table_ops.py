@@ -89,6 +89,7 @@ def convert_to_cached_config(configs: Dict[str, entry.HashTableConfigInstance]):
     table_config.CopyFrom(config.table_config)
     if is_exporting():
       table_config.entry_config.entry_type = embedding_hash_table_pb2.EntryConfig.EntryType.SERVING
+    entry.set_default_seeds(table_config, table_name)
     mconfig.names.append(table_name)
     mconfig.configs.append(table_config)
     dims.append(infer_dim_size(table_config))
@@ -406,17 +407,34 @@ class MultiHashTable(BaseMultiTypeHashTable, RawMultiTypeHashTable):
         {k: _convert_to_float32(v[1]) for k, v in slot_to_id_and_grad.items()})
     return self.raw_apply_gradients(ragged_id, flat_grad, global_step, req_time)
 
-  def save(self, basename: tf.Tensor) -> "MultiHashTable":
+  def save(self,
+           basename: tf.Tensor,
+           id_shard_index: int = 0,
+           id_num_shards: int = 1) -> "MultiHashTable":
+    """The ids of the table are recorded as those with
+    floormod(id, id_num_shards) == id_shard_index, i.e. of this PS."""
     new_handle = hash_table_ops.monolith_multi_hash_table_save(
         mtable=self._handle,
         basename=basename,
         nshards=self._saver_parallel,
-        slot_expire_time_config=self._slot_expire_time_config)
+        slot_expire_time_config=self._slot_expire_time_config,
+        id_shard_index=id_shard_index,
+        id_num_shards=id_num_shards)
     return self._copy_with_new_table(new_handle)
 
-  def restore(self, basename: tf.Tensor) -> "MultiHashTable":
+  def restore(self,
+              basename: tf.Tensor,
+              id_shard_index: int = 0,
+              id_num_shards: int = 1) -> "MultiHashTable":
+    """Restores from basename, a scalar, or a vector of the basenames saved by
+    all PS of a cluster of different size. Only ids with
+    floormod(id, id_num_shards) == id_shard_index are restored, and files
+    saved with none of them are not read."""
     new_handle = hash_table_ops.monolith_multi_hash_table_restore(
-        mtable=self._handle, basename=basename)
+        mtable=self._handle,
+        basename=basename,
+        id_shard_index=id_shard_index,
+        id_num_shards=id_num_shards)
     return self._copy_with_new_table(new_handle)
 
   def as_op(self, *args, **kwargs):  # pylint: disable=unused-argument
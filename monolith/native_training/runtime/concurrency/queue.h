@@ -15,8 +15,19 @@
 #ifndef MONOLITH_MONOLITH_NATIVE_TRAINING_RUNTIME_CONCURRENCY_QUEUE_H_
 #define MONOLITH_MONOLITH_NATIVE_TRAINING_RUNTIME_CONCURRENCY_QUEUE_H_
 
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <climits>
 #include <condition_variable>
+#include <cstdint>
+#include <limits>
+#include <memory>
 #include <mutex>
 #include <queue>
 #include <thread>
@@ -149,6 +160,373 @@ class Queue {
 
   std::condition_variable dequeue_cond_;
 };
+
+namespace internal {
+
+// Lets threads sleep until some lock-free condition might have changed.
+// Waiters follow the pattern
+//   key = PrepareWait(); if (!condition) Wait(key, deadline); else
+//   CancelWait();
+// and Notify must be called after the condition changed. Notify is a fence
+// plus a relaxed load as long as nobody is waiting.
+class EventCount {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  uint32_t PrepareWait() {
+    waiters_.fetch_add(1, std::memory_order_seq_cst);
+    return epoch_.load(std::memory_order_acquire);
+  }
+
+  void CancelWait() { waiters_.fetch_sub(1, std::memory_order_seq_cst); }
+
+  // Returns false if the deadline passed before a Notify.
+  bool Wait(uint32_t key, Clock::time_point deadline) {
+    bool notified = true;
+    while (epoch_.load(std::memory_order_acquire) == key) {
+      if (deadline == Clock::time_point::max()) {
+        FutexWait(key, nullptr);
+        continue;
+      }
+      auto now = Clock::now();
+      if (now >= deadline) {
+        notified = false;
+        break;
+      }
+      int64_t ns =
+          std::chrono::duration_cast<std::chrono::nanoseconds>(deadline - now)
+              .count();
+      struct timespec ts;
+      ts.tv_sec = ns / 1000000000;
+      ts.tv_nsec = ns % 1000000000;
+      FutexWait(key, &ts);
+    }
+    waiters_.fetch_sub(1, std::memory_order_seq_cst);
+    return notified;
+  }
+
+  // Wakes up at most n waiters.
+  void Notify(int n) {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (waiters_.load(std::memory_order_relaxed) == 0) {
+      return;
+    }
+    epoch_.fetch_add(1, std::memory_order_release);
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&epoch_),
+            FUTEX_WAKE_PRIVATE, n, nullptr, nullptr, 0);
+  }
+
+ private:
+  void FutexWait(uint32_t key, const struct timespec* timeout) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&epoch_),
+            FUTEX_WAIT_PRIVATE, key, timeout, nullptr, 0);
+  }
+
+  std::atomic<uint32_t> epoch_{0};
+  std::atomic<int32_t> waiters_{0};
+};
+
+}  // namespace internal
+
+// A bounded lock-free multi-producer multi-consumer FIFO queue with the same
+// blocking and try_* interface as Queue, plus batched push_n/pop_n.
+//
+// Slots are a ring buffer of cells tagged with sequence numbers (Vyukov's
+// bounded MPMC queue), so producers and consumers only contend on one CAS
+// each. Threads only sleep (on a futex) when the queue is empty or full.
+//
+// Unlike Queue, max_size is rounded up to a power of two of at least 2 (a
+// single cell could not tell a full slot from a free one of the next lap),
+// and there is neither front() nor an ordered variant.
+template <typename T>
+class MPMCQueue {
+ public:
+  explicit MPMCQueue(size_t max_size = 1)
+      : capacity_(RoundUpToPowerOfTwo(std::max<size_t>(max_size, 2))),
+        mask_(capacity_ - 1),
+        cells_(new Cell[capacity_]) {
+    for (size_t i = 0; i < capacity_; ++i) {
+      cells_[i].seq.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  MPMCQueue(const MPMCQueue&) = delete;
+
+  MPMCQueue& operator=(const MPMCQueue&) = delete;
+
+  // Remove and return an item from the queue, it blocks if no item was
+  // available.
+  T pop() {
+    T item;
+    pop(item);
+    return item;
+  }
+
+  // Remove an item(and assign to T& item) from the queue, it blocks if
+  // no item was available.
+  void pop(T& item) {  // NOLINT
+    Await(&not_empty_, [&] { return TryPop(&item); }, kForever);
+    not_full_.Notify(1);
+  }
+
+  // Try to remove an item(and assign to T& item) from the queue, it blocks
+  // at most 'timeout' duration and return false if no item was available
+  // within that time.
+  template <typename Rep = int64_t, typename Period = std::milli>
+  bool try_pop(T& item, std::chrono::duration<Rep, Period> timeout) {  // NOLINT
+    if (!Await(&not_empty_, [&] { return TryPop(&item); },
+               Deadline(timeout))) {
+      return false;
+    }
+    not_full_.Notify(1);
+    return true;
+  }
+
+  // Put an item into the queue, it blocks if no free slot was available.
+  void push(T item) {
+    Await(&not_full_, [&] { return TryPush(&item); }, kForever);
+    not_empty_.Notify(1);
+  }
+
+  // Try to push an item into the queue, it blocks at most 'timeout'
+  // duration and return false if no free slot was available within
+  // that time.
+  template <typename Rep = int64_t, typename Period = std::milli>
+  bool try_push(T item, std::chrono::duration<Rep, Period> timeout) {
+    if (!Await(&not_full_, [&] { return TryPush(&item); },
+               Deadline(timeout))) {
+      return false;
+    }
+    not_empty_.Notify(1);
+    return true;
+  }
+
+  // Moves n items starting at first into the queue, it blocks until all of
+  // them were pushed. Items are claimed in runs of consecutive slots, so the
+  // run of one producer is never interleaved with other producers.
+  template <typename InputIt>
+  void push_n(InputIt first, size_t n) {
+    while (n > 0) {
+      size_t pushed = 0;
+      Await(&not_full_,
+            [&] { return (pushed = TryPushN(first, n)) > 0; }, kForever);
+      std::advance(first, pushed);
+      n -= pushed;
+      not_empty_.Notify(static_cast<int>(std::min<size_t>(pushed, INT_MAX)));
+    }
+  }
+
+  // Removes at most max_n items into out, it blocks if no item was
+  // available. Returns the number of items removed.
+  template <typename OutputIt>
+  size_t pop_n(OutputIt out, size_t max_n) {
+    return PopN(out, max_n, kForever);
+  }
+
+  // Like pop_n, but blocks at most 'timeout' duration and returns 0 if no
+  // item was available within that time.
+  template <typename OutputIt, typename Rep = int64_t,
+            typename Period = std::milli>
+  size_t try_pop_n(OutputIt out, size_t max_n,
+                   std::chrono::duration<Rep, Period> timeout) {
+    return PopN(out, max_n, Deadline(timeout));
+  }
+
+  // Return true if the queue is empty, false otherwise (not reliable).
+  bool empty() const {
+    return dequeue_pos_.load(std::memory_order_acquire) >=
+           enqueue_pos_.load(std::memory_order_acquire);
+  }
+
+  size_t capacity() const { return capacity_; }
+
+ private:
+  using Clock = internal::EventCount::Clock;
+
+  // A cell with seq == pos is free for the producer of ticket pos, a cell
+  // with seq == pos + 1 holds the item for the consumer of ticket pos.
+  struct Cell {
+    std::atomic<size_t> seq;
+    T value;
+  };
+
+  static constexpr int kSpins = 64;
+  static constexpr size_t kCacheLineSize = 64;
+
+  static size_t RoundUpToPowerOfTwo(size_t n) {
+    size_t result = 1;
+    while (result < n) {
+      result <<= 1;
+    }
+    return result;
+  }
+
+  template <typename Rep, typename Period>
+  static Clock::time_point Deadline(std::chrono::duration<Rep, Period> timeout) {
+    return Clock::now() +
+           std::chrono::duration_cast<Clock::duration>(timeout);
+  }
+
+  // Retries fn until it succeeds or the deadline passes. Spins for a short
+  // while before going to sleep on event.
+  template <typename Fn>
+  static bool Await(internal::EventCount* event, Fn&& fn,
+                    Clock::time_point deadline) {
+    for (int i = 0; i < kSpins; ++i) {
+      if (fn()) {
+        return true;
+      }
+    }
+    while (true) {
+      uint32_t key = event->PrepareWait();
+      if (fn()) {
+        event->CancelWait();
+        return true;
+      }
+      if (!event->Wait(key, deadline)) {
+        return fn();
+      }
+      if (fn()) {
+        return true;
+      }
+    }
+  }
+
+  bool TryPush(T* item) {
+    size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+    while (true) {
+      Cell& cell = cells_[pos & mask_];
+      size_t seq = cell.seq.load(std::memory_order_acquire);
+      auto diff = static_cast<std::intptr_t>(seq - pos);
+      if (diff == 0) {
+        if (enqueue_pos_.compare_exchange_weak(pos, pos + 1,
+                                               std::memory_order_relaxed)) {
+          cell.value = std::move(*item);
+          cell.seq.store(pos + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = enqueue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  bool TryPop(T* item) {
+    size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+    while (true) {
+      Cell& cell = cells_[pos & mask_];
+      size_t seq = cell.seq.load(std::memory_order_acquire);
+      auto diff = static_cast<std::intptr_t>(seq - (pos + 1));
+      if (diff == 0) {
+        if (dequeue_pos_.compare_exchange_weak(pos, pos + 1,
+                                               std::memory_order_relaxed)) {
+          *item = std::move(cell.value);
+          cell.seq.store(pos + capacity_, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = dequeue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // Claims the longest run (at most n) of free cells starting at the
+  // enqueue position with a single CAS.
+  template <typename InputIt>
+  size_t TryPushN(InputIt first, size_t n) {
+    size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+    while (true) {
+      size_t k = 0;
+      while (k < n && cells_[(pos + k) & mask_].seq.load(
+                          std::memory_order_acquire) == pos + k) {
+        ++k;
+      }
+      if (k == 0) {
+        size_t seq = cells_[pos & mask_].seq.load(std::memory_order_acquire);
+        if (static_cast<std::intptr_t>(seq - pos) < 0) {
+          return 0;
+        }
+        pos = enqueue_pos_.load(std::memory_order_relaxed);
+        continue;
+      }
+      if (enqueue_pos_.compare_exchange_weak(pos, pos + k,
+                                             std::memory_order_relaxed)) {
+        for (size_t i = 0; i < k; ++i, ++first) {
+          Cell& cell = cells_[(pos + i) & mask_];
+          cell.value = std::move(*first);
+          cell.seq.store(pos + i + 1, std::memory_order_release);
+        }
+        return k;
+      }
+    }
+  }
+
+  template <typename OutputIt>
+  size_t TryPopN(OutputIt* out, size_t max_n) {
+    size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+    while (true) {
+      size_t k = 0;
+      while (k < max_n && cells_[(pos + k) & mask_].seq.load(
+                              std::memory_order_acquire) == pos + k + 1) {
+        ++k;
+      }
+      if (k == 0) {
+        size_t seq = cells_[pos & mask_].seq.load(std::memory_order_acquire);
+        if (static_cast<std::intptr_t>(seq - (pos + 1)) < 0) {
+          return 0;
+        }
+        pos = dequeue_pos_.load(std::memory_order_relaxed);
+        continue;
+      }
+      if (dequeue_pos_.compare_exchange_weak(pos, pos + k,
+                                             std::memory_order_relaxed)) {
+        for (size_t i = 0; i < k; ++i) {
+          Cell& cell = cells_[(pos + i) & mask_];
+          *(*out)++ = std::move(cell.value);
+          cell.seq.store(pos + i + capacity_, std::memory_order_release);
+        }
+        return k;
+      }
+    }
+  }
+
+  template <typename OutputIt>
+  size_t PopN(OutputIt out, size_t max_n, Clock::time_point deadline) {
+    if (max_n == 0) {
+      return 0;
+    }
+    size_t popped = 0;
+    Await(&not_empty_, [&] { return (popped = TryPopN(&out, max_n)) > 0; },
+          deadline);
+    if (popped > 0) {
+      not_full_.Notify(static_cast<int>(std::min<size_t>(popped, INT_MAX)));
+    }
+    return popped;
+  }
+
+  static constexpr Clock::time_point kForever = Clock::time_point::max();
+
+  const size_t capacity_;
+  const size_t mask_;
+  std::unique_ptr<Cell[]> cells_;
+
+  // Producers and consumers each get their own cache line.
+  char pad0_[kCacheLineSize];
+  std::atomic<size_t> enqueue_pos_{0};
+  char pad1_[kCacheLineSize - sizeof(std::atomic<size_t>)];
+  std::atomic<size_t> dequeue_pos_{0};
+  char pad2_[kCacheLineSize - sizeof(std::atomic<size_t>)];
+
+  internal::EventCount not_empty_;
+  internal::EventCount not_full_;
+};
+
+template <typename T>
+constexpr typename MPMCQueue<T>::Clock::time_point MPMCQueue<T>::kForever;
 }  // namespace concurrency
 }  // namespace monolith
 
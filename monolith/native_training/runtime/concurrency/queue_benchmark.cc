@@ -0,0 +1,107 @@
+// Copyright 2022 ByteDance and/or its affiliates.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "monolith/native_training/runtime/concurrency/queue.h"
+
+namespace monolith {
+namespace concurrency {
+namespace {
+
+const int kCapacity = 1024;
+const int kItems = 1 << 16;
+const int kBatchSize = 16;
+
+// Moves kItems strings from range(0) producers to range(0) consumers.
+template <typename QueueType>
+void BM_HandOff(benchmark::State& state) {  // NOLINT
+  int64_t thread_num = state.range(0);
+  int64_t items_per_thread = kItems / thread_num;
+  for (auto _ : state) {
+    QueueType queue(kCapacity);
+    std::vector<std::thread> threads;
+    for (int64_t i = 0; i < thread_num; ++i) {
+      threads.emplace_back([&]() {
+        for (int64_t j = 0; j < items_per_thread; ++j) {
+          queue.push(std::string("item"));
+        }
+      });
+      threads.emplace_back([&]() {
+        std::string item;
+        for (int64_t j = 0; j < items_per_thread; ++j) {
+          queue.pop(item);
+        }
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * items_per_thread * thread_num);
+}
+
+void BM_MPMCQueueBatchHandOff(benchmark::State& state) {  // NOLINT
+  int64_t thread_num = state.range(0);
+  int64_t batches_per_thread = kItems / kBatchSize / thread_num;
+  for (auto _ : state) {
+    MPMCQueue<std::string> queue(kCapacity);
+    std::vector<std::thread> threads;
+    for (int64_t i = 0; i < thread_num; ++i) {
+      threads.emplace_back([&]() {
+        std::vector<std::string> items(kBatchSize);
+        for (int64_t j = 0; j < batches_per_thread; ++j) {
+          std::fill(items.begin(), items.end(), "item");
+          queue.push_n(items.begin(), items.size());
+        }
+      });
+      threads.emplace_back([&]() {
+        std::vector<std::string> items(kBatchSize);
+        int64_t remaining = batches_per_thread * kBatchSize;
+        while (remaining > 0) {
+          remaining -= queue.pop_n(
+              items.begin(), std::min<int64_t>(remaining, items.size()));
+        }
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * batches_per_thread *
+                          kBatchSize * thread_num);
+}
+
+BENCHMARK_TEMPLATE(BM_HandOff, Queue<std::string>)
+    ->RangeMultiplier(2)
+    ->Range(1, 64)
+    ->UseRealTime();
+BENCHMARK_TEMPLATE(BM_HandOff, MPMCQueue<std::string>)
+    ->RangeMultiplier(2)
+    ->Range(1, 64)
+    ->UseRealTime();
+BENCHMARK(BM_MPMCQueueBatchHandOff)
+    ->RangeMultiplier(2)
+    ->Range(1, 64)
+    ->UseRealTime();
+
+}  // namespace
+}  // namespace concurrency
+}  // namespace monolith
+
+BENCHMARK_MAIN();
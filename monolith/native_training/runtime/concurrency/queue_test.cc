@@ -16,7 +16,10 @@
 
 #include <atomic>
 #include <memory>
+#include <numeric>
+#include <string>
 #include <thread>
+#include <vector>
 
 #include "gtest/gtest.h"
 
@@ -117,6 +120,139 @@ TEST(QueueTest, Timeout) {
   EXPECT_NEAR(PopTimeout(1000), 1000.f, 20);
 }
 
+TEST(MPMCQueueTest, Fifo) {
+  MPMCQueue<std::string> queue(3);
+  EXPECT_EQ(queue.capacity(), 4);
+  EXPECT_TRUE(queue.empty());
+  for (int i = 0; i < 4; ++i) {
+    EXPECT_TRUE(queue.try_push(std::to_string(i), milliseconds(0)));
+  }
+  EXPECT_FALSE(queue.try_push("4", milliseconds(1)));
+  EXPECT_FALSE(queue.empty());
+  for (int i = 0; i < 4; ++i) {
+    EXPECT_EQ(queue.pop(), std::to_string(i));
+  }
+  std::string item;
+  EXPECT_FALSE(queue.try_pop(item, milliseconds(1)));
+  EXPECT_TRUE(queue.empty());
+}
+
+TEST(MPMCQueueTest, Basic) {
+  MPMCQueue<int64_t> queue(128);
+  const int iterations = 10 * 10000;
+  const int producer_thread_count = 10;
+  const int consumer_thread_count = 10;
+  std::atomic<int64_t> sum(0);
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i != producer_thread_count; ++i) {
+    threads.emplace_back([&]() {
+      for (int j = 1; j <= iterations; ++j) {
+        queue.push(j);
+      }
+    });
+  }
+  for (int i = 0; i != consumer_thread_count; ++i) {
+    threads.emplace_back([&]() {
+      int64_t value;
+      while (true) {
+        queue.pop(value);
+        if (value < 0) break;
+        sum += value;
+      }
+    });
+  }
+  for (int i = 0; i != producer_thread_count; ++i) {
+    threads[i].join();
+  }
+  for (int i = 0; i != consumer_thread_count; ++i) {
+    queue.push(-1);
+  }
+  for (size_t i = producer_thread_count; i != threads.size(); ++i) {
+    threads[i].join();
+  }
+
+  EXPECT_EQ(sum, static_cast<int64_t>(iterations) * (iterations + 1) / 2 *
+                     producer_thread_count);
+  EXPECT_TRUE(queue.empty());
+}
+
+TEST(MPMCQueueTest, Batch) {
+  MPMCQueue<int> queue(64);
+  const int batches = 10000;
+  const int batch_size = 100;
+  const int producer_thread_count = 4;
+  const int consumer_thread_count = 4;
+  std::atomic<int> consumer_count(0);
+
+  std::vector<std::thread> producers, consumers;
+  for (int i = 0; i != producer_thread_count; ++i) {
+    producers.emplace_back([&]() {
+      std::vector<int> batch(batch_size);
+      for (int j = 0; j != batches; ++j) {
+        std::iota(batch.begin(), batch.end(), 0);
+        queue.push_n(batch.begin(), batch.size());
+      }
+    });
+  }
+  std::atomic<bool> done(false);
+  for (int i = 0; i != consumer_thread_count; ++i) {
+    consumers.emplace_back([&]() {
+      std::vector<int> batch(32);
+      while (true) {
+        size_t n = queue.try_pop_n(batch.begin(), batch.size(),
+                                   milliseconds(10));
+        if (n == 0 && done) break;
+        consumer_count += n;
+      }
+    });
+  }
+  for (auto& t : producers) t.join();
+  done = true;
+  for (auto& t : consumers) t.join();
+
+  EXPECT_EQ(consumer_count, batches * batch_size * producer_thread_count);
+}
+
+TEST(MPMCQueueTest, BatchKeepsOrderOfSingleProducer) {
+  MPMCQueue<int> queue(8);
+  std::thread producer([&]() {
+    std::vector<int> values(1000);
+    std::iota(values.begin(), values.end(), 0);
+    queue.push_n(values.begin(), values.size());
+  });
+  std::vector<int> values;
+  while (values.size() < 1000) {
+    int buffer[5];
+    size_t n = queue.pop_n(buffer, 5);
+    EXPECT_GT(n, 0);
+    values.insert(values.end(), buffer, buffer + n);
+  }
+  producer.join();
+  for (int i = 0; i < 1000; ++i) {
+    EXPECT_EQ(values[i], i);
+  }
+}
+
+TEST(MPMCQueueTest, Timeout) {
+  MPMCQueue<int> queue(1);
+  EXPECT_EQ(queue.capacity(), 2);
+  queue.push(1);
+  queue.push(1);
+  auto start = high_resolution_clock::now();
+  EXPECT_FALSE(queue.try_push(2, milliseconds(10)));
+  auto elapsed = high_resolution_clock::now() - start;
+  EXPECT_NEAR(duration_cast<microseconds>(elapsed).count() / 1000.f, 10.f, 2);
+
+  EXPECT_EQ(queue.pop(), 1);
+  EXPECT_EQ(queue.pop(), 1);
+  int item;
+  start = high_resolution_clock::now();
+  EXPECT_FALSE(queue.try_pop(item, milliseconds(10)));
+  elapsed = high_resolution_clock::now() - start;
+  EXPECT_NEAR(duration_cast<microseconds>(elapsed).count() / 1000.f, 10.f, 2);
+}
+
 }  // namespace
 }  // namespace concurrency
 }  // namespace monolith
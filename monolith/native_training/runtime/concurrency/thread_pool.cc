@@ -27,41 +27,243 @@ limitations under the License.
 
 #include "thread_pool.h"
 
+#include <pthread.h>
+#include <sched.h>
+
+#include <algorithm>
+#include <fstream>
+#include <string>
+
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_split.h"
+#include "absl/synchronization/blocking_counter.h"
+
 namespace monolith {
 namespace concurrency {
+namespace {
+
+// Workers retry stealing this many times before going to sleep.
+constexpr int kStealRounds = 2;
+
+// Number of ranges per thread in ParallelFor.
+constexpr int64_t kBlocksPerThread = 4;
+
+thread_local const ThreadPool *current_pool = nullptr;
+thread_local int current_index = -1;
+
+// Parses a sysfs cpu list like "0-3,8,10-11".
+std::vector<int> ParseCpuList(const std::string &list) {
+  std::vector<int> cpus;
+  for (absl::string_view range :
+       absl::StrSplit(list, ',', absl::SkipWhitespace())) {
+    std::vector<absl::string_view> bounds = absl::StrSplit(range, '-');
+    int first = 0, last = 0;
+    if (!absl::SimpleAtoi(bounds[0], &first)) continue;
+    last = first;
+    if (bounds.size() > 1 && !absl::SimpleAtoi(bounds[1], &last)) continue;
+    for (int cpu = first; cpu <= last; ++cpu) {
+      cpus.push_back(cpu);
+    }
+  }
+  return cpus;
+}
+
+// CPUs the process may run on, grouped by NUMA node.
+std::vector<int> CpusInNumaOrder() {
+  cpu_set_t allowed;
+  CPU_ZERO(&allowed);
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+    return {};
+  }
+  std::vector<int> cpus;
+  std::vector<bool> seen(CPU_SETSIZE, false);
+  // Node ids may be sparse, so keep probing past missing nodes for a while.
+  for (int node = 0, missing = 0; missing < 8; ++node) {
+    std::ifstream in("/sys/devices/system/node/node" + std::to_string(node) +
+                     "/cpulist");
+    std::string list;
+    if (!in || !std::getline(in, list)) {
+      ++missing;
+      continue;
+    }
+    missing = 0;
+    for (int cpu : ParseCpuList(list)) {
+      if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed) && !seen[cpu]) {
+        seen[cpu] = true;
+        cpus.push_back(cpu);
+      }
+    }
+  }
+  for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+    if (CPU_ISSET(cpu, &allowed) && !seen[cpu]) {
+      cpus.push_back(cpu);
+    }
+  }
+  return cpus;
+}
+
+}  // namespace
+
+ThreadPool::ThreadPool(int num_threads, const Options &options) {
+  for (int i = 0; i < num_threads; ++i) {
+    workers_.push_back(std::make_unique<Worker>());
+  }
+  std::vector<int> cpus;
+  if (options.pin_threads) {
+    cpus = CpusInNumaOrder();
+  }
+  for (int i = 0; i < num_threads; ++i) {
+    threads_.emplace_back(&ThreadPool::WorkLoop, this, i);
+    if (!cpus.empty()) {
+      cpu_set_t cpu_set;
+      CPU_ZERO(&cpu_set);
+      CPU_SET(cpus[i % cpus.size()], &cpu_set);
+      // Pinning is best effort, the worker just floats if it fails.
+      pthread_setaffinity_np(threads_.back().native_handle(), sizeof(cpu_set),
+                             &cpu_set);
+    }
+  }
+}
 
 ThreadPool::~ThreadPool() {
   {
     absl::MutexLock l(&mu_);
-    for (size_t i = 0; i < threads_.size(); i++) {
-      queue_.push(nullptr);  // Shutdown signal.
-    }
+    stop_ = true;
+    cv_.SignalAll();
   }
   for (auto &t : threads_) {
     t.join();
   }
 }
 
-void ThreadPool::Schedule(std::function<void()> func) {
-  assert(func != nullptr);
-  absl::MutexLock l(&mu_);
-  queue_.push(std::move(func));
+void ThreadPool::Schedule(Task func) {
+  assert(func);
+  if (workers_.empty()) {
+    func();
+    return;
+  }
+  Push(std::move(func));
+}
+
+int ThreadPool::CurrentThreadId() const {
+  return current_pool == this ? current_index : -1;
+}
+
+void ThreadPool::Push(Task task) {
+  int index = CurrentThreadId();
+  if (index >= 0) {
+    Worker *worker = workers_[index].get();
+    absl::MutexLock l(&worker->mu);
+    worker->tasks.push_front(std::move(task));
+  } else {
+    index = next_worker_.fetch_add(1, std::memory_order_relaxed) %
+            workers_.size();
+    Worker *worker = workers_[index].get();
+    absl::MutexLock l(&worker->mu);
+    worker->tasks.push_back(std::move(task));
+  }
+  // Pairs with the seq_cst increment of num_sleeping_ in WorkLoop: either
+  // the worker sees the task before sleeping or we see the sleeper.
+  pending_.fetch_add(1, std::memory_order_seq_cst);
+  if (num_sleeping_.load(std::memory_order_seq_cst) > 0) {
+    absl::MutexLock l(&mu_);
+    cv_.Signal();
+  }
+}
+
+bool ThreadPool::Pop(int index, Task *task) {
+  if (pending_.load(std::memory_order_relaxed) <= 0) {
+    return false;
+  }
+  const int num_workers = workers_.size();
+  for (int i = 0; i < num_workers; ++i) {
+    Worker *worker = workers_[(index + i) % num_workers].get();
+    absl::MutexLock l(&worker->mu);
+    if (worker->tasks.empty()) {
+      continue;
+    }
+    if (i == 0) {
+      *task = std::move(worker->tasks.front());
+      worker->tasks.pop_front();
+    } else {
+      *task = std::move(worker->tasks.back());
+      worker->tasks.pop_back();
+    }
+    pending_.fetch_sub(1, std::memory_order_relaxed);
+    return true;
+  }
+  return false;
 }
 
-void ThreadPool::WorkLoop() {
+void ThreadPool::WorkLoop(int index) {
+  current_pool = this;
+  current_index = index;
   while (true) {
-    std::function<void()> func;
-    {
-      absl::MutexLock l(&mu_);
-      mu_.Await(absl::Condition(this, &ThreadPool::WorkAvailable));
-      func = std::move(queue_.front());
-      queue_.pop();
+    Task task;
+    bool found = false;
+    for (int round = 0; round < kStealRounds && !found; ++round) {
+      found = Pop(index, &task);
+    }
+    if (found) {
+      task();
+      continue;
     }
-    if (func == nullptr) {  // Shutdown signal.
+
+    absl::MutexLock l(&mu_);
+    num_sleeping_.fetch_add(1, std::memory_order_seq_cst);
+    while (!stop_ && pending_.load(std::memory_order_seq_cst) <= 0) {
+      cv_.Wait(&mu_);
+    }
+    num_sleeping_.fetch_sub(1, std::memory_order_relaxed);
+    if (stop_ && pending_.load(std::memory_order_relaxed) <= 0) {
       break;
     }
-    func();
   }
+  current_pool = nullptr;
+  current_index = -1;
+}
+
+void ThreadPool::ParallelFor(
+    int64_t total, int64_t min_block_size,
+    const std::function<void(int64_t, int64_t)> &fn) {
+  if (total <= 0) {
+    return;
+  }
+  const int64_t num_threads = NumThreads() + 1;
+  int64_t block_size =
+      std::max<int64_t>({min_block_size, 1,
+                         (total + num_threads * kBlocksPerThread - 1) /
+                             (num_threads * kBlocksPerThread)});
+  const int64_t num_blocks = (total + block_size - 1) / block_size;
+  if (num_blocks == 1 || workers_.empty()) {
+    fn(0, total);
+    return;
+  }
+
+  // Helpers may start after all blocks are done and ParallelFor returned, so
+  // the shared state outlives the call. fn is only touched for claimed
+  // blocks, which all finish before the call returns.
+  struct State {
+    explicit State(int64_t num_blocks) : done(num_blocks) {}
+    std::atomic<int64_t> next_block{0};
+    absl::BlockingCounter done;
+  };
+  auto state = std::make_shared<State>(num_blocks);
+  const std::function<void(int64_t, int64_t)> *fn_ptr = &fn;
+  auto run_blocks = [state, fn_ptr, total, block_size, num_blocks]() {
+    int64_t block;
+    while ((block = state->next_block.fetch_add(1)) < num_blocks) {
+      int64_t begin = block * block_size;
+      (*fn_ptr)(begin, std::min(total, begin + block_size));
+      state->done.DecrementCount();
+    }
+  };
+  int64_t num_helpers = std::min<int64_t>(NumThreads(), num_blocks - 1);
+  for (int64_t i = 0; i < num_helpers; ++i) {
+    Schedule(run_blocks);
+  }
+  run_blocks();
+  state->done.Wait();
 }
 
 }  // namespace concurrency
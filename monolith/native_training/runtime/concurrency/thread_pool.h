@@ -27,46 +27,201 @@ limitations under the License.
 #ifndef MONOLITH_MONOLITH_NATIVE_TRAINING_RUNTIME_CONCURRENCY_THREAD_POOL_H_
 #define MONOLITH_MONOLITH_NATIVE_TRAINING_RUNTIME_CONCURRENCY_THREAD_POOL_H_
 
+#include <atomic>
 #include <cassert>
 #include <cstddef>
+#include <cstdint>
+#include <deque>
 #include <functional>
-#include <queue>
+#include <memory>
+#include <new>
 #include <thread>
+#include <type_traits>
+#include <utility>
 #include <vector>
 #include "absl/base/thread_annotations.h"
 #include "absl/synchronization/mutex.h"
 
 namespace monolith {
 namespace concurrency {
+
+// A move-only void() callable. Callables up to kInlineSize bytes (e.g.
+// lambdas capturing a few pointers, or a std::function) are stored inline,
+// so scheduling them does not allocate.
+class Task {
+ public:
+  static constexpr size_t kInlineSize = 48;
+
+  Task() = default;
+
+  template <typename F,
+            typename = typename std::enable_if<!std::is_same<
+                typename std::decay<F>::type, Task>::value>::type>
+  Task(F &&f) {  // NOLINT
+    using Fn = typename std::decay<F>::type;
+    Construct<Fn>(std::forward<F>(f),
+                  std::integral_constant<
+                      bool, sizeof(Fn) <= kInlineSize &&
+                                alignof(Fn) <= alignof(std::max_align_t) &&
+                                std::is_nothrow_move_constructible<
+                                    Fn>::value>());
+  }
+
+  Task(Task &&other) noexcept { MoveFrom(&other); }
+
+  Task &operator=(Task &&other) noexcept {
+    if (this != &other) {
+      Reset();
+      MoveFrom(&other);
+    }
+    return *this;
+  }
+
+  Task(const Task &) = delete;
+  Task &operator=(const Task &) = delete;
+
+  ~Task() { Reset(); }
+
+  explicit operator bool() const { return ops_ != nullptr; }
+
+  void operator()() { ops_->invoke(&storage_); }
+
+ private:
+  struct Ops {
+    void (*invoke)(void *storage);
+    // Moves the callable from src to dst and destroys it in src.
+    void (*relocate)(void *dst, void *src);
+    void (*destroy)(void *storage);
+  };
+
+  template <typename Fn>
+  struct InlineOps {
+    static void Invoke(void *storage) { (*static_cast<Fn *>(storage))(); }
+    static void Relocate(void *dst, void *src) {
+      new (dst) Fn(std::move(*static_cast<Fn *>(src)));
+      static_cast<Fn *>(src)->~Fn();
+    }
+    static void Destroy(void *storage) { static_cast<Fn *>(storage)->~Fn(); }
+    static constexpr Ops kOps = {&Invoke, &Relocate, &Destroy};
+  };
+
+  template <typename Fn>
+  struct HeapOps {
+    static void Invoke(void *storage) { (**static_cast<Fn **>(storage))(); }
+    static void Relocate(void *dst, void *src) {
+      *static_cast<Fn **>(dst) = *static_cast<Fn **>(src);
+    }
+    static void Destroy(void *storage) { delete *static_cast<Fn **>(storage); }
+    static constexpr Ops kOps = {&Invoke, &Relocate, &Destroy};
+  };
+
+  template <typename Fn, typename F>
+  void Construct(F &&f, std::true_type /* inline */) {
+    new (&storage_) Fn(std::forward<F>(f));
+    ops_ = &InlineOps<Fn>::kOps;
+  }
+
+  template <typename Fn, typename F>
+  void Construct(F &&f, std::false_type /* inline */) {
+    *reinterpret_cast<Fn **>(&storage_) = new Fn(std::forward<F>(f));
+    ops_ = &HeapOps<Fn>::kOps;
+  }
+
+  void MoveFrom(Task *other) {
+    if (other->ops_ != nullptr) {
+      other->ops_->relocate(&storage_, &other->storage_);
+      ops_ = other->ops_;
+      other->ops_ = nullptr;
+    }
+  }
+
+  void Reset() {
+    if (ops_ != nullptr) {
+      ops_->destroy(&storage_);
+      ops_ = nullptr;
+    }
+  }
+
+  typename std::aligned_storage<kInlineSize, alignof(std::max_align_t)>::type
+      storage_;
+  const Ops *ops_ = nullptr;
+};
+
+template <typename Fn>
+constexpr Task::Ops Task::InlineOps<Fn>::kOps;
+
+template <typename Fn>
+constexpr Task::Ops Task::HeapOps<Fn>::kOps;
+
 /**
- * A simple ThreadPool implementation for tests/benchmarks.
+ * A work-stealing ThreadPool.
+ *
+ * Every worker owns a deque of tasks. Tasks scheduled from a worker go to the
+ * front of its own deque and run next, tasks scheduled from other threads are
+ * spread round-robin to the back of the deques. Idle workers steal from the
+ * back of the other deques, starting with their neighbours, before going to
+ * sleep. There is no pool-wide lock on the Schedule/run path; the pool mutex
+ * is only taken to wake up sleeping workers.
  */
 class ThreadPool {
  public:
-  explicit ThreadPool(int num_threads) {
-    for (int i = 0; i < num_threads; ++i) {
-      threads_.emplace_back(&ThreadPool::WorkLoop, this);
-    }
-  }
+  struct Options {
+    // Pins worker i to one CPU of the process affinity mask. CPUs are taken
+    // NUMA node by node, so neighbouring workers (which steal from each other
+    // first) share a node.
+    bool pin_threads = false;
+  };
+
+  explicit ThreadPool(int num_threads) : ThreadPool(num_threads, Options()) {}
+
+  ThreadPool(int num_threads, const Options &options);
 
   ThreadPool(const ThreadPool &) = delete;
   ThreadPool &operator=(const ThreadPool &) = delete;
 
+  // Runs all scheduled tasks before joining the workers.
   ~ThreadPool();
 
   // Schedule a function to be run on a ThreadPool thread immediately.
-  void Schedule(std::function<void()> func);
+  void Schedule(Task func);
+
+  // Calls fn(begin, end) for consecutive ranges covering [0, total), on the
+  // pool and the calling thread, and returns once all of them finished.
+  // Ranges have at least min_block_size elements, and are otherwise sized to
+  // give every thread a few ranges, which are handed out dynamically so that
+  // uneven ranges balance out. Safe to call from a pool thread.
+  void ParallelFor(int64_t total, int64_t min_block_size,
+                   const std::function<void(int64_t, int64_t)> &fn);
+
+  int NumThreads() const { return static_cast<int>(workers_.size()); }
+
+  // Index of the calling pool thread, or -1 if called from another thread.
+  int CurrentThreadId() const;
 
  private:
-  bool WorkAvailable() const ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
-    return !queue_.empty();
-  }
+  struct Worker {
+    absl::Mutex mu;
+    std::deque<Task> tasks ABSL_GUARDED_BY(mu);
+  };
 
-  void WorkLoop();
+  void Push(Task task);
 
-  absl::Mutex mu_;
-  std::queue<std::function<void()>> queue_ ABSL_GUARDED_BY(mu_);
+  // Pops from the own deque of worker index, or steals from the others.
+  bool Pop(int index, Task *task);
+
+  void WorkLoop(int index);
+
+  std::vector<std::unique_ptr<Worker>> workers_;
   std::vector<std::thread> threads_;
+
+  // Tasks pushed but not yet popped.
+  std::atomic<int64_t> pending_{0};
+  std::atomic<int> num_sleeping_{0};
+  std::atomic<uint32_t> next_worker_{0};
+
+  absl::Mutex mu_;
+  absl::CondVar cv_;
+  bool stop_ ABSL_GUARDED_BY(mu_) = false;
 };
 
 }  // namespace concurrency
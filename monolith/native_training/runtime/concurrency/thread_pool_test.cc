@@ -0,0 +1,128 @@
+// Copyright 2022 ByteDance and/or its affiliates.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "monolith/native_training/runtime/concurrency/thread_pool.h"
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "absl/synchronization/blocking_counter.h"
+#include "gtest/gtest.h"
+
+namespace monolith {
+namespace concurrency {
+namespace {
+
+TEST(TaskTest, InlineAndHeap) {
+  int calls = 0;
+  Task small([&calls]() { ++calls; });
+  small();
+  std::array<int64_t, 16> big_capture{};
+  big_capture[15] = 2;
+  Task big([&calls, big_capture]() { calls += big_capture[15]; });
+  big();
+  Task moved = std::move(big);
+  EXPECT_FALSE(big);
+  moved();
+  EXPECT_EQ(calls, 5);
+
+  auto counter = std::make_shared<int>(0);
+  {
+    Task owner([counter]() { ++*counter; });
+    EXPECT_EQ(counter.use_count(), 2);
+    Task other;
+    other = std::move(owner);
+    other();
+  }
+  EXPECT_EQ(*counter, 1);
+  EXPECT_EQ(counter.use_count(), 1);
+}
+
+TEST(ThreadPoolTest, Schedule) {
+  std::atomic<int> count(0);
+  {
+    ThreadPool pool(4);
+    for (int i = 0; i < 10000; ++i) {
+      pool.Schedule([&count]() { ++count; });
+    }
+  }
+  // The destructor runs all scheduled tasks.
+  EXPECT_EQ(count, 10000);
+}
+
+TEST(ThreadPoolTest, ScheduleFromWorkers) {
+  std::atomic<int> count(0);
+  ThreadPool pool(4);
+  absl::BlockingCounter done(100 * 100);
+  for (int i = 0; i < 100; ++i) {
+    pool.Schedule([&]() {
+      EXPECT_GE(pool.CurrentThreadId(), 0);
+      for (int j = 0; j < 100; ++j) {
+        pool.Schedule([&]() {
+          ++count;
+          done.DecrementCount();
+        });
+      }
+    });
+  }
+  done.Wait();
+  EXPECT_EQ(count, 100 * 100);
+  EXPECT_EQ(pool.CurrentThreadId(), -1);
+}
+
+TEST(ThreadPoolTest, ParallelFor) {
+  ThreadPool pool(4);
+  for (int64_t total : {0, 1, 7, 1000, 100003}) {
+    std::vector<std::atomic<int>> visited(total);
+    pool.ParallelFor(total, 16, [&](int64_t begin, int64_t end) {
+      EXPECT_LT(begin, end);
+      for (int64_t i = begin; i < end; ++i) {
+        ++visited[i];
+      }
+    });
+    for (int64_t i = 0; i < total; ++i) {
+      EXPECT_EQ(visited[i], 1);
+    }
+  }
+}
+
+TEST(ThreadPoolTest, NestedParallelFor) {
+  ThreadPool pool(2);
+  std::atomic<int64_t> sum(0);
+  pool.ParallelFor(8, 1, [&](int64_t begin, int64_t end) {
+    for (int64_t i = begin; i < end; ++i) {
+      pool.ParallelFor(1000, 1, [&](int64_t b, int64_t e) { sum += e - b; });
+    }
+  });
+  EXPECT_EQ(sum, 8 * 1000);
+}
+
+TEST(ThreadPoolTest, PinThreads) {
+  ThreadPool::Options options;
+  options.pin_threads = true;
+  std::atomic<int> count(0);
+  {
+    ThreadPool pool(3, options);
+    pool.ParallelFor(100, 1, [&](int64_t begin, int64_t end) {
+      count += end - begin;
+    });
+  }
+  EXPECT_EQ(count, 100);
+}
+
+}  // namespace
+}  // namespace concurrency
+}  // namespace monolith
@@ -0,0 +1,187 @@
+// Copyright 2022 ByteDance and/or its affiliates.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "monolith/native_training/runtime/hash_filter/fid_count_sketch.h"
+
+#include <algorithm>
+#include <limits>
+
+#include "monolith/native_training/data/training_instance/cc/reader_util.h"
+
+namespace monolith {
+namespace hash_filter {
+namespace {
+
+constexpr uint32_t kMaxCount = std::numeric_limits<uint32_t>::max();
+
+uint64_t Hash(int64_t fid) {
+  // The murmur3 finalizer.
+  uint64_t h = static_cast<uint64_t>(fid);
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+uint64_t RoundUpToPowerOfTwo(int64_t n) {
+  uint64_t result = 1;
+  while (result < static_cast<uint64_t>(std::max<int64_t>(n, 1))) {
+    result <<= 1;
+  }
+  return result;
+}
+
+}  // namespace
+
+FidCountSketch::FidCountSketch(const Options& options)
+    : mask_(RoundUpToPowerOfTwo(options.width) - 1),
+      depth_(std::max(options.depth, 1)),
+      half_life_steps_(options.half_life_steps),
+      counters_(new Counter[(mask_ + 1) * depth_]()),
+      decay_start_step_(0),
+      next_decay_step_(std::numeric_limits<int64_t>::min()) {}
+
+void FidCountSketch::Update(absl::Span<const int64_t> fids, int64_t step,
+                            absl::Span<int64_t> counts) {
+  Decay(step);
+  // Counts repeated fids once per batch, which also keeps the hot fids of a
+  // batch from hammering their counters.
+  struct Occurrence {
+    uint32_t num = 0;
+    int64_t estimate = 0;
+  };
+  absl::flat_hash_map<int64_t, Occurrence> occurrences;
+  occurrences.reserve(fids.size());
+  for (int64_t fid : fids) {
+    ++occurrences[fid].num;
+  }
+  absl::flat_hash_map<int64_t, SlotStats> batch_slot_stats;
+  {
+    absl::ReaderMutexLock l(&decay_mu_);
+    for (auto& it : occurrences) {
+      const uint64_t hash = Hash(it.first);
+      const uint32_t num = it.second.num;
+      uint32_t before = kMaxCount, after = kMaxCount;
+      for (int row = 0; row < depth_; ++row) {
+        Counter& c = counter(row, hash);
+        uint32_t old = c.load(std::memory_order_relaxed);
+        uint32_t updated;
+        do {
+          updated = old > kMaxCount - num ? kMaxCount : old + num;
+        } while (!c.compare_exchange_weak(old, updated,
+                                          std::memory_order_relaxed));
+        before = std::min(before, old);
+        after = std::min(after, updated);
+      }
+      it.second.estimate = after;
+      SlotStats& stats = batch_slot_stats[slot_id_v2(it.first)];
+      stats.occurrences += num;
+      stats.new_fids += before == 0;
+    }
+    // Still under decay_mu_, so a decay halves all of the batch or none.
+    absl::MutexLock slot_lock(&slot_mu_);
+    for (const auto& it : batch_slot_stats) {
+      SlotStats& stats = slot_stats_[it.first];
+      stats.occurrences += it.second.occurrences;
+      stats.new_fids += it.second.new_fids;
+    }
+  }
+  if (!counts.empty()) {
+    for (size_t i = 0; i < fids.size(); ++i) {
+      counts[i] = occurrences[fids[i]].estimate;
+    }
+  }
+}
+
+uint32_t FidCountSketch::Estimate(uint64_t hash) const {
+  uint32_t estimate = kMaxCount;
+  for (int row = 0; row < depth_; ++row) {
+    estimate =
+        std::min(estimate, counter(row, hash).load(std::memory_order_relaxed));
+  }
+  return estimate;
+}
+
+int64_t FidCountSketch::Lookup(int64_t fid) const {
+  absl::ReaderMutexLock l(&decay_mu_);
+  return Estimate(Hash(fid));
+}
+
+void FidCountSketch::Lookup(absl::Span<const int64_t> fids,
+                            absl::Span<int64_t> counts) const {
+  absl::ReaderMutexLock l(&decay_mu_);
+  for (size_t i = 0; i < fids.size(); ++i) {
+    counts[i] = Estimate(Hash(fids[i]));
+  }
+}
+
+std::vector<std::pair<int64_t, FidCountSketch::SlotStats>>
+FidCountSketch::GetSlotStats() const {
+  std::vector<std::pair<int64_t, SlotStats>> result;
+  {
+    absl::MutexLock l(&slot_mu_);
+    result.assign(slot_stats_.begin(), slot_stats_.end());
+  }
+  std::sort(result.begin(), result.end(),
+            [](const std::pair<int64_t, SlotStats>& a,
+               const std::pair<int64_t, SlotStats>& b) {
+              return a.first < b.first;
+            });
+  return result;
+}
+
+void FidCountSketch::Decay(int64_t step) {
+  if (half_life_steps_ <= 0 ||
+      step < next_decay_step_.load(std::memory_order_acquire)) {
+    return;
+  }
+  absl::MutexLock l(&decay_mu_);
+  const int64_t next_decay_step = next_decay_step_.load();
+  if (next_decay_step == std::numeric_limits<int64_t>::min()) {
+    // The first update starts the first half life.
+    decay_start_step_ = step;
+    next_decay_step_.store(step + half_life_steps_);
+    return;
+  }
+  if (step < next_decay_step) {
+    return;
+  }
+  const int64_t half_lives = (step - decay_start_step_) / half_life_steps_;
+  // Shifting by the full width is undefined, and clears the value anyway.
+  const int shift = static_cast<int>(std::min<int64_t>(half_lives, 63));
+  for (uint64_t i = 0; i < (mask_ + 1) * depth_; ++i) {
+    uint64_t c = counters_[i].load(std::memory_order_relaxed);
+    counters_[i].store(static_cast<uint32_t>(c >> shift),
+                       std::memory_order_relaxed);
+  }
+  {
+    absl::MutexLock slot_lock(&slot_mu_);
+    for (auto it = slot_stats_.begin(); it != slot_stats_.end();) {
+      it->second.occurrences >>= shift;
+      it->second.new_fids >>= shift;
+      if (it->second.occurrences == 0) {
+        slot_stats_.erase(it++);
+      } else {
+        ++it;
+      }
+    }
+  }
+  decay_start_step_ += half_lives * half_life_steps_;
+  next_decay_step_.store(decay_start_step_ + half_life_steps_);
+}
+
+}  // namespace hash_filter
+}  // namespace monolith
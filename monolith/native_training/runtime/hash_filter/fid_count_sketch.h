@@ -0,0 +1,117 @@
+// Copyright 2022 ByteDance and/or its affiliates.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MONOLITH_NATIVE_TRAINING_RUNTIME_HASH_FILTER_FID_COUNT_SKETCH_H_
+#define MONOLITH_NATIVE_TRAINING_RUNTIME_HASH_FILTER_FID_COUNT_SKETCH_H_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/types/span.h"
+
+namespace monolith {
+namespace hash_filter {
+
+// Estimates how often each fid occurred with a count-min sketch: `depth` rows
+// of `width` saturating counters, and the count of a fid is the smallest of
+// its counters in all rows. Estimates never undercount, and overcount by at
+// most about e * total / width with probability 1 - exp(-depth). The memory is
+// fixed at depth * width * 4 bytes, however many fids are seen.
+//
+// Occurrences decay by step: all counts halve every half_life_steps steps.
+// Also keeps per slot totals, decayed the same way.
+//
+// Thread safe. Concurrent updates only contend on the counters they share.
+class FidCountSketch {
+ public:
+  struct Options {
+    // Rounded up to a power of two.
+    int64_t width = 1 << 20;
+    int depth = 4;
+    // 0 disables decay.
+    int64_t half_life_steps = 0;
+  };
+
+  struct SlotStats {
+    // Occurrences of the fids of the slot.
+    int64_t occurrences = 0;
+    // Fids whose estimated count was 0 before they occurred, an estimate of
+    // the number of distinct fids of the slot.
+    int64_t new_fids = 0;
+  };
+
+  explicit FidCountSketch(const Options& options);
+
+  FidCountSketch(const FidCountSketch&) = delete;
+  FidCountSketch& operator=(const FidCountSketch&) = delete;
+
+  // Adds one occurrence of every element of `fids` at `step`, after decaying
+  // the counts up to `step`. If counts is not empty, it gets the estimated
+  // count of every fid, including its occurrences in this batch.
+  void Update(absl::Span<const int64_t> fids, int64_t step,
+              absl::Span<int64_t> counts);
+
+  // Writes the estimated count of every fid.
+  void Lookup(absl::Span<const int64_t> fids,
+              absl::Span<int64_t> counts) const;
+
+  int64_t Lookup(int64_t fid) const;
+
+  // Stats of the slots seen so far, sorted by slot.
+  std::vector<std::pair<int64_t, SlotStats>> GetSlotStats() const;
+
+  int64_t width() const { return mask_ + 1; }
+  int depth() const { return depth_; }
+  size_t memory_bytes() const { return (mask_ + 1) * depth_ * sizeof(Counter); }
+
+ private:
+  using Counter = std::atomic<uint32_t>;
+
+  // Halves the counts as many times as half lives passed up to step.
+  void Decay(int64_t step);
+
+  // Counter of fid in row, from the two halves of its hash.
+  Counter& counter(int row, uint64_t hash) const {
+    uint64_t index = ((hash >> 32) + row * (hash | 1)) & mask_;
+    return counters_[row * (mask_ + 1) + index];
+  }
+
+  uint32_t Estimate(uint64_t hash) const;
+
+  const uint64_t mask_;
+  const int depth_;
+  const int64_t half_life_steps_;
+  std::unique_ptr<Counter[]> counters_;
+
+  // Updates share it, decays are exclusive.
+  mutable absl::Mutex decay_mu_;
+  // The step the last half life started at.
+  int64_t decay_start_step_ ABSL_GUARDED_BY(decay_mu_);
+  // Read without the lock to skip it until the next half life.
+  std::atomic<int64_t> next_decay_step_;
+
+  mutable absl::Mutex slot_mu_;
+  absl::flat_hash_map<int64_t, SlotStats> slot_stats_ ABSL_GUARDED_BY(slot_mu_);
+};
+
+}  // namespace hash_filter
+}  // namespace monolith
+
+#endif  // MONOLITH_NATIVE_TRAINING_RUNTIME_HASH_FILTER_FID_COUNT_SKETCH_H_
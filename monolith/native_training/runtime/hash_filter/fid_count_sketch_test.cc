@@ -0,0 +1,141 @@
+// Copyright 2022 ByteDance and/or its affiliates.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "monolith/native_training/runtime/hash_filter/fid_count_sketch.h"
+
+#include <cmath>
+#include <map>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace monolith {
+namespace hash_filter {
+namespace {
+
+using ::testing::ElementsAre;
+
+int64_t Fid(int64_t slot, int64_t id) { return (slot << 48) | id; }
+
+FidCountSketch::Options MakeOptions(int64_t width, int64_t half_life_steps) {
+  FidCountSketch::Options options;
+  options.width = width;
+  options.half_life_steps = half_life_steps;
+  return options;
+}
+
+TEST(FidCountSketchTest, Basic) {
+  FidCountSketch sketch(MakeOptions(1000, 0));
+  EXPECT_EQ(sketch.width(), 1024);
+  EXPECT_EQ(sketch.memory_bytes(), 1024 * 4 * 4);
+  std::vector<int64_t> fids = {Fid(1, 1), Fid(2, 7), Fid(1, 1), Fid(1, 2)};
+  std::vector<int64_t> counts(fids.size());
+  sketch.Update(fids, 0, absl::MakeSpan(counts));
+  EXPECT_THAT(counts, ElementsAre(2, 1, 2, 1));
+  sketch.Update(fids, 1, absl::MakeSpan(counts));
+  EXPECT_THAT(counts, ElementsAre(4, 2, 4, 2));
+  EXPECT_EQ(sketch.Lookup(Fid(1, 1)), 4);
+  EXPECT_EQ(sketch.Lookup(Fid(3, 1)), 0);
+
+  auto stats = sketch.GetSlotStats();
+  ASSERT_EQ(stats.size(), 2);
+  EXPECT_EQ(stats[0].first, 1);
+  EXPECT_EQ(stats[0].second.occurrences, 6);
+  EXPECT_EQ(stats[0].second.new_fids, 2);
+  EXPECT_EQ(stats[1].first, 2);
+  EXPECT_EQ(stats[1].second.occurrences, 2);
+  EXPECT_EQ(stats[1].second.new_fids, 1);
+}
+
+TEST(FidCountSketchTest, Decay) {
+  FidCountSketch sketch(MakeOptions(1024, 10));
+  std::vector<int64_t> fids(64, Fid(1, 1));
+  sketch.Update(fids, 100, {});
+  sketch.Update(fids, 109, {});
+  EXPECT_EQ(sketch.Lookup(Fid(1, 1)), 128);
+  // One half life since step 100.
+  sketch.Update({}, 110, {});
+  EXPECT_EQ(sketch.Lookup(Fid(1, 1)), 64);
+  // Two more, and the next one starts at step 130.
+  sketch.Update({}, 135, {});
+  EXPECT_EQ(sketch.Lookup(Fid(1, 1)), 16);
+  sketch.Update({}, 139, {});
+  EXPECT_EQ(sketch.Lookup(Fid(1, 1)), 16);
+  sketch.Update({}, 140, {});
+  EXPECT_EQ(sketch.Lookup(Fid(1, 1)), 8);
+  EXPECT_EQ(sketch.GetSlotStats()[0].second.occurrences, 8);
+  // Long enough to forget everything.
+  sketch.Update({}, 10000, {});
+  EXPECT_EQ(sketch.Lookup(Fid(1, 1)), 0);
+  EXPECT_TRUE(sketch.GetSlotStats().empty());
+}
+
+TEST(FidCountSketchTest, NeverUndercounts) {
+  FidCountSketch sketch(MakeOptions(1 << 12, 0));
+  std::mt19937_64 gen(0);
+  // Zipf like: small ids are much more frequent.
+  std::map<int64_t, int64_t> expected;
+  std::vector<int64_t> fids;
+  for (int i = 0; i < 100000; ++i) {
+    int64_t id = static_cast<int64_t>(
+        std::exp(std::uniform_real_distribution<double>(0, 12)(gen)));
+    fids.push_back(Fid(id % 3, id));
+    ++expected[fids.back()];
+  }
+  for (size_t begin = 0; begin < fids.size(); begin += 1000) {
+    sketch.Update(absl::MakeConstSpan(fids).subspan(begin, 1000), 0, {});
+  }
+  int64_t overcounted = 0;
+  for (const auto& it : expected) {
+    int64_t estimate = sketch.Lookup(it.first);
+    EXPECT_GE(estimate, it.second);
+    // e * total / width is about 66.
+    overcounted += estimate > it.second + 66;
+  }
+  EXPECT_LT(overcounted, expected.size() / 20);
+}
+
+TEST(FidCountSketchTest, ConcurrentUpdates) {
+  FidCountSketch sketch(MakeOptions(1 << 10, 5));
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&sketch, t] {
+      std::vector<int64_t> fids;
+      for (int i = 0; i < 100; ++i) {
+        fids.push_back(Fid(t, i % 10));
+      }
+      for (int step = 0; step < 200; ++step) {
+        sketch.Update(fids, step, {});
+        sketch.Lookup(Fid(t, 0));
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  // Threads run their steps at their own pace, so how much was decayed
+  // depends on the interleaving.
+  for (int t = 0; t < 4; ++t) {
+    EXPECT_GT(sketch.Lookup(Fid(t, 0)), 0);
+    EXPECT_LE(sketch.Lookup(Fid(t, 0)), 10 * 200);
+  }
+  EXPECT_EQ(sketch.GetSlotStats().size(), 4);
+}
+
+}  // namespace
+}  // namespace hash_filter
+}  // namespace monolith
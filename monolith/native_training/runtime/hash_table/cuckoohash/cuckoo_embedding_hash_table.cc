@@ -219,7 +219,7 @@ class CuckooEmbeddingHashTable : public EmbeddingHashTableInterface {
       int64_t id = ids[i];
       bool existed = !UpsertEntry(id, [&](EntryType& entry) {
         entry.SetTimestamp(update_time);
-        accessor_->Init(entry_helper_.Get(entry));
+        accessor_->Init(id, entry_helper_.Get(entry));
       });
       status[i] = existed;
     }
@@ -325,6 +325,13 @@ class CuckooEmbeddingHashTable : public EmbeddingHashTableInterface {
     m_.clear_with_callback(fn);
   }
 
+  void Reserve(int64_t num_entries) override {
+    // reserve may also shrink the table.
+    if (num_entries > 0 && static_cast<size_t>(num_entries) > m_.capacity()) {
+      m_.reserve(num_entries);
+    }
+  }
+
   int64_t Size() const override { return m_.size(); }
 
   int DimSize() const override { return accessor_->DimSize(); }
@@ -346,7 +353,7 @@ class CuckooEmbeddingHashTable : public EmbeddingHashTableInterface {
   bool UpsertEntry(int64_t id,
                    const std::function<void(EntryType&)>& upsert_fn) {
     auto init_fn = [&](EntryType& entry) {
-      accessor_->Init(entry_helper_.Get(entry));
+      accessor_->Init(id, entry_helper_.Get(entry));
       upsert_fn(entry);
     };
     return entry_helper_.Upsert(&m_, id, upsert_fn, init_fn);
@@ -121,6 +121,10 @@ class EmbeddingHashTableInterface {
   // Clears data of hash table.
   virtual void Clear() = 0;
 
+  // Makes room for at least |num_entries| entries, e.g. before a restore, so
+  // that the table does not grow step by step while it is filled.
+  virtual void Reserve(int64_t num_entries) = 0;
+
   // Returns the size of the current table.
   virtual int64_t Size() const = 0;
 
@@ -212,6 +216,10 @@ class DefaultEmbeddingHashTableDecorator : public EmbeddingHashTableInterface {
 
   void Clear() override { return base_->Clear(); }
 
+  void Reserve(int64_t num_entries) override {
+    return base_->Reserve(num_entries);
+  }
+
   int64_t Size() const override { return base_->Size(); }
 
   int DimSize() const override { return base_->DimSize(); }
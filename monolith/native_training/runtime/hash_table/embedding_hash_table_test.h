@@ -144,6 +144,21 @@ TEST_P(ReadWriteEmbeddingHashTableTest, Clear) {
   EXPECT_THAT(emb, testing::ElementsAre(0.0f));
 }
 
+TEST_P(ReadWriteEmbeddingHashTableTest, Reserve) {
+  auto p = GetParam();
+  EmbeddingHashTableConfig config = std::get<0>(p);
+  std::unique_ptr<EmbeddingHashTableHelper> table =
+      std::make_unique<EmbeddingHashTableHelper>(
+          NewEmbeddingHashTableFromConfig(config));
+  table->Assign({1}, {{2.0f}});
+  table->Reserve(100000);
+  table->Reserve(10);
+  EXPECT_EQ(table->Size(), 1);
+  std::vector<float> emb(1);
+  table->Lookup(1, absl::MakeSpan(emb));
+  EXPECT_THAT(emb, testing::ElementsAre(2.0f));
+}
+
 class SaveRestoreEmbeddingHashTestTest
     : public ::testing::TestWithParam<
           std::tuple<EmbeddingHashTableConfig, std::vector<float>>> {};
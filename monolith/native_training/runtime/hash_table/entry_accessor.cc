@@ -70,6 +70,8 @@ class ServingEntryAccessor final : public EntryAccessorInterface {
     // No need to initialize serving entry
   }
 
+  void Init(int64_t id, void* ctx) const override {}
+
   void Fill(const void* ctx, absl::Span<float> num) const override {
     compressor_->Decode(ctx, num);
   }
@@ -166,6 +168,12 @@ class EntryAccessor final : public EntryAccessorInterface {
     optimizer_->Init(GetMutableOptimizerCtx(ctx));
   }
 
+  void Init(int64_t id, void* ctx) const override {
+    auto num_span = GetMutableNum(ctx);
+    initializer_->Initialize(id, num_span);
+    optimizer_->Init(GetMutableOptimizerCtx(ctx));
+  }
+
   void Fill(const void* ctx, absl::Span<float> num) const override {
     retriever_->Retrieve(ctx, num);
   }
@@ -51,6 +51,10 @@ class EntryAccessorInterface {
   // Initialize the given entry.
   virtual void Init(void* ctx) const = 0;
 
+  // Initialize the entry of id. Random initial values are a function of the
+  // id, no matter which thread creates the entry.
+  virtual void Init(int64_t id, void* ctx) const { Init(ctx); }
+
   // Fills the num based on entry.
   virtual void Fill(const void* ctx, absl::Span<float> num) const = 0;
 
@@ -46,6 +46,10 @@ class EntryAccessorDecorator : public EntryAccessorInterface {
 
   void Init(void* ctx) const override { entry_accessor_->Init(ctx); }
 
+  void Init(int64_t id, void* ctx) const override {
+    entry_accessor_->Init(id, ctx);
+  }
+
   void Fill(const void* ctx, absl::Span<float> num) const override {
     entry_accessor_->Fill(ctx, num);
   }
@@ -0,0 +1,101 @@
+// Copyright 2022 ByteDance and/or its affiliates.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MONOLITH_NATIVE_TRAINING_RUNTIME_HASH_TABLE_INITIALIZER_COUNTER_RANDOM
+#define MONOLITH_NATIVE_TRAINING_RUNTIME_HASH_TABLE_INITIALIZER_COUNTER_RANDOM
+
+#include <cstdint>
+
+#if defined(_ENABLE_AVX) && defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace monolith {
+namespace hash_table {
+
+// A counter-based generator: number i of a stream is a hash of the key of the
+// stream and i, so it does not depend on what was generated before, or on
+// which thread generates it.
+
+// The key of the stream of an id, e.g. the initial values of a fid.
+inline uint64_t CounterRandomKey(uint64_t seed, uint64_t id) {
+  // The finalizer of splitmix64.
+  uint64_t z = seed * 0x9E3779B97F4A7C15ULL + id;
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
+namespace counter_random_internal {
+
+inline uint32_t Mix(uint32_t x) {
+  x ^= x >> 16;
+  x *= 0x7FEB352DU;
+  x ^= x >> 15;
+  x *= 0x846CA68BU;
+  x ^= x >> 16;
+  return x;
+}
+
+inline uint32_t Bits(uint64_t key, uint32_t i) {
+  uint32_t x = Mix(i * 0x9E3779B9U ^ static_cast<uint32_t>(key));
+  return Mix(x ^ static_cast<uint32_t>(key >> 32));
+}
+
+#if defined(_ENABLE_AVX) && defined(__AVX2__)
+inline __m256i Mix(__m256i x) {
+  x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 16));
+  x = _mm256_mullo_epi32(x, _mm256_set1_epi32(0x7FEB352D));
+  x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 15));
+  x = _mm256_mullo_epi32(x, _mm256_set1_epi32(0x846CA68B));
+  return _mm256_xor_si256(x, _mm256_srli_epi32(x, 16));
+}
+#endif
+
+}  // namespace counter_random_internal
+
+// Fills out[0, n) with numbers [0, n) of the stream of key, uniform in
+// [minval, maxval).
+inline void CounterRandomUniform(uint64_t key, float minval, float maxval,
+                                 float* out, int n) {
+  constexpr float kScale = 1.0f / (1 << 24);
+  const float range = maxval - minval;
+  int i = 0;
+#if defined(_ENABLE_AVX) && defined(__AVX2__)
+  const __m256i key_lo = _mm256_set1_epi32(static_cast<uint32_t>(key));
+  const __m256i key_hi = _mm256_set1_epi32(static_cast<uint32_t>(key >> 32));
+  const __m256i golden = _mm256_set1_epi32(0x9E3779B9);
+  const __m256 scale = _mm256_set1_ps(kScale * range);
+  const __m256 min = _mm256_set1_ps(minval);
+  __m256i counter = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  for (; i + 8 <= n; i += 8) {
+    __m256i x = _mm256_xor_si256(_mm256_mullo_epi32(counter, golden), key_lo);
+    x = counter_random_internal::Mix(x);
+    x = counter_random_internal::Mix(_mm256_xor_si256(x, key_hi));
+    // The top 24 bits are exact in a float.
+    __m256 u = _mm256_cvtepi32_ps(_mm256_srli_epi32(x, 8));
+    _mm256_storeu_ps(out + i, _mm256_add_ps(min, _mm256_mul_ps(u, scale)));
+    counter = _mm256_add_epi32(counter, _mm256_set1_epi32(8));
+  }
+#endif
+  for (; i < n; ++i) {
+    const float u = counter_random_internal::Bits(key, i) >> 8;
+    out[i] = minval + u * (kScale * range);
+  }
+}
+
+}  // namespace hash_table
+}  // namespace monolith
+
+#endif  // MONOLITH_NATIVE_TRAINING_RUNTIME_HASH_TABLE_INITIALIZER_COUNTER_RANDOM
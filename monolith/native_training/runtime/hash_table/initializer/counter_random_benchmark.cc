@@ -0,0 +1,67 @@
+// Copyright 2022 ByteDance and/or its affiliates.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <random>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "monolith/native_training/runtime/hash_table/initializer/counter_random.h"
+
+namespace monolith {
+namespace hash_table {
+namespace {
+
+constexpr int kNumIds = 1024;
+
+// Args: dim. Initializes the rows of kNumIds new ids.
+
+// The initializer before: one float at a time from a thread local mt19937.
+void BM_Mt19937Uniform(benchmark::State& state) {  // NOLINT
+  const int dim = state.range(0);
+  std::vector<float> rows(kNumIds * dim);
+  for (auto _ : state) {
+    for (int id = 0; id < kNumIds; ++id) {
+      thread_local std::mt19937 generator;
+      std::uniform_real_distribution<float> distribution(-0.05f, 0.05f);
+      float* row = rows.data() + id * dim;
+      for (int i = 0; i < dim; ++i) {
+        row[i] = distribution(generator);
+      }
+    }
+    benchmark::DoNotOptimize(rows.data());
+  }
+  state.SetItemsProcessed(state.iterations() * kNumIds * dim);
+}
+
+void BM_CounterUniform(benchmark::State& state) {  // NOLINT
+  const int dim = state.range(0);
+  std::vector<float> rows(kNumIds * dim);
+  for (auto _ : state) {
+    for (int id = 0; id < kNumIds; ++id) {
+      CounterRandomUniform(CounterRandomKey(0, id), -0.05f, 0.05f,
+                           rows.data() + id * dim, dim);
+    }
+    benchmark::DoNotOptimize(rows.data());
+  }
+  state.SetItemsProcessed(state.iterations() * kNumIds * dim);
+}
+
+BENCHMARK(BM_Mt19937Uniform)->Arg(8)->Arg(16)->Arg(32)->Arg(64)->Arg(128);
+BENCHMARK(BM_CounterUniform)->Arg(8)->Arg(16)->Arg(32)->Arg(64)->Arg(128);
+
+}  // namespace
+}  // namespace hash_table
+}  // namespace monolith
+
+BENCHMARK_MAIN();
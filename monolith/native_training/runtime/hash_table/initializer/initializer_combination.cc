@@ -16,6 +16,7 @@
 #include "monolith/native_training/runtime/hash_table/initializer/initializer_combination.h"
 
 #include "absl/strings/str_format.h"
+#include "monolith/native_training/runtime/hash_table/initializer/counter_random.h"
 
 namespace monolith {
 namespace hash_table {
@@ -34,6 +35,14 @@ class CombinedInitializer : public InitializerInterface {
     init2_->Initialize(nums.subspan(init1_->DimSize()));
   }
 
+  void Initialize(int64_t id, absl::Span<float> nums) const override {
+    init1_->Initialize(id, nums);
+    // The second initializer draws another stream, even with the same seed.
+    init2_->Initialize(
+        static_cast<int64_t>(CounterRandomKey(init1_->DimSize(), id)),
+        nums.subspan(init1_->DimSize()));
+  }
+
   std::string DebugString() const override {
     return absl::StrFormat("%s|%s", init1_->DebugString(),
                            init2_->DebugString());
@@ -15,6 +15,9 @@
 #ifndef MONOLITH_NATIVE_TRAINING_RUNTIME_HASH_TABLE_INITIALIZER_INTERFACE
 #define MONOLITH_NATIVE_TRAINING_RUNTIME_HASH_TABLE_INITIALIZER_INTERFACE
 
+#include <cstdint>
+#include <string>
+
 #include "absl/types/span.h"
 
 namespace monolith {
@@ -28,6 +31,12 @@ class InitializerInterface {
 
   virtual void Initialize(absl::Span<float> nums) const = 0;
 
+  // Initializes the nums of the entry of id. Initializers drawing random
+  // numbers make them a function of the id, so that they are reproducible.
+  virtual void Initialize(int64_t id, absl::Span<float> nums) const {
+    Initialize(nums);
+  }
+
   virtual std::string DebugString() const = 0;
 };
 
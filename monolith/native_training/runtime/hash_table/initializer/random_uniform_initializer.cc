@@ -14,8 +14,11 @@
 
 #include "monolith/native_training/runtime/hash_table/initializer/random_uniform_initializer.h"
 
-#include <random>
+#include <atomic>
+#include <limits>
+
 #include "absl/strings/str_format.h"
+#include "monolith/native_training/runtime/hash_table/initializer/counter_random.h"
 
 namespace monolith {
 namespace hash_table {
@@ -24,26 +27,37 @@ namespace {
 class RandomUniformInitializer : public InitializerInterface {
  public:
   explicit RandomUniformInitializer(RandomUniformInitializerConfig conf)
-      : conf_(std::move(conf)) {}
+      : conf_(std::move(conf)),
+        // The streams without an id are keyed apart from those of the ids.
+        stream_seed_(CounterRandomKey(conf_.seed(),
+                                      std::numeric_limits<uint64_t>::max())) {}
 
   int DimSize() const override { return conf_.dim_size(); }
 
   void Initialize(absl::Span<float> nums) const override {
-    thread_local std::mt19937 generator;
-    std::uniform_real_distribution<float> distribution(conf_.minval(),
-                                                       conf_.maxval());
-    for (int i = 0; i < conf_.dim_size(); ++i) {
-      nums[i] = distribution(generator);
-    }
+    // Without an id, every call takes the next stream of the seed.
+    const uint64_t stream =
+        next_stream_.fetch_add(1, std::memory_order_relaxed);
+    CounterRandomUniform(CounterRandomKey(stream_seed_, stream),
+                         conf_.minval(), conf_.maxval(), nums.data(),
+                         conf_.dim_size());
+  }
+
+  void Initialize(int64_t id, absl::Span<float> nums) const override {
+    CounterRandomUniform(CounterRandomKey(conf_.seed(), id), conf_.minval(),
+                         conf_.maxval(), nums.data(), conf_.dim_size());
   }
 
   std::string DebugString() const override {
-    return absl::StrFormat("RandomUniform(D=%d, min=%f, max=%f)", DimSize(),
-                           conf_.minval(), conf_.maxval());
+    return absl::StrFormat("RandomUniform(D=%d, min=%f, max=%f, seed=%d)",
+                           DimSize(), conf_.minval(), conf_.maxval(),
+                           conf_.seed());
   }
 
  private:
   RandomUniformInitializerConfig conf_;
+  const uint64_t stream_seed_;
+  mutable std::atomic<uint64_t> next_stream_{0};
 };
 
 }  // namespace
@@ -15,18 +15,24 @@
 #include "monolith/native_training/runtime/hash_table/initializer/random_uniform_initializer.h"
 
 #include <algorithm>
+#include <thread>
+#include <vector>
 
 #include "absl/types/span.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
+#include "monolith/native_training/runtime/hash_table/initializer/counter_random.h"
 #include "monolith/native_training/runtime/hash_table/initializer/initializer_config.pb.h"
 
 namespace monolith {
 namespace hash_table {
 namespace {
 
+using ::testing::ElementsAreArray;
+using ::testing::Ge;
 using ::testing::Gt;
 using ::testing::Lt;
+using ::testing::Ne;
 
 TEST(RandomUniformInitializer, Basic) {
   const int kDimSize = 1000;
@@ -41,6 +47,95 @@ TEST(RandomUniformInitializer, Basic) {
   EXPECT_THAT(*std::min_element(num.begin(), num.end()), Lt(0.9));
 }
 
+TEST(RandomUniformInitializer, SameValuesForSameId) {
+  const int kDimSize = 37;
+  RandomUniformInitializerConfig config;
+  config.set_dim_size(kDimSize);
+  config.set_seed(7);
+  auto initializer = NewRandomUniformInitializer(config);
+  std::vector<float> expected(kDimSize);
+  initializer->Initialize(12345, absl::MakeSpan(expected));
+  for (float x : expected) {
+    EXPECT_THAT(x, Ge(config.minval()));
+    EXPECT_THAT(x, Lt(config.maxval()));
+  }
+
+  // No matter which thread initializes the id.
+  std::vector<std::vector<float>> nums(4, std::vector<float>(kDimSize));
+  std::vector<std::thread> threads;
+  for (auto& num : nums) {
+    threads.emplace_back(
+        [&]() { initializer->Initialize(12345, absl::MakeSpan(num)); });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  for (const auto& num : nums) {
+    EXPECT_THAT(num, ElementsAreArray(expected));
+  }
+
+  std::vector<float> other(kDimSize);
+  initializer->Initialize(12346, absl::MakeSpan(other));
+  EXPECT_THAT(other, Ne(expected));
+  config.set_seed(8);
+  NewRandomUniformInitializer(config)->Initialize(12345,
+                                                  absl::MakeSpan(other));
+  EXPECT_THAT(other, Ne(expected));
+}
+
+TEST(RandomUniformInitializer, StreamsWithoutIdFollowSeed) {
+  const int kDimSize = 19;
+  RandomUniformInitializerConfig config;
+  config.set_dim_size(kDimSize);
+  config.set_seed(7);
+  auto initializer = NewRandomUniformInitializer(config);
+  auto same_seed = NewRandomUniformInitializer(config);
+  config.set_seed(8);
+  auto other_seed = NewRandomUniformInitializer(config);
+
+  std::vector<float> first(kDimSize), second(kDimSize), num(kDimSize);
+  initializer->Initialize(absl::MakeSpan(first));
+  initializer->Initialize(absl::MakeSpan(second));
+  EXPECT_THAT(second, Ne(first));
+  same_seed->Initialize(absl::MakeSpan(num));
+  EXPECT_THAT(num, ElementsAreArray(first));
+  same_seed->Initialize(absl::MakeSpan(num));
+  EXPECT_THAT(num, ElementsAreArray(second));
+  other_seed->Initialize(absl::MakeSpan(num));
+  EXPECT_THAT(num, Ne(first));
+}
+
+TEST(CounterRandomUniform, NumberIDependsOnlyOnKeyAndI) {
+  const uint64_t key = CounterRandomKey(1, 2);
+  std::vector<float> all(67);
+  CounterRandomUniform(key, -1, 1, all.data(), all.size());
+  for (int n : {1, 7, 8, 9, 31}) {
+    std::vector<float> prefix(n);
+    CounterRandomUniform(key, -1, 1, prefix.data(), n);
+    for (int i = 0; i < n; ++i) {
+      EXPECT_NEAR(prefix[i], all[i], 1e-6) << n << " " << i;
+    }
+  }
+}
+
+TEST(CounterRandomUniform, Uniform) {
+  const int kNum = 1 << 16;
+  std::vector<float> nums(kNum);
+  CounterRandomUniform(CounterRandomKey(0, 0), 0, 1, nums.data(), kNum);
+  std::vector<int> buckets(16);
+  double sum = 0;
+  for (float x : nums) {
+    ASSERT_THAT(x, Ge(0));
+    ASSERT_THAT(x, Lt(1));
+    ++buckets[static_cast<int>(x * buckets.size())];
+    sum += x;
+  }
+  EXPECT_NEAR(sum / kNum, 0.5, 0.01);
+  for (int count : buckets) {
+    EXPECT_NEAR(count, kNum / buckets.size(), kNum / buckets.size() * 0.1);
+  }
+}
+
 }  // namespace
 }  // namespace hash_table
 }  // namespace monolith
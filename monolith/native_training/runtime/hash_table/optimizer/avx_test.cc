@@ -61,6 +61,79 @@ TEST(AVX, Basic) {
   TestAdagradOptimize(224);
 }
 
+void TestProducts(size_t dim) {
+  std::vector<float> a(dim), b(dim), y(dim);
+  absl::BitGen bit_gen;
+  for (size_t i = 0; i < dim; ++i) {
+    a[i] = absl::Uniform<float>(bit_gen, -1.f, 1.f);
+    b[i] = absl::Uniform<float>(bit_gen, -1.f, 1.f);
+    y[i] = absl::Uniform<float>(bit_gen, -1.f, 1.f);
+  }
+  std::vector<float> multiply(dim), multiply_avx(dim);
+  std::vector<float> multiply_add(y), multiply_add_avx(y);
+  std::vector<float> axpy(y), axpy_avx(y);
+  BaseMultiply(a.data(), b.data(), multiply.data(), dim);
+  BaseMultiplyAdd(a.data(), b.data(), multiply_add.data(), dim);
+  BaseAxpy(0.5f, a.data(), axpy.data(), dim);
+#if defined(_ENABLE_AVX) && defined(__AVX__)
+  EXPECT_NEAR(BaseDot(a.data(), b.data(), dim),
+              Avx256Dot(a.data(), b.data(), dim), 1e-5);
+  Avx256Multiply(a.data(), b.data(), multiply_avx.data(), dim);
+  Avx256MultiplyAdd(a.data(), b.data(), multiply_add_avx.data(), dim);
+  Avx256Axpy(0.5f, a.data(), axpy_avx.data(), dim);
+#else
+  static_assert(false, "AVX is not available, please check and recompile!");
+#endif
+
+  for (size_t i = 0; i < dim; ++i) {
+    EXPECT_NEAR(multiply[i], multiply_avx[i], 1e-6);
+    EXPECT_NEAR(multiply_add[i], multiply_add_avx[i], 1e-6);
+    EXPECT_NEAR(axpy[i], axpy_avx[i], 1e-6);
+  }
+}
+
+TEST(AVX, Products) {
+  for (size_t dim : {1, 7, 8, 16, 39, 224}) {
+    TestProducts(dim);
+  }
+}
+
+void TestElementwise(size_t dim) {
+  std::vector<float> a(dim), y(dim), x(dim);
+  absl::BitGen bit_gen;
+  for (size_t i = 0; i < dim; ++i) {
+    a[i] = absl::Uniform<float>(bit_gen, -1.f, 1.f);
+    y[i] = absl::Uniform<float>(bit_gen, 0.f, 1.f);
+    x[i] = absl::Uniform<float>(bit_gen, 0.f, 4.f);
+  }
+  std::vector<float> square_sum(y), square_sum_avx(y);
+  std::vector<float> scale(x), scale_avx(x);
+  std::vector<float> roots(x), roots_avx(x);
+  BaseReduceSquareSum(a.data(), square_sum.data(), dim);
+  BaseScale(scale.data(), 0.3f, dim);
+  BaseSqrt(roots.data(), dim);
+#if defined(_ENABLE_AVX) && defined(__AVX__)
+  Avx256ReduceSquareSum(a.data(), square_sum_avx.data(), dim);
+  Avx256Scale(scale_avx.data(), 0.3f, dim);
+  Avx256Sqrt(roots_avx.data(), dim);
+#else
+  static_assert(false, "AVX is not available, please check and recompile!");
+#endif
+
+  for (size_t i = 0; i < dim; ++i) {
+    EXPECT_NEAR(square_sum[i], square_sum_avx[i], 1e-6);
+    // Both are correctly rounded.
+    EXPECT_EQ(scale[i], scale_avx[i]);
+    EXPECT_EQ(roots[i], roots_avx[i]);
+  }
+}
+
+TEST(AVX, Elementwise) {
+  for (size_t dim : {1, 7, 8, 9, 15, 16, 39, 224}) {
+    TestElementwise(dim);
+  }
+}
+
 
 }  // namespace
 }  // namespace hash_table
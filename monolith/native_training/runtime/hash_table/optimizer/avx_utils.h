@@ -19,6 +19,9 @@
 #ifndef MONOLITH_NATIVE_TRAINING_RUNTIME_HASH_TABLE_OPTIMIZER_AVX_UTILS
 #define MONOLITH_NATIVE_TRAINING_RUNTIME_HASH_TABLE_OPTIMIZER_AVX_UTILS
 
+#include <cmath>
+#include <cstddef>
+
 #if defined(_ENABLE_AVX) && defined(__AVX__)
 #include <immintrin.h>
 #endif
@@ -92,6 +95,52 @@ inline void BaseReduceSum(const float* a, const float* b, float* output,
   }
 }
 
+inline void BaseReduceSquareSum(const float* a, float* output, size_t len) {
+  for (size_t i = 0; i < len; ++i) {
+    output[i] += a[i] * a[i];
+  }
+}
+
+inline void BaseScale(float* x, float scale, size_t len) {
+  for (size_t i = 0; i < len; ++i) {
+    x[i] *= scale;
+  }
+}
+
+inline void BaseSqrt(float* x, size_t len) {
+  for (size_t i = 0; i < len; ++i) {
+    x[i] = std::sqrt(x[i]);
+  }
+}
+
+inline float BaseDot(const float* a, const float* b, size_t len) {
+  float sum = 0;
+  for (size_t i = 0; i < len; ++i) {
+    sum += a[i] * b[i];
+  }
+  return sum;
+}
+
+inline void BaseMultiply(const float* a, const float* b, float* output,
+                         size_t len) {
+  for (size_t i = 0; i < len; ++i) {
+    output[i] = a[i] * b[i];
+  }
+}
+
+inline void BaseMultiplyAdd(const float* a, const float* b, float* output,
+                            size_t len) {
+  for (size_t i = 0; i < len; ++i) {
+    output[i] += a[i] * b[i];
+  }
+}
+
+inline void BaseAxpy(float alpha, const float* x, float* y, size_t len) {
+  for (size_t i = 0; i < len; ++i) {
+    y[i] += alpha * x[i];
+  }
+}
+
 #if defined(_ENABLE_AVX) && defined(__AVX__)
 inline void Avx256AdagradOptimize(float* num, float* norm, const float* grad,
                                   size_t len, float lr, float w_decay) {
@@ -233,6 +282,82 @@ inline void Avx256ReduceSum(const float* a, const float* b, float* output,
     BaseReduceSum(a, b, output, len);
   }
 }
+
+inline void Avx256ReduceSquareSum(const float* a, float* output, size_t len) {
+  for (; len > 7; len -= 8, a += 8, output += 8) {
+    const __m256 _a = _mm256_loadu_ps(a);
+    const __m256 _output = _mm256_loadu_ps(output);
+    _mm256_storeu_ps(output, _mm256_fmadd_ps(_a, _a, _output));
+  }
+  if (len) {
+    BaseReduceSquareSum(a, output, len);
+  }
+}
+
+inline void Avx256Scale(float* x, float scale, size_t len) {
+  const __m256 _scale = _mm256_set1_ps(scale);
+  for (; len > 7; len -= 8, x += 8) {
+    _mm256_storeu_ps(x, _mm256_mul_ps(_mm256_loadu_ps(x), _scale));
+  }
+  if (len) {
+    BaseScale(x, scale, len);
+  }
+}
+
+inline void Avx256Sqrt(float* x, size_t len) {
+  for (; len > 7; len -= 8, x += 8) {
+    _mm256_storeu_ps(x, _mm256_sqrt_ps(_mm256_loadu_ps(x)));
+  }
+  if (len) {
+    BaseSqrt(x, len);
+  }
+}
+
+inline float Avx256Dot(const float* a, const float* b, size_t len) {
+  __m256 _sum = _mm256_setzero_ps();
+  for (; len > 7; len -= 8, a += 8, b += 8) {
+    _sum = _mm256_fmadd_ps(_mm256_loadu_ps(a), _mm256_loadu_ps(b), _sum);
+  }
+  float sum = sum8(_sum);
+  if (len) {
+    sum += BaseDot(a, b, len);
+  }
+  return sum;
+}
+
+inline void Avx256Multiply(const float* a, const float* b, float* output,
+                           size_t len) {
+  for (; len > 7; len -= 8, a += 8, b += 8, output += 8) {
+    _mm256_storeu_ps(output,
+                     _mm256_mul_ps(_mm256_loadu_ps(a), _mm256_loadu_ps(b)));
+  }
+  if (len) {
+    BaseMultiply(a, b, output, len);
+  }
+}
+
+inline void Avx256MultiplyAdd(const float* a, const float* b, float* output,
+                              size_t len) {
+  for (; len > 7; len -= 8, a += 8, b += 8, output += 8) {
+    const __m256 _output = _mm256_loadu_ps(output);
+    _mm256_storeu_ps(output, _mm256_fmadd_ps(_mm256_loadu_ps(a),
+                                             _mm256_loadu_ps(b), _output));
+  }
+  if (len) {
+    BaseMultiplyAdd(a, b, output, len);
+  }
+}
+
+inline void Avx256Axpy(float alpha, const float* x, float* y, size_t len) {
+  const __m256 _alpha = _mm256_set1_ps(alpha);
+  for (; len > 7; len -= 8, x += 8, y += 8) {
+    _mm256_storeu_ps(
+        y, _mm256_fmadd_ps(_alpha, _mm256_loadu_ps(x), _mm256_loadu_ps(y)));
+  }
+  if (len) {
+    BaseAxpy(alpha, x, y, len);
+  }
+}
 #endif
 
 inline void AdagradOptimize(float* num, float* norm, const float* grad,
@@ -253,6 +378,69 @@ inline void ReduceSum(const float* a, const float* b, float* output,
 #endif
 }
 
+// output += a * a
+inline void ReduceSquareSum(const float* a, float* output, size_t len) {
+#if defined(_ENABLE_AVX) && defined(__AVX__)
+  Avx256ReduceSquareSum(a, output, len);
+#else
+  BaseReduceSquareSum(a, output, len);
+#endif
+}
+
+inline void Scale(float* x, float scale, size_t len) {
+#if defined(_ENABLE_AVX) && defined(__AVX__)
+  Avx256Scale(x, scale, len);
+#else
+  BaseScale(x, scale, len);
+#endif
+}
+
+inline void Sqrt(float* x, size_t len) {
+#if defined(_ENABLE_AVX) && defined(__AVX__)
+  Avx256Sqrt(x, len);
+#else
+  BaseSqrt(x, len);
+#endif
+}
+
+// Returns the dot product of a and b.
+inline float Dot(const float* a, const float* b, size_t len) {
+#if defined(_ENABLE_AVX) && defined(__AVX__)
+  return Avx256Dot(a, b, len);
+#else
+  return BaseDot(a, b, len);
+#endif
+}
+
+// output = a * b
+inline void Multiply(const float* a, const float* b, float* output,
+                     size_t len) {
+#if defined(_ENABLE_AVX) && defined(__AVX__)
+  Avx256Multiply(a, b, output, len);
+#else
+  BaseMultiply(a, b, output, len);
+#endif
+}
+
+// output += a * b
+inline void MultiplyAdd(const float* a, const float* b, float* output,
+                        size_t len) {
+#if defined(_ENABLE_AVX) && defined(__AVX__)
+  Avx256MultiplyAdd(a, b, output, len);
+#else
+  BaseMultiplyAdd(a, b, output, len);
+#endif
+}
+
+// y += alpha * x
+inline void Axpy(float alpha, const float* x, float* y, size_t len) {
+#if defined(_ENABLE_AVX) && defined(__AVX__)
+  Avx256Axpy(alpha, x, y, len);
+#else
+  BaseAxpy(alpha, x, y, len);
+#endif
+}
+
 }  // namespace hash_table
 }  // namespace monolith
 #endif  // MONOLITH_NATIVE_TRAINING_RUNTIME_HASH_TABLE_OPTIMIZER_AVX_UTILS
@@ -90,6 +90,7 @@ class EmbeddingHashTableTfBridge : public ResourceBase {
   Status Restore(OpKernelContext* ctx, DumpShard shard,
                  std::function<bool(EntryDump*, int64_t*)> get_fn) const;
   void Clear() const { table_->Clear(); }
+  void Reserve(int64_t num_entries) const { table_->Reserve(num_entries); }
   int64_t Size() const { return table_->Size(); }
 
   int32 dim_size() const;
@@ -0,0 +1,200 @@
+// Copyright 2022 ByteDance and/or its affiliates.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MONOLITH_NATIVE_TRAINING_RUNTIME_OPS_EMBEDDING_LAYOUT_PLAN_H_
+#define MONOLITH_NATIVE_TRAINING_RUNTIME_OPS_EMBEDDING_LAYOUT_PLAN_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+
+#include "monolith/native_training/runtime/hash_table/optimizer/avx_utils.h"
+
+namespace tensorflow {
+namespace monolith_tf {
+
+enum class SlicePooling { kSum, kMean, kFirstN };
+
+// One slice of a layout output, compiled from its OutConfig/SliceConfig once
+// when the kernel is constructed. Row r of the slice is the `span()` floats at
+// r * row_stride + dst_offset of output tensor `output`, and is pooled from
+// columns [src_start, src_start + dim) of the embeddings of the fids of
+// feature list `nfl_idx`.
+struct LayoutSlicePlan {
+  int output = 0;
+  int64_t row_stride = 0;
+  int64_t dst_offset = 0;
+  int nfl_idx = 0;
+  int slice_idx = 0;
+  int src_start = 0;
+  int dim = 0;
+  int max_sequence_length = 0;
+  SlicePooling pooling = SlicePooling::kSum;
+  // ADDN layouts sum their slices into the same floats.
+  bool add = false;
+  // The first slice of its layout.
+  bool first = false;
+
+  int64_t span() const {
+    return pooling == SlicePooling::kFirstN
+               ? static_cast<int64_t>(dim) * max_sequence_length
+               : dim;
+  }
+};
+
+namespace layout_plan_internal {
+
+// out = src / n, or out += src / n.
+inline void MeanPool(const float* src, int dim, int n, bool init, float* out) {
+  if (init) {
+    for (int i = 0; i < dim; ++i) {
+      out[i] = src[i] / n;
+    }
+  } else {
+    for (int i = 0; i < dim; ++i) {
+      out[i] += src[i] / n;
+    }
+  }
+}
+
+inline void SumPool(const float* src, int dim, bool init, float* out) {
+  if (init) {
+    std::memcpy(out, src, dim * sizeof(float));
+  } else {
+    ::monolith::hash_table::ReduceSum(src, out, out, dim);
+  }
+}
+
+// A fid offset is the index of its embeddings and the row in them.
+inline void ParseFidOffset(uint64_t fid_offset, int64_t* index1,
+                           int64_t* index2) {
+  *index1 = static_cast<int64_t>(fid_offset >> 32);
+  *index2 = static_cast<int64_t>(fid_offset & 0xffffffffu);
+}
+
+template <typename Rows>
+inline float* SliceOf(const Rows& rows, int64_t index2, int src_start,
+                      int dim) {
+  const int64_t offset = index2 * rows.offset + src_start;
+  if (offset + dim > static_cast<int64_t>(rows.count)) {
+    return nullptr;
+  }
+  return const_cast<float*>(rows.ptr) + offset;
+}
+
+}  // namespace layout_plan_internal
+
+// Pools the slice of the embeddings of fid_offsets[0, fid_num) into out,
+// which has slice.span() floats. With init the first fid overwrites out,
+// otherwise every fid is added to it. Rows is an array of
+// {ptr, offset (row stride), count (floats)} of num_rows embeddings. Returns
+// false if a fid offset points outside of them.
+template <typename FidOffset, typename Rows>
+inline bool GatherSlice(const LayoutSlicePlan& slice,
+                        const FidOffset* fid_offsets, int64_t fid_num,
+                        const Rows* rows, int64_t num_rows, bool init,
+                        float* out) {
+  if (slice.pooling == SlicePooling::kFirstN) {
+    fid_num = std::min<int64_t>(fid_num, slice.max_sequence_length);
+  }
+  for (int64_t i = 0; i < fid_num; ++i) {
+    int64_t index1, index2;
+    layout_plan_internal::ParseFidOffset(fid_offsets[i], &index1, &index2);
+    if (index1 >= num_rows) {
+      return false;
+    }
+    const float* src = layout_plan_internal::SliceOf(
+        rows[index1], index2, slice.src_start, slice.dim);
+    if (src == nullptr) {
+      return false;
+    }
+    if (i + 1 < fid_num) {
+      int64_t next1, next2;
+      layout_plan_internal::ParseFidOffset(fid_offsets[i + 1], &next1,
+                                           &next2);
+      if (next1 < num_rows) {
+        __builtin_prefetch(rows[next1].ptr + next2 * rows[next1].offset +
+                           slice.src_start);
+      }
+    }
+    switch (slice.pooling) {
+      case SlicePooling::kSum:
+        layout_plan_internal::SumPool(src, slice.dim, init && i == 0, out);
+        break;
+      case SlicePooling::kMean:
+        layout_plan_internal::MeanPool(src, slice.dim, fid_num, init && i == 0,
+                                       out);
+        break;
+      case SlicePooling::kFirstN:
+        std::memcpy(out + i * slice.dim, src, slice.dim * sizeof(float));
+        break;
+    }
+  }
+  return true;
+}
+
+// Adds the gradient of one row of the slice, grad with slice.span() floats, to
+// the embedding gradients of fid_offsets[0, fid_num). locks(index1, index2)
+// returns the std::mutex guarding an embedding row, or nullptr if no other
+// thread writes to it. inits(index1, index2) returns the char flag set while
+// the row is still to be overwritten instead of added to, or nullptr.
+template <typename FidOffset, typename Rows, typename LockFn,
+          typename InitFn>
+inline bool ScatterSlice(const LayoutSlicePlan& slice,
+                         const FidOffset* fid_offsets, int64_t fid_num,
+                         const Rows* rows, int64_t num_rows, const float* grad,
+                         const LockFn& locks, const InitFn& inits) {
+  const int mean_n = slice.pooling == SlicePooling::kMean ? fid_num : 0;
+  if (slice.pooling == SlicePooling::kFirstN) {
+    fid_num = std::min<int64_t>(fid_num, slice.max_sequence_length);
+  }
+  for (int64_t i = 0; i < fid_num; ++i) {
+    int64_t index1, index2;
+    layout_plan_internal::ParseFidOffset(fid_offsets[i], &index1, &index2);
+    if (index1 >= num_rows) {
+      return false;
+    }
+    float* dst = layout_plan_internal::SliceOf(rows[index1], index2,
+                                               slice.src_start, slice.dim);
+    if (dst == nullptr) {
+      return false;
+    }
+    const float* src =
+        slice.pooling == SlicePooling::kFirstN ? grad + i * slice.dim : grad;
+    std::mutex* mu = locks(index1, index2);
+    if (mu != nullptr) {
+      mu->lock();
+    }
+    char* init = inits(index1, index2);
+    const bool overwrite = init != nullptr && *init;
+    if (mean_n) {
+      layout_plan_internal::MeanPool(src, slice.dim, mean_n, overwrite, dst);
+    } else {
+      layout_plan_internal::SumPool(src, slice.dim, overwrite, dst);
+    }
+    if (overwrite) {
+      *init = false;
+    }
+    if (mu != nullptr) {
+      mu->unlock();
+    }
+  }
+  return true;
+}
+
+}  // namespace monolith_tf
+}  // namespace tensorflow
+
+#endif  // MONOLITH_NATIVE_TRAINING_RUNTIME_OPS_EMBEDDING_LAYOUT_PLAN_H_
@@ -0,0 +1,157 @@
+// Copyright 2022 ByteDance and/or its affiliates.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstring>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "monolith/native_training/runtime/ops/embedding_layout_plan.h"
+
+namespace tensorflow {
+namespace monolith_tf {
+namespace {
+
+struct Rows {
+  const float* ptr;
+  uint32_t offset;
+  uint32_t count;
+};
+
+// Args: number of features, dim. A batch of 256 rows with 2 fids per feature
+// and row, concatenated into one output.
+struct Input {
+  static constexpr int kBatchSize = 256;
+  static constexpr int kFidsPerRow = 2;
+  // The embeddings of the unique fids of a batch.
+  static constexpr int kTableRows = 1 << 12;
+
+  explicit Input(const benchmark::State& state)
+      : num_features(state.range(0)), dim(state.range(1)) {
+    std::mt19937 gen(0);
+    std::uniform_real_distribution<float> value(-1.0f, 1.0f);
+    table.resize(kTableRows * dim);
+    for (float& x : table) {
+      x = value(gen);
+    }
+    rows.push_back(Rows{table.data(), static_cast<uint32_t>(dim),
+                        static_cast<uint32_t>(table.size())});
+    std::uniform_int_distribution<uint64_t> row(0, kTableRows - 1);
+    fid_offsets.resize(num_features * kBatchSize * kFidsPerRow);
+    for (uint64_t& fid_offset : fid_offsets) {
+      fid_offset = row(gen);
+    }
+    for (int i = 0; i < num_features; ++i) {
+      LayoutSlicePlan slice;
+      slice.row_stride = num_features * dim;
+      slice.dst_offset = i * dim;
+      slice.nfl_idx = i;
+      slice.dim = dim;
+      plan.push_back(slice);
+    }
+    out.resize(kBatchSize * num_features * dim);
+  }
+
+  // The fids of feature i in batch row r.
+  const uint64_t* fids(int i, int r) const {
+    return fid_offsets.data() + (i * kBatchSize + r) * kFidsPerRow;
+  }
+
+  void SetItemsProcessed(benchmark::State* state) const {
+    state->SetItemsProcessed(state->iterations() * kBatchSize * num_features);
+  }
+
+  int num_features;
+  int dim;
+  std::vector<float> table;
+  std::vector<Rows> rows;
+  std::vector<uint64_t> fid_offsets;
+  std::vector<LayoutSlicePlan> plan;
+  std::vector<float> out;
+};
+
+typedef void (*PoolingFunc)(const float* src, int dim, bool* init, float* dst);
+
+void SumPooling(const float* src, int dim, bool* init, float* dst) {
+  if (*init) {
+    std::memcpy(dst, src, dim * sizeof(float));
+    *init = false;
+  } else {
+    for (int i = 0; i < dim; ++i) {
+      dst[i] += src[i];
+    }
+  }
+}
+
+// Like the kernels before: the output of every slice is looked up per call,
+// and every fid is pooled through a function pointer, slice by slice.
+void BM_InterpretedLayout(benchmark::State& state) {  // NOLINT
+  Input input(state);
+  PoolingFunc pooling = SumPooling;
+  benchmark::DoNotOptimize(pooling);
+  for (auto _ : state) {
+    std::unordered_map<int, int64_t> slice_to_offset;
+    for (const LayoutSlicePlan& slice : input.plan) {
+      slice_to_offset[slice.nfl_idx] = slice.dst_offset;
+    }
+    for (const LayoutSlicePlan& slice : input.plan) {
+      float* base = input.out.data() + slice_to_offset.at(slice.nfl_idx);
+      for (int r = 0; r < Input::kBatchSize; ++r) {
+        float* dst = base + r * slice.row_stride;
+        const uint64_t* fids = input.fids(slice.nfl_idx, r);
+        bool init = true;
+        for (int k = 0; k < Input::kFidsPerRow; ++k) {
+          pooling(input.table.data() + fids[k] * input.dim, input.dim, &init,
+                  dst);
+        }
+      }
+    }
+    benchmark::DoNotOptimize(input.out.data());
+  }
+  input.SetItemsProcessed(&state);
+}
+
+// The compiled plan, row by row as every worker runs it.
+void BM_LayoutPlan(benchmark::State& state) {  // NOLINT
+  Input input(state);
+  for (auto _ : state) {
+    for (int r = 0; r < Input::kBatchSize; ++r) {
+      for (const LayoutSlicePlan& slice : input.plan) {
+        GatherSlice(slice, input.fids(slice.nfl_idx, r), Input::kFidsPerRow,
+                    input.rows.data(), input.rows.size(), true,
+                    input.out.data() + r * slice.row_stride + slice.dst_offset);
+      }
+    }
+    benchmark::DoNotOptimize(input.out.data());
+  }
+  input.SetItemsProcessed(&state);
+}
+
+void Args(benchmark::internal::Benchmark* b) {
+  for (int64_t num_features : {100, 1000}) {
+    for (int64_t dim : {8, 16, 64}) {
+      b->Args({num_features, dim});
+    }
+  }
+}
+
+BENCHMARK(BM_InterpretedLayout)->Apply(Args);
+BENCHMARK(BM_LayoutPlan)->Apply(Args);
+
+}  // namespace
+}  // namespace monolith_tf
+}  // namespace tensorflow
+
+BENCHMARK_MAIN();
@@ -0,0 +1,184 @@
+// Copyright 2022 ByteDance and/or its affiliates.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "monolith/native_training/runtime/ops/embedding_layout_plan.h"
+
+#include <thread>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace tensorflow {
+namespace monolith_tf {
+namespace {
+
+using ::testing::ElementsAre;
+
+struct Rows {
+  const float* ptr;
+  uint32_t offset;
+  uint32_t count;
+};
+
+uint64_t FidOffset(uint64_t index1, uint64_t index2) {
+  return index1 << 32 | index2;
+}
+
+LayoutSlicePlan MakeSlice(SlicePooling pooling, int src_start, int dim,
+                          int max_sequence_length = 0) {
+  LayoutSlicePlan slice;
+  slice.pooling = pooling;
+  slice.src_start = src_start;
+  slice.dim = dim;
+  slice.max_sequence_length = max_sequence_length;
+  return slice;
+}
+
+class EmbeddingLayoutPlanTest : public ::testing::Test {
+ protected:
+  // Two tables of rows with 3 floats: row i of table t is
+  // {100 * t + 10 * i, 100 * t + 10 * i + 1, 100 * t + 10 * i + 2}.
+  EmbeddingLayoutPlanTest() {
+    for (int t = 0; t < 2; ++t) {
+      for (int i = 0; i < 4; ++i) {
+        for (int j = 0; j < 3; ++j) {
+          tables_[t].push_back(100 * t + 10 * i + j);
+        }
+      }
+      rows_.push_back(Rows{tables_[t].data(), 3,
+                           static_cast<uint32_t>(tables_[t].size())});
+    }
+  }
+
+  std::vector<float> tables_[2];
+  std::vector<Rows> rows_;
+};
+
+TEST_F(EmbeddingLayoutPlanTest, GatherSum) {
+  std::vector<uint64_t> fids = {FidOffset(0, 1), FidOffset(1, 2)};
+  LayoutSlicePlan slice = MakeSlice(SlicePooling::kSum, 1, 2);
+  std::vector<float> out = {1000, 1000};
+  ASSERT_TRUE(GatherSlice(slice, fids.data(), fids.size(), rows_.data(),
+                          rows_.size(), true, out.data()));
+  EXPECT_THAT(out, ElementsAre(11 + 121, 12 + 122));
+  // Without init it adds up.
+  ASSERT_TRUE(GatherSlice(slice, fids.data(), 1, rows_.data(), rows_.size(),
+                          false, out.data()));
+  EXPECT_THAT(out, ElementsAre(11 + 121 + 11, 12 + 122 + 12));
+}
+
+TEST_F(EmbeddingLayoutPlanTest, GatherMean) {
+  std::vector<uint64_t> fids = {FidOffset(0, 0), FidOffset(0, 3)};
+  LayoutSlicePlan slice = MakeSlice(SlicePooling::kMean, 0, 3);
+  std::vector<float> out(3, 1000);
+  ASSERT_TRUE(GatherSlice(slice, fids.data(), fids.size(), rows_.data(),
+                          rows_.size(), true, out.data()));
+  EXPECT_THAT(out, ElementsAre(15, 16, 17));
+}
+
+TEST_F(EmbeddingLayoutPlanTest, GatherFirstN) {
+  std::vector<uint64_t> fids = {FidOffset(1, 0), FidOffset(0, 2),
+                                FidOffset(0, 1)};
+  LayoutSlicePlan slice = MakeSlice(SlicePooling::kFirstN, 2, 1, 2);
+  EXPECT_EQ(slice.span(), 2);
+  std::vector<float> out(3, -1);
+  ASSERT_TRUE(GatherSlice(slice, fids.data(), fids.size(), rows_.data(),
+                          rows_.size(), true, out.data()));
+  // Only the first max_sequence_length fids.
+  EXPECT_THAT(out, ElementsAre(102, 22, -1));
+}
+
+TEST_F(EmbeddingLayoutPlanTest, GatherOutOfRange) {
+  LayoutSlicePlan slice = MakeSlice(SlicePooling::kSum, 1, 2);
+  std::vector<float> out(2);
+  uint64_t fid = FidOffset(2, 0);
+  EXPECT_FALSE(GatherSlice(slice, &fid, 1, rows_.data(), rows_.size(), true,
+                           out.data()));
+  fid = FidOffset(0, 4);
+  EXPECT_FALSE(GatherSlice(slice, &fid, 1, rows_.data(), rows_.size(), true,
+                           out.data()));
+}
+
+TEST_F(EmbeddingLayoutPlanTest, Scatter) {
+  std::vector<float> grads(tables_[0].size());
+  std::vector<Rows> grad_rows = {
+      Rows{grads.data(), 3, static_cast<uint32_t>(grads.size())}};
+  auto no_locks = [](int64_t, int64_t) -> std::mutex* { return nullptr; };
+  auto no_inits = [](int64_t, int64_t) -> char* { return nullptr; };
+  std::vector<uint64_t> fids = {FidOffset(0, 1), FidOffset(0, 1),
+                                FidOffset(0, 3)};
+  std::vector<float> grad = {2, 4};
+
+  ASSERT_TRUE(ScatterSlice(MakeSlice(SlicePooling::kSum, 1, 2), fids.data(),
+                           fids.size(), grad_rows.data(), grad_rows.size(),
+                           grad.data(), no_locks, no_inits));
+  EXPECT_THAT(grads, ElementsAre(0, 0, 0, 0, 4, 8, 0, 0, 0, 0, 2, 4));
+
+  ASSERT_TRUE(ScatterSlice(MakeSlice(SlicePooling::kMean, 0, 2), fids.data(),
+                           2, grad_rows.data(), grad_rows.size(), grad.data(),
+                           no_locks, no_inits));
+  EXPECT_THAT(grads, ElementsAre(0, 0, 0, 2, 8, 8, 0, 0, 0, 0, 2, 4));
+
+  // Row i of the sequence goes to fid i.
+  ASSERT_TRUE(ScatterSlice(MakeSlice(SlicePooling::kFirstN, 0, 1, 2),
+                           fids.data() + 1, 2, grad_rows.data(),
+                           grad_rows.size(), grad.data(), no_locks, no_inits));
+  EXPECT_THAT(grads, ElementsAre(0, 0, 0, 4, 8, 8, 0, 0, 0, 4, 2, 4));
+
+  // The first write of a row with an init flag overwrites it.
+  char init[4] = {true, true, true, true};
+  ASSERT_TRUE(ScatterSlice(
+      MakeSlice(SlicePooling::kSum, 2, 1), fids.data(), fids.size(),
+      grad_rows.data(), grad_rows.size(), grad.data(), no_locks,
+      [&init](int64_t, int64_t index2) { return &init[index2]; }));
+  EXPECT_THAT(grads, ElementsAre(0, 0, 0, 4, 8, 4, 0, 0, 0, 4, 2, 2));
+  EXPECT_THAT(init, ElementsAre(true, false, true, false));
+}
+
+TEST_F(EmbeddingLayoutPlanTest, ConcurrentScatter) {
+  constexpr int kDim = 16;
+  constexpr int kNumRows = 8;
+  std::vector<float> grads(kNumRows * kDim);
+  std::vector<Rows> grad_rows = {
+      Rows{grads.data(), kDim, static_cast<uint32_t>(grads.size())}};
+  std::mutex locks[kNumRows];
+  auto get_lock = [&locks](int64_t, int64_t index2) { return &locks[index2]; };
+  auto no_inits = [](int64_t, int64_t) -> char* { return nullptr; };
+  std::vector<uint64_t> fids;
+  for (int i = 0; i < 64; ++i) {
+    fids.push_back(FidOffset(0, i % kNumRows));
+  }
+  std::vector<float> grad(kDim, 1);
+  LayoutSlicePlan slice = MakeSlice(SlicePooling::kSum, 0, kDim);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&] {
+      for (int step = 0; step < 100; ++step) {
+        ScatterSlice(slice, fids.data(), fids.size(), grad_rows.data(),
+                     grad_rows.size(), grad.data(), get_lock, no_inits);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  for (float g : grads) {
+    EXPECT_EQ(g, 4 * 100 * 64 / kNumRows);
+  }
+}
+
+}  // namespace
+}  // namespace monolith_tf
+}  // namespace tensorflow
@@ -0,0 +1,92 @@
+// Copyright 2022 ByteDance and/or its affiliates.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MONOLITH_NATIVE_TRAINING_RUNTIME_OPS_EMBEDDING_SCATTER_H_
+#define MONOLITH_NATIVE_TRAINING_RUNTIME_OPS_EMBEDDING_SCATTER_H_
+
+#include <algorithm>
+#include <cstdint>
+
+#include "monolith/native_training/runtime/hash_table/optimizer/avx_utils.h"
+
+namespace tensorflow {
+namespace monolith_tf {
+
+// Destination ranges of a scatter-add: threads adding different ranges never
+// write the same row. Every thread scans all the entries in order and adds the
+// ones in its ranges, so the sources are read sequentially and every
+// destination sums its rows in the same order as a serial loop would.
+struct ScatterRanges {
+  int64_t min = 0;
+  // Every range is 1 << shift destinations wide.
+  int shift = 0;
+  int64_t num_ranges = 1;
+
+  int64_t range(int64_t dest) const { return (dest - min) >> shift; }
+};
+
+// Splits the destinations of dests[0, n) into up to num_ranges ranges.
+template <typename T>
+inline ScatterRanges SplitDestinations(const T* dests, int64_t n,
+                                       int64_t num_ranges) {
+  ScatterRanges ranges;
+  if (n == 0 || num_ranges <= 1) {
+    return ranges;
+  }
+  const auto minmax = std::minmax_element(dests, dests + n);
+  ranges.min = *minmax.first;
+  const int64_t span = static_cast<int64_t>(*minmax.second) - ranges.min + 1;
+  while ((span - 1) >> ranges.shift >= num_ranges) {
+    ++ranges.shift;
+  }
+  ranges.num_ranges = ((span - 1) >> ranges.shift) + 1;
+  return ranges;
+}
+
+// Adds row i of src ([n, dim]) to the `dim` floats at dst(dests[i]) for the
+// entries whose destinations are in ranges [begin, end).
+template <typename T, typename DstFn>
+inline void ScatterAdd(const ScatterRanges& ranges, const T* dests, int64_t n,
+                       const float* src, int64_t dim, int64_t begin,
+                       int64_t end, const DstFn& dst) {
+  constexpr int64_t kChunkSize = 256;
+  constexpr int64_t kPrefetchDistance = 4;
+  const bool all = begin == 0 && end == ranges.num_ranges;
+  // Whether an entry is in the ranges is a coin flip for the branch
+  // predictor, so the entries of a chunk are selected without branches first.
+  int64_t selected[kChunkSize];
+  for (int64_t chunk = 0; chunk < n; chunk += kChunkSize) {
+    const int64_t chunk_end = std::min(n, chunk + kChunkSize);
+    int64_t num_selected = 0;
+    for (int64_t i = chunk; i < chunk_end; ++i) {
+      const uint64_t range = ranges.range(dests[i]) - begin;
+      selected[num_selected] = i;
+      num_selected += all || range < static_cast<uint64_t>(end - begin);
+    }
+    for (int64_t k = 0; k < num_selected; ++k) {
+      // The destinations are scattered, the sources are sequential.
+      if (k + kPrefetchDistance < num_selected) {
+        __builtin_prefetch(dst(dests[selected[k + kPrefetchDistance]]), 1);
+      }
+      const int64_t i = selected[k];
+      float* out = dst(dests[i]);
+      ::monolith::hash_table::ReduceSum(src + i * dim, out, out, dim);
+    }
+  }
+}
+
+}  // namespace monolith_tf
+}  // namespace tensorflow
+
+#endif  // MONOLITH_NATIVE_TRAINING_RUNTIME_OPS_EMBEDDING_SCATTER_H_
@@ -0,0 +1,106 @@
+// Copyright 2022 ByteDance and/or its affiliates.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <vector>
+
+#include "absl/random/random.h"
+#include "benchmark/benchmark.h"
+#include "monolith/native_training/runtime/concurrency/thread_pool.h"
+#include "monolith/native_training/runtime/ops/embedding_scatter.h"
+
+namespace tensorflow {
+namespace monolith_tf {
+namespace {
+
+// Args: entries, dim, destination rows and threads.
+struct Input {
+  explicit Input(const benchmark::State& state)
+      : n(state.range(0)),
+        dim(state.range(1)),
+        dests(n),
+        src(n * dim),
+        output(state.range(2) * dim) {
+    absl::BitGen bit_gen;
+    for (int64_t& d : dests) {
+      d = absl::Uniform<int64_t>(bit_gen, 0, state.range(2));
+    }
+    for (float& v : src) {
+      v = absl::Uniform<float>(bit_gen, -1.f, 1.f);
+    }
+  }
+
+  float* row(int64_t d) { return output.data() + d * dim; }
+
+  int64_t n;
+  int64_t dim;
+  std::vector<int64_t> dests;
+  std::vector<float> src;
+  std::vector<float> output;
+};
+
+// The serial loop of the gradient ops before.
+void BM_SerialScatterAdd(benchmark::State& state) {  // NOLINT
+  Input input(state);
+  for (auto _ : state) {
+    std::fill(input.output.begin(), input.output.end(), 0);
+    for (int64_t i = 0; i < input.n; ++i) {
+      float* out = input.row(input.dests[i]);
+      const float* value = input.src.data() + i * input.dim;
+      for (int64_t j = 0; j < input.dim; ++j) {
+        out[j] += value[j];
+      }
+    }
+    benchmark::DoNotOptimize(input.output.data());
+  }
+  state.SetItemsProcessed(state.iterations() * input.n);
+}
+
+void BM_ParallelScatterAdd(benchmark::State& state) {  // NOLINT
+  Input input(state);
+  const int64_t num_threads = state.range(3);
+  monolith::concurrency::ThreadPool thread_pool(num_threads);
+  auto dst = [&input](int64_t d) { return input.row(d); };
+  for (auto _ : state) {
+    std::fill(input.output.begin(), input.output.end(), 0);
+    ScatterRanges ranges =
+        SplitDestinations(input.dests.data(), input.n, num_threads);
+    thread_pool.ParallelFor(
+        ranges.num_ranges, 1, [&](int64_t begin, int64_t end) {
+          ScatterAdd(ranges, input.dests.data(), input.n, input.src.data(),
+                     input.dim, begin, end, dst);
+        });
+    benchmark::DoNotOptimize(input.output.data());
+  }
+  state.SetItemsProcessed(state.iterations() * input.n);
+}
+
+void Args(benchmark::internal::Benchmark* b) {
+  for (int64_t dim : {8, 32, 128}) {
+    for (int64_t rows : {4096, 1 << 20}) {
+      for (int64_t threads : {1, 8}) {
+        b->Args({1 << 18, dim, rows, threads});
+      }
+    }
+  }
+}
+
+BENCHMARK(BM_SerialScatterAdd)->Apply(Args);
+BENCHMARK(BM_ParallelScatterAdd)->Apply(Args)->UseRealTime();
+
+}  // namespace
+}  // namespace monolith_tf
+}  // namespace tensorflow
+
+BENCHMARK_MAIN();
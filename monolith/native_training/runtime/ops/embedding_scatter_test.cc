@@ -0,0 +1,96 @@
+// Copyright 2022 ByteDance and/or its affiliates.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "monolith/native_training/runtime/ops/embedding_scatter.h"
+
+#include <algorithm>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace tensorflow {
+namespace monolith_tf {
+namespace {
+
+TEST(EmbeddingScatterTest, SplitDestinations) {
+  std::vector<int64_t> dests = {7, 2, 5, 3, 2, 9};
+  // Destinations [2, 6) and [6, 10).
+  ScatterRanges ranges = SplitDestinations(dests.data(), dests.size(), 3);
+  EXPECT_EQ(ranges.num_ranges, 2);
+  EXPECT_EQ(ranges.range(5), 0);
+  EXPECT_EQ(ranges.range(6), 1);
+  EXPECT_EQ(ranges.range(9), 1);
+
+  ranges = SplitDestinations(dests.data(), dests.size(), 1);
+  EXPECT_EQ(ranges.num_ranges, 1);
+
+  // More ranges than destinations.
+  std::vector<int32_t> same = {4, 4, 4};
+  ranges = SplitDestinations(same.data(), same.size(), 8);
+  EXPECT_EQ(ranges.num_ranges, 1);
+  EXPECT_EQ(ranges.range(4), 0);
+
+  ranges = SplitDestinations(same.data(), 0, 8);
+  EXPECT_EQ(ranges.num_ranges, 1);
+}
+
+TEST(EmbeddingScatterTest, SameAsSerialScatter) {
+  std::mt19937 gen(0);
+  for (int64_t dim : {1, 8, 13, 32}) {
+    const int64_t num_rows = 100, n = 5000;
+    std::vector<int64_t> dests(n);
+    std::vector<float> src(n * dim);
+    // Hot rows, like repeated fids.
+    std::geometric_distribution<int64_t> row_dist(0.05);
+    for (int64_t& d : dests) {
+      d = std::min<int64_t>(row_dist(gen), num_rows - 1);
+    }
+    std::uniform_real_distribution<float> value_dist(-1, 1);
+    for (float& v : src) {
+      v = value_dist(gen);
+    }
+    std::vector<float> expected(num_rows * dim, 0);
+    for (int64_t i = 0; i < n; ++i) {
+      for (int64_t j = 0; j < dim; ++j) {
+        expected[dests[i] * dim + j] += src[i * dim + j];
+      }
+    }
+
+    for (int64_t num_ranges : {1, 4, 16}) {
+      ScatterRanges ranges = SplitDestinations(dests.data(), n, num_ranges);
+      std::vector<float> output(num_rows * dim, 0);
+      auto dst = [&output, dim](int64_t row) {
+        return output.data() + row * dim;
+      };
+      std::vector<std::thread> threads;
+      for (int64_t r = 0; r < ranges.num_ranges; r += 2) {
+        threads.emplace_back([&, r] {
+          ScatterAdd(ranges, dests.data(), n, src.data(), dim, r,
+                     std::min(r + 2, ranges.num_ranges), dst);
+        });
+      }
+      for (auto& thread : threads) {
+        thread.join();
+      }
+      // Every row sums in the serial order, so the results are identical.
+      EXPECT_EQ(output, expected) << "dim " << dim << " ranges " << num_ranges;
+    }
+  }
+}
+
+}  // namespace
+}  // namespace monolith_tf
+}  // namespace tensorflow
@@ -40,7 +40,8 @@ FileMetricWriter::FileMetricWriter(std::string filename)
     TF_CHECK_OK(env->RecursivelyCreateDir(dirname));
     TF_CHECK_OK(env->NewWritableFile(filename_, &fp_));
 
-    queue_ = std::make_unique<monolith::concurrency::Queue<std::string>>(8192);
+    queue_ =
+        std::make_unique<monolith::concurrency::MPMCQueue<std::string>>(8192);
     thread_pool_ = std::make_unique<monolith::concurrency::ThreadPool>(1);
     thread_pool_->Schedule([this]() {
       RecordWriterOptions options;
@@ -42,7 +42,7 @@ class FileMetricWriter {
   int64_t total_consume_;
   int64_t total_dump_;
   std::unique_ptr<tensorflow::WritableFile> fp_;
-  std::unique_ptr<monolith::concurrency::Queue<std::string>> queue_;
+  std::unique_ptr<monolith::concurrency::MPMCQueue<std::string>> queue_;
   std::unique_ptr<monolith::concurrency::ThreadPool> thread_pool_;
 };
 
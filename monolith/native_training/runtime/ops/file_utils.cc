@@ -14,9 +14,11 @@
 
 #include "monolith/native_training/runtime/ops/file_utils.h"
 
+#include "absl/strings/str_cat.h"
 #include "absl/strings/str_format.h"
 #include "re2/re2.h"
 #include "tensorflow/core/platform/errors.h"
+#include "tensorflow/core/platform/raw_coding.h"
 
 namespace tensorflow {
 namespace monolith_tf {
@@ -24,8 +26,18 @@ namespace monolith_tf {
 namespace {
 
 const char* const kShardedFileFormat = "%s-%05d-of-%05d";
+
+int Gcd(int a, int b) {
+  while (b != 0) {
+    int rem = a % b;
+    a = b;
+    b = rem;
+  }
+  return a;
 }
 
+}  // namespace
+
 std::string GetShardedFileName(absl::string_view basename, int shard,
                                int nshards) {
   return absl::StrFormat(kShardedFileFormat, basename, shard, nshards);
@@ -99,5 +111,49 @@ std::vector<std::string> FileSpec::GetFilenames() const {
   return filenames;
 }
 
+bool Intersects(IdShard a, IdShard b) {
+  // By the chinese remainder theorem, id = a.index mod a.num and
+  // id = b.index mod b.num have a common solution iff the indices are equal
+  // modulo gcd(a.num, b.num).
+  const int gcd = Gcd(a.num, b.num);
+  return a.index % gcd == b.index % gcd;
+}
+
+double Overlap(IdShard a, IdShard b) {
+  // The common ids are a single residue class modulo lcm(a.num, b.num).
+  return Intersects(a, b) ? static_cast<double>(Gcd(a.num, b.num)) / b.num
+                          : 0.0;
+}
+
+bool IsSubset(IdShard a, IdShard b) {
+  return a.num % b.num == 0 && a.index % b.num == b.index;
+}
+
+bool PeekEntryDumpId(absl::string_view serialized, int64_t* id) {
+  // Tag of `optional sfixed64 id = 1`, followed by the little endian value.
+  constexpr char kIdTag = (1 << 3) | 1;
+  if (serialized.size() < 1 + sizeof(int64_t) || serialized[0] != kIdTag) {
+    return false;
+  }
+  *id = static_cast<int64_t>(core::DecodeFixed64(serialized.data() + 1));
+  return true;
+}
+
+Status GetShardedFiles(Env* env, absl::Span<const std::string> basenames,
+                       std::vector<ShardedFile>* files) {
+  files->clear();
+  for (const std::string& basename : basenames) {
+    std::vector<std::string> matched;
+    TF_RETURN_IF_ERROR(
+        env->GetMatchingPaths(absl::StrCat(basename, "-*"), &matched));
+    FileSpec spec;
+    TF_RETURN_IF_ERROR(ValidateShardedFiles(basename, matched, &spec));
+    for (int i = 0; i < spec.nshards(); ++i) {
+      files->push_back({basename, i, spec.nshards()});
+    }
+  }
+  return Status::OK();
+}
+
 }  // namespace monolith_tf
 }  // namespace tensorflow
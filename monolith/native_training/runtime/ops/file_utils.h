@@ -15,8 +15,13 @@
 #ifndef MONOLITH_NATIVE_TRAINING_RUNTIME_OPS_FILE_UTILS
 #define MONOLITH_NATIVE_TRAINING_RUNTIME_OPS_FILE_UTILS
 
+#include <cstdint>
+#include <string>
+#include <vector>
+
 #include "absl/strings/string_view.h"
 #include "absl/types/span.h"
+#include "tensorflow/core/platform/env.h"
 #include "tensorflow/core/platform/status.h"
 
 namespace tensorflow {
@@ -50,6 +55,49 @@ Status ValidateShardedFiles(absl::string_view basename,
                             absl::Span<const std::string> filenames,
                             FileSpec* spec = nullptr);
 
+// The ids owned by one of `num` shards, i.e. floormod(id, num) == index.
+// This is how ids are mapped to PS, so a checkpoint written by PS `index` of
+// `num` only contains ids of that shard.
+struct IdShard {
+  int index = 0;
+  int num = 1;
+
+  bool Contains(int64_t id) const {
+    int64_t mod = id % num;
+    return (mod < 0 ? mod + num : mod) == index;
+  }
+};
+
+// Returns false if no id is in both shards.
+bool Intersects(IdShard a, IdShard b);
+
+// Returns true if all ids of `a` are in `b`.
+bool IsSubset(IdShard a, IdShard b);
+
+// Returns the fraction of the ids of `a` which are in `b`, for ids spread
+// evenly over the shards.
+double Overlap(IdShard a, IdShard b);
+
+// Reads the id of a serialized monolith::hash_table::EntryDump without
+// parsing it. Returns false if it is not the leading field.
+bool PeekEntryDumpId(absl::string_view serialized, int64_t* id);
+
+// One file of a sharded checkpoint.
+struct ShardedFile {
+  std::string basename;
+  int shard = 0;
+  int nshards = 0;
+
+  std::string filename() const {
+    return GetShardedFileName(basename, shard, nshards);
+  }
+};
+
+// Finds and validates the sharded files of every basename, e.g. of the
+// checkpoints written by all PS of a cluster of different size.
+Status GetShardedFiles(Env* env, absl::Span<const std::string> basenames,
+                       std::vector<ShardedFile>* files);
+
 }  // namespace monolith_tf
 }  // namespace tensorflow
 
@@ -18,6 +18,7 @@
 
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
+#include "monolith/native_training/runtime/hash_table/embedding_hash_table.pb.h"
 #include "tensorflow/core/lib/core/status_test_util.h"
 
 namespace tensorflow {
@@ -62,6 +63,56 @@ TEST(ValidateShardedFilesTest, LargeFileSet) {
   TF_EXPECT_OK(ValidateShardedFiles("/a", filenames));
 }
 
+TEST(IdShardTest, Contains) {
+  IdShard shard{1, 3};
+  EXPECT_TRUE(shard.Contains(1));
+  EXPECT_TRUE(shard.Contains(4));
+  EXPECT_TRUE(shard.Contains(-2));
+  EXPECT_FALSE(shard.Contains(0));
+  EXPECT_FALSE(shard.Contains(-1));
+  EXPECT_TRUE(IdShard().Contains(-7));
+}
+
+TEST(IdShardTest, IntersectsAndIsSubset) {
+  // Checkpoints of 4 PS, restored by 6 PS.
+  EXPECT_TRUE(Intersects({1, 4}, {3, 6}));
+  EXPECT_TRUE(Intersects({1, 4}, {5, 6}));
+  EXPECT_FALSE(Intersects({1, 4}, {0, 6}));
+  EXPECT_FALSE(IsSubset({1, 4}, {3, 6}));
+  EXPECT_TRUE(Intersects({0, 1}, {3, 6}));
+  // Checkpoints of 4 PS, restored by 2 PS.
+  EXPECT_TRUE(IsSubset({1, 4}, {1, 2}));
+  EXPECT_TRUE(IsSubset({3, 4}, {1, 2}));
+  EXPECT_FALSE(IsSubset({2, 4}, {1, 2}));
+  EXPECT_FALSE(Intersects({2, 4}, {1, 2}));
+  EXPECT_TRUE(IsSubset({0, 1}, {0, 1}));
+}
+
+TEST(IdShardTest, Overlap) {
+  EXPECT_DOUBLE_EQ(Overlap({1, 4}, {3, 6}), 1.0 / 3);
+  EXPECT_DOUBLE_EQ(Overlap({1, 4}, {0, 6}), 0.0);
+  EXPECT_DOUBLE_EQ(Overlap({1, 4}, {1, 2}), 1.0);
+  EXPECT_DOUBLE_EQ(Overlap({0, 1}, {2, 5}), 0.2);
+}
+
+TEST(PeekEntryDumpIdTest, Basic) {
+  // Field 1, sfixed64 id, of -2 (tag 0x09), then field 4, int64
+  // last_update_ts_sec, of 1 (tag 0x20).
+  const char serialized[] = "\x09\xfe\xff\xff\xff\xff\xff\xff\xff\x20\x01";
+  monolith::hash_table::EntryDump dump;
+  dump.set_id(-2);
+  dump.set_last_update_ts_sec(1);
+  EXPECT_EQ(dump.SerializeAsString(),
+            std::string(serialized, sizeof(serialized) - 1));
+  int64_t id = 0;
+  EXPECT_TRUE(PeekEntryDumpId(
+      absl::string_view(serialized, sizeof(serialized) - 1), &id));
+  EXPECT_EQ(id, -2);
+  EXPECT_FALSE(PeekEntryDumpId(absl::string_view(serialized, 5), &id));
+  // Only last_update_ts_sec, without an id.
+  EXPECT_FALSE(PeekEntryDumpId("\x20\x01", &id));
+}
+
 }  // namespace
 }  // namespace monolith_tf
 }  // namespace tensorflow
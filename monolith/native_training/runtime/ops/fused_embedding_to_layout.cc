@@ -14,50 +14,15 @@
 
 #include "monolith/native_training/runtime/ops/fused_embedding_to_layout.h"
 
+#include <atomic>
+#include <memory>
+#include <mutex>
+
 namespace tensorflow {
 namespace monolith_tf {
 
 namespace fused_layout {
 
-void *MemCopy(float *dest, const float *src, std::size_t count) {
-  return std::memcpy(dest, src, count * sizeof(float));
-}
-
-template <class TInit>
-void OptimizedSumpooling(const float *src, const int dim_num, void *init_ptr,
-                         float *dst, void *one_mutex_ptr = nullptr,
-                         int mean_pool_fid_num = 0) {
-  std::mutex *one_mutex = static_cast<std::mutex *>(one_mutex_ptr);
-  TInit *init = static_cast<TInit *>(init_ptr);
-  if (one_mutex) {
-    one_mutex->lock();
-  }
-  if (init && *init) {
-    if (mean_pool_fid_num) {
-      for (size_t i = 0; i < dim_num; ++i) {
-        dst[i] = (src[i] / mean_pool_fid_num);
-      }
-    } else {
-      MemCopy(dst, src, dim_num);
-    }
-    *init = false;
-  } else {
-    // ::monolith::hash_table::ReduceSum(src, dst, dst, dim_num);
-    if (mean_pool_fid_num) {
-      for (size_t i = 0; i < dim_num; ++i) {
-        dst[i] += (src[i] / mean_pool_fid_num);
-      }
-    } else {
-      for (size_t i = 0; i < dim_num; ++i) {
-        dst[i] += src[i];
-      }
-    }
-  }
-  if (one_mutex) {
-    one_mutex->unlock();
-  }
-}
-
 NoneLayout::NoneLayout(const std::string &name, const OutConfig &out_conf,
                        OpInputList &tensor_list, int &start_idx)
     : Layout(name, out_conf) {
@@ -191,6 +156,140 @@ PtrWrapper DefaultLayout::GetSlice(int row_id, const SliceConfig &slice_conf) {
   }
 }
 
+namespace {
+
+int64 RowStride(const LayoutShape &shape) {
+  int64 stride = 1;
+  for (int i = 1; i < shape.dims_size(); ++i) {
+    stride *= shape.dims(i);
+  }
+  return stride;
+}
+
+// Compiles the slice configs of the layouts into the flat plan the CPU kernels
+// run. The outputs and offsets are the ones NoneLayout and DefaultLayout
+// resolve per call.
+Status CompileLayoutPlan(const FeatureConfigs &feature_cfgs,
+                         const std::vector<std::string> &layout_names,
+                         std::vector<LayoutSlicePlan> *plan) {
+  int output = 0;
+  for (const auto &layout_name : layout_names) {
+    const OutConfig &out_conf = feature_cfgs.out_configs().at(layout_name);
+    const bool none = out_conf.out_type() == OutType::NONE;
+    if (none ? out_conf.shape_size() != out_conf.slice_configs_size()
+             : out_conf.shape_size() != 1) {
+      return errors::InvalidArgument("Layout ", layout_name, " has ",
+                                     out_conf.shape_size(), " shapes for ",
+                                     out_conf.slice_configs_size(), " slices.");
+    }
+    int offset = 0;
+    for (int i = 0; i < out_conf.slice_configs_size(); ++i) {
+      const SliceConfig &slice_conf = out_conf.slice_configs(i);
+      const LayoutShape &shape = out_conf.shape(none ? i : 0);
+      const bool firstn = slice_conf.pooling_type() == PoolingType::FIRSTN;
+      // [batch_size, (features_size,) (max_seq_len,) num_dim], the features
+      // dimension is only in stack layouts.
+      const int min_rank = firstn ? 3 : 2;
+      const int rank = shape.dims_size();
+      if (rank < min_rank || rank > min_rank + (none ? 0 : 1)) {
+        return errors::InvalidArgument("Layout ", layout_name, " slice ", i,
+                                       " has a shape of rank ", rank);
+      }
+      LayoutSlicePlan slice;
+      slice.output = none ? output + i : output;
+      slice.row_stride = RowStride(shape);
+      slice.dst_offset = !firstn && rank == 3 ? offset * shape.dims(2) : offset;
+      slice.nfl_idx = slice_conf.feature_idx();
+      slice.slice_idx = slice_conf.slice_idx();
+      slice.src_start = slice_conf.start();
+      slice.dim = slice_conf.end() - slice_conf.start();
+      slice.max_sequence_length = slice_conf.max_sequence_length();
+      slice.add = out_conf.out_type() == OutType::ADDN;
+      slice.first = i == 0;
+      switch (slice_conf.pooling_type()) {
+        case PoolingType::SUM:
+          slice.pooling = SlicePooling::kSum;
+          break;
+        case PoolingType::MEAN:
+          slice.pooling = SlicePooling::kMean;
+          break;
+        case PoolingType::FIRSTN:
+          slice.pooling = SlicePooling::kFirstN;
+          break;
+        default:
+          return errors::InvalidArgument("Unknown pooling type of ",
+                                         slice_conf.feature_name());
+      }
+      if (out_conf.out_type() == OutType::STACK) {
+        offset += 1;
+      } else if (out_conf.out_type() == OutType::CONCAT) {
+        offset += slice.dim;
+      } else if (!none && !slice.add) {
+        return errors::InvalidArgument("Unknown out type of ", layout_name);
+      }
+      plan->push_back(slice);
+    }
+    output += none ? out_conf.slice_configs_size() : 1;
+  }
+  return Status::OK();
+}
+
+// The feature of the first row of a slice in this batch.
+struct SliceFeature {
+  // -1 if the feature list is missing.
+  int begin = -1;
+  // All rows share the feature of the first row.
+  bool shared = false;
+};
+
+Status ResolveSliceFeatures(const std::vector<LayoutSlicePlan> &plan,
+                            const uint32 *nfl_offset_vec, int total_nfl_num,
+                            int total_feature_num,
+                            std::vector<SliceFeature> *features) {
+  features->resize(plan.size());
+  for (size_t i = 0; i < plan.size(); ++i) {
+    if (plan[i].nfl_idx >= total_nfl_num) {
+      return errors::InvalidArgument("Feature list ", plan[i].nfl_idx,
+                                     " is out of the ", total_nfl_num,
+                                     " in the batch.");
+    }
+    bool is_shared;
+    int nfl_offset, feature_num;
+    GetFeatureInfo(plan[i].nfl_idx, nfl_offset_vec, total_nfl_num,
+                   total_feature_num, &is_shared, &nfl_offset, &feature_num);
+    if (feature_num) {
+      (*features)[i].begin = nfl_offset;
+      (*features)[i].shared = is_shared;
+    }
+  }
+  return Status::OK();
+}
+
+// The fids of feature feature_idx are fids_offset_vec[*begin, *end).
+bool GetFeatureFids(int feature_idx, const int32 *feature_offset_vec,
+                    int total_feature_num, int total_fid_num, int *begin,
+                    int *end) {
+  if (feature_idx >= total_feature_num) {
+    return false;
+  }
+  *begin = feature_offset_vec[feature_idx];
+  *end = feature_idx + 1 < total_feature_num
+             ? feature_offset_vec[feature_idx + 1]
+             : total_fid_num;
+  return 0 <= *begin && *begin <= *end && *end <= total_fid_num;
+}
+
+// About the floats a batch row of the plan reads and writes.
+int64 PlanRowCost(const std::vector<LayoutSlicePlan> &plan) {
+  int64 cost = 0;
+  for (const LayoutSlicePlan &slice : plan) {
+    cost += 4 * slice.span();
+  }
+  return cost;
+}
+
+}  // namespace
+
 MonolithEmbeddingToLayoutBase::MonolithEmbeddingToLayoutBase(
     OpKernelConstruction *ctx, int version)
     : OpKernel(ctx), version_(version) {
@@ -281,6 +380,8 @@ MonolithEmbeddingToLayoutBase::MonolithEmbeddingToLayoutBase(
     }
   }
   std::sort(layout_names_.begin(), layout_names_.end());
+  OP_REQUIRES_OK(
+      ctx, CompileLayoutPlan(feature_cfgs_, layout_names_, &layout_plan_));
 }
 
 MonolithEmbeddingToLayoutOp::MonolithEmbeddingToLayoutOp(
@@ -513,7 +614,7 @@ void MonolithEmbeddingToLayoutOp::Compute(OpKernelContext *ctx) {
 
   int offset = 0;
   std::vector<std::shared_ptr<Layout>> layouts;
-  {
+  if (!UseLayoutPlan()) {
     auto activity =
         std::make_unique<profiler::TraceMe>([]() { return "CreateLayout"; });
     for (const auto &layout_name : GetLayoutNames()) {
@@ -539,75 +640,6 @@ void MonolithEmbeddingToLayoutOp::Compute(OpKernelContext *ctx) {
           req_num, ctx, &layout_tensor_list);
 }
 
-void ForwardTaskRunImpl(int slice_conf_i, int dim_num, int64 nfl_idx,
-                        ::monolith::io::proto::OutType out_type,
-                        ::monolith::io::proto::PoolingType pooling_type,
-                        int max_sequence_length, int start,
-                        const uint64 *fids_offset_vec, int total_fid_num,
-                        const int32 *feature_offset_vec, int total_feature_num,
-                        const uint32 *nfl_offset_vec, int total_nfl_num,
-                        int batch_size, const PtrWrapper *embeddings_data,
-                        int embeddings_data_size, PtrWrapper *ptr_info_ptr) {
-  PtrWrapper &ptr_info = *ptr_info_ptr;
-  bool is_shared;
-  int nfl_offset, feature_num;
-  GetFeatureInfo(nfl_idx, nfl_offset_vec, total_nfl_num, total_feature_num,
-                 &is_shared, &nfl_offset, &feature_num);
-  if (!feature_num) return;  // nfl exits
-
-  std::unique_ptr<float[]> tmp;
-  if (is_shared && (out_type == OutType::ADDN)) {
-    tmp.reset(new float[dim_num]());
-  }
-  int feature_idx = nfl_offset + 0;
-  for (size_t index = 0; index < batch_size; ++index) {
-    int temp_offset = index * ptr_info.offset;
-    if (pooling_type == PoolingType::FIRSTN) {
-      CHECK(temp_offset + max_sequence_length * dim_num <= ptr_info.count);
-    } else {
-      CHECK(temp_offset + dim_num <= ptr_info.count);
-    }
-    if (!is_shared || index == 0) {
-      bool init = (out_type != OutType::ADDN) || tmp;
-      GatherEmb(
-          feature_idx, max_sequence_length, pooling_type, dim_num, start,
-          embeddings_data, embeddings_data_size, fids_offset_vec, total_fid_num,
-          feature_offset_vec, total_feature_num,
-          const_cast<float *>(tmp ? tmp.get() : ptr_info.ptr + temp_offset),
-          OptimizedSumpooling<bool>, MemCopy, nullptr, nullptr,
-          DefaultGetInitFunc, &init);
-      if (tmp) {
-        bool init_tmp = (out_type != OutType::ADDN) || (slice_conf_i == 0);
-        OptimizedSumpooling<bool>(
-            tmp.get(), dim_num, &init_tmp,
-            const_cast<float *>(ptr_info.ptr + temp_offset));
-      }
-      feature_idx++;
-    } else {
-      if (tmp) {
-        bool init_tmp = (slice_conf_i == 0);  // && index == 0
-        OptimizedSumpooling<bool>(
-            tmp.get(), dim_num, &init_tmp,
-            const_cast<float *>(ptr_info.ptr + temp_offset));
-      } else {
-        switch (pooling_type) {
-          case PoolingType::SUM:
-          case PoolingType::MEAN:
-            MemCopy(const_cast<float *>(ptr_info.ptr + temp_offset),
-                    ptr_info.ptr, dim_num);
-            break;
-          case PoolingType::FIRSTN:
-            MemCopy(const_cast<float *>(ptr_info.ptr + temp_offset),
-                    ptr_info.ptr, dim_num * max_sequence_length);
-            break;
-          default:
-            break;
-        }
-      }
-    }
-  }
-}
-
 void MonolithEmbeddingToLayoutOp::TaskRun(
     const std::vector<std::shared_ptr<Layout>> &layouts,
     const std::vector<PtrWrapper> &embeddings_data,
@@ -620,29 +652,76 @@ void MonolithEmbeddingToLayoutOp::TaskRun(
     const std::vector<int> &each_req_fid_offset, int req_num,
     OpKernelContext *ctx, OpOutputList *layout_tensor_list) {
   CHECK_EQ(req_num, 1);
+  const std::vector<LayoutSlicePlan> &plan = GetLayoutPlan();
+  std::vector<float *> outputs(layout_tensor_list->size());
   for (int32 idx = 0; idx < layout_tensor_list->size(); ++idx) {
     (*layout_tensor_list)[idx]->flat<float>().setZero();
+    outputs[idx] = (*layout_tensor_list)[idx]->flat<float>().data();
+  }
+  std::vector<SliceFeature> features;
+  OP_REQUIRES_OK(ctx, ResolveSliceFeatures(plan, nfl_offset_vec, total_nfl_num,
+                                           total_feature_num, &features));
+
+  // Shared features are gathered once, and copied to every row.
+  std::vector<int64> shared_offsets(plan.size() + 1, 0);
+  for (size_t i = 0; i < plan.size(); ++i) {
+    if (features[i].begin >= 0 && batch_size > 0) {
+      OP_REQUIRES(ctx,
+                  (batch_size - 1) * plan[i].row_stride + plan[i].span() <=
+                      (*layout_tensor_list)[plan[i].output]->NumElements(),
+                  errors::InvalidArgument("Layout output ", plan[i].output,
+                                          " is too small for the batch."));
+    }
+    shared_offsets[i + 1] =
+        shared_offsets[i] + (features[i].shared ? plan[i].span() : 0);
+  }
+  std::vector<float> shared_rows(shared_offsets.back(), 0.0f);
+  for (size_t i = 0; i < plan.size(); ++i) {
+    if (features[i].begin < 0 || !features[i].shared) continue;
+    int fid_begin, fid_end;
+    OP_REQUIRES(
+        ctx,
+        GetFeatureFids(features[i].begin, feature_offset_vec, total_feature_num,
+                       total_fid_num, &fid_begin, &fid_end) &&
+            GatherSlice(plan[i], fids_offset_vec + fid_begin,
+                        fid_end - fid_begin, embeddings_data.data(),
+                        embeddings_data.size(), true,
+                        shared_rows.data() + shared_offsets[i]),
+        errors::InvalidArgument("Invalid fid offsets of feature list ",
+                                plan[i].nfl_idx));
   }
-  auto gather_emb_fn = [&, this](int start, int end) {
-    for (int64 para_i = start; para_i < end; ++para_i) {
-      auto &layout = layouts.at(para_i);
-      // CHECK(end - start == 1);
-      const ::google::protobuf::RepeatedPtrField<SliceConfig>
-          &layout_slice_configs = layout->GetSliceConfig();
-      for (uint slice_conf_i = 0; slice_conf_i < layout_slice_configs.size();
-           ++slice_conf_i) {
-        const SliceConfig &slice_conf = layout_slice_configs[slice_conf_i];
-        int dim_num = slice_conf.end() - slice_conf.start();
-        PtrWrapper ptr_info = layout->GetSlice(0, slice_conf);
-        const int64 nfl_idx = slice_conf.feature_idx();
-
-        ForwardTaskRunImpl(slice_conf_i, dim_num, nfl_idx, layout->out_type(),
-                           slice_conf.pooling_type(),
-                           slice_conf.max_sequence_length(), slice_conf.start(),
-                           fids_offset_vec, total_fid_num, feature_offset_vec,
-                           total_feature_num, nfl_offset_vec, total_nfl_num,
-                           batch_size, embeddings_data.data(),
-                           embeddings_data.size(), &ptr_info);
+
+  // Every row of every output is written by one thread, slice by slice in
+  // the order of the plan.
+  std::atomic<bool> ok(true);
+  auto gather_rows = [&](int64 begin, int64 end) {
+    for (int64 row = begin; row < end; ++row) {
+      for (size_t i = 0; i < plan.size(); ++i) {
+        const LayoutSlicePlan &slice = plan[i];
+        const SliceFeature &feature = features[i];
+        if (feature.begin < 0) continue;
+        float *out = outputs[slice.output] + row * slice.row_stride +
+                     slice.dst_offset;
+        if (feature.shared) {
+          const float *shared = shared_rows.data() + shared_offsets[i];
+          if (slice.add && !slice.first) {
+            ::monolith::hash_table::ReduceSum(shared, out, out, slice.span());
+          } else {
+            std::memcpy(out, shared, slice.span() * sizeof(float));
+          }
+          continue;
+        }
+        int fid_begin, fid_end;
+        // Slices of ADDN layouts add up in zeros.
+        if (!GetFeatureFids(feature.begin + row, feature_offset_vec,
+                            total_feature_num, total_fid_num, &fid_begin,
+                            &fid_end) ||
+            !GatherSlice(slice, fids_offset_vec + fid_begin,
+                         fid_end - fid_begin, embeddings_data.data(),
+                         embeddings_data.size(), !slice.add, out)) {
+          ok = false;
+          return;
+        }
       }
     }
   };
@@ -650,22 +729,17 @@ void MonolithEmbeddingToLayoutOp::TaskRun(
   {
     auto activity =
         std::make_unique<profiler::TraceMe>([]() { return "GatherEmbFn"; });
-    int parallel_flag = GetParallelFlag();
-    if (parallel_flag == 0) {
-      for (int i = 0; i < layouts.size(); ++i) {
-        gather_emb_fn(i, i + 1);
-      }
+    if (GetParallelFlag() == 0) {
+      gather_rows(0, batch_size);
     } else {
-      auto workers = ctx->device()->tensorflow_cpu_worker_threads()->workers;
-      workers->ParallelFor(
-          layouts.size(),
-          thread::ThreadPool::SchedulingParams(
-              thread::ThreadPool::SchedulingStrategy::kFixedBlockSize,
-              absl::nullopt,
-              1),  // block_size
-          gather_emb_fn);
+      const DeviceBase::CpuWorkerThreads &worker_threads =
+          *ctx->device()->tensorflow_cpu_worker_threads();
+      Shard(worker_threads.num_threads, worker_threads.workers, batch_size,
+            PlanRowCost(plan), gather_rows);
     }
   }
+  OP_REQUIRES(ctx, ok,
+              errors::InvalidArgument("Invalid fid or feature offsets."));
 }
 
 class MonolithEmbeddingToLayoutOpV2 : public MonolithEmbeddingToLayoutOp {
@@ -848,18 +922,20 @@ void MonolithEmbeddingToLayoutGradOp::Compute(OpKernelContext *ctx) {
 
   int offset = 0;
   std::vector<std::shared_ptr<Layout>> layouts;
-  for (const auto &layout_name : GetLayoutNames()) {
-    const OutConfig &out_conf = GetFeatureCfgs().out_configs().at(layout_name);
-
-    switch (out_conf.out_type()) {
-      case OutType::NONE:
-        layouts.push_back(std::make_shared<NoneLayout>(layout_name, out_conf,
-                                                       tensors_grad, offset));
-        break;
-      default:
-        layouts.push_back(std::make_shared<DefaultLayout>(
-            layout_name, out_conf, tensors_grad, offset));
-        break;
+  if (!UseLayoutPlan()) {
+    for (const auto &layout_name : GetLayoutNames()) {
+      const OutConfig &out_conf =
+          GetFeatureCfgs().out_configs().at(layout_name);
+      switch (out_conf.out_type()) {
+        case OutType::NONE:
+          layouts.push_back(std::make_shared<NoneLayout>(
+              layout_name, out_conf, tensors_grad, offset));
+          break;
+        default:
+          layouts.push_back(std::make_shared<DefaultLayout>(
+              layout_name, out_conf, tensors_grad, offset));
+          break;
+      }
     }
   }
 
@@ -871,28 +947,6 @@ void MonolithEmbeddingToLayoutGradOp::Compute(OpKernelContext *ctx) {
 }
 
 static constexpr int NUM_LOCKS = 512;
-void *ScatterGradGetMutexFuncFunc(void *main_params, int32 index1,
-                                  int32 index2) {
-  std::mutex *mutex_list = static_cast<std::mutex *>(main_params);
-  int lock_idx = index1 * index2;
-  int mutex_idx = lock_idx % NUM_LOCKS;
-  auto one_mutex = mutex_list + mutex_idx;
-  return one_mutex;
-}
-struct ScatterGradGetInitFuncParams {
-  int slice_conf_slice_idx;
-  const std::vector<std::pair<int, int>> *ufid_grads_info;
-  GroupA *init;
-};
-void *ScatterGradGetInitFunc(void *main_params, int32 index1, int32 index2) {
-  ScatterGradGetInitFuncParams *params =
-      static_cast<ScatterGradGetInitFuncParams *>(main_params);
-  const auto &fid_info = params->ufid_grads_info->at(index1);
-  CUSTOM_CHECK(index2 < fid_info.second);
-  int real_ufid_idx = fid_info.first + index2;
-  auto init_p = params->init->Get(real_ufid_idx, params->slice_conf_slice_idx);
-  return init_p;
-}
 
 void MonolithEmbeddingToLayoutGradOp::TaskRun(
     const std::vector<std::shared_ptr<Layout>> &layouts,
@@ -905,72 +959,81 @@ void MonolithEmbeddingToLayoutGradOp::TaskRun(
   for (int32 idx = 0; idx < embeddings_grad_list->size(); ++idx) {
     (*embeddings_grad_list)[idx]->flat<float>().setConstant(0);
   }
-  int parallel_flag = GetParallelFlag();
+  const std::vector<LayoutSlicePlan> &plan = GetLayoutPlan();
+  OpInputList tensors_grad;
+  OP_REQUIRES_OK(ctx, ctx->input_list("tensors_grad", &tensors_grad));
+  std::vector<const float *> grads(tensors_grad.size());
+  for (int idx = 0; idx < tensors_grad.size(); ++idx) {
+    grads[idx] = tensors_grad[idx].flat<float>().data();
+  }
+  std::vector<SliceFeature> features;
+  OP_REQUIRES_OK(ctx, ResolveSliceFeatures(plan, nfl_offset_vec, total_nfl_num,
+                                           total_feature_num, &features));
+  for (size_t i = 0; i < plan.size(); ++i) {
+    if (features[i].begin >= 0 && batch_size > 0) {
+      OP_REQUIRES(ctx,
+                  (batch_size - 1) * plan[i].row_stride + plan[i].span() <=
+                      tensors_grad[plan[i].output].NumElements(),
+                  errors::InvalidArgument("Layout grad ", plan[i].output,
+                                          " is too small for the batch."));
+    }
+  }
 
-  // mutex/init per op compute, because there are several(>1) grad op
-  // calculated togather.
-  std::unique_ptr<mutex[]> mutex_list;
+  // Rows scatter in parallel, so the embedding rows of the fids they share
+  // are guarded by striped locks. Locks and init flags are per op compute,
+  // because there are several(>1) grad ops calculated together.
+  const int parallel_flag = GetParallelFlag();
+  std::unique_ptr<std::mutex[]> mutex_list;
   if (parallel_flag != 0) {
-    mutex_list = std::make_unique<mutex[]>(NUM_LOCKS);
+    mutex_list = std::make_unique<std::mutex[]>(NUM_LOCKS);
   }
-  auto scatter_grad_fn = [&, this](int start, int end) {
-    for (int64 para_i = start; para_i < end; ++para_i) {
-      auto &layout = layouts.at(para_i);
-      // CHECK(end - start == 1);
-      const ::google::protobuf::RepeatedPtrField<SliceConfig>
-          &layout_slice_configs = layout->GetSliceConfig();
-      for (const SliceConfig &slice_conf : layout_slice_configs) {
-        int dim_num = slice_conf.end() - slice_conf.start();
-        PtrWrapper ptr_info = layout->GetSlice(0, slice_conf);
-        const int64 &nfl_idx = slice_conf.feature_idx();
-        bool is_shared;
-        int nfl_offset, feature_num;
-        GetFeatureInfo(nfl_idx, nfl_offset_vec, total_nfl_num,
-                       total_feature_num, &is_shared, &nfl_offset,
-                       &feature_num);
-        if (!feature_num) continue;  // nfl exits
-        int feature_idx = nfl_offset + 0;
-        for (size_t index = 0; index < batch_size; ++index) {
-          int temp_offset = index * ptr_info.offset;
-          if (slice_conf.pooling_type() == PoolingType::FIRSTN) {
-            CHECK(temp_offset + slice_conf.max_sequence_length() * dim_num <=
-                  ptr_info.count);
-          } else {
-            CHECK(temp_offset + dim_num <= ptr_info.count);
-          }
-          ScatterGradGetInitFuncParams init_params(
-              {slice_conf.slice_idx(), ufid_grads_info, init});
-          ScatterGrad(feature_idx, slice_conf.max_sequence_length(),
-                      slice_conf.pooling_type(), ptr_info.ptr + temp_offset,
-                      dim_num, slice_conf.start(), fids_offset_vec,
-                      total_fid_num, feature_offset_vec, total_feature_num,
-                      embeddings_grads_data->size(),
-                      embeddings_grads_data->data(), OptimizedSumpooling<char>,
-                      (mutex_list ? ScatterGradGetMutexFuncFunc : nullptr),
-                      (mutex_list ? mutex_list.get() : nullptr),
-                      (init ? ScatterGradGetInitFunc : nullptr), &init_params);
-          if (!is_shared) {  // train don't have shared feature
-            feature_idx++;
-          }
+  auto get_mutex = [&](int64 index1, int64 index2) -> std::mutex * {
+    if (!mutex_list) return nullptr;
+    const uint64 key = static_cast<uint64>(index1) * 0x9E3779B97F4A7C15ULL +
+                       static_cast<uint64>(index2);
+    return &mutex_list[key % NUM_LOCKS];
+  };
+  std::atomic<bool> ok(true);
+  auto scatter_rows = [&](int64 begin, int64 end) {
+    for (int64 row = begin; row < end; ++row) {
+      for (size_t i = 0; i < plan.size(); ++i) {
+        const LayoutSlicePlan &slice = plan[i];
+        const SliceFeature &feature = features[i];
+        if (feature.begin < 0) continue;
+        // Train doesn't have shared features, but they still add up.
+        const int feature_idx = feature.shared ? feature.begin
+                                               : feature.begin + row;
+        const float *grad =
+            grads[slice.output] + row * slice.row_stride + slice.dst_offset;
+        auto get_init = [&](int64 index1, int64 index2) -> char * {
+          if (init == nullptr) return nullptr;
+          const auto &fid_info = ufid_grads_info->at(index1);
+          return init->Get(fid_info.first + index2, slice.slice_idx);
+        };
+        int fid_begin, fid_end;
+        if (!GetFeatureFids(feature_idx, feature_offset_vec, total_feature_num,
+                            total_fid_num, &fid_begin, &fid_end) ||
+            !ScatterSlice(slice, fids_offset_vec + fid_begin,
+                          fid_end - fid_begin, embeddings_grads_data->data(),
+                          embeddings_grads_data->size(), grad, get_mutex,
+                          get_init)) {
+          ok = false;
+          return;
         }
       }
     }
   };
 
   if (parallel_flag == 0) {
-    for (int i = 0; i < layouts.size(); ++i) {
-      scatter_grad_fn(i, i + 1);
-    }
+    scatter_rows(0, batch_size);
   } else {
-    auto worker_threads = ctx->device()->tensorflow_cpu_worker_threads();
-    worker_threads->workers->ParallelFor(
-        layouts.size(),
-        thread::ThreadPool::SchedulingParams(
-            thread::ThreadPool::SchedulingStrategy::kFixedBlockSize,
-            absl::nullopt,
-            1),  // block_size
-        scatter_grad_fn);
+    const DeviceBase::CpuWorkerThreads &worker_threads =
+        *ctx->device()->tensorflow_cpu_worker_threads();
+    Shard(worker_threads.num_threads, worker_threads.workers, batch_size,
+          PlanRowCost(plan), scatter_rows);
   }
+  OP_REQUIRES(ctx, ok,
+              errors::InvalidArgument("Invalid fid or feature offsets."));
 }
 
 class MonolithEmbeddingToLayoutGradOpV2
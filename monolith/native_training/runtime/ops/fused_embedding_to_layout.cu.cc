@@ -205,6 +205,7 @@ class MonolithEmbeddingToLayoutOpV3GPU : public MonolithEmbeddingToLayoutOp {
   explicit MonolithEmbeddingToLayoutOpV3GPU(OpKernelConstruction *ctx,
                                             int verison = 3)
       : MonolithEmbeddingToLayoutOp(ctx, verison) {}
+  bool UseLayoutPlan() const override { return false; }
   virtual void TaskRun(const std::vector<std::shared_ptr<Layout>> &layouts,
                        const std::vector<PtrWrapper> &embeddings_data,
                        const uint64 *fids_offset_vec, int total_fid_num,
@@ -386,6 +387,7 @@ class MonolithEmbeddingToLayoutGradOpV3GPU
   explicit MonolithEmbeddingToLayoutGradOpV3GPU(OpKernelConstruction *ctx,
                                                 int verison = 3)
       : MonolithEmbeddingToLayoutGradOp(ctx, verison) {}
+  bool UseLayoutPlan() const override { return false; }
   void TaskRun(const std::vector<std::shared_ptr<Layout>> &layouts,
                const std::vector<std::pair<int, int>> *ufid_grads_info,
                const uint64 *fids_offset_vec, int total_fid_num,
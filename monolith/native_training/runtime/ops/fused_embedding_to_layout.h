@@ -23,6 +23,7 @@
 
 #include "idl/matrix/proto/example.pb.h"
 #include "monolith/native_training/data/training_instance/cc/pb_variant.h"
+#include "monolith/native_training/runtime/ops/embedding_layout_plan.h"
 #include "monolith/native_training/runtime/hash_table/optimizer/avx_utils.h"
 #include "tensorflow/core/profiler/lib/traceme.h"
 
@@ -160,6 +161,9 @@ class MonolithEmbeddingToLayoutBase : public OpKernel {
   std::string variant_type_;
   FeatureConfigs feature_cfgs_;
   std::vector<std::string> layout_names_;
+  // The slices of all layouts, in the order of layout_names_ and their slice
+  // configs.
+  std::vector<LayoutSlicePlan> layout_plan_;
   int max_slice_num_ = 0;
   std::vector<std::vector<int>> table_feature_dim_;
   int ps_num_ = 0;
@@ -171,6 +175,7 @@ class MonolithEmbeddingToLayoutBase : public OpKernel {
   const std::string &GetVariantType() { return variant_type_; }
   const std::vector<std::string> &GetLayoutNames() { return layout_names_; }
   const FeatureConfigs &GetFeatureCfgs() { return feature_cfgs_; }
+  const std::vector<LayoutSlicePlan> &GetLayoutPlan() { return layout_plan_; }
   int GetPsNum() { return ps_num_; }
   int GetParallelFlag() { return parallel_flag_; }
   int GetVersion() { return version_; }
@@ -266,6 +271,8 @@ class MonolithEmbeddingToLayoutOp : public MonolithEmbeddingToLayoutBase {
                                        int version = 1);
 
   void Compute(OpKernelContext *ctx) override;
+  // The CPU kernel runs the layout plan, and gets no layouts.
+  virtual bool UseLayoutPlan() const { return true; }
   virtual void TaskRun(const std::vector<std::shared_ptr<Layout>> &layouts,
                        const std::vector<PtrWrapper> &embeddings_data,
                        const uint64 *fids_offset_vec, int total_fid_num,
@@ -352,6 +359,8 @@ class MonolithEmbeddingToLayoutGradOp : public MonolithEmbeddingToLayoutBase {
                                            int version = 1);
 
   void Compute(OpKernelContext *ctx) override;
+  // The CPU kernel runs the layout plan, and gets no layouts.
+  virtual bool UseLayoutPlan() const { return true; }
   virtual void TaskRun(const std::vector<std::shared_ptr<Layout>> &layouts,
                        const std::vector<std::pair<int, int>> *ufid_grads_info,
                        const uint64 *fids_offset_vec, int total_fid_num,
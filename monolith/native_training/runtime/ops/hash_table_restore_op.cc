@@ -14,12 +14,16 @@
 
 #include <atomic>
 #include <cstring>
+#include <memory>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include "absl/strings/str_cat.h"
+#include "absl/strings/str_join.h"
 #include "monolith/native_training/runtime/ops/embedding_hash_table_tf_bridge.h"
 #include "monolith/native_training/runtime/ops/file_utils.h"
+#include "monolith/native_training/runtime/ops/restore_pipeline.h"
 #include "tensorflow/core/framework/op_kernel.h"
 #include "tensorflow/core/kernels/ops_util.h"
 #include "tensorflow/core/lib/io/path.h"
@@ -28,155 +32,143 @@
 
 namespace tensorflow {
 namespace monolith_tf {
-namespace {
-
-// Carries the data through async process.
-// It will ref and unref |p_hash_table|.
-struct AsyncPack {
-  AsyncPack(OpKernelContext* p_ctx, EmbeddingHashTableTfBridge* p_hash_table,
-            std::string p_basename, std::function<void()> p_done,
-            int p_thread_num)
-      : ctx(p_ctx),
-        basename(std::move(p_basename)),
-        record_count(0),
-        hash_table(p_hash_table),
-        done(std::move(p_done)),
-        thread_num(p_thread_num),
-        finish_num(0),
-        status(thread_num) {
-    hash_table->Ref();
-  }
-
-  ~AsyncPack() { hash_table->Unref(); }
-
-  OpKernelContext* ctx;
-  std::string basename;
-  std::atomic_long record_count;
-  EmbeddingHashTableTfBridge* hash_table;
-  std::function<void()> done;
-  const int thread_num;
-  std::atomic_int finish_num;
-  std::vector<Status> status;
-};
-
-}  // namespace
 
 class HashTableRestoreOp : public AsyncOpKernel {
  public:
-  explicit HashTableRestoreOp(OpKernelConstruction* ctx) : AsyncOpKernel(ctx) {}
+  explicit HashTableRestoreOp(OpKernelConstruction* ctx) : AsyncOpKernel(ctx) {
+    OP_REQUIRES_OK(ctx, ctx->GetAttr("id_shard_index", &id_shard_.index));
+    OP_REQUIRES_OK(ctx, ctx->GetAttr("id_num_shards", &id_shard_.num));
+    OP_REQUIRES(ctx, id_shard_.index >= 0 && id_shard_.index < id_shard_.num,
+                errors::InvalidArgument("Invalid id shard ", id_shard_.index,
+                                        " of ", id_shard_.num));
+  }
 
   void ComputeAsync(OpKernelContext* ctx, DoneCallback done) override {
     EmbeddingHashTableTfBridge* hash_table = nullptr;
     OP_REQUIRES_OK_ASYNC(
         ctx, LookupResource(ctx, HandleFromInput(ctx, 0), &hash_table), done);
     core::ScopedUnref unref(hash_table);
+    // A scalar, or the checkpoints of all PS of a cluster of different size,
+    // in which case id_shard selects the ids of this PS.
     const Tensor& basename_tensor = ctx->input(1);
-    const std::string basename = basename_tensor.scalar<tstring>()();
-    std::vector<std::string> files;
-    OP_REQUIRES_OK_ASYNC(
-        ctx, ctx->env()->GetMatchingPaths(absl::StrCat(basename, "-*"), &files),
-        done);
-
-    FileSpec file_spec;
-    OP_REQUIRES_OK_ASYNC(ctx, ValidateShardedFiles(basename, files, &file_spec),
+    std::vector<std::string> basenames;
+    for (int64 i = 0; i < basename_tensor.NumElements(); ++i) {
+      basenames.push_back(basename_tensor.flat<tstring>()(i));
+    }
+    std::vector<ShardedFile> files;
+    OP_REQUIRES_OK_ASYNC(ctx, GetShardedFiles(ctx->env(), basenames, &files),
                          done);
-    OP_REQUIRES_ASYNC(ctx, file_spec.nshards() > 0,
+    OP_REQUIRES_ASYNC(ctx, !files.empty(),
                       errors::NotFound("Unable to find the dump files for: ",
-                                       name(), " in ", basename),
+                                       name(), " in ",
+                                       absl::StrJoin(basenames, ",")),
                       done);
     ctx->set_output(0, ctx->input(0));
     hash_table->Clear();
-    int nshards = files.size();
-    auto pack =
-        new AsyncPack(ctx, hash_table, basename, std::move(done), nshards);
-    for (int i = 0; i < nshards; ++i) {
-      ctx->device()->tensorflow_cpu_worker_threads()->workers->Schedule(
-          [this, pack, i, nshards] {
-            WorkerThread({i, nshards}, pack);
-          });
-    }
+    hash_table->Ref();
+    // The pipeline runs on the worker threads, this one included.
+    ctx->device()->tensorflow_cpu_worker_threads()->workers->Schedule(
+        [this, ctx, hash_table, files, done]() {
+          Status s = Restore(ctx, hash_table, files);
+          hash_table->Unref();
+          OP_REQUIRES_OK_ASYNC(ctx, s, done);
+          done();
+        });
   }
 
  private:
-  void WorkerThread(EmbeddingHashTableTfBridge::DumpShard shard, AsyncPack* p) {
-    p->status[shard.idx] = RestoreOneShard(shard, p);
-    if (p->finish_num.fetch_add(1) == p->thread_num - 1) {
-      auto summary = p->hash_table->Summary();
-      auto basename = tensorflow::io::Basename(p->basename);
-      LOG(INFO) << absl::StrFormat(
-          "Hash table: %s, summary: %s, restore read %ld records, skip %ld "
-          "zero embeddings",
-          basename, summary, p->record_count,
-          p->record_count - p->hash_table->Size());
-      Cleanup(p);
-    }
-  }
-
-  Status RestoreOneShard(EmbeddingHashTableTfBridge::DumpShard shard,
-                         AsyncPack* p) {
-    std::string filename =
-        GetShardedFileName(p->basename, shard.idx, shard.total);
-    std::unique_ptr<RandomAccessFile> f;
+  using EntryDump = EmbeddingHashTableTfBridge::EntryDump;
+
+  Status Restore(OpKernelContext* ctx, EmbeddingHashTableTfBridge* hash_table,
+                 const std::vector<ShardedFile>& files) const {
+    const auto* worker_threads = ctx->device()->tensorflow_cpu_worker_threads();
+    auto options = RestorePipeline<tstring, EntryDump>::Options::ForNumThreads(
+        worker_threads->num_threads);
+    // The files being read, each by one task at a time.
+    std::vector<std::unique_ptr<RandomAccessFile>> fps(files.size());
+    std::vector<std::unique_ptr<io::SequentialRecordReader>> readers(
+        files.size());
+    auto read_fn = [&](int stream, tstring* record) {
+      if (readers[stream] == nullptr) {
+        TF_RETURN_IF_ERROR(ctx->env()->NewRandomAccessFile(
+            files[stream].filename(), &fps[stream]));
+        io::RecordReaderOptions opts;
+        opts.buffer_size = 10 * 1024 * 1024;
+        readers[stream] = std::make_unique<io::SequentialRecordReader>(
+            fps[stream].get(), opts);
+      }
+      Status s = readers[stream]->ReadRecord(record);
+      if (!s.ok()) {
+        readers[stream].reset();
+        fps[stream].reset();
+      }
+      return s;
+    };
 
-    TF_RETURN_IF_ERROR(p->ctx->env()->NewRandomAccessFile(filename, &f));
-    io::RecordReaderOptions opts;
-    opts.buffer_size = 10 * 1024 * 1024;
-    io::SequentialRecordReader reader(f.get(), opts);
-    Status restore_status;
-    auto get_fn = [&reader, &restore_status, &p](
-        EmbeddingHashTableTfBridge::EntryDump* dump, int64_t* max_update_ts) {
-      Status s = GetRecord(&reader, dump);
-      if (TF_PREDICT_FALSE(!s.ok())) {
-        if (!errors::IsOutOfRange(s)) {
-          restore_status = s;
+    std::atomic_long record_count(0);
+    // Records of ids outside of id_shard_.
+    std::atomic_long skip_count(0);
+    auto parse_fn = [&](tstring* record, EntryDump* dump, bool* keep) {
+      record_count.fetch_add(1, std::memory_order_relaxed);
+      const absl::string_view serialized(record->data(), record->size());
+      int64_t id;
+      // Records of other shards are dropped before parsing them.
+      *keep = id_shard_.num == 1 || !PeekEntryDumpId(serialized, &id) ||
+              id_shard_.Contains(id);
+      if (*keep) {
+        if (!dump->ParseFromArray(record->data(), record->size())) {
+          return errors::FailedPrecondition(
+              "Unable to parse data. Data might be corrupted");
         }
-        return false;
+        *keep = id_shard_.num == 1 || id_shard_.Contains(dump->id());
       }
-      p->record_count.fetch_add(1);
-      if (!dump->has_last_update_ts_sec()) {
-        dump->set_last_update_ts_sec(0);
+      if (!*keep) {
+        skip_count.fetch_add(1, std::memory_order_relaxed);
       }
-
-      *max_update_ts = std::max(dump->last_update_ts_sec(), *max_update_ts);
-      return true;
+      return Status::OK();
     };
 
-    TF_RETURN_IF_ERROR(p->hash_table->Restore(p->ctx, shard, get_fn));
-    TF_RETURN_IF_ERROR(restore_status);
-    return Status::OK();
-  }
-
-  static Status GetRecord(io::SequentialRecordReader* reader,
-                          EmbeddingHashTableTfBridge::EntryDump* dump) {
-    tstring s;
-    TF_RETURN_IF_ERROR(reader->ReadRecord(&s));
-    if (!dump->ParseFromArray(s.data(), s.size())) {
-      return errors::FailedPrecondition(
-          "Unable to parse data. Data might be corrupted");
-    }
+    const int num_threads = options.num_threads;
+    auto insert_fn = [&](int thread, absl::Span<EntryDump> dumps) {
+      size_t next = 0;
+      auto get_fn = [&dumps, &next](EntryDump* dump, int64_t* max_update_ts) {
+        if (next == dumps.size()) {
+          return false;
+        }
+        dump->Swap(&dumps[next++]);
+        if (!dump->has_last_update_ts_sec()) {
+          dump->set_last_update_ts_sec(0);
+        }
+        *max_update_ts = std::max(dump->last_update_ts_sec(), *max_update_ts);
+        return true;
+      };
+      return hash_table->Restore(ctx, {thread, num_threads}, get_fn);
+    };
 
+    RestorePipeline<tstring, EntryDump> pipeline(files.size(), read_fn,
+                                                 parse_fn, insert_fn, options,
+                                                 worker_threads->workers);
+    TF_RETURN_IF_ERROR(pipeline.Run());
+    auto summary = hash_table->Summary();
+    auto basename = tensorflow::io::Basename(files.front().basename);
+    LOG(INFO) << absl::StrFormat(
+        "Hash table: %s, summary: %s, restore read %ld records, skip %ld "
+        "zero embeddings, %ld records of other id shards",
+        basename, summary, record_count.load(),
+        record_count.load() - skip_count.load() - hash_table->Size(),
+        skip_count.load());
     return Status::OK();
   }
 
-  // Clean up when all shards are done.
-  void Cleanup(AsyncPack* p) {
-    auto done = [p]() {
-      // We want to delete p first and then call done.
-      auto done = std::move(p->done);
-      delete p;
-      done();
-    };
-    for (int i = 0; i < p->thread_num; ++i) {
-      OP_REQUIRES_OK_ASYNC(p->ctx, p->status[i], done);
-    }
-    done();
-  }
+  IdShard id_shard_;
 };
 
 REGISTER_OP("MonolithHashTableRestore")
     .Input("handle: resource")
     .Input("basename: string")
     .Output("output_handle: resource")
+    .Attr("id_shard_index: int = 0")
+    .Attr("id_num_shards: int = 1")
     .SetShapeFn(shape_inference::ScalarShape);
 
 REGISTER_KERNEL_BUILDER(Name("MonolithHashTableRestore").Device(DEVICE_CPU),
@@ -12,20 +12,34 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
-#include <cmath>
-#include <cstdio>
-#include <ctime>
-#include <random>
-#include <string>
+#include <algorithm>
+#include <functional>
 #include <vector>
 
+#include "monolith/native_training/runtime/ops/inbatch_auc_loss.h"
 #include "tensorflow/core/framework/op.h"
 #include "tensorflow/core/framework/op_kernel.h"
 #include "tensorflow/core/framework/shape_inference.h"
 #include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/util/work_sharder.h"
 
 namespace tensorflow {
 namespace monolith_tf {
+namespace {
+
+// Pairs of a logit outside of the band are summed in O(1), the band is at
+// most the whole other side.
+int64 PerLogitCost(int64 num_others) {
+  return std::max<int64>(num_others, 1) * 20;
+}
+
+void ParallelFor(OpKernelContext *ctx, int64 total, int64 cost_per_unit,
+                 const std::function<void(int64, int64)> &fn) {
+  auto workers = ctx->device()->tensorflow_cpu_worker_threads();
+  Shard(workers->num_threads, workers->workers, total, cost_per_unit, fn);
+}
+
+}  // namespace
 
 class InbatchAucLossOp : public OpKernel {
  public:
@@ -44,28 +58,20 @@ class InbatchAucLossOp : public OpKernel {
     OP_REQUIRES(ctx, label_tensor->NumElements() == logit_tensor->NumElements(),
                 errors::InvalidArgument("the label and logit not match"));
 
-    std::vector<size_t> positive, negative;
-    auto label_flat = label_tensor->flat<float>();
-    for (size_t i = 0; i < label_flat.size(); ++i) {
-      if (label_flat(i) > 0) {
-        positive.push_back(i);
-      } else if (label_flat(i) > -10000) {
-        negative.push_back(i);
-      }
-    }
-
-    float loss = 0;
-    auto logit_flat = logit_tensor->flat<float>();
-    for (const size_t &i : positive) {
-      float pos_logit = logit_flat(i);
-      for (const size_t &j : negative) {
-        float diff = pos_logit - logit_flat(j);
-        if (diff > -87 && diff < 88) {
-          loss += diff - log(1.0 + exp(diff));
-        } else if (diff <= -87) {
-          loss += diff;
-        }
-      }
+    InbatchAucPairs pairs(label_tensor->flat<float>().data(),
+                          logit_tensor->flat<float>().data(),
+                          label_tensor->NumElements());
+    std::vector<double> losses(pairs.num_positives());
+    ParallelFor(ctx, pairs.num_positives(),
+                PerLogitCost(pairs.num_negatives()),
+                [&pairs, &losses](int64 begin, int64 end) {
+                  for (int64 k = begin; k < end; ++k) {
+                    losses[k] = pairs.PositiveLoss(k);
+                  }
+                });
+    double loss = 0;
+    for (double l : losses) {
+      loss += l;
     }
 
     Tensor *loss_tensor = nullptr;
@@ -97,40 +103,27 @@ class InbatchAucLossGradOp : public OpKernel {
     auto logit_grad_float = logit_grad_tensor->flat<float>();
     logit_grad_float.setZero();
 
-    std::vector<size_t> positive, negative;
-    auto label_flat = label_tensor->flat<float>();
-    for (size_t i = 0; i < label_flat.size(); ++i) {
-      if (label_flat(i) > 0) {
-        positive.push_back(i);
-      } else if (label_flat(i) > -10000) {
-        negative.push_back(i);
-      }
-    }
-
-    auto logit_flat = logit_tensor->flat<float>();
-    for (const size_t &i : positive) {
-      float pos_logit = logit_flat(i);
-      for (const size_t &j : negative) {
-        float diff = pos_logit - logit_flat(j);
-        float grad_ij;
-        if (diff > -87 && diff < 88) {
-          grad_ij = 1.0 - 1.0 / (1.0 + exp(-diff));
-        } else if (diff <= -87) {
-          grad_ij = 1;
-        } else {
-          grad_ij = 0;
-        }
-
-        logit_grad_float(i) += grad_ij;
-        logit_grad_float(j) -= neg_weight_ * grad_ij;
-      }
-    }
-
-    if (grad != 1) {
-      for (size_t i = 0; i < logit_grad_float.size(); ++i) {
-        logit_grad_float(i) *= grad;
-      }
-    }
+    InbatchAucPairs pairs(label_tensor->flat<float>().data(),
+                          logit_tensor->flat<float>().data(),
+                          label_tensor->NumElements());
+    // Every logit is written by exactly one of the two passes.
+    ParallelFor(ctx, pairs.num_positives(),
+                PerLogitCost(pairs.num_negatives()),
+                [&](int64 begin, int64 end) {
+                  for (int64 k = begin; k < end; ++k) {
+                    logit_grad_float(pairs.positive_index(k)) =
+                        grad * pairs.PositiveGrad(k);
+                  }
+                });
+    const float neg_scale = -neg_weight_ * grad;
+    ParallelFor(ctx, pairs.num_negatives(),
+                PerLogitCost(pairs.num_positives()),
+                [&](int64 begin, int64 end) {
+                  for (int64 k = begin; k < end; ++k) {
+                    logit_grad_float(pairs.negative_index(k)) =
+                        neg_scale * pairs.NegativeGrad(k);
+                  }
+                });
   }
 
  private:
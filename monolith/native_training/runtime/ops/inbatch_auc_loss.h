@@ -0,0 +1,179 @@
+// Copyright 2022 ByteDance and/or its affiliates.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MONOLITH_NATIVE_TRAINING_RUNTIME_OPS_INBATCH_AUC_LOSS_H_
+#define MONOLITH_NATIVE_TRAINING_RUNTIME_OPS_INBATCH_AUC_LOSS_H_
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "third_party/eigen3/Eigen/Core"
+
+namespace tensorflow {
+namespace monolith_tf {
+
+// The in-batch pairwise logistic loss
+//   loss = sum_{i in positives, j in negatives} log(sigmoid(p_i - n_j))
+// and its gradients, without evaluating every pair one by one.
+//
+// Positives and negatives are sorted by logit. For a pair whose logit gap d
+// has |d| > kTailGap, log(sigmoid(d)) and sigmoid(-d) equal -exp(-d),
+// d - exp(d), exp(-d) or 1 - exp(d) within float precision, so all such pairs
+// of a logit are summed in closed form from prefix sums over the other side.
+// Only pairs inside the band |d| <= kTailGap are evaluated, contiguously and
+// with vectorized exp / log1p. The per logit methods are const and may be
+// called concurrently.
+class InbatchAucPairs {
+ public:
+  static constexpr float kTailGap = 16.0f;
+
+  // Labels > 0 are positives, labels in (-10000, 0] are negatives, the rest
+  // take no part in the loss.
+  InbatchAucPairs(const float* label, const float* logit, int64_t size) {
+    for (int64_t i = 0; i < size; ++i) {
+      if (label[i] > 0) {
+        pos_.index.push_back(i);
+      } else if (label[i] > -10000) {
+        neg_.index.push_back(i);
+      }
+    }
+    pos_.Build(logit);
+    neg_.Build(logit);
+  }
+
+  int64_t num_positives() const { return pos_.index.size(); }
+  int64_t num_negatives() const { return neg_.index.size(); }
+
+  // Position in the batch of the k-th positive / negative by logit.
+  int64_t positive_index(int64_t k) const { return pos_.index[k]; }
+  int64_t negative_index(int64_t k) const { return neg_.index[k]; }
+
+  // sum_j log(sigmoid(p_k - n_j)) over all negatives j.
+  double PositiveLoss(int64_t k) const {
+    const float p = pos_.logit[k];
+    const int64_t lo = neg_.LowerBound(p - kTailGap);
+    const int64_t hi = neg_.UpperBound(p + kTailGap);
+    const int64_t n = num_negatives();
+    // n_j < p - kTailGap: log(sigmoid(d)) = -exp(-d).
+    double loss = -neg_.ExpSumBelow(lo, -p);
+    // n_j > p + kTailGap: log(sigmoid(d)) = d - exp(d).
+    loss += (n - hi) * static_cast<double>(p) - (neg_.sum[n] - neg_.sum[hi]) -
+            neg_.NegExpSumFrom(hi, p);
+    // log(sigmoid(d)) = -(max(-d, 0) + log1p(exp(-|d|))).
+    auto x = neg_.Band(lo, hi) - p;
+    loss -= (x.max(0.0f) + (-x.abs()).exp().log1p()).sum();
+    return loss;
+  }
+
+  // d loss / d p_k = sum_j sigmoid(n_j - p_k).
+  double PositiveGrad(int64_t k) const {
+    const float p = pos_.logit[k];
+    const int64_t lo = neg_.LowerBound(p - kTailGap);
+    const int64_t hi = neg_.UpperBound(p + kTailGap);
+    const int64_t n = num_negatives();
+    double grad = neg_.ExpSumBelow(lo, -p);
+    grad += (n - hi) - neg_.NegExpSumFrom(hi, p);
+    grad += ((p - neg_.Band(lo, hi)).exp() + 1.0f).inverse().sum();
+    return grad;
+  }
+
+  // -d loss / d n_k = sum_i sigmoid(n_k - p_i).
+  double NegativeGrad(int64_t k) const {
+    const float n = neg_.logit[k];
+    const int64_t lo = pos_.LowerBound(n - kTailGap);
+    const int64_t hi = pos_.UpperBound(n + kTailGap);
+    double grad = lo - pos_.ExpSumBelow(lo, -n);
+    grad += pos_.NegExpSumFrom(hi, n);
+    grad += ((pos_.Band(lo, hi) - n).exp() + 1.0f).inverse().sum();
+    return grad;
+  }
+
+ private:
+  using ConstArrayMap = Eigen::Map<const Eigen::ArrayXf>;
+
+  struct Side {
+    std::vector<int64_t> index;
+    // Sorted ascending, NaNs last.
+    std::vector<float> logit;
+    // Of size logit.size() + 1: sum and exp_prefix are prefix sums of logit
+    // and exp(logit), neg_exp_suffix is the suffix sum of exp(-logit), so
+    // that the exponential sums are never differences of large terms. They
+    // are taken relative to anchor, which keeps them finite as long as the
+    // logits of a batch span less than ~1400.
+    std::vector<double> sum;
+    std::vector<double> exp_prefix;
+    std::vector<double> neg_exp_suffix;
+    double anchor = 0;
+
+    void Build(const float* logits) {
+      std::sort(index.begin(), index.end(), [logits](int64_t a, int64_t b) {
+        return logits[a] < logits[b] ||
+               (std::isnan(logits[b]) && !std::isnan(logits[a]));
+      });
+      const size_t size = index.size();
+      logit.resize(size);
+      for (size_t i = 0; i < size; ++i) {
+        logit[i] = logits[index[i]];
+      }
+      if (size > 0) {
+        anchor = (static_cast<double>(logit.front()) + logit.back()) / 2;
+      }
+      sum.assign(size + 1, 0);
+      exp_prefix.assign(size + 1, 0);
+      neg_exp_suffix.assign(size + 1, 0);
+      for (size_t i = 0; i < size; ++i) {
+        sum[i + 1] = sum[i] + logit[i];
+        exp_prefix[i + 1] = exp_prefix[i] + std::exp(logit[i] - anchor);
+      }
+      for (size_t i = size; i > 0; --i) {
+        neg_exp_suffix[i - 1] =
+            neg_exp_suffix[i] + std::exp(anchor - logit[i - 1]);
+      }
+    }
+
+    int64_t LowerBound(float x) const {
+      return std::lower_bound(logit.begin(), logit.end(), x) - logit.begin();
+    }
+
+    int64_t UpperBound(float x) const {
+      return std::upper_bound(logit.begin(), logit.end(), x) - logit.begin();
+    }
+
+    // sum_{i < end} exp(logit[i] + offset)
+    double ExpSumBelow(int64_t end, double offset) const {
+      double s = exp_prefix[end];
+      return s > 0 ? std::exp(std::log(s) + anchor + offset) : 0;
+    }
+
+    // sum_{i >= begin} exp(offset - logit[i])
+    double NegExpSumFrom(int64_t begin, double offset) const {
+      double s = neg_exp_suffix[begin];
+      return s > 0 ? std::exp(std::log(s) - anchor + offset) : 0;
+    }
+
+    ConstArrayMap Band(int64_t begin, int64_t end) const {
+      return ConstArrayMap(logit.data() + begin, end - begin);
+    }
+  };
+
+  Side pos_;
+  Side neg_;
+};
+
+}  // namespace monolith_tf
+}  // namespace tensorflow
+
+#endif  // MONOLITH_NATIVE_TRAINING_RUNTIME_OPS_INBATCH_AUC_LOSS_H_
@@ -0,0 +1,141 @@
+// Copyright 2022 ByteDance and/or its affiliates.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cmath>
+#include <vector>
+
+#include "absl/random/random.h"
+#include "benchmark/benchmark.h"
+#include "monolith/native_training/runtime/concurrency/thread_pool.h"
+#include "monolith/native_training/runtime/ops/inbatch_auc_loss.h"
+
+namespace tensorflow {
+namespace monolith_tf {
+namespace {
+
+// Args: batch size, stddev of the logits.
+struct Input {
+  Input(int64_t batch_size, float stddev)
+      : label(batch_size), logit(batch_size), grad(batch_size) {
+    absl::BitGen bit_gen;
+    for (int64_t i = 0; i < batch_size; ++i) {
+      label[i] = absl::Bernoulli(bit_gen, 0.5) ? 1 : 0;
+      logit[i] = absl::Gaussian<float>(bit_gen, 0, stddev);
+    }
+  }
+
+  std::vector<float> label;
+  std::vector<float> logit;
+  std::vector<float> grad;
+};
+
+// The pair by pair loop of the loss and gradient ops before.
+void BM_PairwiseAucLoss(benchmark::State& state) {  // NOLINT
+  Input input(state.range(0), state.range(1));
+  std::vector<size_t> positive, negative;
+  for (size_t i = 0; i < input.label.size(); ++i) {
+    (input.label[i] > 0 ? positive : negative).push_back(i);
+  }
+  for (auto _ : state) {
+    float loss = 0;
+    std::fill(input.grad.begin(), input.grad.end(), 0);
+    for (size_t i : positive) {
+      for (size_t j : negative) {
+        float diff = input.logit[i] - input.logit[j];
+        if (diff > -87 && diff < 88) {
+          loss += diff - log(1.0 + exp(diff));
+          float grad_ij = 1.0 - 1.0 / (1.0 + exp(-diff));
+          input.grad[i] += grad_ij;
+          input.grad[j] -= grad_ij;
+        } else if (diff <= -87) {
+          loss += diff;
+          input.grad[i] += 1;
+          input.grad[j] -= 1;
+        }
+      }
+    }
+    benchmark::DoNotOptimize(loss);
+    benchmark::DoNotOptimize(input.grad.data());
+  }
+  state.SetItemsProcessed(state.iterations() * input.label.size());
+}
+
+void RunSortedAucLoss(Input* input,
+                      monolith::concurrency::ThreadPool* thread_pool) {
+  auto parallel_for = [thread_pool](int64_t total,
+                                    const std::function<void(int64_t, int64_t)>&
+                                        fn) {
+    if (thread_pool == nullptr) {
+      fn(0, total);
+    } else {
+      thread_pool->ParallelFor(total, 64, fn);
+    }
+  };
+  InbatchAucPairs pairs(input->label.data(), input->logit.data(),
+                        input->label.size());
+  std::vector<double> losses(pairs.num_positives());
+  parallel_for(pairs.num_positives(), [&](int64_t begin, int64_t end) {
+    for (int64_t k = begin; k < end; ++k) {
+      losses[k] = pairs.PositiveLoss(k);
+      input->grad[pairs.positive_index(k)] = pairs.PositiveGrad(k);
+    }
+  });
+  parallel_for(pairs.num_negatives(), [&](int64_t begin, int64_t end) {
+    for (int64_t k = begin; k < end; ++k) {
+      input->grad[pairs.negative_index(k)] = -pairs.NegativeGrad(k);
+    }
+  });
+  benchmark::DoNotOptimize(losses.data());
+  benchmark::DoNotOptimize(input->grad.data());
+}
+
+void BM_SortedAucLoss(benchmark::State& state) {  // NOLINT
+  Input input(state.range(0), state.range(1));
+  for (auto _ : state) {
+    RunSortedAucLoss(&input, nullptr);
+  }
+  state.SetItemsProcessed(state.iterations() * input.label.size());
+}
+
+void BM_ParallelSortedAucLoss(benchmark::State& state) {  // NOLINT
+  Input input(state.range(0), state.range(1));
+  monolith::concurrency::ThreadPool thread_pool(8);
+  for (auto _ : state) {
+    RunSortedAucLoss(&input, &thread_pool);
+  }
+  state.SetItemsProcessed(state.iterations() * input.label.size());
+}
+
+// Typical logits put every pair in the band, wide ones put most pairs on the
+// closed form tails.
+void Args(benchmark::internal::Benchmark* b) {
+  for (int64_t batch_size : {1 << 12, 1 << 14, 1 << 16}) {
+    for (int64_t stddev : {2, 64}) {
+      b->Args({batch_size, stddev});
+    }
+  }
+}
+
+BENCHMARK(BM_PairwiseAucLoss)->Apply(Args)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_SortedAucLoss)->Apply(Args)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_ParallelSortedAucLoss)
+    ->Apply(Args)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+}  // namespace
+}  // namespace monolith_tf
+}  // namespace tensorflow
+
+BENCHMARK_MAIN();
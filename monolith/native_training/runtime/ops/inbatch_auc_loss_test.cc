@@ -0,0 +1,100 @@
+// Copyright 2022 ByteDance and/or its affiliates.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "monolith/native_training/runtime/ops/inbatch_auc_loss.h"
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace tensorflow {
+namespace monolith_tf {
+namespace {
+
+// Pair by pair in double, the gradient of logit i is d loss / d logit_i.
+double NaiveLoss(const std::vector<float>& label,
+                 const std::vector<float>& logit, std::vector<double>* grad) {
+  grad->assign(label.size(), 0);
+  double loss = 0;
+  for (size_t i = 0; i < label.size(); ++i) {
+    if (label[i] <= 0) continue;
+    for (size_t j = 0; j < label.size(); ++j) {
+      if (label[j] > 0 || label[j] <= -10000) continue;
+      double d = static_cast<double>(logit[i]) - logit[j];
+      loss -= d > 0 ? std::log1p(std::exp(-d)) : -d + std::log1p(std::exp(d));
+      double g = 1 / (1 + std::exp(d));
+      (*grad)[i] += g;
+      (*grad)[j] -= g;
+    }
+  }
+  return loss;
+}
+
+void ExpectMatchesNaive(const std::vector<float>& label,
+                        const std::vector<float>& logit) {
+  std::vector<double> expected_grad;
+  double expected_loss = NaiveLoss(label, logit, &expected_grad);
+
+  InbatchAucPairs pairs(label.data(), logit.data(), label.size());
+  double loss = 0;
+  std::vector<double> grad(label.size(), 0);
+  for (int64_t k = 0; k < pairs.num_positives(); ++k) {
+    loss += pairs.PositiveLoss(k);
+    grad[pairs.positive_index(k)] = pairs.PositiveGrad(k);
+  }
+  for (int64_t k = 0; k < pairs.num_negatives(); ++k) {
+    grad[pairs.negative_index(k)] = -pairs.NegativeGrad(k);
+  }
+  EXPECT_NEAR(loss, expected_loss, 1e-5 * std::abs(expected_loss) + 1e-6);
+  for (size_t i = 0; i < label.size(); ++i) {
+    EXPECT_NEAR(grad[i], expected_grad[i],
+                1e-5 * std::abs(expected_grad[i]) + 1e-6)
+        << i;
+  }
+}
+
+TEST(InbatchAucPairsTest, Small) {
+  ExpectMatchesNaive({1, 0, 0, 1}, {0.5, -0.2, -0.4, 0.8});
+}
+
+TEST(InbatchAucPairsTest, IgnoredLabels) {
+  ExpectMatchesNaive({1, -20000, 0, 1, -1}, {0.5, 3, -0.4, 0.8, 2});
+}
+
+TEST(InbatchAucPairsTest, OneSided) {
+  ExpectMatchesNaive({1, 1, 1}, {0.5, -0.2, 3});
+  ExpectMatchesNaive({0, 0}, {0.5, -0.2});
+  ExpectMatchesNaive({}, {});
+}
+
+TEST(InbatchAucPairsTest, MatchesNaive) {
+  std::mt19937 gen(0);
+  std::bernoulli_distribution positive(0.3);
+  // Wide enough for plenty of pairs on both tails of the band.
+  for (float stddev : {0.5f, 4.0f, 20.0f, 100.0f}) {
+    std::normal_distribution<float> logit_dist(1.0f, stddev);
+    std::vector<float> label(1000), logit(1000);
+    for (size_t i = 0; i < label.size(); ++i) {
+      label[i] = positive(gen) ? 1 : 0;
+      logit[i] = logit_dist(gen);
+    }
+    ExpectMatchesNaive(label, logit);
+  }
+}
+
+}  // namespace
+}  // namespace monolith_tf
+}  // namespace tensorflow
@@ -12,6 +12,7 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
 #include <cstring>
 
 #include "absl/container/flat_hash_map.h"
@@ -21,6 +22,7 @@
 #include "tensorflow/core/util/work_sharder.h"
 
 #include "monolith/native_training/runtime/hash_table/optimizer/avx_utils.h"
+#include "monolith/native_training/runtime/ops/embedding_scatter.h"
 
 namespace tensorflow {
 namespace monolith_tf {
@@ -33,6 +35,18 @@ struct EmbeddingLocation {
   int64 pos;
 };
 
+// Every thread of a scatter-add scans all entries, so there are only as many
+// destination ranges as threads, and only for enough entries to pay for it.
+int64 NumScatterRanges(const DeviceBase::CpuWorkerThreads& worker_threads,
+                       int64 num_entries) {
+  constexpr int64 kMinEntriesPerRange = 4096;
+  return std::min<int64>(num_entries / kMinEntriesPerRange,
+                         worker_threads.num_threads);
+}
+
+// The cost of adding one entry of `dim` floats.
+int64 ScatterCost(int64 dim) { return 2 * dim; }
+
 }  // namespace
 
 // Maps input ids into embeddings.
@@ -117,28 +131,61 @@ class MapIdToEmbeddingGradientOp : public OpKernel {
     const Tensor& input = ctx->input(num_splits_);
     const Tensor& grads = ctx->input(num_splits_ + 1);
     const int64 embedding_size = grads.dim_size(grads.dims() - 1);
-    absl::flat_hash_map<int64, EmbeddingLocation> id_to_loc;
-    std::vector<TTypes<float>::Matrix> embedding_grads_mats;
-    embedding_grads_mats.reserve(num_splits_);
+    // Ids map to their row in the splits concatenated, so the rows can be
+    // split by destination like a single tensor.
+    absl::flat_hash_map<int64, int64> id_to_row;
+    std::vector<int64> split_begins(num_splits_ + 1, 0);
+    std::vector<float*> embedding_grads(num_splits_);
     for (int i = 0; i < num_splits_; ++i) {
       auto ids = ctx->input(i).flat<int64>();
       int64 len_ids = ids.dimension(0);
+      split_begins[i + 1] = split_begins[i] + len_ids;
       for (int64 j = 0; j < ids.dimension(0); ++j) {
-        id_to_loc.insert({ids(j), {i, j}});
+        id_to_row.insert({ids(j), split_begins[i] + j});
       }
       Tensor* output;
       OP_REQUIRES_OK(
           ctx, ctx->allocate_output(i, {len_ids, embedding_size}, &output));
       std::memset(output->data(), 0, output->AllocatedBytes());
-      embedding_grads_mats.emplace_back(output->matrix<float>());
+      embedding_grads[i] = output->flat<float>().data();
     }
     auto input_flat = input.flat<int64>();
-    auto grads_mat =
-        grads.shaped<float, 2>({input.NumElements(), embedding_size});
-    for (int64 k = 0; k < input_flat.dimension(0); ++k) {
-      const EmbeddingLocation& loc = id_to_loc.find(input_flat(k))->second;
-      embedding_grads_mats[loc.index].chip<0>(loc.pos) += grads_mat.chip<0>(k);
+    const int64 input_size = input_flat.dimension(0);
+    const DeviceBase::CpuWorkerThreads& worker_threads =
+        *ctx->device()->tensorflow_cpu_worker_threads();
+    std::vector<int64> rows(input_size);
+    auto map_fn = [&](const int64 begin, const int64 end) {
+      for (int64 k = begin; k < end; ++k) {
+        auto iter = id_to_row.find(input_flat(k));
+        if (iter == id_to_row.end()) {
+          return ctx->SetStatus(
+              errors::InvalidArgument("Unable to map id ", input_flat(k)));
+        }
+        rows[k] = iter->second;
+      }
+    };
+    Shard(worker_threads.num_threads, worker_threads.workers, input_size,
+          /*cost_per_unit=*/100, map_fn);
+    if (!ctx->status().ok()) {
+      return;
     }
+
+    const ScatterRanges ranges = SplitDestinations(
+        rows.data(), input_size, NumScatterRanges(worker_threads, input_size));
+    auto dst_fn = [&](int64 row) {
+      const int64 i = std::upper_bound(split_begins.begin(),
+                                       split_begins.end(), row) -
+                      split_begins.begin() - 1;
+      return embedding_grads[i] + (row - split_begins[i]) * embedding_size;
+    };
+    const float* grads_data = grads.flat<float>().data();
+    Shard(worker_threads.num_threads, worker_threads.workers,
+          ranges.num_ranges,
+          input_size / ranges.num_ranges * ScatterCost(embedding_size),
+          [&](const int64 begin, const int64 end) {
+            ScatterAdd(ranges, rows.data(), input_size, grads_data,
+                       embedding_size, begin, end, dst_fn);
+          });
   }
 
  private:
@@ -227,12 +274,23 @@ class GatherEmbeddingsByInputGradientOp : public OpKernel {
     OP_REQUIRES_OK(ctx,
                    ctx->allocate_output(0, {len_ids, embedding_size}, &output));
     std::memset(output->data(), 0, output->AllocatedBytes());
-    TTypes<float>::Matrix embedding_grads_mats = output->matrix<float>();
-
-    for (int64 k = 0; k < input_size; ++k) {
-      const int64 loc = index_mapping_flat(k);
-      embedding_grads_mats.chip<0>(loc) += grads_mat.chip<0>(k);
-    }
+    float* embedding_grads = output->flat<float>().data();
+
+    const DeviceBase::CpuWorkerThreads& worker_threads =
+        *ctx->device()->tensorflow_cpu_worker_threads();
+    const ScatterRanges ranges =
+        SplitDestinations(index_mapping_flat.data(), input_size,
+                          NumScatterRanges(worker_threads, input_size));
+    auto dst_fn = [embedding_grads, embedding_size](int64 loc) {
+      return embedding_grads + loc * embedding_size;
+    };
+    Shard(worker_threads.num_threads, worker_threads.workers,
+          ranges.num_ranges,
+          input_size / ranges.num_ranges * ScatterCost(embedding_size),
+          [&](const int64 begin, const int64 end) {
+            ScatterAdd(ranges, index_mapping_flat.data(), input_size,
+                       grads_mat.data(), embedding_size, begin, end, dst_fn);
+          });
   }
 };
 
@@ -262,28 +320,45 @@ class FusedGatherEmbeddingsByInputOp : public OpKernel {
       output_ptrs[i] = out->flat<float>().data();
     }
 
+    // Shards the rows of all inputs together, so that one large input does
+    // not end up on a single thread.
+    std::vector<int64> input_begins(num_of_inputs_ + 1, 0);
+    int64 total_floats = 0;
+    for (int i = 0; i < num_of_inputs_; ++i) {
+      input_begins[i + 1] = input_begins[i] + inputs[i].NumElements();
+      total_floats += inputs[i].NumElements() * embedding_dims_[i];
+    }
+    const int64 total_rows = input_begins.back();
+    const float* fused_embeddings = fused_embeddings_flat.data();
     auto fill_fn = [&](const int64 begin, const int64 end) {
-      for (int i = begin; i < end; ++i) {
-        auto embedding_offset_vec = inputs[i].vec<int32>();
-        int embedding_dim = embedding_dims_[i];
-
-        for (int j = 0; j < embedding_offset_vec.size(); ++j) {
-          auto offset = embedding_offset_vec(j);
+      constexpr int kPrefetchDistance = 4;
+      int i = std::upper_bound(input_begins.begin(), input_begins.end(),
+                               begin) -
+              input_begins.begin() - 1;
+      for (int64 row = begin; row < end; ++i) {
+        const int32* offsets = inputs[i].vec<int32>().data();
+        const int embedding_dim = embedding_dims_[i];
+        const int64 last = std::min(end, input_begins[i + 1]) - input_begins[i];
+        for (int64 j = row - input_begins[i]; j < last; ++j) {
+          if (j + kPrefetchDistance < last) {
+            __builtin_prefetch(fused_embeddings +
+                               offsets[j + kPrefetchDistance]);
+          }
           std::memcpy(output_ptrs[i] + j * embedding_dim,
-                      fused_embeddings_flat.data() + offset,
+                      fused_embeddings + offsets[j],
                       embedding_dim * sizeof(float));
         }
+        row = input_begins[i] + last;
       }
     };
 
-    auto worker_threads = ctx->device()->tensorflow_cpu_worker_threads();
-    worker_threads->workers->ParallelFor(
-        num_of_inputs_,
-        thread::ThreadPool::SchedulingParams(
-            thread::ThreadPool::SchedulingStrategy::kFixedBlockSize,
-            absl::nullopt,
-            1),  // block_size
-        fill_fn);
+    if (total_rows == 0) {
+      return;
+    }
+    const DeviceBase::CpuWorkerThreads& worker_threads =
+        *ctx->device()->tensorflow_cpu_worker_threads();
+    Shard(worker_threads.num_threads, worker_threads.workers, total_rows,
+          /*cost_per_unit=*/total_floats / total_rows + 1, fill_fn);
   }
 
  private:
@@ -304,37 +379,46 @@ class FusedGatherEmbeddingsByInputGradientOp : public OpKernel {
     Tensor* output;
     OP_REQUIRES_OK(ctx, ctx->allocate_output(
                             0, TensorShape({fused_embeddings_size}), &output));
-    auto output_flat = output->flat<float>();
+    float* output_data = output->flat<float>().data();
     std::memset(output->data(), 0, output->AllocatedBytes());
     // By design, different inputs from num_of_inputs_ are sharded into
-    // different positions in the flattened gradients, and thus simply do a
-    // parallel fill function.
+    // different positions in the flattened gradients. Large inputs are split
+    // further into ranges of offsets, so that one large input does not end up
+    // on a single thread.
+    const DeviceBase::CpuWorkerThreads& worker_threads =
+        *ctx->device()->tensorflow_cpu_worker_threads();
+    std::vector<ScatterRanges> ranges(num_of_inputs_);
+    // (input, range) pairs.
+    std::vector<std::pair<int, int64>> units;
+    int64 total_cost = 0;
+    for (int i = 0; i < num_of_inputs_; ++i) {
+      const Tensor& offsets = ctx->input(num_of_inputs_ + 1 + i);
+      ranges[i] = SplitDestinations(
+          offsets.vec<int32>().data(), offsets.NumElements(),
+          NumScatterRanges(worker_threads, offsets.NumElements()));
+      for (int64 r = 0; r < ranges[i].num_ranges; ++r) {
+        units.emplace_back(i, r);
+      }
+      total_cost += offsets.NumElements() * ScatterCost(embedding_dims_[i]);
+    }
+    if (units.empty()) {
+      return;
+    }
+    auto dst_fn = [output_data](int32 offset) { return output_data + offset; };
     auto fill_fn = [&](const int64 begin, const int64 end) {
-      for (int i = begin; i < end; ++i) {
-        auto input_flat = ctx->input(1 + i).flat<float>();
-        auto embedding_offset_vec =
-            ctx->input(num_of_inputs_ + 1 + i).vec<int32>();
-        int embedding_dim = embedding_dims_[i];
-        for (int j = 0; j < embedding_offset_vec.dimension(0); ++j) {
-          int32 offset = embedding_offset_vec(j);
-          const float* input_a =
-              const_cast<float*>(input_flat.data()) + j * embedding_dim;
-          float* output_b = static_cast<float*>(output_flat.data()) + offset;
-          // Use AVX acceleration for reducesum.
-          ::monolith::hash_table::ReduceSum(input_a, output_b, output_b,
-                                            embedding_dim);
-        }
+      for (int64 u = begin; u < end; ++u) {
+        const int i = units[u].first;
+        const int64 r = units[u].second;
+        const Tensor& offsets = ctx->input(num_of_inputs_ + 1 + i);
+        // Use AVX acceleration for reducesum.
+        ScatterAdd(ranges[i], offsets.vec<int32>().data(),
+                   offsets.NumElements(),
+                   ctx->input(1 + i).flat<float>().data(), embedding_dims_[i],
+                   r, r + 1, dst_fn);
       }
     };
-
-    auto worker_threads = ctx->device()->tensorflow_cpu_worker_threads();
-    worker_threads->workers->ParallelFor(
-        num_of_inputs_,
-        thread::ThreadPool::SchedulingParams(
-            thread::ThreadPool::SchedulingStrategy::kFixedBlockSize,
-            absl::nullopt,
-            1),  // block_size
-        fill_fn);
+    Shard(worker_threads.num_threads, worker_threads.workers, units.size(),
+          total_cost / units.size() + 1, fill_fn);
   }
 
  private:
@@ -16,11 +16,13 @@
 #include <cstring>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "absl/container/flat_hash_map.h"
 #include "absl/container/flat_hash_set.h"
 #include "absl/random/random.h"
 #include "absl/strings/str_cat.h"
+#include "absl/strings/str_join.h"
 #include "absl/time/clock.h"
 #include "absl/time/time.h"
 #include "monolith/native_training/data/training_instance/cc/reader_util.h"
@@ -28,6 +30,7 @@
 #include "monolith/native_training/runtime/ops/embedding_hash_table_tf_bridge.h"
 #include "monolith/native_training/runtime/ops/file_utils.h"
 #include "monolith/native_training/runtime/ops/multi_hash_table.h"
+#include "monolith/native_training/runtime/ops/restore_pipeline.h"
 #include "tensorflow/core/framework/op_kernel.h"
 #include "tensorflow/core/kernels/ops_util.h"
 #include "tensorflow/core/lib/io/record_reader.h"
@@ -47,18 +50,17 @@ using tensorflow::strings::HumanReadableNumBytes;
 template <typename TableType>
 struct AsyncPack {
   AsyncPack(OpKernelContext* p_ctx, core::RefCountPtr<TableType> p_mtable,
-            std::string p_basename,
+            std::string p_basename, IdShard p_id_shard,
             std::vector<std::unique_ptr<EmbeddingHashTableTfBridge::LockCtx>>
                 p_lock_ctxs,
             std::function<void()> p_done, int p_thread_num)
       : ctx(p_ctx),
         basename(std::move(p_basename)),
-        record_count(0),
+        id_shard(p_id_shard),
         mtable(std::move(p_mtable)),
         lock_ctxs(std::move(p_lock_ctxs)),
         done(std::move(p_done)),
         thread_num(p_thread_num),
-        finish_num(0),
         status(p_thread_num) {}
 
   ~AsyncPack() {
@@ -70,38 +72,75 @@ struct AsyncPack {
 
   OpKernelContext* ctx;
   std::string basename;
-  mutable std::atomic_long record_count;
+  // The ids saved.
+  IdShard id_shard;
   core::RefCountPtr<TableType> mtable;
   std::vector<std::unique_ptr<EmbeddingHashTableTfBridge::LockCtx>> lock_ctxs;
   std::function<void()> done;
   const int thread_num;
-  mutable std::atomic_int finish_num;
   mutable std::vector<Status> status;
 };
 
-template <typename TableType>
-struct EntryDumpIter {
-  explicit EntryDumpIter(io::SequentialRecordReader* reader_, int64_t limit_)
-      : reader(reader_), limit(limit_), offset(0) {}
-  bool GetNext(const AsyncPack<TableType>* p,
-               EmbeddingHashTableTfBridge::EntryDump* dump, Status* status) {
-    *status = Status::OK();
-    if (offset >= limit) return false;
-    tstring s;
-    *status = reader->ReadRecord(&s);
-    if (!status->ok() || !dump->ParseFromArray(s.data(), s.size())) {
-      *status = errors::DataLoss("Parse entry failed!");
-      return false;
-    }
-    offset++;
-    p->record_count.fetch_add(1);
+// A record of a checkpoint file, and the table to restore it into.
+struct TableRecord {
+  int table = -1;
+  // If the ids of the table in the file are not all ours.
+  bool filter = false;
+  tstring data;
+};
 
-    return true;
-  }
+struct TableEntry {
+  int table = -1;
+  EmbeddingHashTableTfBridge::EntryDump dump;
+};
 
-  io::SequentialRecordReader* reader;
-  int64_t limit;
-  int64_t offset;
+// A checkpoint file, and what to restore from it.
+struct CheckpointFile {
+  ShardedFile file;
+  std::vector<monolith::hash_table::MultiHashTableMetadata> metas;
+  // Per table in the file, the table to restore it into, or -1.
+  std::vector<int> table_idx;
+  std::vector<bool> filter;
+  // Tables after this one are skipped.
+  int last_table = -1;
+
+  // While the file is read.
+  std::unique_ptr<RandomAccessFile> fp;
+  std::unique_ptr<io::SequentialRecordReader> reader;
+  int table = 0;
+  uint64_t table_offset = 0;
+
+  // Reads the next record of a table to restore.
+  Status Next(Env* env, TableRecord* record) {
+    if (reader == nullptr) {
+      TF_RETURN_IF_ERROR(env->NewRandomAccessFile(file.filename(), &fp));
+      io::RecordReaderOptions options;
+      options.compression_type = io::RecordReaderOptions::SNAPPY_COMPRESSION;
+      options.buffer_size = 10 * 1024 * 1024;
+      reader = std::make_unique<io::SequentialRecordReader>(fp.get(), options);
+    }
+    while (true) {
+      while (table <= last_table &&
+             table_offset == metas[table].num_entries()) {
+        ++table;
+        table_offset = 0;
+      }
+      if (table > last_table) {
+        reader.reset();
+        fp.reset();
+        return errors::OutOfRange("End of ", file.filename());
+      }
+      if (!reader->ReadRecord(&record->data).ok()) {
+        return errors::DataLoss("Parse entry failed!");
+      }
+      ++table_offset;
+      if (table_idx[table] >= 0) {
+        record->table = table_idx[table];
+        record->filter = filter[table];
+        return Status::OK();
+      }
+    }
+  }
 };
 
 const char* const kShardedMetadataFileFormat = "%s.meta-%05d-of-%05d";
@@ -119,6 +158,11 @@ class MultiHashTableSaveOp : public AsyncOpKernel {
   explicit MultiHashTableSaveOp(OpKernelConstruction* ctx)
       : AsyncOpKernel(ctx) {
     OP_REQUIRES_OK(ctx, ctx->GetAttr("nshards", &nshards_));
+    OP_REQUIRES_OK(ctx, ctx->GetAttr("id_shard_index", &id_shard_.index));
+    OP_REQUIRES_OK(ctx, ctx->GetAttr("id_num_shards", &id_shard_.num));
+    OP_REQUIRES(ctx, id_shard_.index >= 0 && id_shard_.index < id_shard_.num,
+                errors::InvalidArgument("Invalid id shard ", id_shard_.index,
+                                        " of ", id_shard_.num));
     OP_REQUIRES_OK(ctx, ctx->GetAttr("slot_expire_time_config",
                                      &slot_expire_time_config_serialized_));
     if (!slot_expire_time_config_serialized_.empty()) {
@@ -156,8 +200,8 @@ class MultiHashTableSaveOp : public AsyncOpKernel {
       lock_ctxs.push_back(std::move(lock_ctx));
     }
     auto pack = std::make_shared<const AsyncPack<TableType>>(
-        ctx, std::move(mtable), basename, std::move(lock_ctxs), std::move(done),
-        real_nshards);
+        ctx, std::move(mtable), basename, id_shard_, std::move(lock_ctxs),
+        std::move(done), real_nshards);
     for (int i = 0; i < real_nshards; ++i) {
       ctx->device()->tensorflow_cpu_worker_threads()->workers->Schedule(
           [this, pack, i, real_nshards] {
@@ -224,6 +268,8 @@ class MultiHashTableSaveOp : public AsyncOpKernel {
       monolith::hash_table::MultiHashTableMetadata meta;
       meta.set_table_name(table_name);
       meta.set_num_entries(num_entries);
+      meta.set_id_shard_index(p->id_shard.index);
+      meta.set_id_num_shards(p->id_shard.num);
       TF_RETURN_IF_ERROR(meta_writer.WriteRecord(meta.SerializeAsString()));
     }
 
@@ -248,6 +294,7 @@ class MultiHashTableSaveOp : public AsyncOpKernel {
   }
 
   int nshards_;
+  IdShard id_shard_;
   std::string slot_expire_time_config_serialized_;
   monolith::hash_table::SlotExpireTimeConfig slot_expire_time_config_;
   std::vector<int64_t> slot_to_expire_time_;
@@ -257,153 +304,218 @@ template <typename TableType>
 class MultiHashTableRestoreOp : public AsyncOpKernel {
  public:
   explicit MultiHashTableRestoreOp(OpKernelConstruction* ctx)
-      : AsyncOpKernel(ctx) {}
+      : AsyncOpKernel(ctx) {
+    OP_REQUIRES_OK(ctx, ctx->GetAttr("id_shard_index", &id_shard_.index));
+    OP_REQUIRES_OK(ctx, ctx->GetAttr("id_num_shards", &id_shard_.num));
+    OP_REQUIRES(ctx, id_shard_.index >= 0 && id_shard_.index < id_shard_.num,
+                errors::InvalidArgument("Invalid id shard ", id_shard_.index,
+                                        " of ", id_shard_.num));
+  }
 
   void ComputeAsync(OpKernelContext* ctx, DoneCallback done) override {
     core::RefCountPtr<TableType> mtable;
     OP_REQUIRES_OK_ASYNC(
         ctx, LookupResource(ctx, HandleFromInput(ctx, 0), &mtable), done);
 
+    // A scalar, or the checkpoints of all PS of a cluster of different size,
+    // in which case id_shard selects the ids of this PS.
     const Tensor& basename_tensor = ctx->input(1);
-    const std::string basename = basename_tensor.scalar<tstring>()();
-    std::vector<std::string> files;
-    OP_REQUIRES_OK_ASYNC(
-        ctx, ctx->env()->GetMatchingPaths(absl::StrCat(basename, "-*"), &files),
-        done);
-
-    FileSpec file_spec;
-    OP_REQUIRES_OK_ASYNC(ctx, ValidateShardedFiles(basename, files, &file_spec),
+    std::vector<std::string> basenames;
+    for (int64 i = 0; i < basename_tensor.NumElements(); ++i) {
+      basenames.push_back(basename_tensor.flat<tstring>()(i));
+    }
+    std::vector<ShardedFile> files;
+    OP_REQUIRES_OK_ASYNC(ctx, GetShardedFiles(ctx->env(), basenames, &files),
                          done);
-    OP_REQUIRES_ASYNC(ctx, file_spec.nshards() > 0,
+    OP_REQUIRES_ASYNC(ctx, !files.empty(),
                       errors::NotFound("Unable to find the dump files for: ",
-                                       name(), " in ", basename),
+                                       name(), " in ",
+                                       absl::StrJoin(basenames, ",")),
                       done);
 
-    int nshards = file_spec.nshards();
-    auto pack = std::make_shared<const AsyncPack<TableType>>(
-        ctx, std::move(mtable), basename,
-        std::vector<std::unique_ptr<EmbeddingHashTableTfBridge::LockCtx>>(),
-        std::move(done), nshards);
-    for (int i = 0; i < nshards; ++i) {
-      ctx->device()->tensorflow_cpu_worker_threads()->workers->Schedule(
-          [this, pack, i, nshards] {
-            WorkerThread({i, nshards}, pack);
-          });
-    }
     ctx->set_output(0, ctx->input(0));
+    // The pipeline runs on the worker threads, this one included.
+    TableType* table = mtable.release();
+    ctx->device()->tensorflow_cpu_worker_threads()->workers->Schedule(
+        [this, ctx, table, files, done]() {
+          Status s = Restore(ctx, table, files);
+          table->Unref();
+          OP_REQUIRES_OK_ASYNC(ctx, s, done);
+          done();
+        });
   }
 
  private:
-  void WorkerThread(EmbeddingHashTableTfBridge::DumpShard shard,
-                    std::shared_ptr<const AsyncPack<TableType>> p) {
-    p->status[shard.idx] = RestoreOneShard(shard, p.get());
-    if (p->finish_num.fetch_add(1) == p->thread_num - 1) {
-      int64_t total_byte_size = 0, total_uncompressed_byte_size = 0,
-              total_size = 0;
-      for (int i = 0; i < p->mtable->size(); ++i) {
-        auto t = p->mtable->table(i);
-        auto name = p->mtable->name(i);
-        auto summary = t->Summary();
-        LOG(INFO) << absl::StrFormat("Hash table: %s, summary: %s", name,
-                                     summary);
-        LogSummary(summary, &total_byte_size, &total_uncompressed_byte_size);
-        total_size += t->Size();
-      }
-
-      LOG(INFO) << absl::StrFormat(
-          "Restore read %ld records, skip %ld zero embeddings", p->record_count,
-          p->record_count - total_size);
-      LOG(INFO) << absl::StrFormat(
-          "total memory: %s, total memory if not compressed: %s",
-          HumanReadableNumBytes(total_byte_size),
-          HumanReadableNumBytes(total_uncompressed_byte_size));
-    }
-  }
-
-  Status RestoreOneShard(EmbeddingHashTableTfBridge::DumpShard shard,
-                         const AsyncPack<TableType>* p) {
-    std::string filename =
-        GetShardedFileName(p->basename, shard.idx, shard.total);
-    std::string meta_filename =
-        GetShardedMetadataFileName(p->basename, shard.idx, shard.total);
-    std::unique_ptr<RandomAccessFile> fp;
-    std::unique_ptr<RandomAccessFile> fp_meta;
-    TF_RETURN_IF_ERROR(p->ctx->env()->NewRandomAccessFile(filename, &fp));
-    TF_RETURN_IF_ERROR(
-        p->ctx->env()->NewRandomAccessFile(meta_filename, &fp_meta));
-
-    io::RecordReaderOptions options;
-    options.compression_type = io::RecordReaderOptions::SNAPPY_COMPRESSION;
-    options.buffer_size = 10 * 1024 * 1024;
-    io::SequentialRecordReader reader(fp.get(), options);
-    io::RecordReaderOptions options_meta;
-    io::SequentialRecordReader meta_reader(fp_meta.get(), options_meta);
-
-    absl::flat_hash_set<std::string> tables_in_shard;
+  using EntryDump = EmbeddingHashTableTfBridge::EntryDump;
+
+  // Reads the metadata of all files, and decides which of their tables to
+  // restore.
+  Status Prepare(OpKernelContext* ctx, const TableType* mtable,
+                 const std::vector<ShardedFile>& files,
+                 std::vector<std::unique_ptr<CheckpointFile>>* checkpoints,
+                 std::vector<int64_t>* num_entries) const {
     absl::flat_hash_map<std::string, int> name_to_idx;
-    for (int i = 0; i < p->mtable->size(); ++i) {
-      name_to_idx.insert({p->mtable->name(i), i});
+    for (int i = 0; i < mtable->size(); ++i) {
+      name_to_idx.insert({mtable->names()[i], i});
     }
-    bool eof = false;
-    Status restore_status;
-    while (!eof) {
-      tstring meta_pb;
-      Status meta_status = meta_reader.ReadRecord(&meta_pb);
-      if (!meta_status.ok()) {
-        if (errors::IsOutOfRange(meta_status)) {
-          eof = true;
-          break;
-        } else {
-          return errors::DataLoss("Read table metadata failed!");
+    absl::flat_hash_set<std::string> tables_in_checkpoint;
+    num_entries->assign(mtable->size(), 0);
+    for (const ShardedFile& file : files) {
+      auto checkpoint = std::make_unique<CheckpointFile>();
+      checkpoint->file = file;
+      std::string meta_filename =
+          GetShardedMetadataFileName(file.basename, file.shard, file.nshards);
+      std::unique_ptr<RandomAccessFile> fp_meta;
+      TF_RETURN_IF_ERROR(
+          ctx->env()->NewRandomAccessFile(meta_filename, &fp_meta));
+      io::RecordReaderOptions options_meta;
+      io::SequentialRecordReader meta_reader(fp_meta.get(), options_meta);
+      while (true) {
+        tstring meta_pb;
+        Status meta_status = meta_reader.ReadRecord(&meta_pb);
+        if (!meta_status.ok()) {
+          if (errors::IsOutOfRange(meta_status)) {
+            break;
+          } else {
+            return errors::DataLoss("Read table metadata failed!");
+          }
         }
-      }
-
-      monolith::hash_table::MultiHashTableMetadata meta;
-      if (!meta.ParseFromArray(meta_pb.data(), meta_pb.size())) {
-        return errors::DataLoss("Parse table metadata failed!");
-      }
-      auto name_iter = name_to_idx.find(meta.table_name());
-      if (name_iter == name_to_idx.end()) {
-        if (shard.idx == 0) {
-          LOG(INFO) << "Table " << meta.table_name()
-                    << " in checkpoint. skipped.";
+        checkpoint->metas.emplace_back();
+        auto& meta = checkpoint->metas.back();
+        if (!meta.ParseFromArray(meta_pb.data(), meta_pb.size())) {
+          return errors::DataLoss("Parse table metadata failed!");
         }
-        tstring dummy_str;
-        for (int64_t i = 0; i < meta.num_entries(); i++) {
-          TF_RETURN_IF_ERROR(reader.ReadRecord(&dummy_str));
+        checkpoint->table_idx.push_back(-1);
+        checkpoint->filter.push_back(false);
+        auto name_iter = name_to_idx.find(meta.table_name());
+        if (name_iter == name_to_idx.end()) {
+          if (tables_in_checkpoint.insert(meta.table_name()).second) {
+            LOG(INFO) << "Table " << meta.table_name()
+                      << " in checkpoint. skipped.";
+          }
+          continue;
         }
-        continue;
-      }
-      tables_in_shard.insert(meta.table_name());
-      EmbeddingHashTableTfBridge* table = p->mtable->table(name_iter->second);
-
-      EntryDumpIter<TableType> entry_iter(&reader, meta.num_entries());
-      auto get_fn = [&](EmbeddingHashTableTfBridge::EntryDump* dump,
-                        int64_t* max_update_ts) {
-        if (!entry_iter.GetNext(p, dump, &restore_status)) return false;
-        if (!dump->has_last_update_ts_sec()) {
-          dump->set_last_update_ts_sec(0);
+        tables_in_checkpoint.insert(meta.table_name());
+        const IdShard saved{meta.id_shard_index(), meta.id_num_shards()};
+        if (meta.num_entries() == 0 || !Intersects(saved, id_shard_)) {
+          continue;
         }
-        *max_update_ts = std::max(dump->last_update_ts_sec(), *max_update_ts);
-        return true;
-      };
-      TF_RETURN_IF_ERROR(table->Restore(p->ctx, shard, get_fn));
-      TF_RETURN_IF_ERROR(restore_status);
+        checkpoint->table_idx.back() = name_iter->second;
+        checkpoint->filter.back() = !IsSubset(saved, id_shard_);
+        checkpoint->last_table = checkpoint->metas.size() - 1;
+        (*num_entries)[name_iter->second] += static_cast<int64_t>(
+            meta.num_entries() * Overlap(saved, id_shard_));
+      }
+      // Files without any table to restore are not read at all.
+      if (checkpoint->last_table >= 0) {
+        checkpoints->push_back(std::move(checkpoint));
+      }
+    }
+    for (const std::string& table_name : mtable->names()) {
+      if (!tables_in_checkpoint.contains(table_name)) {
+        LOG(WARNING) << "Table " << table_name << " not found checkpoint.";
+      }
+    }
+    return Status::OK();
+  }
+
+  Status Restore(OpKernelContext* ctx, TableType* mtable,
+                 const std::vector<ShardedFile>& files) {
+    std::vector<std::unique_ptr<CheckpointFile>> checkpoints;
+    std::vector<int64_t> num_entries;
+    TF_RETURN_IF_ERROR(Prepare(ctx, mtable, files, &checkpoints, &num_entries));
+    // Sized up front, the tables do not rehash over and over while they are
+    // filled.
+    for (int i = 0; i < mtable->size(); ++i) {
+      mtable->table(i)->Reserve(mtable->table(i)->Size() + num_entries[i]);
     }
-    if (shard.idx == 0) {
-      for (const std::string& table_name : p->mtable->names()) {
-        if (!tables_in_shard.contains(table_name)) {
-          LOG(WARNING) << "Table " << table_name << " not found checkpoint.";
+
+    auto read_fn = [&](int stream, TableRecord* record) {
+      return checkpoints[stream]->Next(ctx->env(), record);
+    };
+
+    std::atomic_long record_count(0);
+    // Records of ids outside of id_shard_.
+    std::atomic_long skip_count(0);
+    auto parse_fn = [&](TableRecord* record, TableEntry* entry, bool* keep) {
+      record_count.fetch_add(1, std::memory_order_relaxed);
+      const absl::string_view serialized(record->data.data(),
+                                         record->data.size());
+      int64_t id;
+      // Entries of other shards are dropped before parsing them.
+      *keep = !record->filter || !PeekEntryDumpId(serialized, &id) ||
+              id_shard_.Contains(id);
+      if (*keep) {
+        if (!entry->dump.ParseFromArray(serialized.data(),
+                                        serialized.size())) {
+          return errors::DataLoss("Parse entry failed!");
         }
+        entry->table = record->table;
+        *keep = !record->filter || id_shard_.Contains(entry->dump.id());
+      }
+      if (!*keep) {
+        skip_count.fetch_add(1, std::memory_order_relaxed);
+      }
+      return Status::OK();
+    };
+
+    const auto* worker_threads = ctx->device()->tensorflow_cpu_worker_threads();
+    auto options = RestorePipeline<TableRecord, TableEntry>::Options::
+        ForNumThreads(worker_threads->num_threads);
+    const int num_threads = options.num_threads;
+    // Batches are inserted table by table.
+    auto insert_fn = [&](int thread, absl::Span<TableEntry> entries) {
+      size_t next = 0;
+      while (next < entries.size()) {
+        const int table_idx = entries[next].table;
+        auto get_fn = [&](EntryDump* dump, int64_t* max_update_ts) {
+          if (next == entries.size() || entries[next].table != table_idx) {
+            return false;
+          }
+          dump->Swap(&entries[next++].dump);
+          if (!dump->has_last_update_ts_sec()) {
+            dump->set_last_update_ts_sec(0);
+          }
+          *max_update_ts =
+              std::max(dump->last_update_ts_sec(), *max_update_ts);
+          return true;
+        };
+        TF_RETURN_IF_ERROR(mtable->table(table_idx)->Restore(
+            ctx, {thread, num_threads}, get_fn));
       }
+      return Status::OK();
+    };
+
+    RestorePipeline<TableRecord, TableEntry> pipeline(
+        checkpoints.size(), read_fn, parse_fn, insert_fn, options,
+        worker_threads->workers);
+    TF_RETURN_IF_ERROR(pipeline.Run());
+
+    int64_t total_byte_size = 0, total_uncompressed_byte_size = 0,
+            total_size = 0;
+    for (int i = 0; i < mtable->size(); ++i) {
+      auto t = mtable->table(i);
+      auto name = mtable->name(i);
+      auto summary = t->Summary();
+      LOG(INFO) << absl::StrFormat("Hash table: %s, summary: %s", name,
+                                   summary);
+      LogSummary(summary, &total_byte_size, &total_uncompressed_byte_size);
+      total_size += t->Size();
     }
-    if (!eof)
-      return errors::DataLoss("Couldn't read all of checkpoint shard ",
-                              shard.idx);
+
+    LOG(INFO) << absl::StrFormat(
+        "Restore read %ld records, skip %ld zero embeddings, %ld records of "
+        "other id shards",
+        record_count.load(),
+        record_count.load() - skip_count.load() - total_size,
+        skip_count.load());
+    LOG(INFO) << absl::StrFormat(
+        "total memory: %s, total memory if not compressed: %s",
+        HumanReadableNumBytes(total_byte_size),
+        HumanReadableNumBytes(total_uncompressed_byte_size));
     return Status::OK();
   }
 
- private:
   template <bool enabled = std::is_same<TableType, MultiHashTable>::value>
   inline typename std::enable_if<enabled, void>::type LogSummary(
       const std::string& summary, int64_t* total_byte_size,
@@ -419,6 +531,8 @@ class MultiHashTableRestoreOp : public AsyncOpKernel {
   inline typename std::enable_if<!enabled, void>::type LogSummary(
       const std::string& summary, int64_t* total_byte_size,
       int64_t* total_uncompressed_byte_size) {}
+
+  IdShard id_shard_;
 };
 
 class MultiHashTableFeatureStatOp : public OpKernel {
@@ -503,6 +617,8 @@ REGISTER_OP("MonolithMultiHashTableSave")
     .Output("output_mtable: resource")
     .Attr("nshards: int=-1")
     .Attr("slot_expire_time_config: string = ''")
+    .Attr("id_shard_index: int = 0")
+    .Attr("id_num_shards: int = 1")
     .SetShapeFn(shape_inference::ScalarShape);
 
 REGISTER_KERNEL_BUILDER(Name("MonolithMultiHashTableSave").Device(DEVICE_CPU),
@@ -512,6 +628,8 @@ REGISTER_OP("MonolithMultiHashTableRestore")
     .Input("mtable: resource")
     .Input("basename: string")
     .Output("output_mtable: resource")
+    .Attr("id_shard_index: int = 0")
+    .Attr("id_num_shards: int = 1")
     .SetShapeFn(shape_inference::ScalarShape);
 
 REGISTER_KERNEL_BUILDER(
@@ -0,0 +1,312 @@
+// Copyright 2022 ByteDance and/or its affiliates.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MONOLITH_NATIVE_TRAINING_RUNTIME_OPS_RAGGED_UNIQUE_H_
+#define MONOLITH_NATIVE_TRAINING_RUNTIME_OPS_RAGGED_UNIQUE_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+namespace tensorflow {
+namespace monolith_tf {
+
+// An open addressing key -> index table for uniquing. Entries are tagged with
+// the generation of the Reset that was current when they were written, so
+// Reset forgets all keys without touching the table, and any int64 is a valid
+// key. Meant to be reused across many small unique passes.
+class UniqueKeyTable {
+ public:
+  // Forgets all keys, and makes room for at least `num_keys` keys.
+  void Reset(int64_t num_keys) {
+    size_t capacity = 16;
+    while (capacity < static_cast<size_t>(num_keys) * 2) {
+      capacity <<= 1;
+    }
+    if (capacity > entries_.size()) {
+      entries_.assign(capacity, Entry());
+      generation_ = 0;
+    }
+    mask_ = entries_.size() - 1;
+    if (++generation_ == 0) {
+      std::fill(entries_.begin(), entries_.end(), Entry());
+      generation_ = 1;
+    }
+  }
+
+  // Returns the index of `key`, after inserting it with `index` if it was
+  // absent. Inserts at most the `num_keys` given to Reset.
+  uint32_t FindOrInsert(int64_t key, uint64_t hash, uint32_t index) {
+    for (size_t i = hash & mask_;; i = (i + 1) & mask_) {
+      Entry& entry = entries_[i];
+      if (entry.generation != generation_) {
+        entry.key = key;
+        entry.generation = generation_;
+        entry.index = index;
+        return index;
+      }
+      if (entry.key == key) {
+        return entry.index;
+      }
+    }
+  }
+
+ private:
+  struct Entry {
+    int64_t key = 0;
+    uint32_t generation = 0;
+    uint32_t index = 0;
+  };
+
+  std::vector<Entry> entries_;
+  size_t mask_ = 0;
+  uint32_t generation_ = 0;
+};
+
+// Uniques the keys of every row of a ragged tensor, keeping the first
+// occurrence order within each row.
+//
+// Rows are uniqued in parallel. Large rows are additionally radix partitioned
+// by key hash into buckets of about kBucketSize keys, which are uniqued
+// independently with a cache resident table, and stitched back together in
+// first occurrence order. The scratch buffers are kept across calls.
+//
+// `parallel_for(total, cost_per_unit, fn)` runs fn(begin, end) over a
+// partition of [0, total), possibly concurrently.
+class RaggedUnique {
+ public:
+  static constexpr int64_t kBucketSize = 4096;
+  static constexpr int64_t kMaxBucketsPerRow = 64;
+
+  // Returns false if splits are not non decreasing from 0.
+  template <typename ParallelFor>
+  bool Unique(const int64_t* keys, const int64_t* splits, int64_t num_rows,
+              const ParallelFor& parallel_for) {
+    keys_ = keys;
+    splits_ = splits;
+    if (num_rows < 0 || splits[0] != 0) {
+      return false;
+    }
+    // Buckets of row r are [row_buckets_[r], row_buckets_[r + 1]).
+    row_buckets_.assign(1, 0);
+    for (int64_t r = 0; r < num_rows; ++r) {
+      int64_t size = splits[r + 1] - splits[r];
+      if (size < 0) {
+        return false;
+      }
+      row_buckets_.push_back(row_buckets_.back() + NumBuckets(size));
+    }
+    const int64_t total = splits[num_rows];
+    uid_.resize(total);
+    order_.resize(total);
+    bucket_splits_.resize(row_buckets_.back() + 1);
+    bucket_splits_.back() = total;
+    unique_splits_.resize(num_rows + 1);
+
+    // Rough cycles per row and per bucket.
+    const int64_t row_cost = 8 * total / std::max<int64_t>(num_rows, 1) + 1;
+    const int64_t bucket_cost =
+        32 * total / std::max<int64_t>(row_buckets_.back(), 1) + 1;
+    parallel_for(num_rows, row_cost, [this](int64_t begin, int64_t end) {
+      for (int64_t r = begin; r < end; ++r) {
+        PartitionRow(r);
+      }
+    });
+    parallel_for(row_buckets_.back(), bucket_cost,
+                 [this](int64_t begin, int64_t end) {
+                   for (int64_t b = begin; b < end; ++b) {
+                     UniqueBucket(b);
+                   }
+                 });
+    parallel_for(num_rows, row_cost, [this](int64_t begin, int64_t end) {
+      for (int64_t r = begin; r < end; ++r) {
+        unique_splits_[r + 1] = MergeRow(r);
+      }
+    });
+    unique_splits_[0] = 0;
+    for (int64_t r = 0; r < num_rows; ++r) {
+      unique_splits_[r + 1] += unique_splits_[r];
+    }
+    return true;
+  }
+
+  // Row splits of the unique keys, valid after Unique.
+  const std::vector<int64_t>& unique_splits() const { return unique_splits_; }
+
+  // Writes the unique keys, and for the j-th unique key of all rows, the
+  // offsets of all its occurrences into the values concatenated row by row,
+  // where a key of row r has dims[r] values:
+  //   value_offset[value_offset_split[j], value_offset_split[j + 1])
+  // The outputs are sized unique_splits().back(), the number of keys and
+  // unique_splits().back() + 1. Returns the total number of values.
+  template <typename ParallelFor>
+  int64_t Fill(const int* dims, int64_t* unique_keys, int64_t* value_offset,
+            int64_t* value_offset_split,
+            const ParallelFor& parallel_for) const {
+    const int64_t num_rows = unique_splits_.size() - 1;
+    std::vector<int64_t> value_base(num_rows + 1, 0);
+    for (int64_t r = 0; r < num_rows; ++r) {
+      value_base[r + 1] =
+          value_base[r] + (splits_[r + 1] - splits_[r]) * dims[r];
+    }
+    value_offset_split[0] = 0;
+    const int64_t row_cost =
+        8 * splits_[num_rows] / std::max<int64_t>(num_rows, 1) + 1;
+    parallel_for(num_rows, row_cost, [&](int64_t begin, int64_t end) {
+      for (int64_t r = begin; r < end; ++r) {
+        // Counting sort of the occurrences by unique key: count, make the
+        // counts exclusive prefix sums, and scatter. After the scatter,
+        // split[u] has moved from the start to the end of unique key u.
+        int64_t* split = value_offset_split + unique_splits_[r] + 1;
+        const int64_t num_unique = unique_splits_[r + 1] - unique_splits_[r];
+        std::fill(split, split + num_unique, 0);
+        for (int64_t i = splits_[r]; i < splits_[r + 1]; ++i) {
+          ++split[uid_[i]];
+        }
+        int64_t start = splits_[r];
+        for (int64_t u = 0; u < num_unique; ++u) {
+          int64_t count = split[u];
+          split[u] = start;
+          start += count;
+        }
+        for (int64_t i = splits_[r], offset = value_base[r];
+             i < splits_[r + 1]; ++i, offset += dims[r]) {
+          value_offset[split[uid_[i]]++] = offset;
+        }
+        int64_t* unique = unique_keys + unique_splits_[r];
+        for (int64_t i = splits_[r]; i < splits_[r + 1]; ++i) {
+          unique[uid_[i]] = keys_[i];
+        }
+      }
+    });
+    return value_base[num_rows];
+  }
+
+ private:
+  static uint64_t Hash(int64_t key) {
+    // The murmur3 finalizer.
+    uint64_t h = static_cast<uint64_t>(key);
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+  }
+
+  static int64_t NumBuckets(int64_t size) {
+    int64_t num_buckets = 1;
+    while (num_buckets < kMaxBucketsPerRow &&
+           num_buckets * kBucketSize * 2 <= size) {
+      num_buckets <<= 1;
+    }
+    return num_buckets;
+  }
+
+  // Buckets are selected by the high bits of the hash, the tables use the
+  // low ones.
+  static int64_t BucketOf(uint64_t hash, int64_t num_buckets) {
+    return num_buckets == 1 ? 0 : hash >> (64 - __builtin_ctzll(num_buckets));
+  }
+
+  // Stably groups the positions of row r by bucket into order_, and records
+  // where its buckets start in bucket_splits_.
+  void PartitionRow(int64_t r) {
+    const int64_t begin = splits_[r], end = splits_[r + 1];
+    const int64_t first_bucket = row_buckets_[r];
+    const int64_t num_buckets = row_buckets_[r + 1] - first_bucket;
+    if (num_buckets == 1) {
+      bucket_splits_[first_bucket] = begin;
+      for (int64_t i = begin; i < end; ++i) {
+        order_[i] = i;
+      }
+      return;
+    }
+    int64_t next[kMaxBucketsPerRow + 1] = {0};
+    for (int64_t i = begin; i < end; ++i) {
+      ++next[BucketOf(Hash(keys_[i]), num_buckets) + 1];
+    }
+    next[0] = begin;
+    for (int64_t b = 0; b < num_buckets; ++b) {
+      next[b + 1] += next[b];
+    }
+    std::copy(next, next + num_buckets, bucket_splits_.begin() + first_bucket);
+    for (int64_t i = begin; i < end; ++i) {
+      order_[next[BucketOf(Hash(keys_[i]), num_buckets)]++] = i;
+    }
+  }
+
+  // Numbers the keys of bucket b in first occurrence order within the
+  // bucket, into uid_. The first occurrence of each key is marked by the
+  // complement of its number.
+  void UniqueBucket(int64_t b) {
+    static thread_local UniqueKeyTable table;
+    const int64_t begin = bucket_splits_[b], end = bucket_splits_[b + 1];
+    table.Reset(end - begin);
+    uint32_t num_unique = 0;
+    for (int64_t k = begin; k < end; ++k) {
+      const int64_t i = order_[k];
+      const int64_t key = keys_[i];
+      uint32_t index = table.FindOrInsert(key, Hash(key), num_unique);
+      if (index == num_unique) {
+        uid_[i] = ~static_cast<int64_t>(num_unique++);
+      } else {
+        uid_[i] = index;
+      }
+    }
+  }
+
+  // Renumbers the keys of row r in first occurrence order within the row,
+  // and returns the number of unique keys of the row. The bucket local
+  // numbers are translated through order_, whose slots of a bucket are free
+  // once the bucket has been uniqued: the number of the j-th key of bucket b
+  // goes to order_[bucket_splits_[b] + j].
+  int64_t MergeRow(int64_t r) {
+    const int64_t begin = splits_[r], end = splits_[r + 1];
+    const int64_t first_bucket = row_buckets_[r];
+    const int64_t num_buckets = row_buckets_[r + 1] - first_bucket;
+    int64_t num_unique = 0;
+    for (int64_t i = begin; i < end; ++i) {
+      const int64_t bucket =
+          num_buckets == 1
+              ? first_bucket
+              : first_bucket + BucketOf(Hash(keys_[i]), num_buckets);
+      int64_t* numbers = order_.data() + bucket_splits_[bucket];
+      if (uid_[i] < 0) {
+        numbers[~uid_[i]] = num_unique;
+        uid_[i] = num_unique++;
+      } else {
+        uid_[i] = numbers[uid_[i]];
+      }
+    }
+    return num_unique;
+  }
+
+  const int64_t* keys_ = nullptr;
+  const int64_t* splits_ = nullptr;
+  std::vector<int64_t> row_buckets_;
+  std::vector<int64_t> bucket_splits_;
+  // Per key position: positions grouped by bucket, then the row wide number
+  // of each bucket local number.
+  std::vector<int64_t> order_;
+  // Per key position: the number of its key within its bucket, then within
+  // its row.
+  std::vector<int64_t> uid_;
+  std::vector<int64_t> unique_splits_;
+};
+
+}  // namespace monolith_tf
+}  // namespace tensorflow
+
+#endif  // MONOLITH_NATIVE_TRAINING_RUNTIME_OPS_RAGGED_UNIQUE_H_
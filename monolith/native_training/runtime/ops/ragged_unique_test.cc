@@ -0,0 +1,162 @@
+// Copyright 2022 ByteDance and/or its affiliates.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "monolith/native_training/runtime/ops/ragged_unique.h"
+
+#include <functional>
+#include <map>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace tensorflow {
+namespace monolith_tf {
+namespace {
+
+using ::testing::ElementsAreArray;
+
+struct Result {
+  std::vector<int64_t> unique_keys;
+  std::vector<int64_t> unique_splits;
+  std::vector<int64_t> value_offset;
+  std::vector<int64_t> value_offset_split;
+  int64_t value_size = 0;
+};
+
+Result NaiveUnique(const std::vector<int64_t>& keys,
+                   const std::vector<int64_t>& splits,
+                   const std::vector<int>& dims) {
+  Result result;
+  result.unique_splits.push_back(0);
+  result.value_offset_split.push_back(0);
+  for (size_t r = 0; r + 1 < splits.size(); ++r) {
+    std::vector<int64_t> unique;
+    std::map<int64_t, std::vector<int64_t>> offsets;
+    for (int64_t i = splits[r]; i < splits[r + 1]; ++i) {
+      if (offsets.count(keys[i]) == 0) {
+        unique.push_back(keys[i]);
+      }
+      offsets[keys[i]].push_back(result.value_size);
+      result.value_size += dims[r];
+    }
+    for (int64_t key : unique) {
+      result.unique_keys.push_back(key);
+      for (int64_t offset : offsets[key]) {
+        result.value_offset.push_back(offset);
+      }
+      result.value_offset_split.push_back(result.value_offset.size());
+    }
+    result.unique_splits.push_back(result.unique_keys.size());
+  }
+  return result;
+}
+
+void SerialFor(int64_t total, int64_t cost,
+               const std::function<void(int64_t, int64_t)>& fn) {
+  fn(0, total);
+}
+
+// Runs every unit on its own thread.
+void ThreadedFor(int64_t total, int64_t cost,
+                 const std::function<void(int64_t, int64_t)>& fn) {
+  std::vector<std::thread> threads;
+  for (int64_t i = 0; i < total; ++i) {
+    threads.emplace_back(fn, i, i + 1);
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
+
+template <typename ParallelFor>
+Result Unique(RaggedUnique* unique, const std::vector<int64_t>& keys,
+              const std::vector<int64_t>& splits, const std::vector<int>& dims,
+              const ParallelFor& parallel_for) {
+  Result result;
+  EXPECT_TRUE(unique->Unique(keys.data(), splits.data(), splits.size() - 1,
+                             parallel_for));
+  result.unique_splits = unique->unique_splits();
+  result.unique_keys.resize(result.unique_splits.back());
+  result.value_offset.resize(keys.size());
+  result.value_offset_split.resize(result.unique_splits.back() + 1);
+  result.value_size = unique->Fill(
+      dims.data(), result.unique_keys.data(), result.value_offset.data(),
+      result.value_offset_split.data(), parallel_for);
+  return result;
+}
+
+void ExpectEqual(const Result& actual, const Result& expected) {
+  EXPECT_THAT(actual.unique_keys, ElementsAreArray(expected.unique_keys));
+  EXPECT_THAT(actual.unique_splits, ElementsAreArray(expected.unique_splits));
+  EXPECT_THAT(actual.value_offset, ElementsAreArray(expected.value_offset));
+  EXPECT_THAT(actual.value_offset_split,
+              ElementsAreArray(expected.value_offset_split));
+  EXPECT_EQ(actual.value_size, expected.value_size);
+}
+
+TEST(RaggedUniqueTest, Basic) {
+  std::vector<int64_t> keys = {0, 1, 2, 1, 0, 0, 1, 0};
+  std::vector<int64_t> splits = {0, 0, 5, 8, 8};
+  std::vector<int> dims = {1, 2, 3, 4};
+  RaggedUnique unique;
+  Result result = Unique(&unique, keys, splits, dims, SerialFor);
+  EXPECT_THAT(result.unique_keys, ElementsAreArray({0, 1, 2, 0, 1}));
+  EXPECT_THAT(result.unique_splits, ElementsAreArray({0, 0, 3, 5, 5}));
+  EXPECT_THAT(result.value_offset,
+              ElementsAreArray({0, 8, 2, 6, 4, 10, 16, 13}));
+  EXPECT_THAT(result.value_offset_split, ElementsAreArray({0, 2, 4, 5, 7, 8}));
+  EXPECT_EQ(result.value_size, 19);
+}
+
+TEST(RaggedUniqueTest, InvalidSplits) {
+  std::vector<int64_t> keys = {0, 1};
+  RaggedUnique unique;
+  std::vector<int64_t> splits = {0, 2, 1};
+  EXPECT_FALSE(unique.Unique(keys.data(), splits.data(), 2, SerialFor));
+  splits = {1, 2};
+  EXPECT_FALSE(unique.Unique(keys.data(), splits.data(), 1, SerialFor));
+}
+
+TEST(RaggedUniqueTest, MatchesNaive) {
+  std::mt19937_64 gen(0);
+  RaggedUnique unique;
+  // Row sizes around and above the bucketing thresholds, including keys
+  // that collide with common sentinels.
+  for (int64_t max_row_size : {10, 10000, 300000}) {
+    std::vector<int64_t> splits = {0};
+    std::vector<int> dims;
+    std::vector<int64_t> keys;
+    for (int r = 0; r < 6; ++r) {
+      int64_t row_size = std::uniform_int_distribution<int64_t>(
+          0, max_row_size)(gen);
+      int64_t key_range = std::max<int64_t>(row_size / (r + 1), 1);
+      for (int64_t i = 0; i < row_size; ++i) {
+        int64_t key = std::uniform_int_distribution<int64_t>(0, key_range)(gen);
+        keys.push_back(key % 7 == 0 ? -key : key * 0x9e3779b97f4a7c15ULL);
+      }
+      splits.push_back(keys.size());
+      dims.push_back(r + 1);
+    }
+    Result expected = NaiveUnique(keys, splits, dims);
+    ExpectEqual(Unique(&unique, keys, splits, dims, SerialFor), expected);
+    ExpectEqual(Unique(&unique, keys, splits, dims, ThreadedFor), expected);
+  }
+}
+
+}  // namespace
+}  // namespace monolith_tf
+}  // namespace tensorflow
@@ -12,7 +12,10 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
 #include <cstring>
+#include <functional>
+#include <vector>
 
 #include "tensorflow/core/framework/op_kernel.h"
 #include "tensorflow/core/framework/shape_inference.h"
@@ -20,104 +23,74 @@
 #include "tensorflow/core/util/work_sharder.h"
 
 #include "monolith/native_training/runtime/hash_table/optimizer/avx_utils.h"
+#include "monolith/native_training/runtime/ops/segment_reduce.h"
 
 namespace tensorflow {
 namespace monolith_tf {
 
-// The difference between this reduce sum op and tf.sparse.reduce_sum is that
-// this supports sparse values which are vectors.
-class ReduceSumOp : public OpKernel {
- public:
-  explicit ReduceSumOp(OpKernelConstruction* ctx) : OpKernel(ctx) {}
-
-  void Compute(OpKernelContext* ctx) override {
-    const Tensor& id_indices = ctx->input(0);
-    auto id_indices_mat = id_indices.matrix<int64>();
-    const Tensor& id_values = ctx->input(1);
-    const int64 value_size = id_values.shape().dim_size(1);
-    auto id_values_mat = id_values.matrix<float>();
-    const Tensor& id_dense_shape = ctx->input(2);
-    const int64 batch_size = id_dense_shape.flat<int64>()(0);
-    Tensor* reduced;
-    OP_REQUIRES_OK(ctx,
-                   ctx->allocate_output(0, {batch_size, value_size}, &reduced));
-    std::memset(reduced->data(), 0, reduced->AllocatedBytes());
-    auto reduced_mat = reduced->matrix<float>();
-    for (int64 i = 0; i < id_indices_mat.dimension(0); ++i) {
-      int64 batch = id_indices_mat(i, 0);
-      reduced_mat.chip<0>(batch) += id_values_mat.chip<0>(i);
-    }
-  }
-};
+namespace {
 
-// The difference between this reduce mean op and tf.sparse.reduce_mean is that
-// this supports sparse values which are vectors.
-class ReduceMeanOp : public OpKernel {
- public:
-  explicit ReduceMeanOp(OpKernelConstruction* ctx) : OpKernel(ctx) {}
+// Runs fn(begin, end) over [0, total) on the CPU worker threads.
+void ParallelFor(OpKernelContext* ctx, int64 total, int64 cost_per_unit,
+                 const std::function<void(int64, int64)>& fn) {
+  auto* worker_threads = ctx->device()->tensorflow_cpu_worker_threads();
+  Shard(worker_threads->num_threads, worker_threads->workers, total,
+        cost_per_unit, fn);
+}
 
-  void Compute(OpKernelContext* ctx) override {
-    const Tensor& id_indices = ctx->input(0);
-    auto id_indices_mat = id_indices.matrix<int64>();
-    const Tensor& id_values = ctx->input(1);
-    const int64 value_size = id_values.shape().dim_size(1);
-    auto id_values_mat = id_values.matrix<float>();
-    const Tensor& id_dense_shape = ctx->input(2);
-    const int64 batch_size = id_dense_shape.flat<int64>()(0);
+Status GroupIdIndices(const Tensor& id_indices, int64 batch_size,
+                      BatchSegments* segments) {
+  auto id_indices_mat = id_indices.matrix<int64>();
+  if (!GroupRowsByBatch(
+          reinterpret_cast<const int64_t*>(id_indices_mat.data()),
+          id_indices_mat.dimension(1), id_indices_mat.dimension(0),
+          batch_size, segments)) {
+    return errors::InvalidArgument(
+        "id_indices contains a batch index out of [0, ", batch_size, ")");
+  }
+  return Status::OK();
+}
 
-    Tensor* reduced;
-    OP_REQUIRES_OK(ctx,
-                   ctx->allocate_output(0, {batch_size, value_size}, &reduced));
-    std::memset(reduced->data(), 0, reduced->AllocatedBytes());
-    auto reduced_mat = reduced->matrix<float>();
-    std::vector<size_t> counter(batch_size, 0);
+// Cost of reducing one batch row.
+int64 BatchRowCost(const BatchSegments& segments, int64 dim) {
+  int64 batch_size = segments.offsets.size() - 1;
+  int64 ids_per_row =
+      segments.offsets.back() / std::max<int64>(batch_size, 1);
+  return (ids_per_row + 1) * dim * 2;
+}
 
-    for (int64 i = 0; i < id_indices_mat.dimension(0); ++i) {
-      int64 batch = id_indices_mat(i, 0);
-      reduced_mat.chip<0>(batch) += id_values_mat.chip<0>(i);
-      counter[batch] += 1;
-    }
-    for (int64 i = 0; i < batch_size; ++i) {
-      float multiply = 1.0 / static_cast<float>(counter[i]);
-      for (int64 j = 0; j < value_size; ++j) {
-        reduced_mat(i, j) *= multiply;
-      }
-    }
-  }
-};
+}  // namespace
 
-// The difference between this reduce square norm and tf.sparse.segment_sqrt_n
-// is that this supports sparse values which are vectors.
-class ReduceSquareNormOp : public OpKernel {
+// The difference between these reduce ops and tf.sparse.reduce_sum,
+// tf.sparse.reduce_mean and tf.sparse.segment_sqrt_n is that they support
+// sparse values which are vectors.
+//
+// Ids are grouped by batch index first, so batch rows are reduced in parallel
+// and each output row is written by exactly one thread.
+template <SegmentReduceType kType>
+class SegmentReduceOp : public OpKernel {
  public:
-  explicit ReduceSquareNormOp(OpKernelConstruction* ctx) : OpKernel(ctx) {}
+  explicit SegmentReduceOp(OpKernelConstruction* ctx) : OpKernel(ctx) {}
 
   void Compute(OpKernelContext* ctx) override {
     const Tensor& id_indices = ctx->input(0);
-    auto id_indices_mat = id_indices.matrix<int64>();
     const Tensor& id_values = ctx->input(1);
     const int64 value_size = id_values.shape().dim_size(1);
-    auto id_values_mat = id_values.matrix<float>();
+    const float* id_values_data = id_values.matrix<float>().data();
     const Tensor& id_dense_shape = ctx->input(2);
     const int64 batch_size = id_dense_shape.flat<int64>()(0);
 
     Tensor* reduced;
     OP_REQUIRES_OK(ctx,
                    ctx->allocate_output(0, {batch_size, value_size}, &reduced));
-    std::memset(reduced->data(), 0, reduced->AllocatedBytes());
-    auto reduced_mat = reduced->matrix<float>();
-
-    for (int64 i = 0; i < id_indices_mat.dimension(0); ++i) {
-      int64 batch = id_indices_mat(i, 0);
-      for (int64 j = 0; j < value_size; ++j) {
-        reduced_mat(batch, j) += (id_values_mat(i, j) * id_values_mat(i, j));
-      }
-    }
-    for (int64 i = 0; i < batch_size; ++i) {
-      for (int64 j = 0; j < value_size; ++j) {
-        reduced_mat(i, j) = std::sqrt(reduced_mat(i, j));
-      }
-    }
+    float* reduced_data = reduced->matrix<float>().data();
+    BatchSegments segments;
+    OP_REQUIRES_OK(ctx, GroupIdIndices(id_indices, batch_size, &segments));
+    ParallelFor(ctx, batch_size, BatchRowCost(segments, value_size),
+                [&](int64 begin, int64 end) {
+                  SegmentReduce(kType, segments, id_values_data, value_size,
+                                begin, end, reduced_data);
+                });
   }
 };
 
@@ -131,19 +104,27 @@ class ReduceSumGradientOp : public OpKernel {
     const int64 len_ids = id_indices_mat.dimension(0);
     const Tensor& grads = ctx->input(1);
     auto grads_mat = grads.matrix<float>();
+    const int64 batch_size = grads_mat.dimension(0);
     const int64 grad_size = grads_mat.dimension(1);
     Tensor* id_value_grads;
     OP_REQUIRES_OK(
         ctx, ctx->allocate_output(0, {len_ids, grad_size}, &id_value_grads));
-    auto id_value_grads_flat = id_value_grads->flat<float>();
-    // Single thread is actually more efficient.
+    float* id_value_grads_data = id_value_grads->matrix<float>().data();
     for (int64 i = 0; i < len_ids; ++i) {
       int64 batch = id_indices_mat(i, 0);
-      std::memcpy(
-          static_cast<float*>(id_value_grads_flat.data()) + i * grad_size,
-          const_cast<float*>(grads_mat.data()) + batch * grad_size,
-          sizeof(float) * grad_size);
+      OP_REQUIRES(ctx, batch >= 0 && batch < batch_size,
+                  errors::InvalidArgument("Batch index ", batch,
+                                          " out of [0, ", batch_size, ")"));
     }
+    // Shard runs small inputs inline, where a single thread is faster.
+    ParallelFor(ctx, len_ids, grad_size, [&](int64 begin, int64 end) {
+      for (int64 i = begin; i < end; ++i) {
+        int64 batch = id_indices_mat(i, 0);
+        std::memcpy(id_value_grads_data + i * grad_size,
+                    grads_mat.data() + batch * grad_size,
+                    sizeof(float) * grad_size);
+      }
+    });
   }
 };
 
@@ -157,25 +138,31 @@ class ReduceMeanGradientOp : public OpKernel {
     const int64 len_ids = id_indices_mat.dimension(0);
     const Tensor& grads = ctx->input(1);
     auto grads_mat = grads.matrix<float>();
+    const int64 batch_size = grads_mat.dimension(0);
     const int64 grad_size = grads_mat.dimension(1);
     Tensor* id_value_grads;
     OP_REQUIRES_OK(
         ctx, ctx->allocate_output(0, {len_ids, grad_size}, &id_value_grads));
-    auto id_value_grads_mat = id_value_grads->matrix<float>();
-    // grad_size equals to indices's batch size.
-    std::vector<size_t> counter(grad_size, 0);
+    float* id_value_grads_data = id_value_grads->matrix<float>().data();
+    std::vector<int64> counter(batch_size, 0);
     for (int64 i = 0; i < len_ids; ++i) {
       int64 batch = id_indices_mat(i, 0);
+      OP_REQUIRES(ctx, batch >= 0 && batch < batch_size,
+                  errors::InvalidArgument("Batch index ", batch,
+                                          " out of [0, ", batch_size, ")"));
       counter[batch] += 1;
     }
 
-    for (int64 i = 0; i < len_ids; ++i) {
-      int64 batch = id_indices_mat(i, 0);
-      float multiply = 1.0 / static_cast<float>(counter[batch]);
-      for (int64 j = 0; j < grad_size; ++j) {
-        id_value_grads_mat(i, j) = grads_mat(batch, j) * multiply;
+    ParallelFor(ctx, len_ids, grad_size * 2, [&](int64 begin, int64 end) {
+      for (int64 i = begin; i < end; ++i) {
+        int64 batch = id_indices_mat(i, 0);
+        float* out = id_value_grads_data + i * grad_size;
+        std::memcpy(out, grads_mat.data() + batch * grad_size,
+                    sizeof(float) * grad_size);
+        ::monolith::hash_table::Scale(
+            out, 1.0f / static_cast<float>(counter[batch]), grad_size);
       }
-    }
+    });
   }
 };
 
@@ -189,7 +176,7 @@ class ReduceSquareNormGradientOp : public OpKernel {
     auto id_indices_mat = id_indices.matrix<int64>();
     const int64 len_ids = id_indices_mat.dimension(0);
     const Tensor& id_values = ctx->input(1);
-    auto id_values_mat = id_values.matrix<float>();
+    const float* id_values_data = id_values.matrix<float>().data();
     const Tensor& grads = ctx->input(2);
     auto grads_mat = grads.matrix<float>();
     const int64 batch_size = grads_mat.dimension(0);
@@ -197,34 +184,34 @@ class ReduceSquareNormGradientOp : public OpKernel {
     Tensor* id_value_grads;
     OP_REQUIRES_OK(
         ctx, ctx->allocate_output(0, {len_ids, grad_size}, &id_value_grads));
-    auto id_value_grads_mat = id_value_grads->matrix<float>();
+    float* id_value_grads_data = id_value_grads->matrix<float>().data();
 
+    BatchSegments segments;
+    OP_REQUIRES_OK(ctx, GroupIdIndices(id_indices, batch_size, &segments));
     Tensor reduced_values(DT_FLOAT, TensorShape({batch_size, grad_size}));
-    std::memset(reduced_values.data(), 0, reduced_values.AllocatedBytes());
-    auto reduced_mat = reduced_values.matrix<float>();
-
-    for (int64 i = 0; i < len_ids; ++i) {
-      int64 batch = id_indices_mat(i, 0);
-      for (int64 j = 0; j < grad_size; ++j) {
-        reduced_mat(batch, j) += (id_values_mat(i, j) * id_values_mat(i, j));
-      }
-    }
-    for (int64 i = 0; i < batch_size; ++i) {
-      for (int64 j = 0; j < grad_size; ++j) {
-        reduced_mat(i, j) = std::sqrt(reduced_mat(i, j));
-      }
-    }
-
-    for (int64 i = 0; i < len_ids; ++i) {
-      int64 batch = id_indices_mat(i, 0);
-      for (int64 j = 0; j < grad_size; ++j) {
-        // dl/dx = x/sqrt(sum(x)) * dl/dy
-        float multiply = (reduced_mat(batch, j) == 0)
-                             ? 0.0
-                             : id_values_mat(i, j) / reduced_mat(batch, j);
-        id_value_grads_mat(i, j) = grads_mat(batch, j) * multiply;
-      }
-    }
+    float* reduced_data = reduced_values.matrix<float>().data();
+    // Every batch row computes its norm and then the gradients of its ids.
+    ParallelFor(
+        ctx, batch_size, BatchRowCost(segments, grad_size) * 2,
+        [&](int64 begin, int64 end) {
+          SegmentReduce(SegmentReduceType::kSquareNorm, segments,
+                        id_values_data, grad_size, begin, end, reduced_data);
+          for (int64 b = begin; b < end; ++b) {
+            const float* norm = reduced_data + b * grad_size;
+            const float* grad = grads_mat.data() + b * grad_size;
+            for (int64 k = segments.offsets[b]; k < segments.offsets[b + 1];
+                 ++k) {
+              int64 i = segments.row(k);
+              const float* x = id_values_data + i * grad_size;
+              float* out = id_value_grads_data + i * grad_size;
+              for (int64 j = 0; j < grad_size; ++j) {
+                // dl/dx = x/sqrt(sum(x)) * dl/dy
+                float multiply = (norm[j] == 0) ? 0.0 : x[j] / norm[j];
+                out[j] = grad[j] * multiply;
+              }
+            }
+          }
+        });
   }
 };
 
@@ -238,37 +225,43 @@ class ReduceSumAndSplitOp : public OpKernel {
 
   void Compute(OpKernelContext* ctx) override {
     const Tensor& id_indices = ctx->input(0);
-    auto id_indices_mat = id_indices.matrix<int64>();
     const Tensor& id_values = ctx->input(1);
     const int64 value_size = id_values.shape().dim_size(1);
-    auto id_values_mat = id_values.matrix<float>();
+    const float* id_values_data = id_values.matrix<float>().data();
     const Tensor& id_dense_shape = ctx->input(2);
     const int64 batch_size = id_dense_shape.flat<int64>()(0);
 
-    std::vector<Tensor*> reduced_list(M_);
+    std::vector<float*> reduced_list(M_);
     for (int i = 0; i < M_; ++i) {
-      OP_REQUIRES_OK(ctx,
-                     ctx->allocate_output(i, {batch_size, split_dims_[i]},
-                                          &reduced_list[i]));
-      std::memset(reduced_list[i]->data(), 0,
-                  reduced_list[i]->AllocatedBytes());
-    }
-
-    for (int64 i = 0; i < id_indices_mat.dimension(0); ++i) {
-      int64 batch = id_indices_mat(i, 0);
-      int emb_offset = 0;
-      for (int j = 0; j < M_; ++j) {
-        auto reduced_mat = reduced_list[j]->matrix<float>();
-        int embedding_dim = split_dims_[j];
-        float* input_a = const_cast<float*>(id_values_mat.data()) +
-                         i * value_size + emb_offset;
-        float* output_b =
-            static_cast<float*>(reduced_mat.data()) + batch * split_dims_[j];
-        ::monolith::hash_table::ReduceSum(input_a, output_b, output_b,
-                                          split_dims_[j]);
-        emb_offset += split_dims_[j];
-      }
+      Tensor* reduced;
+      OP_REQUIRES_OK(ctx, ctx->allocate_output(
+                              i, {batch_size, split_dims_[i]}, &reduced));
+      reduced_list[i] = reduced->matrix<float>().data();
     }
+    BatchSegments segments;
+    OP_REQUIRES_OK(ctx, GroupIdIndices(id_indices, batch_size, &segments));
+
+    ParallelFor(
+        ctx, batch_size, BatchRowCost(segments, value_size),
+        [&](int64 begin, int64 end) {
+          for (int64 b = begin; b < end; ++b) {
+            for (int j = 0; j < M_; ++j) {
+              std::memset(reduced_list[j] + b * split_dims_[j], 0,
+                          sizeof(float) * split_dims_[j]);
+            }
+            for (int64 k = segments.offsets[b]; k < segments.offsets[b + 1];
+                 ++k) {
+              const float* input_a =
+                  id_values_data + segments.row(k) * value_size;
+              for (int j = 0; j < M_; ++j) {
+                float* output_b = reduced_list[j] + b * split_dims_[j];
+                ::monolith::hash_table::ReduceSum(input_a, output_b, output_b,
+                                                  split_dims_[j]);
+                input_a += split_dims_[j];
+              }
+            }
+          }
+        });
   }
 
  private:
@@ -295,23 +288,24 @@ class ReduceSumAndSplitGradientOp : public OpKernel {
     Tensor* id_value_grads;
     OP_REQUIRES_OK(
         ctx, ctx->allocate_output(0, {len_ids, grad_dim_}, &id_value_grads));
-    auto id_value_grads_flat = id_value_grads->flat<float>();
-    int offset = 0;
+    float* id_value_grads_data = id_value_grads->matrix<float>().data();
+    std::vector<const float*> grads_list(M_);
     for (int i = 0; i < M_; ++i) {
       const Tensor& grads = ctx->input(i + 1);
-      auto grads_mat = grads.matrix<float>();
-      const int64 grad_size = grads_mat.dimension(1);
-      CHECK(grad_size == split_dims_[i]);
-      auto block_size = sizeof(float) * grad_size;
-      for (int64 j = 0; j < len_ids; ++j) {
+      CHECK(grads.dim_size(1) == split_dims_[i]);
+      grads_list[i] = grads.matrix<float>().data();
+    }
+    ParallelFor(ctx, len_ids, grad_dim_, [&](int64 begin, int64 end) {
+      for (int64 j = begin; j < end; ++j) {
         int64 batch = id_indices_mat(j, 0);
-        std::memcpy(static_cast<float*>(id_value_grads_flat.data()) +
-                        j * grad_dim_ + offset,
-                    const_cast<float*>(grads_mat.data()) + batch * grad_size,
-                    block_size);
+        float* out = id_value_grads_data + j * grad_dim_;
+        for (int i = 0; i < M_; ++i) {
+          std::memcpy(out, grads_list[i] + batch * split_dims_[i],
+                      sizeof(float) * split_dims_[i]);
+          out += split_dims_[i];
+        }
       }
-      offset += grad_size;
-    }
+    });
   }
 
  private:
@@ -425,11 +419,11 @@ REGISTER_OP("MonolithFusedReduceSumAndSplitGradient")
     .SetShapeFn(FusedGradientReduceShape);
 
 REGISTER_KERNEL_BUILDER(Name("MonolithReduceSum").Device(DEVICE_CPU),
-                        ReduceSumOp);
+                        SegmentReduceOp<SegmentReduceType::kSum>);
 REGISTER_KERNEL_BUILDER(Name("MonolithReduceMean").Device(DEVICE_CPU),
-                        ReduceMeanOp);
+                        SegmentReduceOp<SegmentReduceType::kMean>);
 REGISTER_KERNEL_BUILDER(Name("MonolithReduceSquareNorm").Device(DEVICE_CPU),
-                        ReduceSquareNormOp);
+                        SegmentReduceOp<SegmentReduceType::kSquareNorm>);
 REGISTER_KERNEL_BUILDER(
     Name("MonolithFusedReduceSumAndSplit").Device(DEVICE_CPU),
     ReduceSumAndSplitOp);
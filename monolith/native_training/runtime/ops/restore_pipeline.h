@@ -0,0 +1,364 @@
+// Copyright 2022 ByteDance and/or its affiliates.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MONOLITH_NATIVE_TRAINING_RUNTIME_OPS_RESTORE_PIPELINE_H_
+#define MONOLITH_NATIVE_TRAINING_RUNTIME_OPS_RESTORE_PIPELINE_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "absl/synchronization/mutex.h"
+#include "absl/types/span.h"
+#include "tensorflow/core/platform/errors.h"
+#include "tensorflow/core/platform/status.h"
+#include "tensorflow/core/platform/threadpool.h"
+
+namespace tensorflow {
+namespace monolith_tf {
+
+// All restore pipelines of the process together hold at most this many
+// batches, besides the first batch of each pipeline.
+constexpr int kMaxRestoreBatchesInFlight = 256;
+
+// The number of batches held by the restore pipelines of the process.
+inline std::atomic_int* RestoreBatchesInFlight() {
+  static std::atomic_int batches(0);
+  return &batches;
+}
+
+// Restores a table from several record streams (e.g. checkpoint files) in
+// batches, each read from a stream, parsed and inserted by tasks on a thread
+// pool shared with the caller. A stream is read in order by one task at a
+// time, while the batches read before are parsed and inserted. The batches in
+// flight are bounded per pipeline and for the process, so a slow insert stalls
+// the reads instead of buffering whole files. Batches, with the records and
+// entries in them, are recycled.
+//
+// Tasks never wait on a pool thread, and the thread calling Run runs tasks
+// too, so the pipeline makes progress however busy the pool is.
+//
+// After the first error, the remaining batches are dropped and the streams
+// which are not started yet are not read.
+template <typename Record, typename Entry>
+class RestorePipeline {
+ public:
+  struct Options {
+    // The number of tasks running at once, including the calling thread.
+    int num_threads = 1;
+    // The number of streams read at once.
+    int num_read_streams = 1;
+    int batch_size = 1024;
+    // Batches of this pipeline, read but not inserted yet.
+    int max_pending_batches = 16;
+
+    // Reading mostly waits for IO, so a quarter of the threads read.
+    static Options ForNumThreads(int num_threads) {
+      Options options;
+      options.num_threads = std::max(1, num_threads);
+      options.num_read_streams = std::max(1, num_threads / 4);
+      options.max_pending_batches = 2 * options.num_threads;
+      return options;
+    }
+  };
+
+  // Reads the next record of `stream` into *record, returns OutOfRange at the
+  // end of the stream. A stream is read in order, by one task at a time.
+  using ReadFn = std::function<Status(int stream, Record* record)>;
+  // Parses *record into *entry, and sets *keep to false to drop the record.
+  using ParseFn =
+      std::function<Status(Record* record, Entry* entry, bool* keep)>;
+  // Inserts the entries of one batch. `thread` is in [0, num_threads), and
+  // no two inserts with the same `thread` run at once.
+  using InsertFn =
+      std::function<Status(int thread, absl::Span<Entry> entries)>;
+
+  RestorePipeline(int num_streams, ReadFn read_fn, ParseFn parse_fn,
+                  InsertFn insert_fn, const Options& options,
+                  thread::ThreadPool* pool)
+      : num_streams_(num_streams),
+        read_fn_(std::move(read_fn)),
+        parse_fn_(std::move(parse_fn)),
+        insert_fn_(std::move(insert_fn)),
+        options_(options),
+        pool_(pool),
+        gate_(std::make_shared<Gate>(this)) {
+    options_.num_threads = std::max(options_.num_threads, 1);
+    if (pool_ == nullptr) {
+      options_.num_threads = 1;
+    }
+    options_.num_read_streams = std::max(options_.num_read_streams, 1);
+    options_.batch_size = std::max(options_.batch_size, 1);
+    options_.max_pending_batches = std::max(options_.max_pending_batches, 1);
+    // The calling thread is worker 0.
+    for (int i = options_.num_threads - 1; i > 0; --i) {
+      idle_workers_.push_back(i);
+    }
+  }
+
+  RestorePipeline(const RestorePipeline&) = delete;
+  RestorePipeline& operator=(const RestorePipeline&) = delete;
+
+  // Runs all streams through the pipeline, blocks until they are done and
+  // returns the first error.
+  Status Run() {
+    Status status;
+    {
+      absl::MutexLock l(&mu_);
+      StartReads();
+      ScheduleWorkers();
+      while (true) {
+        while (ready_.empty() && !Done()) {
+          cv_.Wait(&mu_);
+        }
+        if (ready_.empty()) {
+          break;
+        }
+        RunTask(0);
+      }
+      status = status_;
+    }
+    // Waits for the workers running, the ones which did not start yet find
+    // the pipeline gone.
+    absl::MutexLock l(&gate_->mu);
+    gate_->pipeline = nullptr;
+    return status;
+  }
+
+ private:
+  struct Batch {
+    std::vector<Record> records;
+    int64_t num_records = 0;
+    std::vector<Entry> entries;
+  };
+
+  // Reads the next batch of stream, or parses and inserts batch.
+  struct Task {
+    int stream;
+    Batch* batch;
+    bool read;
+  };
+
+  // The pipeline of the workers scheduled on the pool, which may run after
+  // Run returns.
+  struct Gate {
+    explicit Gate(RestorePipeline* pipeline) : pipeline(pipeline) {}
+
+    absl::Mutex mu;
+    RestorePipeline* pipeline ABSL_GUARDED_BY(mu);
+  };
+
+  bool Done() const ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    const bool all_read =
+        num_read_streams_ == 0 && next_stream_ == num_streams_;
+    return ready_.empty() && num_running_ == 0 && (failed_ || all_read);
+  }
+
+  static void Work(const std::shared_ptr<Gate>& gate, int worker) {
+    absl::ReaderMutexLock gate_lock(&gate->mu);
+    RestorePipeline* pipeline = gate->pipeline;
+    if (pipeline == nullptr) {
+      return;
+    }
+    // Runs the ready tasks on worker, then gives it back.
+    absl::MutexLock l(&pipeline->mu_);
+    while (!pipeline->ready_.empty()) {
+      pipeline->RunTask(worker);
+    }
+    pipeline->idle_workers_.push_back(worker);
+  }
+
+  void RunTask(int worker) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    Task task = ready_.front();
+    ready_.pop_front();
+    ++num_running_;
+    mu_.Unlock();
+    Status s;
+    if (task.read) {
+      s = Read(task.stream, task.batch);
+    } else {
+      s = ParseAndInsert(worker, task.batch);
+    }
+    mu_.Lock();
+    --num_running_;
+    if (task.read && s.ok()) {
+      waiting_streams_.push_back(task.stream);
+    } else if (task.read && errors::IsOutOfRange(s)) {
+      --num_read_streams_;
+    } else if (!s.ok()) {
+      Fail(s);
+    }
+    if (task.read && !failed_ && task.batch->num_records > 0) {
+      Push({task.stream, task.batch, /*read=*/false});
+    } else {
+      ReleaseBatch(task.batch);
+    }
+    StartReads();
+    ScheduleWorkers();
+    cv_.SignalAll();
+  }
+
+  // Fills batch with the next records of stream, returns OutOfRange at the
+  // end of it.
+  Status Read(int stream, Batch* batch) {
+    batch->records.resize(options_.batch_size);
+    batch->num_records = 0;
+    while (batch->num_records < options_.batch_size) {
+      if (failed_.load(std::memory_order_relaxed)) {
+        return errors::Cancelled("Restore failed");
+      }
+      TF_RETURN_IF_ERROR(read_fn_(stream, &batch->records[batch->num_records]));
+      ++batch->num_records;
+    }
+    return Status::OK();
+  }
+
+  Status ParseAndInsert(int worker, Batch* batch) {
+    if (failed_.load(std::memory_order_relaxed)) {
+      return Status::OK();
+    }
+    if (batch->entries.size() < batch->records.size()) {
+      batch->entries.resize(batch->records.size());
+    }
+    int64_t num_entries = 0;
+    for (int64_t i = 0; i < batch->num_records; ++i) {
+      bool keep = true;
+      TF_RETURN_IF_ERROR(
+          parse_fn_(&batch->records[i], &batch->entries[num_entries], &keep));
+      num_entries += keep;
+    }
+    if (num_entries == 0) {
+      return Status::OK();
+    }
+    return insert_fn_(worker,
+                      absl::MakeSpan(batch->entries.data(), num_entries));
+  }
+
+  // Starts the streams allowed, and the reads of the streams waiting for a
+  // batch.
+  void StartReads() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    if (failed_) {
+      waiting_streams_.clear();
+      return;
+    }
+    while (num_read_streams_ < options_.num_read_streams &&
+           next_stream_ < num_streams_) {
+      waiting_streams_.push_back(next_stream_++);
+      ++num_read_streams_;
+    }
+    while (!waiting_streams_.empty()) {
+      Batch* batch = AcquireBatch();
+      if (batch == nullptr) {
+        // One of the batches in flight is released later.
+        return;
+      }
+      Push({waiting_streams_.front(), batch, /*read=*/true});
+      waiting_streams_.pop_front();
+    }
+  }
+
+  // Returns nullptr if the pipeline or the process holds enough batches. A
+  // pipeline always gets its first one.
+  Batch* AcquireBatch() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    if (num_batches_ >= options_.max_pending_batches) {
+      return nullptr;
+    }
+    const int in_flight = RestoreBatchesInFlight()->fetch_add(1);
+    if (num_batches_ > 0 && in_flight >= kMaxRestoreBatchesInFlight) {
+      RestoreBatchesInFlight()->fetch_sub(1);
+      return nullptr;
+    }
+    ++num_batches_;
+    if (free_batches_.empty()) {
+      batches_.push_back(std::make_unique<Batch>());
+      return batches_.back().get();
+    }
+    Batch* batch = free_batches_.back();
+    free_batches_.pop_back();
+    return batch;
+  }
+
+  void ReleaseBatch(Batch* batch) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    --num_batches_;
+    RestoreBatchesInFlight()->fetch_sub(1);
+    free_batches_.push_back(batch);
+  }
+
+  // Queues task, for an idle worker of the pool if there is one.
+  void Push(Task task) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    ready_.push_back(task);
+    if (!idle_workers_.empty()) {
+      new_workers_.push_back(idle_workers_.back());
+      idle_workers_.pop_back();
+    }
+  }
+
+  // Schedules the workers taken by Push. The pool may run a closure inline,
+  // so it is called without the lock.
+  void ScheduleWorkers() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    while (!new_workers_.empty()) {
+      std::vector<int> workers;
+      workers.swap(new_workers_);
+      mu_.Unlock();
+      for (int worker : workers) {
+        pool_->Schedule([gate = gate_, worker]() { Work(gate, worker); });
+      }
+      mu_.Lock();
+    }
+  }
+
+  void Fail(const Status& s) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    if (status_.ok()) {
+      status_ = s;
+    }
+    failed_ = true;
+  }
+
+  const int num_streams_;
+  ReadFn read_fn_;
+  ParseFn parse_fn_;
+  InsertFn insert_fn_;
+  Options options_;
+  thread::ThreadPool* const pool_;
+  const std::shared_ptr<Gate> gate_;
+
+  absl::Mutex mu_;
+  absl::CondVar cv_;
+  // Read by the tasks without the lock, to stop early.
+  std::atomic_bool failed_{false};
+  Status status_ ABSL_GUARDED_BY(mu_);
+  std::deque<Task> ready_ ABSL_GUARDED_BY(mu_);
+  int num_running_ ABSL_GUARDED_BY(mu_) = 0;
+  // The workers of the pool not scheduled.
+  std::vector<int> idle_workers_ ABSL_GUARDED_BY(mu_);
+  std::vector<int> new_workers_ ABSL_GUARDED_BY(mu_);
+  // Streams started and not finished yet, and the next one to start.
+  int num_read_streams_ ABSL_GUARDED_BY(mu_) = 0;
+  int next_stream_ ABSL_GUARDED_BY(mu_) = 0;
+  // Streams whose next read waits for a batch.
+  std::deque<int> waiting_streams_ ABSL_GUARDED_BY(mu_);
+  int num_batches_ ABSL_GUARDED_BY(mu_) = 0;
+  std::vector<std::unique_ptr<Batch>> batches_ ABSL_GUARDED_BY(mu_);
+  std::vector<Batch*> free_batches_ ABSL_GUARDED_BY(mu_);
+};
+
+}  // namespace monolith_tf
+}  // namespace tensorflow
+
+#endif  // MONOLITH_NATIVE_TRAINING_RUNTIME_OPS_RESTORE_PIPELINE_H_
@@ -0,0 +1,220 @@
+// Copyright 2022 ByteDance and/or its affiliates.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "monolith/native_training/runtime/ops/restore_pipeline.h"
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+#include "absl/synchronization/mutex.h"
+#include "absl/synchronization/notification.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/threadpool.h"
+
+namespace tensorflow {
+namespace monolith_tf {
+namespace {
+
+using ::testing::ElementsAreArray;
+
+using Pipeline = RestorePipeline<int64_t, int64_t>;
+
+// Stream s has the records s * 1000 + [0, sizes[s]).
+class FakeStreams {
+ public:
+  explicit FakeStreams(std::vector<int64_t> sizes)
+      : sizes_(std::move(sizes)), next_(sizes_.size(), 0) {}
+
+  Status Read(int stream, int64_t* record) {
+    if (next_[stream] == sizes_[stream]) {
+      return errors::OutOfRange("End of stream ", stream);
+    }
+    *record = stream * 1000 + next_[stream]++;
+    return Status::OK();
+  }
+
+  int num_streams() const { return sizes_.size(); }
+
+ private:
+  std::vector<int64_t> sizes_;
+  std::vector<int64_t> next_;
+};
+
+TEST(RestorePipelineTest, InsertsKeptRecords) {
+  // Fewer pool threads than tasks, the calling thread runs them too.
+  thread::ThreadPool pool(Env::Default(), "restore", 2);
+  for (int num_threads : {1, 3, 8}) {
+    FakeStreams streams({0, 5, 2500, 1, 1024, 700});
+    std::vector<int64_t> expected;
+    for (int s = 0; s < streams.num_streams(); ++s) {
+      FakeStreams copy = streams;
+      int64_t record;
+      while (copy.Read(s, &record).ok()) {
+        if (record % 3 != 0) expected.push_back(record * 2);
+      }
+    }
+    absl::Mutex mu;
+    std::vector<int64_t> inserted;
+    Pipeline::Options options;
+    options.num_threads = num_threads;
+    options.num_read_streams = num_threads;
+    options.batch_size = 128;
+    Pipeline pipeline(
+        streams.num_streams(),
+        [&streams](int stream, int64_t* record) {
+          return streams.Read(stream, record);
+        },
+        [](int64_t* record, int64_t* entry, bool* keep) {
+          *entry = *record * 2;
+          *keep = *record % 3 != 0;
+          return Status::OK();
+        },
+        [&](int thread, absl::Span<int64_t> entries) {
+          EXPECT_LE(entries.size(), 128);
+          EXPECT_GE(thread, 0);
+          EXPECT_LT(thread, num_threads);
+          absl::MutexLock l(&mu);
+          inserted.insert(inserted.end(), entries.begin(), entries.end());
+          return Status::OK();
+        },
+        options, &pool);
+    TF_EXPECT_OK(pipeline.Run());
+    EXPECT_EQ(RestoreBatchesInFlight()->load(), 0);
+    std::sort(expected.begin(), expected.end());
+    std::sort(inserted.begin(), inserted.end());
+    EXPECT_THAT(inserted, ElementsAreArray(expected));
+  }
+}
+
+TEST(RestorePipelineTest, BatchesInFlightAreBounded) {
+  thread::ThreadPool pool(Env::Default(), "restore", 4);
+  FakeStreams streams({5000, 5000, 5000, 5000});
+  Pipeline::Options options;
+  options.num_threads = 4;
+  options.num_read_streams = 4;
+  options.batch_size = 16;
+  options.max_pending_batches = 3;
+  // Records read and not inserted yet.
+  std::atomic_int pending(0);
+  std::atomic_int max_pending(0);
+  absl::Mutex mu;
+  Pipeline pipeline(
+      streams.num_streams(),
+      [&](int stream, int64_t* record) {
+        Status s;
+        {
+          absl::MutexLock l(&mu);
+          s = streams.Read(stream, record);
+        }
+        if (s.ok()) {
+          int n = pending.fetch_add(1) + 1;
+          int max = max_pending.load();
+          while (n > max && !max_pending.compare_exchange_weak(max, n)) {
+          }
+        }
+        return s;
+      },
+      [](int64_t* record, int64_t* entry, bool* keep) {
+        *entry = *record;
+        return Status::OK();
+      },
+      [&](int thread, absl::Span<int64_t> entries) {
+        pending.fetch_sub(entries.size());
+        return Status::OK();
+      },
+      options, &pool);
+  TF_EXPECT_OK(pipeline.Run());
+  EXPECT_EQ(pending.load(), 0);
+  EXPECT_LE(max_pending.load(), 3 * 16);
+  EXPECT_EQ(RestoreBatchesInFlight()->load(), 0);
+}
+
+TEST(RestorePipelineTest, RunsOnBusyPool) {
+  // As an op restoring on the only worker thread, the workers scheduled on
+  // the pool can not start before Run returns.
+  thread::ThreadPool pool(Env::Default(), "restore", 1);
+  FakeStreams streams({300, 200, 100});
+  Pipeline::Options options;
+  options.num_threads = 4;
+  options.num_read_streams = 2;
+  options.batch_size = 16;
+  int64_t num_inserted = 0;
+  Status status;
+  absl::Notification done;
+  pool.Schedule([&]() {
+    Pipeline pipeline(
+        streams.num_streams(),
+        [&streams](int stream, int64_t* record) {
+          return streams.Read(stream, record);
+        },
+        [](int64_t* record, int64_t* entry, bool* keep) {
+          *entry = *record;
+          return Status::OK();
+        },
+        [&num_inserted](int thread, absl::Span<int64_t> entries) {
+          EXPECT_EQ(thread, 0);
+          num_inserted += entries.size();
+          return Status::OK();
+        },
+        options, &pool);
+    status = pipeline.Run();
+    done.Notify();
+  });
+  done.WaitForNotification();
+  TF_EXPECT_OK(status);
+  EXPECT_EQ(num_inserted, 600);
+}
+
+TEST(RestorePipelineTest, Errors) {
+  thread::ThreadPool pool(Env::Default(), "restore", 4);
+  Pipeline::Options options;
+  options.num_threads = 4;
+  options.num_read_streams = 5;
+  options.batch_size = 16;
+  options.max_pending_batches = 4;
+  auto read_fn = [](int stream, int64_t* record) {
+    *record = 1;
+    return stream == 3 ? errors::DataLoss("read") : Status::OK();
+  };
+  auto parse_fn = [](int64_t* record, int64_t* entry, bool* keep) {
+    return Status::OK();
+  };
+  auto insert_fn = [](int thread, absl::Span<int64_t> entries) {
+    return errors::Internal("insert");
+  };
+  // Endless streams, the first error must stop all of them.
+  Pipeline read_error(5, read_fn, parse_fn,
+                      [](int thread, absl::Span<int64_t> entries) {
+                        return Status::OK();
+                      },
+                      options, &pool);
+  EXPECT_EQ(read_error.Run().code(), error::DATA_LOSS);
+  Pipeline insert_error(
+      5,
+      [](int stream, int64_t* record) {
+        *record = 1;
+        return Status::OK();
+      },
+      parse_fn, insert_fn, options, &pool);
+  EXPECT_EQ(insert_error.Run().code(), error::INTERNAL);
+  EXPECT_EQ(RestoreBatchesInFlight()->load(), 0);
+}
+
+}  // namespace
+}  // namespace monolith_tf
+}  // namespace tensorflow
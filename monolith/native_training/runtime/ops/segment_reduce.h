@@ -0,0 +1,119 @@
+// Copyright 2022 ByteDance and/or its affiliates.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef MONOLITH_NATIVE_TRAINING_RUNTIME_OPS_SEGMENT_REDUCE_H_
+#define MONOLITH_NATIVE_TRAINING_RUNTIME_OPS_SEGMENT_REDUCE_H_
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "monolith/native_training/runtime/hash_table/optimizer/avx_utils.h"
+
+namespace tensorflow {
+namespace monolith_tf {
+
+// Rows of a sparse id tensor grouped by their batch index: the rows of batch b
+// are row(offsets[b]) ... row(offsets[b + 1] - 1), in their original order.
+// Reducing batch rows independently lets threads split the batch without ever
+// writing the same output row.
+struct BatchSegments {
+  std::vector<int64_t> offsets;
+  // Empty if the rows were already sorted by batch, as in a canonical
+  // SparseTensor, then row(k) == k.
+  std::vector<int64_t> rows;
+
+  int64_t size(int64_t batch) const {
+    return offsets[batch + 1] - offsets[batch];
+  }
+
+  int64_t row(int64_t k) const { return rows.empty() ? k : rows[k]; }
+};
+
+// Groups the nnz rows of indices (row major, `stride` columns, the batch
+// index in column 0) by a stable counting sort. Returns false if a batch
+// index is out of [0, batch_size).
+inline bool GroupRowsByBatch(const int64_t* indices, int64_t stride,
+                             int64_t nnz, int64_t batch_size,
+                             BatchSegments* segments) {
+  segments->offsets.assign(batch_size + 1, 0);
+  segments->rows.clear();
+  bool sorted = true;
+  for (int64_t i = 0; i < nnz; ++i) {
+    int64_t batch = indices[i * stride];
+    if (batch < 0 || batch >= batch_size) {
+      return false;
+    }
+    sorted = sorted && (i == 0 || indices[(i - 1) * stride] <= batch);
+    ++segments->offsets[batch + 1];
+  }
+  for (int64_t b = 0; b < batch_size; ++b) {
+    segments->offsets[b + 1] += segments->offsets[b];
+  }
+  if (sorted) {
+    return true;
+  }
+  segments->rows.resize(nnz);
+  std::vector<int64_t> next(segments->offsets.begin(),
+                            segments->offsets.end() - 1);
+  for (int64_t i = 0; i < nnz; ++i) {
+    segments->rows[next[indices[i * stride]]++] = i;
+  }
+  return true;
+}
+
+enum class SegmentReduceType { kSum, kMean, kSquareNorm };
+
+// Computes output rows [begin, end) of a segment reduction of values
+// ([nnz, dim]) into output ([batch_size, dim]). The mean scaling and the
+// square root are applied while the row is still in cache.
+inline void SegmentReduce(SegmentReduceType type,
+                          const BatchSegments& segments, const float* values,
+                          int64_t dim, int64_t begin, int64_t end,
+                          float* output) {
+  for (int64_t b = begin; b < end; ++b) {
+    float* out = output + b * dim;
+    std::memset(out, 0, sizeof(float) * dim);
+    const int64_t first = segments.offsets[b];
+    const int64_t n = segments.size(b);
+    switch (type) {
+      case SegmentReduceType::kSum:
+      case SegmentReduceType::kMean:
+        for (int64_t i = 0; i < n; ++i) {
+          ::monolith::hash_table::ReduceSum(values + segments.row(first + i) * dim,
+                                            out, out,
+                                            dim);
+        }
+        if (type == SegmentReduceType::kMean) {
+          // Like before, an empty batch row is 0 / 0.
+          ::monolith::hash_table::Scale(out, 1.0f / static_cast<float>(n),
+                                        dim);
+        }
+        break;
+      case SegmentReduceType::kSquareNorm:
+        for (int64_t i = 0; i < n; ++i) {
+          ::monolith::hash_table::ReduceSquareSum(
+              values + segments.row(first + i) * dim, out, dim);
+        }
+        ::monolith::hash_table::Sqrt(out, dim);
+        break;
+    }
+  }
+}
+
+}  // namespace monolith_tf
+}  // namespace tensorflow
+
+#endif  // MONOLITH_NATIVE_TRAINING_RUNTIME_OPS_SEGMENT_REDUCE_H_
@@ -0,0 +1,116 @@
+// Copyright 2022 ByteDance and/or its affiliates.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <vector>
+
+#include "absl/random/random.h"
+#include "benchmark/benchmark.h"
+#include "monolith/native_training/runtime/concurrency/thread_pool.h"
+#include "monolith/native_training/runtime/ops/segment_reduce.h"
+
+namespace tensorflow {
+namespace monolith_tf {
+namespace {
+
+struct Input {
+  Input(int64_t nnz, int64_t dim, int64_t batch_size)
+      : indices(nnz * 2), values(nnz * dim), output(batch_size * dim) {
+    absl::BitGen bit_gen;
+    std::vector<int64_t> batches(nnz);
+    for (int64_t& batch : batches) {
+      batch = absl::Uniform<int64_t>(bit_gen, 0, batch_size);
+    }
+    // Sorted by batch, like the indices of a SparseTensor.
+    std::sort(batches.begin(), batches.end());
+    for (int64_t i = 0; i < nnz; ++i) {
+      indices[i * 2] = batches[i];
+      indices[i * 2 + 1] = i;
+    }
+    for (float& v : values) {
+      v = absl::Uniform<float>(bit_gen, -1.f, 1.f);
+    }
+  }
+
+  std::vector<int64_t> indices;
+  std::vector<float> values;
+  std::vector<float> output;
+};
+
+// The per id scatter loop the reduce ops used before.
+void BM_ScatterReduceSum(benchmark::State& state) {  // NOLINT
+  int64_t nnz = state.range(0), dim = state.range(1), batch = state.range(2);
+  Input input(nnz, dim, batch);
+  for (auto _ : state) {
+    std::fill(input.output.begin(), input.output.end(), 0);
+    for (int64_t i = 0; i < nnz; ++i) {
+      float* out = input.output.data() + input.indices[i * 2] * dim;
+      const float* value = input.values.data() + i * dim;
+      for (int64_t j = 0; j < dim; ++j) {
+        out[j] += value[j];
+      }
+    }
+    benchmark::DoNotOptimize(input.output.data());
+  }
+  state.SetItemsProcessed(state.iterations() * nnz);
+}
+
+void BM_SegmentReduceSum(benchmark::State& state) {  // NOLINT
+  int64_t nnz = state.range(0), dim = state.range(1), batch = state.range(2);
+  Input input(nnz, dim, batch);
+  BatchSegments segments;
+  for (auto _ : state) {
+    GroupRowsByBatch(input.indices.data(), 2, nnz, batch, &segments);
+    SegmentReduce(SegmentReduceType::kSum, segments, input.values.data(), dim,
+                  0, batch, input.output.data());
+    benchmark::DoNotOptimize(input.output.data());
+  }
+  state.SetItemsProcessed(state.iterations() * nnz);
+}
+
+void BM_ParallelSegmentReduceSum(benchmark::State& state) {  // NOLINT
+  int64_t nnz = state.range(0), dim = state.range(1), batch = state.range(2);
+  Input input(nnz, dim, batch);
+  BatchSegments segments;
+  monolith::concurrency::ThreadPool thread_pool(8);
+  for (auto _ : state) {
+    GroupRowsByBatch(input.indices.data(), 2, nnz, batch, &segments);
+    thread_pool.ParallelFor(batch, 16, [&](int64_t begin, int64_t end) {
+      SegmentReduce(SegmentReduceType::kSum, segments, input.values.data(),
+                    dim, begin, end, input.output.data());
+    });
+    benchmark::DoNotOptimize(input.output.data());
+  }
+  state.SetItemsProcessed(state.iterations() * nnz);
+}
+
+void Args(benchmark::internal::Benchmark* b) {
+  for (int64_t nnz : {1 << 12, 1 << 16}) {
+    for (int64_t dim : {8, 32, 128}) {
+      for (int64_t batch : {256, 4096}) {
+        b->Args({nnz, dim, batch});
+      }
+    }
+  }
+}
+
+BENCHMARK(BM_ScatterReduceSum)->Apply(Args);
+BENCHMARK(BM_SegmentReduceSum)->Apply(Args);
+BENCHMARK(BM_ParallelSegmentReduceSum)->Apply(Args)->UseRealTime();
+
+}  // namespace
+}  // namespace monolith_tf
+}  // namespace tensorflow
+
+BENCHMARK_MAIN();
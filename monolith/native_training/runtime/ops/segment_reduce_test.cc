@@ -0,0 +1,119 @@
+// Copyright 2022 ByteDance and/or its affiliates.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "monolith/native_training/runtime/ops/segment_reduce.h"
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace tensorflow {
+namespace monolith_tf {
+namespace {
+
+std::vector<float> NaiveReduce(SegmentReduceType type,
+                               const std::vector<int64_t>& indices,
+                               const std::vector<float>& values, int64_t dim,
+                               int64_t batch_size) {
+  std::vector<float> output(batch_size * dim, 0);
+  std::vector<int64_t> counter(batch_size, 0);
+  for (size_t i = 0; i < indices.size() / 2; ++i) {
+    int64_t batch = indices[i * 2];
+    ++counter[batch];
+    for (int64_t j = 0; j < dim; ++j) {
+      float v = values[i * dim + j];
+      output[batch * dim + j] +=
+          type == SegmentReduceType::kSquareNorm ? v * v : v;
+    }
+  }
+  for (int64_t b = 0; b < batch_size; ++b) {
+    for (int64_t j = 0; j < dim; ++j) {
+      float& out = output[b * dim + j];
+      if (type == SegmentReduceType::kMean) {
+        out *= 1.0f / counter[b];
+      } else if (type == SegmentReduceType::kSquareNorm) {
+        out = std::sqrt(out);
+      }
+    }
+  }
+  return output;
+}
+
+TEST(SegmentReduceTest, GroupRowsByBatch) {
+  // (batch, index) pairs.
+  std::vector<int64_t> indices = {2, 0, 0, 0, 2, 1, 0, 1, 3, 0};
+  BatchSegments segments;
+  ASSERT_TRUE(GroupRowsByBatch(indices.data(), 2, 5, 4, &segments));
+  EXPECT_EQ(segments.offsets, std::vector<int64_t>({0, 2, 2, 4, 5}));
+  EXPECT_EQ(segments.rows, std::vector<int64_t>({1, 3, 0, 2, 4}));
+  EXPECT_EQ(segments.size(1), 0);
+  EXPECT_EQ(segments.row(2), 0);
+
+  std::vector<int64_t> sorted = {0, 0, 0, 1, 2, 0, 2, 1};
+  ASSERT_TRUE(GroupRowsByBatch(sorted.data(), 2, 4, 3, &segments));
+  EXPECT_EQ(segments.offsets, std::vector<int64_t>({0, 2, 2, 4}));
+  EXPECT_TRUE(segments.rows.empty());
+  EXPECT_EQ(segments.row(3), 3);
+
+  indices[8] = 4;
+  EXPECT_FALSE(GroupRowsByBatch(indices.data(), 2, 5, 4, &segments));
+}
+
+TEST(SegmentReduceTest, MatchesNaiveReduce) {
+  std::mt19937 gen(0);
+  std::uniform_real_distribution<float> value_dist(-1, 1);
+  for (int64_t dim : {1, 8, 13, 32}) {
+    const int64_t batch_size = 17, nnz = 200;
+    std::uniform_int_distribution<int64_t> batch_dist(0, batch_size - 2);
+    std::vector<int64_t> indices;
+    for (int64_t i = 0; i < nnz; ++i) {
+      indices.push_back(batch_dist(gen));
+      indices.push_back(i);
+    }
+    std::vector<float> values(nnz * dim);
+    for (float& v : values) v = value_dist(gen);
+    BatchSegments segments;
+    ASSERT_TRUE(
+        GroupRowsByBatch(indices.data(), 2, nnz, batch_size, &segments));
+
+    for (auto type : {SegmentReduceType::kSum, SegmentReduceType::kMean,
+                      SegmentReduceType::kSquareNorm}) {
+      std::vector<float> expected =
+          NaiveReduce(type, indices, values, dim, batch_size);
+      std::vector<float> output(batch_size * dim, -1);
+      // Two halves, as two threads would.
+      SegmentReduce(type, segments, values.data(), dim, 0, 5, output.data());
+      SegmentReduce(type, segments, values.data(), dim, 5, batch_size,
+                    output.data());
+      for (int64_t i = 0; i < (batch_size - 1) * dim; ++i) {
+        EXPECT_NEAR(output[i], expected[i], 1e-5);
+      }
+      // The last batch row has no ids.
+      for (int64_t j = 0; j < dim; ++j) {
+        float last = output[(batch_size - 1) * dim + j];
+        if (type == SegmentReduceType::kMean) {
+          EXPECT_TRUE(std::isnan(last));
+        } else {
+          EXPECT_EQ(last, 0);
+        }
+      }
+    }
+  }
+}
+
+}  // namespace
+}  // namespace monolith_tf
+}  // namespace tensorflow
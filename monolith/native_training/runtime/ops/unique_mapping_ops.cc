@@ -13,14 +13,17 @@
 // limitations under the License.
 
 #include <cstring>
+#include <functional>
+#include <vector>
 
 #include "absl/algorithm/container.h"
-#include "absl/container/flat_hash_map.h"
 #include "absl/strings/str_format.h"
+#include "monolith/native_training/runtime/ops/ragged_unique.h"
 #include "tensorflow/core/framework/op_kernel.h"
 #include "tensorflow/core/framework/resource_mgr.h"
 #include "tensorflow/core/framework/shape_inference.h"
 #include "tensorflow/core/platform/threadpool.h"
+#include "tensorflow/core/util/work_sharder.h"
 
 namespace tensorflow {
 namespace monolith_tf {
@@ -62,65 +65,45 @@ class UniqueKeyWitValueAndOffsetOp : public OpKernel {
     OP_REQUIRES(c, key_split.size() == dims_size_ + 1,
                 errors::InvalidArgument("RaggedKey should have ", dims_size_,
                                         " but got ", key_split.size() - 1));
-    Tensor* t;
-
-    std::vector<int64> unique_key;
-    unique_key.reserve(key.size());
+    OP_REQUIRES(c, key_split(dims_size_) == key.size(),
+                errors::InvalidArgument("RaggedKey should have ", key.size(),
+                                        " values but got ",
+                                        key_split(dims_size_)));
+
+    // Kept per thread so that the scratch buffers are reused across steps.
+    static thread_local RaggedUnique unique;
+    auto parallel_for = [c](int64 total, int64 cost_per_unit,
+                            const std::function<void(int64, int64)>& fn) {
+      auto workers = c->device()->tensorflow_cpu_worker_threads();
+      Shard(workers->num_threads, workers->workers, total, cost_per_unit, fn);
+    };
+    OP_REQUIRES(
+        c,
+        unique.Unique(reinterpret_cast<const int64_t*>(key.data()),
+                      reinterpret_cast<const int64_t*>(key_split.data()),
+                      dims_size_, parallel_for),
+        errors::InvalidArgument("RaggedKey splits should be non decreasing "
+                                "from 0"));
+    const std::vector<int64_t>& unique_split = unique.unique_splits();
+    const int64 num_unique = unique_split.back();
 
+    Tensor* t;
+    OP_REQUIRES_OK(c, c->allocate_output(0, {num_unique}, &t));
+    auto unique_key_vec = t->vec<int64>();
     OP_REQUIRES_OK(c, c->allocate_output(1, {dims_size_ + 1}, &t));
-    auto unique_key_split_vec = t->vec<int64>();
-    unique_key_split_vec(0) = 0;
-
+    std::memcpy(t->vec<int64>().data(), unique_split.data(),
+                sizeof(int64) * unique_split.size());
     OP_REQUIRES_OK(c, c->allocate_output(2, {key.size()}, &t));
     auto value_offset_vec = t->vec<int64>();
-    int64 value_offset_vec_offset = 0;
-
-    std::vector<int64> value_offset_split;
-    value_offset_split.reserve(key.size());
-    value_offset_split.push_back(0);
-
-    int64 value_offset = 0;
-    absl::flat_hash_map<int64, absl::InlinedVector<int64, 4>> m;
-    int j = 0;
-    m.reserve(2 * (key_split(1) - key_split(0)));
-    for (int i = 0;; ++i) {
-      while (i == key_split(j + 1)) {
-        unique_key_split_vec(j + 1) = unique_key.size();
-        for (int k = unique_key_split_vec(j); k < unique_key_split_vec(j + 1);
-             ++k) {
-          auto it = m.find(unique_key[k]);
-          for (int64 value_offset_for_key : it->second) {
-            value_offset_vec(value_offset_vec_offset++) = value_offset_for_key;
-          }
-          value_offset_split.push_back(value_offset_vec_offset);
-        }
-        ++j;
-        if (j < dims_size_) {
-          m.clear();
-          m.reserve(2 * (key_split(j + 1) - key_split(j)));
-        } else {
-          break;
-        }
-      }
-      if (i == key.size()) break;
-      auto it = m.find(key(i));
-      if (it == m.end()) {
-        m.insert({key(i), {value_offset}});
-        unique_key.push_back(key(i));
-      } else {
-        it->second.push_back(value_offset);
-      }
-      value_offset += dims_[j];
-    }
-    OP_REQUIRES_OK(c, c->allocate_output(0, {unique_key.size()}, &t));
-    auto unique_key_vec = t->vec<int64>();
-    std::memcpy(unique_key_vec.data(), unique_key.data(),
-                sizeof(int64) * unique_key.size());
-    OP_REQUIRES_OK(c, c->allocate_output(3, {value_offset_split.size()}, &t));
+    OP_REQUIRES_OK(c, c->allocate_output(3, {num_unique + 1}, &t));
     auto value_offset_split_vec = t->vec<int64>();
-    std::memcpy(value_offset_split_vec.data(), value_offset_split.data(),
-                sizeof(int64) * value_offset_split.size());
-    OP_REQUIRES_OK(c, CreateSharedTensor(c, {value_offset}));
+
+    int64 value_size = unique.Fill(
+        dims_.data(), reinterpret_cast<int64_t*>(unique_key_vec.data()),
+        reinterpret_cast<int64_t*>(value_offset_vec.data()),
+        reinterpret_cast<int64_t*>(value_offset_split_vec.data()),
+        parallel_for);
+    OP_REQUIRES_OK(c, CreateSharedTensor(c, {value_size}));
   }
 
   Status CreateSharedTensor(OpKernelContext* c, TensorShape shape) {